@@ -0,0 +1,63 @@
+#include "BenchmarkUtil.h"
+#include "ServerList.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ConsoleInterface's "exit" command refers to it; main.cpp is not linked
+std::atomic<bool> g_running{true};
+
+std::string WriteServerList(int count) {
+    std::string path = "/tmp/cs_bench_serverlist_" + std::to_string(getpid()) + "_" + std::to_string(count) + ".dat";
+
+    FILE* file = fopen(path.c_str(), "w");
+
+    if (file != nullptr) {
+        for (int n = 0; n < count; n++) {
+            fprintf(file, "%d\t\"Server %d\"\t\"127.0.0.1\"\t%d\t\"SHOW\"\n", n, n, 55901 + n);
+        }
+
+        fprintf(file, "end\n");
+        fclose(file);
+    }
+
+    return path;
+}
+
+void LoadOnlineServers(int count) {
+    std::string path = WriteServerList(count);
+
+    gServerList.Load(path.c_str());
+    gServerList.SetShowOfflineServers(false);
+
+    unlink(path.c_str());
+
+    for (int n = 0; n < count; n++) {
+        SDHP_GAME_SERVER_LIVE_RECV pMsg;
+        pMsg.header.set(0x01, sizeof(pMsg));
+        pMsg.ServerCode = (uint16_t)n;
+        pMsg.UserTotal = (uint8_t)(n % 100);
+        pMsg.UserCount = (uint16_t)n;
+        pMsg.AccountCount = (uint16_t)n;
+        pMsg.MaxUserCount = 1000;
+
+        gServerList.ServerProtocolCore(0x01, (uint8_t*)&pMsg, sizeof(pMsg));
+    }
+}
+
+StdoutSilencer::StdoutSilencer() {
+    fflush(stdout);
+    saved_ = dup(STDOUT_FILENO);
+
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+}
+
+StdoutSilencer::~StdoutSilencer() {
+    fflush(stdout);
+    dup2(saved_, STDOUT_FILENO);
+    close(saved_);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+// Shared fixtures for the microbenchmarks
+
+// ServerList.dat with count visible servers (codes 0..count-1) in a temp file
+std::string WriteServerList(int count);
+
+// Load count servers into gServerList and heartbeat each one online
+void LoadOnlineServers(int count);
+
+// Sends stdout to /dev/null while alive, so benchmarks of code that prints
+// do not measure the terminal (and do not garble the report)
+class StdoutSilencer {
+public:
+    StdoutSilencer();
+    ~StdoutSilencer();
+
+private:
+    int saved_;
+};
@@ -0,0 +1,80 @@
+// CIpManager insert/check/remove with the table holding N other addresses
+
+#include "IpManager.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> MakeAddresses(int count, int salt) {
+    std::vector<std::string> addresses;
+
+    for (int n = 0; n < count; n++) {
+        char address[16];
+        snprintf(address, sizeof(address), "%d.%d.%d.%d", 10 + salt, (n >> 16) & 0xFF, (n >> 8) & 0xFF, n & 0xFF);
+        addresses.push_back(address);
+    }
+
+    return addresses;
+}
+
+static std::unique_ptr<CIpManager> MakeTable(const std::vector<std::string>& resident) {
+    std::unique_ptr<CIpManager> table(new CIpManager);
+
+    for (const std::string& address : resident) {
+        table->InsertIpAddress(address.c_str());
+    }
+
+    return table;
+}
+
+static void BM_IpManager_InsertRemove(benchmark::State& state) {
+    auto resident = MakeAddresses((int)state.range(0), 0);
+    auto visitors = MakeAddresses(1024, 1);
+    auto table = MakeTable(resident);
+    size_t n = 0;
+
+    for (auto _ : state) {
+        const char* address = visitors[n++ & 1023].c_str();
+        table->InsertIpAddress(address);
+        table->RemoveIpAddress(address);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IpManager_InsertRemove)->Arg(0)->Arg(1000)->Arg(8000);
+
+static void BM_IpManager_CheckHit(benchmark::State& state) {
+    auto resident = MakeAddresses((int)state.range(0), 0);
+    auto table = MakeTable(resident);
+    size_t n = 0;
+
+    MaxIpConnection = 4;
+
+    for (auto _ : state) {
+        bool allowed = table->CheckIpAddress(resident[n++ % resident.size()].c_str());
+        benchmark::DoNotOptimize(allowed);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IpManager_CheckHit)->Arg(1000)->Arg(8000);
+
+static void BM_IpManager_CheckMiss(benchmark::State& state) {
+    auto resident = MakeAddresses((int)state.range(0), 0);
+    auto visitors = MakeAddresses(1024, 1);
+    auto table = MakeTable(resident);
+    size_t n = 0;
+
+    MaxIpConnection = 4;
+
+    for (auto _ : state) {
+        bool allowed = table->CheckIpAddress(visitors[n++ & 1023].c_str());
+        benchmark::DoNotOptimize(allowed);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IpManager_CheckMiss)->Arg(1000)->Arg(8000);
@@ -0,0 +1,38 @@
+// LogAdd through the console with general output on, and switched off
+
+#include "BenchmarkUtil.h"
+#include "Console.h"
+#include "ConsoleInterface.h"
+#include "Util.h"
+
+#include <benchmark/benchmark.h>
+
+static void BM_LogAdd_Enabled(benchmark::State& state) {
+    ConsoleInterface console;
+    g_console_interface = &console;
+    gConsole.EnableOutput[CON_GENERAL] = true;
+
+    {
+        StdoutSilencer silencer;
+
+        for (auto _ : state) {
+            LogAdd(2, "[Protocol] Received packet: Index=%d, Head=0x%02X, Size=%d", 42, 0xF4, 4);
+        }
+    }
+
+    g_console_interface = nullptr;
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogAdd_Enabled);
+
+static void BM_LogAdd_Disabled(benchmark::State& state) {
+    gConsole.EnableOutput[CON_GENERAL] = false;
+
+    for (auto _ : state) {
+        LogAdd(2, "[Protocol] Received packet: Index=%d, Head=0x%02X, Size=%d", 42, 0xF4, 4);
+    }
+
+    gConsole.EnableOutput[CON_GENERAL] = true;
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogAdd_Disabled);
@@ -0,0 +1,120 @@
+// ClientSession::parse_packets framing and ConnectServerProtocolCore dispatch.
+// Replies go nowhere: the SocketManager is never started, so DataSend finds
+// no session and the benchmarks measure parsing and handlers only.
+
+#include "BenchmarkUtil.h"
+#include "ClientSession.h"
+#include "ConnectServerProtocol.h"
+#include "Console.h"
+#include "SocketManager.h"
+
+#include <benchmark/benchmark.h>
+#include <boost/asio.hpp>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct PacketFixture
+{
+    PacketFixture() : socket_manager(io), session(std::make_shared<ClientSession>(io, 0)) {
+        g_socket_manager = &socket_manager;
+        gConsole.EnableOutput[CON_GENERAL] = false;
+    }
+
+    ~PacketFixture() {
+        g_socket_manager = nullptr;
+        gConsole.EnableOutput[CON_GENERAL] = true;
+    }
+
+    boost::asio::io_context io;
+    SocketManager socket_manager;
+    std::shared_ptr<ClientSession> session;
+};
+
+// C1:F4:FF is framed like any request but dispatches to nothing
+const uint8_t IGNORED_REQUEST[] = {0xC1, 0x04, 0xF4, 0xFF};
+
+}
+
+// N requests arriving in one read
+static void BM_ParsePackets_Pipelined(benchmark::State& state) {
+    PacketFixture fixture;
+    std::vector<uint8_t> input;
+
+    for (int n = 0; n < state.range(0); n++) {
+        input.insert(input.end(), IGNORED_REQUEST, IGNORED_REQUEST + sizeof(IGNORED_REQUEST));
+    }
+
+    for (auto _ : state) {
+        bool parsed = fixture.session->receive(input.data(), input.size());
+        benchmark::DoNotOptimize(parsed);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_ParsePackets_Pipelined)->Arg(1)->Arg(16)->Arg(256);
+
+// One 64-byte C2 packet arriving in reads of N bytes
+static void BM_ParsePackets_Fragmented(benchmark::State& state) {
+    PacketFixture fixture;
+    std::vector<uint8_t> packet(64, 0);
+    packet[0] = 0xC2;
+    packet[1] = 0x00;
+    packet[2] = (uint8_t)packet.size();
+    packet[3] = 0xF4;
+    packet[4] = 0xFF;
+
+    size_t chunk = (size_t)state.range(0);
+
+    for (auto _ : state) {
+        for (size_t offset = 0; offset < packet.size(); offset += chunk) {
+            bool parsed = fixture.session->receive(packet.data() + offset, std::min(chunk, packet.size() - offset));
+            benchmark::DoNotOptimize(parsed);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * packet.size());
+}
+BENCHMARK(BM_ParsePackets_Fragmented)->Arg(1)->Arg(3)->Arg(16)->Arg(64);
+
+static void BM_ProtocolCore_ServerList(benchmark::State& state) {
+    PacketFixture fixture;
+    LoadOnlineServers(100);
+
+    const uint8_t request[] = {0xC1, 0x04, 0xF4, 0x02};
+
+    for (auto _ : state) {
+        ConnectServerProtocolCore(0, 0xF4, request, sizeof(request));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProtocolCore_ServerList);
+
+static void BM_ProtocolCore_ServerInfo(benchmark::State& state) {
+    PacketFixture fixture;
+    LoadOnlineServers(100);
+
+    const uint8_t request[] = {0xC1, 0x05, 0xF4, 0x03, 42};
+
+    for (auto _ : state) {
+        ConnectServerProtocolCore(0, 0xF4, request, sizeof(request));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProtocolCore_ServerInfo);
+
+static void BM_ProtocolCore_Unknown(benchmark::State& state) {
+    PacketFixture fixture;
+
+    for (auto _ : state) {
+        ConnectServerProtocolCore(0, 0xF4, IGNORED_REQUEST, sizeof(IGNORED_REQUEST));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProtocolCore_Unknown);
@@ -0,0 +1,51 @@
+// ServerList.dat loading: CReadScript tokenizing alone, and the full
+// CServerList::Load on top of it
+
+#include "BenchmarkUtil.h"
+#include "Console.h"
+#include "ReadScript.h"
+#include "ServerList.h"
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+static void BM_ReadScript_Tokenize(benchmark::State& state) {
+    std::string path = WriteServerList((int)state.range(0));
+
+    for (auto _ : state) {
+        CReadScript script;
+        script.Load(path.c_str());
+
+        int tokens = 0;
+
+        while (true) {
+            eTokenResult token = script.GetToken();
+
+            if (token == TOKEN_END || token == TOKEN_END_SECTION || token == TOKEN_ERROR) {
+                break;
+            }
+
+            tokens++;
+        }
+
+        benchmark::DoNotOptimize(tokens);
+    }
+
+    unlink(path.c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReadScript_Tokenize)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_ServerList_Load(benchmark::State& state) {
+    std::string path = WriteServerList((int)state.range(0));
+    gConsole.EnableOutput[CON_GENERAL] = false;
+
+    for (auto _ : state) {
+        gServerList.Load(path.c_str());
+    }
+
+    gConsole.EnableOutput[CON_GENERAL] = true;
+    unlink(path.c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ServerList_Load)->Arg(10)->Arg(100)->Arg(1000);
@@ -0,0 +1,44 @@
+// List reply generation over 10/100/1000 online servers
+
+#include "BenchmarkUtil.h"
+#include "ConnectServerProtocol.h"
+#include "Console.h"
+#include "ServerList.h"
+
+#include <benchmark/benchmark.h>
+
+static uint8_t g_reply[64 * 1024];
+
+static void BM_GenerateServerList(benchmark::State& state) {
+    gConsole.EnableOutput[CON_GENERAL] = false;
+    LoadOnlineServers((int)state.range(0));
+    gConsole.EnableOutput[CON_GENERAL] = true;
+
+    long count = 0;
+
+    for (auto _ : state) {
+        int size = PMSG_SERVER_LIST_SEND::Size;
+        count = gServerList.GenerateServerList(g_reply, &size, sizeof(g_reply));
+        benchmark::DoNotOptimize(g_reply);
+    }
+
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GenerateServerList)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_GenerateCustomServerList(benchmark::State& state) {
+    gConsole.EnableOutput[CON_GENERAL] = false;
+    LoadOnlineServers((int)state.range(0));
+    gConsole.EnableOutput[CON_GENERAL] = true;
+
+    long count = 0;
+
+    for (auto _ : state) {
+        int size = PMSG_CUSTOM_SERVER_LIST_SEND::Size;
+        count = gServerList.GenerateCustomServerList(g_reply, &size, sizeof(g_reply));
+        benchmark::DoNotOptimize(g_reply);
+    }
+
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GenerateCustomServerList)->Arg(10)->Arg(100)->Arg(1000);
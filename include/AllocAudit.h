@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Global allocation audit (ENABLE_ALLOC_AUDIT / CS_ALLOC_AUDIT builds only)
+// Replaces the global operator new/delete with versions that count every
+// allocation per thread and sample the calling site of every Nth allocation.
+// Used to prove the request path is allocation-free once warmed up.
+
+constexpr int MAX_ALLOC_AUDIT_THREADS = 64;
+constexpr int MAX_ALLOC_AUDIT_SAMPLES = 256;
+
+struct ALLOC_AUDIT_SAMPLE {
+    void* site;
+    size_t size;
+};
+
+struct ALLOC_AUDIT_THREAD {
+    char name[16];
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> deallocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint32_t> sample_count;
+    ALLOC_AUDIT_SAMPLE samples[MAX_ALLOC_AUDIT_SAMPLES];
+};
+
+class AllocAudit {
+public:
+    // Counter block of the calling thread (registered on first use)
+    static ALLOC_AUDIT_THREAD* current_thread();
+
+    // Tag the calling thread so reports can tell io threads apart
+    static void set_thread_name(const char* name);
+
+    // Sample the call site of every Nth allocation (0 = sampling off)
+    static void set_sample_rate(uint32_t every_n);
+
+    // Allocations made by all registered threads since startup
+    static uint64_t total_allocations();
+
+    // Write per-thread counters and the hottest sampled sites to the log
+    static void report();
+
+    // Forget all counters and samples (e.g. after warm-up)
+    static void reset();
+};
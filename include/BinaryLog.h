@@ -0,0 +1,267 @@
+#pragma once
+
+#include "RecordRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary log sink ([Log] LOG=1): every LogAdd line is also appended to
+// pre-allocated, memory-mapped segment files as a compact record (time,
+// level, call site, session, raw arguments) without formatting the text.
+// The calling thread only walks the format for its argument types and
+// copies them into a RecordRing; a writer thread moves records into the
+// current segment, so io threads never touch the disk. Segments rotate by
+// size and age, the oldest are deleted past MaxFiles. Each segment carries
+// the formats of the call sites it uses, so it decodes on its own:
+// tools/cs_logcat turns segments back into text.
+// POSIX only (mmap); on Windows start() reports the sink as unsupported.
+
+#define BINARY_LOG_MAGIC 0x4C425343 // "CSBL"
+#define BINARY_LOG_VERSION 1
+
+constexpr int MAX_BINLOG_SITES = 4096;          // Distinct formats, power of two
+constexpr size_t MAX_BINLOG_ARGUMENTS = 512;    // Encoded argument bytes per line
+constexpr size_t MAX_BINLOG_STRING = 255;       // Longer %s arguments are cut
+
+enum eBinaryLogRecord : uint8_t
+{
+    BINLOG_ENTRY = 1,       // Payload: encoded arguments of Site's format
+    BINLOG_SITE = 2,        // Payload: the format of Site, NUL terminated
+};
+
+enum eLogLevel : uint8_t
+{
+    LOG_LEVEL_ERROR = 1,    // LogAdd color 1 (red)
+    LOG_LEVEL_NOTICE = 2,   // Color 2 (green)
+    LOG_LEVEL_INFO = 3,     // Everything else
+};
+
+// Segment layout: header, then records back to back, each padded to 8
+// bytes, up to the first record with Length 0 (unused preallocated space)
+struct BINLOG_SEGMENT_HEADER
+{
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t RecordSize;    // sizeof(BINLOG_RECORD) of the writer
+    uint32_t Pid;
+    uint32_t Sequence;      // Segments written by this process, from 0
+    uint64_t Created;       // Wall clock ns
+    uint64_t Capacity;      // File size as allocated
+};
+
+struct BINLOG_RECORD
+{
+    uint16_t Length;        // Header and payload, before padding
+    uint8_t Type;
+    uint8_t Level;
+    uint32_t Site;
+    uint32_t Session;       // BINLOG_NO_SESSION outside a session
+    uint32_t Thread;        // Kernel tid
+    uint64_t Time;          // Wall clock ns
+};
+
+constexpr uint32_t BINLOG_NO_SESSION = 0xFFFFFFFF;
+
+static inline uint8_t LogLevelOf(int color) {
+    return color == 1 ? LOG_LEVEL_ERROR : (color == 2 ? LOG_LEVEL_NOTICE : LOG_LEVEL_INFO);
+}
+
+// Argument encoding, shared by the sink and the decoder. Integers, pointers
+// and floating point values take 8 bytes; a string takes a length byte and
+// up to MAX_BINLOG_STRING bytes. A '*' width or precision is an int of its own.
+enum eBinaryLogArgument : uint8_t
+{
+    BINLOG_ARG_SIGNED,
+    BINLOG_ARG_UNSIGNED,
+    BINLOG_ARG_DOUBLE,
+    BINLOG_ARG_STRING,
+    BINLOG_ARG_POINTER,
+};
+
+enum eBinaryLogLength : uint8_t
+{
+    BINLOG_LEN_NONE,
+    BINLOG_LEN_HH,
+    BINLOG_LEN_H,
+    BINLOG_LEN_L,
+    BINLOG_LEN_LL,
+    BINLOG_LEN_Z,
+    BINLOG_LEN_J,
+    BINLOG_LEN_T,
+    BINLOG_LEN_LONG_DOUBLE,
+};
+
+struct BINLOG_SPEC
+{
+    const char* Begin;      // The '%'
+    size_t Size;            // Through the conversion character
+    int Stars;              // '*' width/precision arguments before the value
+    uint8_t Length;         // eBinaryLogLength
+    uint8_t Argument;       // eBinaryLogArgument
+    char Conversion;
+};
+
+// Next conversion taking an argument at or after cursor; literal text and
+// "%%" are skipped over. False at the end of the format or at a conversion
+// this encoding does not carry (%n, unknown characters).
+static inline bool NextLogSpec(const char*& cursor, BINLOG_SPEC* spec) {
+    for (;;) {
+        while (*cursor != '\0' && *cursor != '%') {
+            cursor++;
+        }
+
+        if (*cursor == '\0') {
+            return false;
+        }
+
+        if (cursor[1] == '%') {
+            cursor += 2;
+            continue;
+        }
+
+        break;
+    }
+
+    const char* p = cursor + 1;
+    spec->Begin = cursor;
+    spec->Stars = 0;
+    spec->Length = BINLOG_LEN_NONE;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        p++;
+    }
+
+    if (*p == '*') {
+        spec->Stars++;
+        p++;
+    }
+
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+
+    if (*p == '.') {
+        p++;
+
+        if (*p == '*') {
+            spec->Stars++;
+            p++;
+        }
+
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+
+    switch (*p) {
+        case 'h': spec->Length = (p[1] == 'h') ? BINLOG_LEN_HH : BINLOG_LEN_H; p += (p[1] == 'h') ? 2 : 1; break;
+        case 'l': spec->Length = (p[1] == 'l') ? BINLOG_LEN_LL : BINLOG_LEN_L; p += (p[1] == 'l') ? 2 : 1; break;
+        case 'q': spec->Length = BINLOG_LEN_LL; p++; break;
+        case 'z': spec->Length = BINLOG_LEN_Z; p++; break;
+        case 'j': spec->Length = BINLOG_LEN_J; p++; break;
+        case 't': spec->Length = BINLOG_LEN_T; p++; break;
+        case 'L': spec->Length = BINLOG_LEN_LONG_DOUBLE; p++; break;
+    }
+
+    switch (*p) {
+        case 'd': case 'i':
+            spec->Argument = BINLOG_ARG_SIGNED;
+            break;
+        case 'u': case 'o': case 'x': case 'X': case 'c':
+            spec->Argument = BINLOG_ARG_UNSIGNED;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->Argument = BINLOG_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->Argument = BINLOG_ARG_STRING;
+            break;
+        case 'p':
+            spec->Argument = BINLOG_ARG_POINTER;
+            break;
+        default:
+            return false;
+    }
+
+    spec->Conversion = *p;
+    spec->Size = (size_t)(p + 1 - cursor);
+    cursor = p + 1;
+    return true;
+}
+
+struct BINARY_LOG_CONFIG
+{
+    std::string Directory;
+    size_t SegmentSize;     // Bytes per segment file
+    uint32_t RotateSeconds; // 0: rotate by size only
+    uint32_t MaxFiles;      // Segments kept; 0 keeps all
+    size_t BufferSize;      // RecordRing between callers and the writer
+};
+
+class BinaryLog {
+public:
+    BinaryLog();
+    ~BinaryLog();
+
+    bool start(const BINARY_LOG_CONFIG& config);
+    void stop();
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Called by LogAdd with its own arguments
+    void append(int color, const char* format, va_list args);
+
+    // Records the calling thread's log lines as belonging to a session
+    class Session {
+    public:
+        explicit Session(uint32_t session) : previous_(t_session_) { t_session_ = session; }
+        ~Session() { t_session_ = previous_; }
+
+    private:
+        uint32_t previous_;
+    };
+
+private:
+    uint32_t intern(const char* format);
+    void run_writer();
+    void drain();
+    void write_record(const uint8_t* record, size_t size);
+    bool open_segment();
+    void close_segment();
+    void remove_old_segments();
+
+    static inline thread_local uint32_t t_session_ = BINLOG_NO_SESSION;
+
+    std::atomic<bool> enabled_;
+    BINARY_LOG_CONFIG config_;
+    RecordRing ring_;
+
+    // Call sites by format pointer; slot n is site n + 1
+    std::atomic<const char*> sites_[MAX_BINLOG_SITES];
+
+    // Writer thread state
+    int fd_;
+    uint8_t* map_;
+    size_t offset_;
+    uint32_t sequence_;
+    uint64_t segment_created_;
+    std::string segment_path_;
+    std::vector<uint8_t> defined_;  // Sites whose format this segment has
+    std::thread writer_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_wakeup_;
+    bool writer_stop_;
+    std::atomic<bool> writer_kicked_;
+
+    std::atomic<int64_t>* records_;
+    std::atomic<int64_t>* bytes_;
+    std::atomic<int64_t>* dropped_;
+    std::atomic<int64_t>* segments_;
+};
+
+extern BinaryLog g_binary_log;
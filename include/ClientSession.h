@@ -1,14 +1,20 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include "HandlerAllocator.h"
+#include "LockProfiler.h"
+#include "RequestTracer.h"
 #include <memory>
 #include <array>
-#include <queue>
 #include <mutex>
 #include <chrono>
 #include <cstdint>
 
 constexpr size_t MAX_PACKET_SIZE = 2048;
+constexpr size_t MAX_SEND_BUFFER_SIZE = MAX_PACKET_SIZE * 2;
+
+// io_context executor that allocates strand work from the session's HandlerMemory
+using SessionExecutor = boost::asio::io_context::basic_executor_type<HandlerAllocator<void>, 0>;
 
 class ClientSession : public std::enable_shared_from_this<ClientSession> {
 public:
@@ -16,37 +22,108 @@ public:
     ~ClientSession();
 
     void start();
+    void reset();
+    bool load_remote_address();
     void async_send(const uint8_t* data, size_t size);
     void close();
 
+    // Encodes a reply in place at the end of the pending send buffer, with
+    // no staging copy: encode(out) writes at most max_size bytes and returns
+    // how many it wrote (0 sends nothing). Runs under the send lock.
+    template <typename Encode>
+    void encode_send(size_t max_size, Encode&& encode);
+
     boost::asio::ip::tcp::socket& socket() { return socket_; }
     int index() const { return index_; }
-    std::string ip_address() const { return ip_address_; }
+    const char* ip_address() const { return ip_address_; }
+    uint32_t ipv4() const { return ipv4_; }     // 0 for IPv6 peers
     bool is_connected() const { return connected_; }
     bool check_timeout(uint32_t timeout_seconds) const;
 
+    // Parse bytes as if they had just been read from the socket (benchmarks);
+    // false on a framing error, when a real read would close the session
+    bool receive(const uint8_t* data, size_t size);
+
 private:
     void start_read();
+    void handle_readable(const boost::system::error_code& error);
     void handle_read(const boost::system::error_code& error, size_t bytes);
     bool parse_packets();
     void process_packet(uint8_t head, const uint8_t* data, size_t size);
 
+    // Under send_mutex_: room for max_size bytes in the pending buffer, or
+    // nullptr (and the session closing) when the client is not draining
+    uint8_t* reserve_send(size_t max_size);
+    void commit_send(const uint8_t* data, size_t size);
+    void schedule_write();
+
     void start_write();
     void handle_write(const boost::system::error_code& error, size_t bytes);
 
+    void finish_traces(uint64_t writes_completed);
+
+    HandlerMemory handler_memory_;
     boost::asio::ip::tcp::socket socket_;
-    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::strand<SessionExecutor> strand_;
 
     std::array<uint8_t, MAX_PACKET_SIZE> recv_buffer_;
     size_t recv_buffer_size_;
 
-    std::queue<std::vector<uint8_t>> send_queue_;
-    std::mutex send_mutex_;
+    // Kernel receive timestamps (ReceiveTimestamps.h): reads go through
+    // recvmsg and each frame records its queueing delay and service time
+    bool timestamped_;
+    uint64_t read_queue_ns_;        // Of the read being parsed
+
+    // Double-buffered sends: replies are appended to the pending buffer
+    // while the other one is being written, so nothing is allocated per packet
+    std::array<std::array<uint8_t, MAX_SEND_BUFFER_SIZE>, 2> send_buffers_;
+    std::array<size_t, 2> send_sizes_;
+    int send_pending_;
+    ProfiledMutex send_mutex_;
     bool write_in_progress_;
 
+    // Request tracing (RequestTracer.h). trace_ is the request whose handler
+    // is running; requests that queued a reply wait in traces_ until the
+    // write carrying it completes. Writes are numbered to match them up.
+    static constexpr size_t MAX_PENDING_TRACES = 8;
+    REQUEST_TRACE trace_;
+    bool trace_open_;
+    std::array<REQUEST_TRACE, MAX_PENDING_TRACES> traces_;
+    size_t trace_count_;
+    uint64_t writes_started_;       // Under send_mutex_
+    uint64_t writes_completed_;
+
     int index_;
-    std::string ip_address_;
+    char ip_address_[16];
+    uint32_t ipv4_;
     bool connected_;
-    std::chrono::steady_clock::time_point connect_time_;
-    std::chrono::steady_clock::time_point last_packet_time_;
+    uint32_t connect_time_;         // GetTickCountCross() ticks
+    uint32_t last_packet_time_;
 };
+
+template <typename Encode>
+void ClientSession::encode_send(size_t max_size, Encode&& encode) {
+    if (!connected_ || max_size == 0 || max_size > MAX_PACKET_SIZE) {
+        return;
+    }
+
+    {
+        std::lock_guard<ProfiledMutex> lock(send_mutex_);
+
+        uint8_t* out = reserve_send(max_size);
+
+        if (out == nullptr) {
+            return;
+        }
+
+        size_t size = encode(out);
+
+        if (size == 0) {
+            return;
+        }
+
+        commit_send(out, size);
+    }
+
+    schedule_write();
+}
@@ -24,6 +24,9 @@ public:
     // Check if key exists in section
     bool has_key(const std::string& section, const std::string& key) const;
 
+    // All keys of a section (empty if it does not exist)
+    std::map<std::string, std::string> get_section(const std::string& section) const;
+
 private:
     std::map<std::string, std::map<std::string, std::string>> config_;
 
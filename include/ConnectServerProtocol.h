@@ -1,21 +1,29 @@
 #pragma once
 
 #include "ProtocolDefines.h"
+#include "WireFormat.h"
 #include <cstdint>
 
+// Client protocol packets (docs/PROTOCOL.md) as wire layouts (WireFormat.h):
+// fixed offsets and byte order, sizes checked at compile time. Replies are
+// encoded straight into the session's send buffer, requests decoded from
+// the received frame.
+
 //**********************************************//
 //********** Client -> ConnectServer ***********//
 //**********************************************//
 
 struct PMSG_SERVER_LIST_RECV
 {
-    PSBMSG_HEAD header; // C1:F4:02
+    static constexpr WireHeader Header{0xC1, 0xF4, 0x02};
+    static constexpr size_t Size = Header.Size;
 };
 
 struct PMSG_SERVER_INFO_RECV
 {
-    PSBMSG_HEAD header; // C1:F4:03
-    uint8_t ServerCode;
+    static constexpr WireHeader Header{0xC1, 0xF4, 0x03};
+    static constexpr WireInt<uint8_t> ServerCode{Header.Size};
+    static constexpr size_t Size = ServerCode.End;
 };
 
 //**********************************************//
@@ -24,48 +32,67 @@ struct PMSG_SERVER_INFO_RECV
 
 struct PMSG_SERVER_INIT_SEND
 {
-    PBMSG_HEAD header; // C1:00
-    uint8_t result;
+    static constexpr WireHeader Header{0xC1, 0x00};
+    static constexpr WireInt<uint8_t> Result{Header.Size};
+    static constexpr size_t Size = Result.End;
 };
 
+// Followed by Count PMSG_CUSTOM_SERVER_LIST
 struct PMSG_CUSTOM_SERVER_LIST_SEND
 {
-    PSWMSG_HEAD header; // C2:F4:01
-    uint8_t count[2];
+    static constexpr WireHeader Header{0xC2, 0xF4, 0x04};
+    static constexpr WireInt<uint16_t, WIRE_BIG_ENDIAN> Count{Header.Size};
+    static constexpr size_t Size = Count.End;
 };
 
 struct PMSG_CUSTOM_SERVER_LIST
 {
-    uint16_t ServerCode;
-    char ServerName[32];
+    static constexpr WireInt<uint16_t> ServerCode{0};
+    static constexpr WireChars<32> ServerName{ServerCode.End};
+    static constexpr size_t Size = ServerName.End;
 };
 
+// Followed by Count PMSG_SERVER_LIST
 struct PMSG_SERVER_LIST_SEND
 {
-    PSWMSG_HEAD header; // C2:F4:02
-    uint8_t count;
+    static constexpr WireHeader Header{0xC2, 0xF4, 0x02};
+    static constexpr WireInt<uint8_t> Count{Header.Size};
+    static constexpr size_t Size = Count.End;
 };
 
 struct PMSG_SERVER_LIST
 {
-    uint16_t ServerCode;
-    uint8_t UserTotal;
+    static constexpr WireInt<uint16_t> ServerCode{0};
+    static constexpr WireInt<uint8_t> UserTotal{ServerCode.End};
+    static constexpr size_t Size = UserTotal.End;
 };
 
 struct PMSG_SERVER_INFO_SEND
 {
-    PSBMSG_HEAD header; // C1:F4:03
-    char ServerAddress[16];
-    uint16_t ServerPort;
+    static constexpr WireHeader Header{0xC1, 0xF4, 0x03};
+    static constexpr WireChars<16> ServerAddress{Header.Size};
+    static constexpr WireInt<uint16_t> ServerPort{ServerAddress.End};
+    static constexpr size_t Size = ServerPort.End;
 };
 
+static_assert(PMSG_SERVER_LIST_RECV::Size == 4, "C1:F4:02 request is 4 bytes");
+static_assert(PMSG_SERVER_INFO_RECV::Size == 5, "C1:F4:03 request is 5 bytes");
+static_assert(PMSG_SERVER_INIT_SEND::Size == 4, "C1:00 is 4 bytes");
+static_assert(PMSG_CUSTOM_SERVER_LIST_SEND::Size == 7, "C2:F4:04 fixed part is 7 bytes");
+static_assert(PMSG_CUSTOM_SERVER_LIST::Size == 34, "custom server list entry is 34 bytes");
+static_assert(PMSG_SERVER_LIST_SEND::Size == 6, "C2:F4:02 fixed part is 6 bytes");
+static_assert(PMSG_SERVER_LIST::Size == 3, "server list entry is 3 bytes, unpadded");
+static_assert(PMSG_SERVER_INFO_SEND::Size == 22, "C1:F4:03 reply is 22 bytes");
+static_assert(PMSG_SERVER_INFO_SEND::Size <= PMSG_SERVER_INFO_SEND::Header.MaxSize, "fits a C1 frame");
+
 //**********************************************//
 //************** Protocol Core *****************//
 //**********************************************//
 
 void ConnectServerProtocolCore(int index, uint8_t head, const uint8_t* lpMsg, int size);
+void DataSend(int index, const uint8_t* lpMsg, int size);
 
-void CCServerInfoRecv(PMSG_SERVER_INFO_RECV* lpMsg, int index);
-void CCServerListRecv(PMSG_SERVER_LIST_RECV* lpMsg, int index);
+void CCServerInfoRecv(const uint8_t* lpMsg, int size, int index);
+void CCServerListRecv(int index);
 void CCCustomServerListSend(int index);
 void CCServerInitSend(int index, int result);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LockProfiler.h"
 #include <string>
 #include <mutex>
 #include <thread>
@@ -28,6 +29,7 @@ public:
 
     void initialize();
     void log(Color color, const std::string& message);
+    void log(Color color, const char* message);
     void update_status(const std::string& status, size_t queue_size);
     void start_input_loop();
     void stop();
@@ -36,7 +38,7 @@ public:
     void set_command_handler(std::function<void(const std::string&)> handler);
 
 private:
-    std::mutex output_mutex_;
+    ProfiledMutex output_mutex_;
     std::atomic<bool> running_;
     std::thread input_thread_;
     std::function<void(const std::string&)> command_handler_;
@@ -47,7 +49,7 @@ private:
     void process_command(const std::string& cmd);
     void show_help();
     void show_status();
-    std::string get_timestamp();
+    void get_timestamp(char* buffer, size_t size);
     void print_banner();
     void clear_screen();
 };
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Control-plane executor: a dedicated io_context and thread for the UDP
+// heartbeat socket, server table mutation and timers, so heartbeats are never
+// queued behind client traffic on the worker pool.
+class ControlPlane {
+public:
+    ControlPlane();
+    ~ControlPlane();
+
+    // cpu >= 0 pins the control-plane thread to that core (Linux)
+    void start(int cpu = -1, uint32_t probe_interval_ms = 100);
+    void stop();
+
+    boost::asio::io_context& context() { return io_context_; }
+
+private:
+    void schedule_probe();
+
+    boost::asio::io_context io_context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard_;
+    boost::asio::steady_timer probe_timer_;
+    std::chrono::steady_clock::time_point probe_expected_;
+    std::chrono::milliseconds probe_interval_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+    // Scheduling lag of the control thread: how late a due timer runs, which is
+    // the delay a heartbeat waits before it is processed
+    std::atomic<int64_t>* lag_us_;
+    std::atomic<int64_t>* lag_max_us_;
+};
+
+extern ControlPlane* g_control_plane;
@@ -1,12 +1,13 @@
 #pragma once
 
-#include <mutex>
+#include "LockProfiler.h"
 
 // Cross-platform wrapper for critical section/mutex
 // Maintains same interface as original Windows CRITICAL_SECTION
+// Profiled under the given site name (see LockProfiler.h)
 class CCriticalSection {
 public:
-    CCriticalSection();
+    explicit CCriticalSection(const char* site = "CCriticalSection");
     ~CCriticalSection();
 
     void lock();
@@ -14,5 +15,5 @@ public:
     bool try_lock();
 
 private:
-    std::recursive_mutex m_mutex;
+    ProfiledRecursiveMutex m_mutex;
 };
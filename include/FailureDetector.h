@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Phi-accrual failure detector (Hayashibara et al.) for server heartbeats.
+// Keeps a window of heartbeat inter-arrival times and turns the time since the
+// last heartbeat into a suspicion level phi = -log10(P(heartbeat still coming)).
+// Because phi only grows until the next heartbeat, the tick at which it crosses
+// a threshold can be computed up front and used as a timer deadline.
+
+#define FAILURE_DETECTOR_WINDOW 32
+
+struct FAILURE_DETECTOR_CONFIG
+{
+    double SuspectPhi;          // Hide the server from lists at this phi
+    double OfflinePhi;          // Declare the server offline at this phi
+    uint32_t MinStdDeviation;   // ms floor for the inter-arrival deviation
+    uint32_t AcceptablePause;   // ms added to the mean interval
+    uint32_t FirstInterval;     // ms assumed until two heartbeats were seen
+    uint32_t MaxHeartbeatPause; // ms hard limit, offline regardless of phi
+};
+
+class CFailureDetector
+{
+public:
+    CFailureDetector();
+
+    void Reset();
+    void Heartbeat(uint32_t now);
+
+    // Window position and sums consistent with the samples; a detector
+    // restored from raw bytes (checkpoint, handoff) must pass before use
+    bool IsValid() const;
+
+    double GetPhi(uint32_t now, const FAILURE_DETECTOR_CONFIG& config) const;
+    uint32_t GetDeadline(double phi, const FAILURE_DETECTOR_CONFIG& config) const;
+    uint32_t GetLastHeartbeat() const { return this->m_LastHeartbeat; }
+    void SetLastHeartbeat(uint32_t tick) { this->m_LastHeartbeat = tick; }
+
+private:
+    double GetPhiElapsed(uint32_t elapsed, const FAILURE_DETECTOR_CONFIG& config) const;
+
+    uint16_t m_Interval[FAILURE_DETECTOR_WINDOW];
+    int m_IntervalCount;
+    int m_IntervalIndex;
+    uint32_t m_IntervalSum;
+    uint64_t m_IntervalSquareSum;
+    uint32_t m_LastHeartbeat;
+    bool m_Started;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Util.h"
+#include <atomic>
+#include <cstdint>
+
+// Flight recorder: every thread keeps its last FLIGHT_RING_SIZE events
+// (accepts, frames, handler calls, state changes, errors) in a fixed ring.
+// Recording is a thread-local lookup, a TSC read and a 24-byte store, with
+// no locks or allocation, so it stays on in production.
+// The crash handler writes all rings to flight_<pid>_<time>.bin with plain
+// write(2) calls; the "flight" console command takes the same snapshot on
+// demand. tools/cs_flightdump turns a dump into a timeline.
+
+#define FLIGHT_DUMP_MAGIC 0x52465343 // "CSFR"
+#define FLIGHT_DUMP_VERSION 1
+
+constexpr int MAX_FLIGHT_THREADS = 64;
+constexpr int FLIGHT_RING_SIZE = 1024;  // Events per thread, power of two
+
+enum eFlightEvent : uint8_t
+{
+    FLIGHT_ACCEPT = 1,          // Value: client IPv4
+    FLIGHT_ACCEPT_REJECT = 2,   // Value: client IPv4 (IP limit)
+    FLIGHT_FRAME = 3,           // A: head, B: subhead, Value: size
+    FLIGHT_HANDLER_ENTER = 4,   // A: head, B: subhead, Value: size
+    FLIGHT_HANDLER_EXIT = 5,    // A: head, B: subhead
+    FLIGHT_SEND = 6,            // A: head, B: subhead, Value: size
+    FLIGHT_CLOSE = 7,
+    FLIGHT_HEARTBEAT = 8,       // Session: sender IPv4, A: head, Value: size
+    FLIGHT_SERVER_STATE = 9,    // Session: server code, A: previous, B: state
+    FLIGHT_ERROR = 10,          // A: eFlightError, Value: error code
+    FLIGHT_MARK = 11,           // Value: caller defined
+};
+
+enum eFlightError : uint8_t
+{
+    FLIGHT_ERROR_READ = 1,
+    FLIGHT_ERROR_WRITE = 2,
+    FLIGHT_ERROR_FRAME = 3,     // Invalid header or size
+    FLIGHT_ERROR_ACCEPT = 4,
+    FLIGHT_ERROR_SEND_FULL = 5,
+    FLIGHT_ERROR_UDP = 6,
+};
+
+struct FLIGHT_EVENT
+{
+    uint64_t Tsc;
+    uint32_t Session;       // Client index unless the event says otherwise
+    uint8_t Type;
+    uint8_t A;
+    uint8_t B;
+    uint8_t Reserved;
+    uint64_t Value;
+};
+
+struct FLIGHT_RING
+{
+    std::atomic<uint64_t> Head;     // Events ever recorded; slot = Head % size
+    uint32_t ThreadId;              // Kernel tid
+    char Name[16];
+    FLIGHT_EVENT Events[FLIGHT_RING_SIZE];
+};
+
+// Dump layout: header, then per thread a FLIGHT_DUMP_THREAD followed by
+// min(Head, RingSize) events oldest first
+struct FLIGHT_DUMP_HEADER
+{
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t EventSize;     // sizeof(FLIGHT_EVENT) of the writer
+    uint32_t RingSize;
+    uint32_t Threads;
+    int32_t Signal;         // 0 for an on-demand snapshot
+    uint32_t Pid;
+    // Two (TSC, wall clock ns) pairs, at startup and at dump time, to turn
+    // TSC values into wall clock time
+    uint64_t StartTsc;
+    uint64_t StartTime;
+    uint64_t DumpTsc;
+    uint64_t DumpTime;
+};
+
+struct FLIGHT_DUMP_THREAD
+{
+    uint32_t ThreadId;
+    uint32_t Events;
+    uint64_t Head;
+    char Name[16];
+};
+
+class FlightRecorder {
+public:
+    static inline uint64_t timestamp() {
+        return ReadTimestampCounter();
+    }
+
+    static inline void record(uint8_t type, uint32_t session, uint8_t a = 0, uint8_t b = 0, uint64_t value = 0) {
+        FLIGHT_RING* ring = t_ring_ != nullptr ? t_ring_ : attach();
+        uint64_t head = ring->Head.load(std::memory_order_relaxed);
+        FLIGHT_EVENT& event = ring->Events[head & (FLIGHT_RING_SIZE - 1)];
+
+        event.Tsc = timestamp();
+        event.Session = session;
+        event.Type = type;
+        event.A = a;
+        event.B = b;
+        event.Reserved = 0;
+        event.Value = value;
+
+        ring->Head.store(head + 1, std::memory_order_release);
+    }
+
+    // Tag the calling thread in dumps ("io", "udp", ...)
+    static void set_thread_name(const char* name);
+
+    // Snapshot every ring to path (not for signal handlers)
+    static bool dump(const char* path);
+
+    // Async-signal-safe: writes the dump to an open descriptor with write(2)
+    // only, from whatever state the rings are in
+    static bool dump_fd(int fd, int signal);
+
+private:
+    static FLIGHT_RING* attach();
+
+    static inline thread_local FLIGHT_RING* t_ring_ = nullptr;
+};
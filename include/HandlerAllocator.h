@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ThreadMonitor.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Per-object handler memory for Boost.Asio (after the Asio "allocation" example).
+// Async operations and strand work started by a session are carved out of a few
+// fixed blocks owned by that session instead of the global heap, so a pooled
+// session serves requests without allocating.
+
+constexpr size_t HANDLER_MEMORY_BLOCKS = 8;
+constexpr size_t HANDLER_MEMORY_BLOCK_SIZE = 512;
+
+class HandlerMemory {
+public:
+    HandlerMemory() : in_use_(0) {}
+
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size) {
+        if (size <= HANDLER_MEMORY_BLOCK_SIZE) {
+            uint32_t used = in_use_.load(std::memory_order_relaxed);
+
+            for (size_t n = 0; n < HANDLER_MEMORY_BLOCKS; n++) {
+                uint32_t bit = 1u << n;
+
+                if ((used & bit) == 0) {
+                    if (in_use_.compare_exchange_strong(used, used | bit, std::memory_order_acquire,
+                                                        std::memory_order_relaxed)) {
+                        return blocks_[n];
+                    }
+                    n = static_cast<size_t>(-1);  // Lost a race; rescan with the fresh mask
+                }
+            }
+        }
+
+        // Oversized or exhausted: fall back to the heap
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        unsigned char* p = static_cast<unsigned char*>(pointer);
+
+        if (p >= blocks_[0] && p < blocks_[0] + sizeof(blocks_)) {
+            size_t n = (p - blocks_[0]) / HANDLER_MEMORY_BLOCK_SIZE;
+            in_use_.fetch_and(~(1u << n), std::memory_order_release);
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char blocks_[HANDLER_MEMORY_BLOCKS][HANDLER_MEMORY_BLOCK_SIZE];
+    std::atomic<uint32_t> in_use_;
+};
+
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) noexcept : memory_(&memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(size_t n) const {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, size_t) const {
+        memory_->deallocate(pointer);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept { return memory_ == other.memory_; }
+    bool operator!=(const HandlerAllocator& other) const noexcept { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory* memory_;
+};
+
+// Completion handler wrapper that exposes the owner's HandlerMemory as its
+// associated allocator, and accounts the call to ThreadMonitor
+template <typename Handler>
+class AllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    AllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory)
+        , handler_(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        HandlerScope scope;     // Busy time of the io thread running it
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline AllocHandler<typename std::decay<Handler>::type> make_alloc_handler(HandlerMemory& memory,
+                                                                           Handler&& handler) {
+    return AllocHandler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// HTTP/JSON view of the server list for launchers and web status pages
+// ([Http] Port). GET /serverlist returns every tenant's servers (code, name,
+// visibility, state, load) and JoinServer health as JSON.
+//  - The body is rendered by render(), a control-plane task, and only when
+//    the table actually changed; requests just write the current body out.
+//  - Every body has a strong ETag (hash of the body). If-None-Match with the
+//    current tag gets 304 Not Modified.
+//  - HTTP/1.1 keep-alive; idle connections close after HTTP_IDLE_TIMEOUT_MS.
+//  - Long poll: GET /serverlist?wait=N with If-None-Match holds the request
+//    until the body changes (200) or N seconds pass (304), N up to
+//    [Http] MaxWaitSeconds.
+
+constexpr int HTTP_MAX_REQUEST = 8192;
+constexpr int HTTP_IDLE_TIMEOUT_MS = 15000;
+
+struct HTTP_STATUS_CONFIG
+{
+    uint16_t Port;
+    uint32_t MaxConnections;
+    uint32_t MaxWaitSeconds;
+};
+
+// One rendering of the server list, shared by every response sending it
+struct HTTP_BODY
+{
+    std::string Json;
+    std::string ETag;               // Quoted, as sent
+    uint64_t Version;               // Renders that changed the body
+};
+
+struct STATS_SERVER_ENTRY;
+class HttpSession;
+
+class HttpStatusServer {
+public:
+    explicit HttpStatusServer(boost::asio::io_context& io);
+    ~HttpStatusServer();
+
+    bool start(const HTTP_STATUS_CONFIG& config);
+    bool start_native(const HTTP_STATUS_CONFIG& config, int native_socket);  // Inherited listening socket
+    void stop();
+    uint16_t port() const { return port_; }
+    int native_handle() { return acceptor_.is_open() ? (int)acceptor_.native_handle() : -1; }
+
+    // Rebuild the body from the server lists; wakes long polls if it changed.
+    // Returns true if it did.
+    bool render();
+
+    std::shared_ptr<const HTTP_BODY> body();
+    uint32_t max_wait_seconds() const { return config_.MaxWaitSeconds; }
+    int connections() const { return connections_->load(std::memory_order_relaxed); }
+
+private:
+    friend class HttpSession;
+
+    void run();
+    void start_accept();
+    // False if the body no longer carries this tag: answer now instead
+    bool register_waiter(const std::shared_ptr<HttpSession>& session, const std::string& etag);
+
+    boost::asio::io_context& io_context_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    HTTP_STATUS_CONFIG config_;
+    uint16_t port_;
+    bool running_;
+
+    std::mutex body_mutex_;
+    std::shared_ptr<const HTTP_BODY> body_;
+    std::string render_buffer_;
+    std::unique_ptr<STATS_SERVER_ENTRY[]> render_servers_;
+
+    // Long polls waiting for the next body
+    std::mutex waiters_mutex_;
+    std::vector<std::weak_ptr<HttpSession>> waiters_;
+
+    // Shared with the sessions, which may outlive the server at shutdown
+    std::shared_ptr<std::atomic<int>> connections_;
+    std::atomic<int64_t>* request_count_;
+    std::atomic<int64_t>* not_modified_count_;
+    std::atomic<int64_t>* render_count_;
+};
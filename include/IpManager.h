@@ -1,9 +1,15 @@
 #pragma once
 
-#include <map>
-#include <string>
 #include <cstdint>
 
+// Open-addressed table sized well above MAX_CLIENT so lookups stay short
+// and no node is ever allocated after startup
+#define MAX_IP_ADDRESS_TABLE 16384
+
+extern int MaxIpConnection;  // From configuration
+
+class CSharedServerTable;
+
 struct IP_ADDRESS_INFO
 {
     char IpAddress[16];
@@ -16,13 +22,25 @@ public:
     CIpManager();
     ~CIpManager();
 
+    // Connections allowed per address; until set, the global MaxIpConnection
+    void SetMaxIpConnection(int count) { this->m_MaxIpConnection = count; }
+    int GetMaxIpConnection() const { return (this->m_MaxIpConnection >= 0) ? this->m_MaxIpConnection : MaxIpConnection; }
+
+    // Prefork worker: count in the table shared by all workers instead
+    void SetSharedTable(CSharedServerTable* lpTable, int worker);
+
     bool CheckIpAddress(const char* IpAddress);
     void InsertIpAddress(const char* IpAddress);
     void RemoveIpAddress(const char* IpAddress);
 
 private:
-    std::map<std::string, IP_ADDRESS_INFO> m_IpAddressInfo;
+    int GetHomeSlot(const char* IpAddress);
+    int FindIpAddress(const char* IpAddress, bool* found);
+
+    IP_ADDRESS_INFO m_IpAddressInfo[MAX_IP_ADDRESS_TABLE];
+    int m_MaxIpConnection;
+    CSharedServerTable* m_SharedTable;
+    int m_SharedWorker;
 };
 
 extern CIpManager gIpManager;
-extern int MaxIpConnection;  // From configuration
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Log-linear latency histogram in nanoseconds, HDR style: values below 16
+// get a bucket each, above that every power of two is split into 8 linear
+// sub-buckets, so any reported percentile is within 12.5% of the truth.
+// Recording is a bucket computation and three relaxed atomic adds; readers
+// may run concurrently and see a slightly torn but usable picture.
+
+constexpr int LATENCY_SUB_BUCKET_BITS = 3;
+constexpr int LATENCY_MAX_EXPONENT = 40;    // ~18 minutes; larger values clamp
+constexpr int LATENCY_BUCKETS = 16 + (LATENCY_MAX_EXPONENT - 4 + 1) * (1 << LATENCY_SUB_BUCKET_BITS);
+
+struct LATENCY_SUMMARY
+{
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    static inline int bucket(uint64_t ns) {
+        if (ns < 16) {
+            return (int)ns;
+        }
+
+#if defined(__GNUC__)
+        int exponent = 63 - __builtin_clzll(ns);
+#else
+        int exponent = 0;
+        for (uint64_t value = ns; value > 1; value >>= 1) {
+            exponent++;
+        }
+#endif
+
+        if (exponent > LATENCY_MAX_EXPONENT) {
+            return LATENCY_BUCKETS - 1;
+        }
+
+        int sub = (int)((ns >> (exponent - LATENCY_SUB_BUCKET_BITS)) & ((1 << LATENCY_SUB_BUCKET_BITS) - 1));
+        return 16 + (exponent - 4) * (1 << LATENCY_SUB_BUCKET_BITS) + sub;
+    }
+
+    // Smallest value that lands in bucket
+    static uint64_t bucket_floor(int bucket);
+
+    inline void record(uint64_t ns) {
+        buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t current = max_.load(std::memory_order_relaxed);
+        while (ns > current && !max_.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    // Upper edge of the bucket holding the given fraction (0..1) of samples
+    uint64_t percentile(double fraction) const;
+
+    LATENCY_SUMMARY summary() const;
+
+    // Add other's samples to this one (e.g. folding per-thread histograms)
+    void merge(const LatencyHistogram& other);
+
+    void reset();
+
+private:
+    std::atomic<uint64_t> buckets_[LATENCY_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "Util.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Lock profiling: ProfiledMutex and ProfiledRecursiveMutex stand in for
+// std::mutex and std::recursive_mutex and account every acquisition to a
+// named site shared by all instances with that name (e.g. every session's
+// send lock is "ClientSession::send"). Per site: acquisitions, contended
+// acquisitions, and log2 histograms of wait and hold time.
+// An uncontended lock costs one try_lock plus two TSC reads and a few
+// relaxed adds. Adaptive locks spin before parking, with a per-site budget
+// that grows while spinning wins and shrinks while it does not.
+// "locks" on the console ranks sites by total wait; acquisition counts are
+// also published as lock.<site>.acquired/contended metrics.
+
+constexpr int MAX_LOCK_SITES = 32;
+constexpr int MAX_LOCK_SITE_NAME = 32;
+constexpr int LOCK_HISTOGRAM_BUCKETS = 40;  // Bucket n: [2^n, 2^(n+1)) ticks
+
+constexpr uint32_t LOCK_SPIN_MIN = 16;
+constexpr uint32_t LOCK_SPIN_MAX = 4096;
+
+struct LOCK_SITE
+{
+    char name[MAX_LOCK_SITE_NAME];
+    std::atomic<int64_t>* acquisitions;     // Metrics lock.<site>.acquired
+    std::atomic<int64_t>* contended;        // Metrics lock.<site>.contended
+    std::atomic<uint64_t> wait_ticks;
+    std::atomic<uint64_t> hold_ticks;
+    std::atomic<uint64_t> max_wait_ticks;
+    std::atomic<uint64_t> max_hold_ticks;
+    std::atomic<uint64_t> wait_histogram[LOCK_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> hold_histogram[LOCK_HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> spin_budget;      // Adaptive locks only
+    std::atomic<uint64_t> spin_wins;        // Contended but got it spinning
+};
+
+// One site as the report sees it, times in ns
+struct LOCK_SITE_STATS
+{
+    const char* name;
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t spin_wins;
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+    uint64_t max_wait_ns;
+    uint64_t max_hold_ns;
+    uint64_t wait_p50_ns;
+    uint64_t wait_p99_ns;
+    uint64_t hold_p50_ns;
+    uint64_t hold_p99_ns;
+};
+
+class LockProfiler {
+public:
+    // Find or register a site (at lock construction, not per acquisition)
+    static LOCK_SITE* site(const char* name);
+
+    // Stats of every site, sorted by total wait, most first
+    static int snapshot(LOCK_SITE_STATS* stats, int max);
+
+    // Write the ranking to the log
+    static void report();
+
+    // Zero all counters and histograms (e.g. after warm-up)
+    static void reset();
+
+    static inline int bucket(uint64_t ticks) {
+#if defined(__GNUC__)
+        int bucket = (ticks == 0) ? 0 : 63 - __builtin_clzll(ticks);
+#else
+        int bucket = 0;
+        while (ticks > 1) {
+            ticks >>= 1;
+            bucket++;
+        }
+#endif
+        return (bucket < LOCK_HISTOGRAM_BUCKETS) ? bucket : LOCK_HISTOGRAM_BUCKETS - 1;
+    }
+
+    static inline void record_wait(LOCK_SITE* site, uint64_t ticks) {
+        site->contended->fetch_add(1, std::memory_order_relaxed);
+        site->wait_ticks.fetch_add(ticks, std::memory_order_relaxed);
+        site->wait_histogram[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+        update_max(site->max_wait_ticks, ticks);
+    }
+
+    static inline void record_hold(LOCK_SITE* site, uint64_t ticks) {
+        site->hold_ticks.fetch_add(ticks, std::memory_order_relaxed);
+        site->hold_histogram[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+        update_max(site->max_hold_ticks, ticks);
+    }
+
+    static inline void cpu_relax() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+private:
+    static inline void update_max(std::atomic<uint64_t>& max, uint64_t value) {
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+template <typename Mutex>
+class BasicProfiledMutex {
+public:
+    explicit BasicProfiledMutex(const char* site, bool adaptive = false)
+        : site_(LockProfiler::site(site)), adaptive_(adaptive), depth_(0), locked_at_(0) {}
+
+    BasicProfiledMutex(const BasicProfiledMutex&) = delete;
+    BasicProfiledMutex& operator=(const BasicProfiledMutex&) = delete;
+
+    void lock() {
+        if (!mutex_.try_lock()) {
+            lock_contended();
+        }
+
+        acquired();
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+
+        acquired();
+        return true;
+    }
+
+    void unlock() {
+        // depth_ and locked_at_ are only touched by the owner
+        if (--depth_ == 0) {
+            LockProfiler::record_hold(site_, ReadTimestampCounter() - locked_at_);
+        }
+
+        mutex_.unlock();
+    }
+
+private:
+    void acquired() {
+        site_->acquisitions->fetch_add(1, std::memory_order_relaxed);
+
+        // Recursive re-entry keeps timing the outermost hold
+        if (depth_++ == 0) {
+            locked_at_ = ReadTimestampCounter();
+        }
+    }
+
+    void lock_contended() {
+        uint64_t started = ReadTimestampCounter();
+
+        if (!adaptive_ || !spin()) {
+            mutex_.lock();
+        }
+
+        LockProfiler::record_wait(site_, ReadTimestampCounter() - started);
+    }
+
+    bool spin() {
+        uint32_t budget = site_->spin_budget.load(std::memory_order_relaxed);
+
+        for (uint32_t n = 0; n < budget; n++) {
+            LockProfiler::cpu_relax();
+
+            if (mutex_.try_lock()) {
+                site_->spin_wins.fetch_add(1, std::memory_order_relaxed);
+                site_->spin_budget.store(std::min(LOCK_SPIN_MAX, budget + budget / 8), std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        site_->spin_budget.store(std::max(LOCK_SPIN_MIN, budget - budget / 4), std::memory_order_relaxed);
+        return false;
+    }
+
+    Mutex mutex_;
+    LOCK_SITE* site_;
+    bool adaptive_;
+    int depth_;
+    uint64_t locked_at_;
+};
+
+using ProfiledMutex = BasicProfiledMutex<std::mutex>;
+using ProfiledRecursiveMutex = BasicProfiledMutex<std::recursive_mutex>;
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Process-wide named metrics (counters and gauges).
+// Look a metric up once at startup and keep the pointer; updates are a single
+// relaxed atomic operation.
+
+constexpr int MAX_METRICS = 256;
+constexpr int MAX_METRIC_NAME = 48;
+
+struct METRIC_INFO
+{
+    char name[MAX_METRIC_NAME];
+    std::atomic<int64_t> value;
+};
+
+class Metrics {
+public:
+    // Find or register a metric (not for hot paths; cache the result)
+    static std::atomic<int64_t>* get(const char* name);
+
+    // Copy up to max metrics into names/values, returns the count
+    static int snapshot(const char** names, int64_t* values, int max);
+
+    // Write every metric to the log
+    static void report();
+
+    // Raise a gauge to value if it is higher (e.g. max latency)
+    static void update_max(std::atomic<int64_t>* metric, int64_t value) {
+        int64_t current = metric->load(std::memory_order_relaxed);
+        while (value > current &&
+               !metric->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+};
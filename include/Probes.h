@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// USDT static probes (provider "connectserver") for bpftrace/SystemTap.
+// Built with ENABLE_USDT when <sys/sdt.h> is available: each probe is a nop
+// plus an ELF note, so it costs nothing until a tracer attaches. Without it
+// the macros expand to nothing and their arguments are not evaluated.
+// scripts/bpftrace has latency breakdowns built on these.
+//
+//   accept          (session, ip)
+//   read            (session, bytes, buffered)
+//   frame           (session, head, subhead, size)
+//   handler__entry  (session, head, subhead, size)
+//   handler__return (session, head, subhead)
+//   send            (session, head, subhead, size)
+//   write__done     (session, bytes)
+//   close           (session)
+//   heartbeat       (ipv4, head, size)
+//   server__state   (server code, previous state, state)
+//
+// session is the client index, e.g.
+//   usdt:./ConnectServer:connectserver:handler__entry { @[arg1, arg2] = count(); }
+
+#ifdef CS_USDT
+
+#include <sys/sdt.h>
+
+#define CS_PROBE1(name, a) DTRACE_PROBE1(connectserver, name, a)
+#define CS_PROBE2(name, a, b) DTRACE_PROBE2(connectserver, name, a, b)
+#define CS_PROBE3(name, a, b, c) DTRACE_PROBE3(connectserver, name, a, b, c)
+#define CS_PROBE4(name, a, b, c, d) DTRACE_PROBE4(connectserver, name, a, b, c, d)
+
+#else
+
+#define CS_PROBE1(name, a) do {} while (0)
+#define CS_PROBE2(name, a, b) do {} while (0)
+#define CS_PROBE3(name, a, b, c) do {} while (0)
+#define CS_PROBE4(name, a, b, c, d) do {} while (0)
+
+#endif
+
+// Head and subhead of a framed C1-C4 packet, 0 where the packet is too short
+inline uint8_t ProbeHead(const uint8_t* packet, size_t size)
+{
+    size_t offset = (packet[0] == 0xC1 || packet[0] == 0xC3) ? 2 : 3;
+    return (size > offset) ? packet[offset] : 0;
+}
+
+inline uint8_t ProbeSubhead(const uint8_t* packet, size_t size)
+{
+    size_t offset = (packet[0] == 0xC1 || packet[0] == 0xC3) ? 3 : 4;
+    return (size > offset) ? packet[offset] : 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LockProfiler.h"
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -33,7 +34,7 @@ public:
     bool GetFromQueue(QUEUE_INFO& info, int timeout_ms = -1);
 
 private:
-    mutable std::mutex m_mutex;
-    std::condition_variable m_cv;
+    mutable ProfiledMutex m_mutex;
+    std::condition_variable_any m_cv;
     std::queue<QUEUE_INFO> m_queue;
 };
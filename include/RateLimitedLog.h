@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Util.h"
+#include <atomic>
+#include <cstdint>
+
+// Per-call-site rate-limited logging for lines a client can trigger at will
+// (junk bytes, connect storms). LogAddLimited(color, format, ...) behaves
+// like LogAdd, but each call site gets its own budget of lines per second,
+// taken from the "[Prefix]" its format starts with ([LogLimits] in the
+// config, Default for the rest). Once over budget the site only counts;
+// at the end of each window (RateLimitedLog::flush, run by the 1 s timer)
+// it logs "suppressed N similar messages" and the budget refills.
+// The fast path is one relaxed fetch_add on the site's counter; the first
+// call of each window also looks up the site's limit.
+
+constexpr uint32_t LOG_LIMIT_DEFAULT = 20;  // Lines per call site per second
+constexpr int MAX_LOG_LIMITS = 32;
+constexpr int MAX_LOG_PREFIX = 24;
+
+struct LOG_SITE
+{
+    int Color;
+    const char* Format;
+    const char* File;
+    int Line;
+    std::atomic<uint32_t> Count;        // Calls in the current window
+    std::atomic<uint32_t> Limit;
+    std::atomic<int> Linked;            // On the flush list
+    LOG_SITE* Next;
+};
+
+class RateLimitedLog {
+public:
+    // Budget for call sites whose format starts with "[prefix]"; an empty
+    // prefix sets the default
+    static void set_limit(const char* prefix, uint32_t per_second);
+
+    // Close the window: summarize suppressed lines, refill every site
+    static void flush();
+
+    static inline bool allow(LOG_SITE* site) {
+        uint32_t count = site->Count.fetch_add(1, std::memory_order_relaxed);
+
+        if (count == 0) {
+            open_window(site);
+        }
+
+        return count < site->Limit.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void open_window(LOG_SITE* site);
+};
+
+// First argument of LogAddLimited's format and arguments
+#define LOG_SITE_FORMAT(format, ...) format
+
+// Statics are constant-initialized: no guard variable on the fast path
+#define LogAddLimited(color, ...)                                                                   \
+    do {                                                                                            \
+        static LOG_SITE log_site_ = {color, LOG_SITE_FORMAT(__VA_ARGS__, ""), __FILE__, __LINE__, {0}, \
+                                     {LOG_LIMIT_DEFAULT}, {0}, nullptr};                            \
+        if (RateLimitedLog::allow(&log_site_)) {                                                    \
+            LogAdd(color, __VA_ARGS__);                                                             \
+        }                                                                                           \
+    } while (0)
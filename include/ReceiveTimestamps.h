@@ -0,0 +1,57 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include <cstddef>
+#include <cstdint>
+
+struct sockaddr;
+
+// Kernel receive timestamps (Linux SO_TIMESTAMPNS). With [Latency]
+// ReceiveTimestamps=1 the TCP sessions and the UDP heartbeat socket read
+// through recvmsg, and each request's latency is split in two:
+//  - queue: from the kernel stamping the packet to the read returning,
+//    i.e. time spent in the socket buffer waiting for a worker;
+//  - service: the handler, from dispatch to return.
+// Growing queue time with flat service time means more workers; growing
+// service time means a slow handler. "latency" on the console reports both.
+// On TCP the kernel stamps the most recent segment consumed by the read,
+// so a read that coalesces several segments reports the shortest wait.
+// Elsewhere (or switched off) the plain Asio read path is used.
+
+enum eReceiveHistogram
+{
+    RECEIVE_TCP_QUEUE = 0,
+    RECEIVE_TCP_SERVICE = 1,
+    RECEIVE_UDP_QUEUE = 2,
+    RECEIVE_UDP_SERVICE = 3,
+    RECEIVE_HISTOGRAMS = 4,
+};
+
+class ReceiveTimestamps {
+public:
+    static void set_enabled(bool enabled);
+    static bool enabled();
+
+    // Ask the kernel to stamp packets on this socket; false if unsupported
+    static bool enable_socket(int fd);
+
+    // Non-blocking recvmsg; kernel_ns gets the receive timestamp
+    // (CLOCK_REALTIME) or 0 when the packet carried none. Returns the byte
+    // count, or -1 with errno set (EAGAIN when nothing is queued).
+    static long receive(int fd, void* data, size_t size, sockaddr* from, unsigned int* from_size, uint64_t* kernel_ns);
+
+    // Clocks to compare against: realtime for kernel stamps, monotonic for
+    // service times
+    static uint64_t realtime_ns();
+    static uint64_t monotonic_ns();
+
+    // Queueing delay of a packet stamped at kernel_ns, read just now
+    static uint64_t queue_delay(uint64_t kernel_ns);
+
+    static LatencyHistogram& histogram(int which);
+
+    // Write percentiles of every histogram to the log
+    static void report();
+
+    static void reset();
+};
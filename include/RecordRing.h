@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Multi-producer, single-consumer byte ring for variable-size records.
+// Producers reserve with one CAS and publish with one release store; the
+// consumer (a writer thread) walks published records in order. A record
+// never wraps: when it does not fit before the end, the rest of the ring is
+// reserved as padding. Full means the caller drops, never blocks.
+
+class RecordRing {
+public:
+    RecordRing();
+
+    // Rounded up to a power of two (at least 64 KB); a no-op once allocated
+    void allocate(size_t size);
+    bool allocated() const { return ring_ != nullptr; }
+    size_t capacity() const { return capacity_; }
+
+    // Space for a size-byte record, or nullptr if the ring is full (or the
+    // record is larger than half of it). Must be followed by publish().
+    uint8_t* reserve(size_t size);
+    void publish(uint8_t* record, size_t size);
+
+    // Bytes reserved and not yet drained
+    size_t used() const {
+        return (size_t)(head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed));
+    }
+
+    // Consumer only: consume(record, size) for every published record, in
+    // order, up to the first one still being written. Returns records seen.
+    template <typename Consume>
+    size_t drain(Consume&& consume);
+
+private:
+    struct SLOT
+    {
+        std::atomic<uint32_t> Length;   // Bytes to the next slot, 0 while unpublished
+        uint32_t Size;                  // Record bytes; 0 for padding
+    };
+
+    static constexpr size_t ALIGN = 8;
+
+    static size_t slot_size(size_t size) {
+        return (sizeof(SLOT) + size + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    std::unique_ptr<uint8_t[]> ring_;
+    size_t capacity_;
+    std::atomic<uint64_t> head_;    // Bytes reserved by producers
+    std::atomic<uint64_t> tail_;    // Bytes released by the consumer
+};
+
+template <typename Consume>
+size_t RecordRing::drain(Consume&& consume) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    size_t records = 0;
+
+    while (tail != head) {
+        SLOT* slot = reinterpret_cast<SLOT*>(ring_.get() + (tail & (capacity_ - 1)));
+        uint32_t length = slot->Length.load(std::memory_order_acquire);
+
+        // Reserved but not yet published; pick it up next round
+        if (length == 0) {
+            break;
+        }
+
+        if (slot->Size != 0) {
+            consume(reinterpret_cast<const uint8_t*>(slot) + sizeof(SLOT), (size_t)slot->Size);
+            records++;
+        }
+
+        // Any offset in here may become a slot header on the next lap; it
+        // must read as unpublished until its producer stores Length
+        memset(reinterpret_cast<uint8_t*>(slot), 0, length);
+        tail += length;
+    }
+
+    tail_.store(tail, std::memory_order_release);
+    return records;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Per-request latency tracing. Every framed client request is stamped at
+// frame completion, handler start, first reply enqueue and completion of
+// the write carrying that reply; the stage durations go into
+// LatencyHistograms kept per (head, subhead) route and per thread, so the
+// hot path never shares a cache line with another io thread. Readers merge
+// the tables on demand ("trace" on the console, trace.* metrics).
+// Requests slower than [Trace] SlowRequestMs are logged with their stage
+// breakdown, one in SlowSampleRate, at most SlowLogPerSecond lines a second;
+// lines held back are counted in the next one that gets through.
+
+constexpr int MAX_TRACE_THREADS = 64;
+constexpr int MAX_TRACE_ROUTES = 16;    // Per thread; the last slot collects the rest
+
+enum eTraceStage
+{
+    TRACE_DISPATCH = 0,     // Frame complete -> handler start
+    TRACE_HANDLER = 1,      // Handler start -> reply enqueued (or handler return)
+    TRACE_WRITE = 2,        // Reply enqueued -> write completed
+    TRACE_TOTAL = 3,        // Frame complete -> write completed
+    TRACE_STAGES = 4,
+};
+
+struct REQUEST_TRACE
+{
+    uint8_t Head;
+    uint8_t Subhead;
+    uint16_t Size;
+    uint64_t Frame;         // RequestTracer::now() stamps
+    uint64_t HandlerStart;
+    uint64_t Enqueued;      // 0 until the handler queues a reply
+    uint64_t HandlerDone;
+    uint64_t Written;
+    uint64_t WriteSeq;      // Session write that carries the reply
+};
+
+struct TRACE_CONFIG
+{
+    bool Enabled;
+    uint64_t SlowRequestNs;     // 0 = no slow-request log
+    uint32_t SlowSampleRate;    // Log one in N slow requests
+    uint32_t SlowLogPerSecond;
+};
+
+struct TRACE_ROUTE_HISTOGRAMS
+{
+    LatencyHistogram Stages[TRACE_STAGES];
+};
+
+struct TRACE_ROUTE
+{
+    std::atomic<uint32_t> Key;  // 0 = free, else ROUTE_KEY(head, subhead)
+    std::atomic<TRACE_ROUTE_HISTOGRAMS*> Histograms;
+};
+
+struct TRACE_THREAD
+{
+    uint32_t ThreadId;
+    TRACE_ROUTE Routes[MAX_TRACE_ROUTES];
+};
+
+// One route (or thread) as the report sees it, merged across threads
+struct TRACE_ROUTE_STATS
+{
+    uint8_t Head;
+    uint8_t Subhead;
+    bool Other;             // Overflow slot: routes past MAX_TRACE_ROUTES
+    LATENCY_SUMMARY Stages[TRACE_STAGES];
+};
+
+class RequestTracer {
+public:
+    static void configure(const TRACE_CONFIG& config);
+
+    static inline bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static inline uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // A request has gone all the way through; record its stages on the
+    // calling thread's tables and check it against the slow threshold
+    static void finish(const REQUEST_TRACE& trace, int session);
+
+    // Routes merged across threads, busiest first
+    static int snapshot_routes(TRACE_ROUTE_STATS* stats, int max);
+
+    // TRACE_TOTAL of one thread merged across its routes
+    static bool thread_total(int thread, uint32_t* thread_id, LATENCY_SUMMARY* total);
+
+    // Write the per-route and per-thread breakdown to the log
+    static void report();
+
+    // Refresh the trace.* gauges in the metrics registry
+    static void publish();
+
+    static void reset();
+
+private:
+    static TRACE_THREAD* attach();
+    static LatencyHistogram* route(uint8_t head, uint8_t subhead);
+    static void log_slow(const REQUEST_TRACE& trace, int session, const uint64_t* stages);
+
+    static inline std::atomic<bool> enabled_{false};
+    static inline thread_local TRACE_THREAD* t_thread_ = nullptr;
+};
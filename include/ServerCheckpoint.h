@@ -0,0 +1,45 @@
+#pragma once
+
+#include "ServerList.h"
+#include <atomic>
+#include <cstdint>
+
+// Warm start: the live server table is copied into a memory-mapped file once
+// a second. Writes are plain stores into the mapping (the page cache keeps
+// them past a crash of the process), so the heartbeat path never syscalls.
+// On startup, entries still fresh are restored as provisional.
+
+#define SERVER_CHECKPOINT_MAGIC 0x4B435343 // "CSCK"
+#define SERVER_CHECKPOINT_VERSION 1
+
+struct SERVER_CHECKPOINT_FILE
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t EntrySize;                 // sizeof(SERVER_LIVE_SNAPSHOT) of the writer
+    std::atomic<uint32_t> Sequence;     // Odd while a save is in progress
+    uint64_t CheckpointTime;            // Wall clock (ms since epoch) of the last save
+    uint32_t EntryCount;
+    SERVER_LIVE_SNAPSHOT Entry[MAX_SERVER_LIST + 1];
+};
+
+class CServerCheckpoint
+{
+public:
+    CServerCheckpoint();
+    ~CServerCheckpoint();
+
+    bool Open(const char* path);
+    void Close();
+    bool IsOpen() { return (this->m_File != nullptr); }
+
+    // Import fresh entries as provisional; returns how many were restored
+    int Restore(CServerList* lpServerList);
+    void Save(CServerList* lpServerList);
+
+private:
+    SERVER_CHECKPOINT_FILE* m_File;
+    int m_Handle;
+};
+
+extern CServerCheckpoint gServerCheckpoint;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ProtocolDefines.h"
+#include "ServerList.h"
+#include "SocketManagerUdp.h"
+#include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cluster mode: ConnectServers behind DNS round-robin replicate the server
+// table over UDP, so a GameServer heartbeats one node and every node answers
+// list/info requests from the merged view.
+// Each round a node pushes the entries it originated since the last round to
+// all peers; every FullSyncInterval it sends everything it knows, which
+// repairs lost datagrams and brings new or restarted nodes up to date.
+// Merging is last-writer-wins per server (see SERVER_CLUSTER_ENTRY).
+
+struct SDHP_CLUSTER_GOSSIP
+{
+    PWMSG_HEAD header; // C2:10
+    uint16_t NodeId;
+    uint16_t Count;
+    uint32_t ClusterKey;
+    // SERVER_CLUSTER_ENTRY Entry[Count]
+};
+
+constexpr uint8_t CLUSTER_GOSSIP_HEAD = 0x10;
+constexpr int MAX_CLUSTER_GOSSIP_ENTRIES =
+    (int)((MAX_UDP_PACKET_SIZE - sizeof(SDHP_CLUSTER_GOSSIP)) / sizeof(SERVER_CLUSTER_ENTRY));
+
+struct CLUSTER_CONFIG
+{
+    uint16_t NodeId;           // 1..65535, unique per node (0 = cluster off)
+    uint16_t Port;             // Gossip UDP port
+    uint32_t ClusterKey;       // Shared value; datagrams with another key are dropped
+    uint32_t Interval;         // ms between delta rounds
+    uint32_t FullSyncInterval; // ms between full-state rounds
+    std::vector<boost::asio::ip::udp::endpoint> Peers;
+};
+
+class ServerCluster {
+public:
+    ServerCluster(boost::asio::io_context& io, CServerList& server_list);
+    ~ServerCluster();
+
+    bool start(const CLUSTER_CONFIG& config);
+    void stop();    // Any thread; returns once the node is closed on the io_context
+    uint16_t port() const { return port_; }
+
+    // "host:port,host:port" -> endpoints; false on a malformed entry
+    static bool parse_peers(const std::string& list, std::vector<boost::asio::ip::udp::endpoint>* peers);
+
+private:
+    void schedule_round();
+    void run_round();
+    void send_entries(int count);
+
+    void start_receive();
+    void handle_receive(const boost::system::error_code& error, size_t bytes);
+    bool is_peer(const boost::asio::ip::udp::endpoint& endpoint) const;
+
+    boost::asio::io_context& io_context_;
+    CServerList& server_list_;
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::steady_timer round_timer_;
+    boost::asio::ip::udp::endpoint remote_endpoint_;
+
+    CLUSTER_CONFIG config_;
+    std::chrono::steady_clock::time_point next_full_sync_;
+    std::atomic<bool> running_;
+    uint16_t port_;
+
+    std::array<SERVER_CLUSTER_ENTRY, MAX_SERVER_LIST> entries_;
+    std::array<uint8_t, MAX_UDP_PACKET_SIZE> send_buffer_;
+    std::array<uint8_t, MAX_UDP_PACKET_SIZE> recv_buffer_;
+
+    // Bandwidth per node and convergence (origin change -> applied here)
+    std::atomic<int64_t>* bytes_sent_;
+    std::atomic<int64_t>* bytes_received_;
+    std::atomic<int64_t>* entries_merged_;
+    std::atomic<int64_t>* convergence_ms_;
+    std::atomic<int64_t>* convergence_max_ms_;
+};
+
+extern ServerCluster* g_server_cluster;
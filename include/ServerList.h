@@ -1,11 +1,21 @@
 #pragma once
 
 #include "ProtocolDefines.h"
-#include <map>
+#include "FailureDetector.h"
+#include "LockProfiler.h"
+#include "WireFormat.h"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 
 #define MAX_JOIN_SERVER_QUEUE_SIZE 100
 
+class CSharedServerTable;
+struct STATS_SERVER_ENTRY;
+
 //**********************************************//
 //********** UDP Protocol Structures ***********//
 //**********************************************//
@@ -26,10 +36,59 @@ struct SDHP_JOIN_SERVER_LIVE_RECV
     uint32_t QueueSize;
 };
 
+// Heartbeats as GameServers and the JoinServer send them: the structs above
+// with their natural alignment, padding included. Decoded through these
+// layouts, so a short datagram is dropped instead of read past its end.
+struct SDHP_GAME_SERVER_LIVE_WIRE
+{
+    static constexpr WireHeader Header{0xC1, 0x01};
+    static constexpr WirePad<1> Pad1{Header.Size};
+    static constexpr WireInt<uint16_t> ServerCode{Pad1.End};
+    static constexpr WireInt<uint8_t> UserTotal{ServerCode.End};
+    static constexpr WirePad<1> Pad2{UserTotal.End};
+    static constexpr WireInt<uint16_t> UserCount{Pad2.End};
+    static constexpr WireInt<uint16_t> AccountCount{UserCount.End};
+    static constexpr WireInt<uint16_t> MaxUserCount{AccountCount.End};
+    static constexpr size_t Size = MaxUserCount.End;
+};
+
+struct SDHP_JOIN_SERVER_LIVE_WIRE
+{
+    static constexpr WireHeader Header{0xC1, 0x02};
+    static constexpr WirePad<1> Pad1{Header.Size};
+    static constexpr WireInt<uint32_t> QueueSize{Pad1.End};
+    static constexpr size_t Size = QueueSize.End;
+};
+
+static_assert(SDHP_GAME_SERVER_LIVE_WIRE::Size == 14 && sizeof(SDHP_GAME_SERVER_LIVE_RECV) == 14 &&
+              offsetof(SDHP_GAME_SERVER_LIVE_RECV, ServerCode) == SDHP_GAME_SERVER_LIVE_WIRE::ServerCode.Offset &&
+              offsetof(SDHP_GAME_SERVER_LIVE_RECV, UserCount) == SDHP_GAME_SERVER_LIVE_WIRE::UserCount.Offset,
+              "C1:01 is 14 bytes, laid out like the GameServer's struct");
+static_assert(SDHP_JOIN_SERVER_LIVE_WIRE::Size == 8 && sizeof(SDHP_JOIN_SERVER_LIVE_RECV) == 8 &&
+              offsetof(SDHP_JOIN_SERVER_LIVE_RECV, QueueSize) == SDHP_JOIN_SERVER_LIVE_WIRE::QueueSize.Offset,
+              "C1:02 is 8 bytes, laid out like the JoinServer's struct");
+
 //**********************************************//
 //************ Server List Info ****************//
 //**********************************************//
 
+#define MAX_SERVER_LIST 1024
+#define MAX_SERVER_CODE 65536
+#define SERVER_SLOT_NONE 0xFFFF
+
+#define SERVER_HEARTBEAT_TIMEOUT 10000
+
+// Liveness slot used by the JoinServer in the detector/deadline arrays
+#define JOIN_SERVER_SLOT MAX_SERVER_LIST
+
+enum eServerState
+{
+    SERVER_STATE_OFFLINE = 0,
+    SERVER_STATE_ONLINE = 1,
+    SERVER_STATE_SUSPECT = 2,
+};
+
+// Cold per-server data: loaded from ServerList.dat, read when replying
 struct SERVER_LIST_INFO
 {
     uint16_t ServerCode;
@@ -37,12 +96,38 @@ struct SERVER_LIST_INFO
     char ServerAddress[16];
     uint16_t ServerPort;
     bool ServerShow;
-    bool ServerState;
-    uint32_t ServerStateTime;
+};
+
+// Live state of one server, carried over to a new process on restart.
+// Times are ages so the receiver can rebase them onto its own tick.
+#define JOIN_SERVER_SNAPSHOT_CODE 0xFFFF
+
+struct SERVER_LIVE_SNAPSHOT
+{
+    uint16_t ServerCode; // JOIN_SERVER_SNAPSHOT_CODE for the JoinServer
+    uint8_t ServerState;
     uint8_t UserTotal;
     uint16_t UserCount;
     uint16_t AccountCount;
     uint16_t MaxUserCount;
+    uint32_t QueueSize;
+    uint32_t HeartbeatAge; // ms since the last heartbeat when taken
+    CFailureDetector Detector;
+};
+
+// Replicated state of one GameServer between cluster nodes; the entry with
+// the higher Version (origin wall-clock ms, then Origin node) wins
+struct SERVER_CLUSTER_ENTRY
+{
+    uint64_t Version;
+    uint16_t ServerCode;
+    uint16_t Origin;       // Node that heard the heartbeat
+    uint16_t UserCount;
+    uint16_t AccountCount;
+    uint16_t MaxUserCount;
+    uint8_t ServerState;
+    uint8_t UserTotal;
+    uint32_t HeartbeatAge; // ms between the last heartbeat and Version
 };
 
 class CServerList
@@ -54,21 +139,100 @@ public:
     void Load(const char* path);
     void MainProc();
     bool CheckJoinServerState();
+    bool CheckServerState(int ServerCode);
+
+    void SetFailureDetectorConfig(const FAILURE_DETECTOR_CONFIG& config);
+    void SetShowOfflineServers(bool show) { this->m_ShowOfflineServers = show; }
+
+    // Event-driven liveness: a timer fires exactly when the next server
+    // crosses its suspect/offline threshold
+    void StartLivenessTimer(boost::asio::io_context& io);
+    void StopLivenessTimer();
+    uint32_t ProcessDeadlines(uint32_t now);
+
+    // Restart handoff/checkpoint: every server that is not offline, and back
+    // again. Provisional entries are trusted until their first live heartbeat.
+    int ExportLiveSnapshot(SERVER_LIVE_SNAPSHOT* lpSnapshot, int maxCount);
+    int ImportLiveSnapshot(const SERVER_LIVE_SNAPSHOT* lpSnapshot, int count, bool provisional = false);
+    bool IsProvisional(int ServerCode);
+
+    // Cluster mode: local changes are versioned under NodeId and exported as
+    // deltas (or in full); entries from peers are merged last-writer-wins
+    void SetClusterNode(uint16_t NodeId);
+    int ExportClusterEntries(SERVER_CLUSTER_ENTRY* lpEntry, int maxCount, bool ChangedOnly);
+    int MergeClusterEntries(const SERVER_CLUSTER_ENTRY* lpEntry, int count, uint32_t* lpMaxLag);
+
+    // Prefork mode: mirror the table into shared memory for the workers
+    void SetSharedTable(CSharedServerTable* lpTable);
+
+    // Stats segment: every server with its live state, and the JoinServer
+    int ExportStats(STATS_SERVER_ENTRY* lpEntry, int maxCount, uint8_t tenant);
+    uint8_t GetJoinServerStats(uint32_t* lpQueueSize);
     
-    long GenerateCustomServerList(uint8_t* lpMsg, int* size);
-    long GenerateServerList(uint8_t* lpMsg, int* size);
+    long GenerateCustomServerList(uint8_t* lpMsg, int* size, int maxSize);
+    long GenerateServerList(uint8_t* lpMsg, int* size, int maxSize);
     
+    int GetServerSlot(int ServerCode);
     SERVER_LIST_INFO* GetServerListInfo(int ServerCode);
+    uint8_t GetServerState(int ServerCode);
+    int GetServerCount() { return this->m_ServerCount; }
     
     void ServerProtocolCore(uint8_t head, uint8_t* lpMsg, int size);
     void GCGameServerLiveRecv(SDHP_GAME_SERVER_LIVE_RECV* lpMsg);
     void JCJoinServerLiveRecv(SDHP_JOIN_SERVER_LIVE_RECV* lpMsg);
 
 private:
+    uint32_t ProcessDeadlinesLocked(uint32_t now);
+    void UpdateDeadline(int slot, uint8_t state);
+    void SetLivenessState(int slot, uint8_t state);
+    void ScheduleLivenessTimer(uint32_t now);
+    void UpdateClusterVersion(int slot);
+
+    // Liveness scans cover the configured slots, then the JoinServer's:
+    // index 0..m_ServerCount
+    int GetLivenessSlot(int index) const { return (index == this->m_ServerCount) ? JOIN_SERVER_SLOT : index; }
+
     bool m_JoinServerState;
     uint32_t m_JoinServerStateTime;
     uint32_t m_JoinServerQueueSize;
-    std::map<int, SERVER_LIST_INFO> m_ServerListInfo;
+
+    // ServerCode -> dense slot (SERVER_SLOT_NONE if unused)
+    uint16_t m_ServerSlot[MAX_SERVER_CODE];
+    int m_ServerCount;
+
+    // Slots with ServerShow set, in ServerCode order (what list replies walk)
+    uint16_t m_VisibleSlot[MAX_SERVER_LIST];
+    int m_VisibleCount;
+
+    // Hot per-slot fields, one array each, written by every heartbeat
+    uint8_t m_ServerState[MAX_SERVER_LIST];
+    uint32_t m_ServerStateTime[MAX_SERVER_LIST];
+    uint8_t m_UserTotal[MAX_SERVER_LIST];
+    uint16_t m_UserCount[MAX_SERVER_LIST];
+    uint16_t m_AccountCount[MAX_SERVER_LIST];
+    uint16_t m_MaxUserCount[MAX_SERVER_LIST];
+    bool m_Provisional[MAX_SERVER_LIST];
+
+    // Cluster replication, guarded by m_LivenessMutex
+    uint16_t m_ClusterNode;
+    uint64_t m_ClusterVersion[MAX_SERVER_LIST];
+    uint16_t m_ClusterOrigin[MAX_SERVER_LIST];
+    bool m_ClusterChanged[MAX_SERVER_LIST];
+
+    SERVER_LIST_INFO m_ServerListInfo[MAX_SERVER_LIST];
+
+    // Liveness (GameServers plus JOIN_SERVER_SLOT), guarded by m_LivenessMutex.
+    // Deadline is the tick of the next state change, 0 if none is pending.
+    FAILURE_DETECTOR_CONFIG m_DetectorConfig;
+    CFailureDetector m_Detector[MAX_SERVER_LIST + 1];
+    uint32_t m_Deadline[MAX_SERVER_LIST + 1];
+    bool m_ShowOfflineServers;
+    CSharedServerTable* m_SharedTable;
+
+    ProfiledMutex m_LivenessMutex;
+    std::unique_ptr<boost::asio::steady_timer> m_LivenessTimer;
+    boost::asio::io_context* m_LivenessContext;   // Runs the timer's handlers
+    uint32_t m_LivenessTimerDeadline;
 };
 
 extern CServerList gServerList;
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "IpManager.h"
+#include "ServerList.h"
+#include <atomic>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Prefork mode: the supervisor's server table, mirrored into shared memory
+// (a memfd the workers inherit) so worker processes answer list and info
+// requests without a copy of their own. The supervisor is the only writer;
+// each entry is a seqlock, and so is the layout (slot maps, counts), so
+// readers never block it and retry on a torn read. Retries are bounded: a
+// supervisor that died mid-write leaves the sequence odd, and the entry then
+// reads as an unavailable server instead of hanging the worker. The same
+// segment holds the per-IP connection counts of all workers, one column per
+// worker, so a crashed worker's connections can be released.
+
+#define SHARED_SERVER_TABLE_MAGIC 0x54535343 // "CSST"
+#define SHARED_SERVER_TABLE_VERSION 2
+
+#define MAX_PREFORK_WORKERS 16
+#define SHARED_TABLE_READ_RETRIES 100
+
+struct SHARED_SERVER_ENTRY
+{
+    std::atomic<uint32_t> Sequence;     // Odd while the entry is rewritten
+    SERVER_LIST_INFO Info;
+    uint8_t ServerState;
+    uint8_t UserTotal;
+};
+
+struct SHARED_IP_ENTRY
+{
+    char IpAddress[16];
+    uint16_t Total;                     // 0 = free slot
+    uint16_t Count[MAX_PREFORK_WORKERS];
+};
+
+struct SHARED_WORKER_INFO
+{
+    std::atomic<int32_t> Pid;           // 0 while not running
+    std::atomic<uint32_t> Restarts;
+    std::atomic<int32_t> Clients;
+    std::atomic<int64_t> Accepts;       // The worker's tcp.* metrics, for
+    std::atomic<int64_t> Rejects;       // the stats segment
+    std::atomic<int64_t> Packets;
+};
+
+struct SHARED_SERVER_TABLE
+{
+    uint32_t Magic;
+    uint32_t Version;
+    std::atomic<uint32_t> LayoutSequence;   // Odd while counts and slot maps are rewritten
+    uint32_t ServerCount;
+    uint32_t VisibleCount;
+    bool ShowOfflineServers;
+
+    uint16_t ServerSlot[MAX_SERVER_CODE];
+    uint16_t VisibleSlot[MAX_SERVER_LIST];
+    SHARED_SERVER_ENTRY Entry[MAX_SERVER_LIST];
+
+    SHARED_WORKER_INFO Worker[MAX_PREFORK_WORKERS];
+
+#ifndef _WIN32
+    pthread_mutex_t IpMutex;            // Process-shared, robust
+#endif
+    SHARED_IP_ENTRY Ip[MAX_IP_ADDRESS_TABLE];
+};
+
+class CSharedServerTable
+{
+public:
+    CSharedServerTable();
+    ~CSharedServerTable();
+
+    // Supervisor: a new segment; Handle() is inherited by the workers
+    bool Create();
+    // Worker: map the segment behind an inherited handle
+    bool Attach(int handle);
+    void Close();
+    bool IsOpen() { return (this->m_Table != nullptr); }
+    int Handle() { return this->m_Handle; }
+    SHARED_SERVER_TABLE* Get() { return this->m_Table; }
+    int GetServerCount() { return (int)this->m_Table->ServerCount; }
+
+    // Writer side, called by CServerList under its liveness lock
+    void PublishLayout(const SERVER_LIST_INFO* lpInfo, int count, const uint16_t* lpVisible, int visibleCount, bool ShowOfflineServers);
+    void PublishSlot(int slot, uint8_t ServerState, uint8_t UserTotal);
+
+    // Reader side: same output as the CServerList functions of the same name
+    long GenerateCustomServerList(uint8_t* lpMsg, int* size, int maxSize);
+    long GenerateServerList(uint8_t* lpMsg, int* size, int maxSize);
+    bool GetServerInfo(int ServerCode, SERVER_LIST_INFO* lpInfo, bool* lpAvailable);
+
+    // Per-IP limits across all workers
+    bool CheckIpAddress(const char* IpAddress, int MaxIpConnection);
+    void InsertIpAddress(const char* IpAddress, int worker);
+    void RemoveIpAddress(const char* IpAddress, int worker);
+    void ReleaseWorker(int worker);     // Drops every count of a dead worker
+
+private:
+    bool Map(int handle);
+    // False if no consistent copy could be read within the retries
+    bool ReadSlot(int slot, SERVER_LIST_INFO* lpInfo, uint8_t* lpState, uint8_t* lpUserTotal);
+    bool LockIp();
+    void UnlockIp();
+    int FindIpAddress(const char* IpAddress, bool* found);
+    void EraseIpSlot(int slot);
+
+    SHARED_SERVER_TABLE* m_Table;
+    int m_Handle;
+};
+
+// Set in worker processes: list and info replies come from here
+extern CSharedServerTable* gSharedServerTable;
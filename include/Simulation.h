@@ -0,0 +1,30 @@
+#pragma once
+
+// Hooks for the deterministic simulation harness (tests/sim).
+// Only compiled in with CS_SIMULATION: the simulator then owns the clock and
+// receives everything the protocol would write to client sockets. Production
+// builds keep steady_clock and real sockets.
+
+#ifdef CS_SIMULATION
+
+#include <atomic>
+#include <cstdint>
+
+// Virtual time in ms, what GetTickCountCross() returns
+extern std::atomic<uint32_t> gSimulationTick;
+
+// Log lines cost more than the simulated work; off unless asked for
+extern bool gSimulationLog;
+
+class CSimulationTransport
+{
+public:
+    virtual ~CSimulationTransport() {}
+
+    // A protocol reply for client index (what DataSend would have written)
+    virtual void ClientSend(int index, const uint8_t* lpMsg, int size) = 0;
+};
+
+extern CSimulationTransport* gSimulationTransport;
+
+#endif // CS_SIMULATION
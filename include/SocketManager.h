@@ -4,39 +4,57 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <cstdint>
 #include "ClientSession.h"
+#include "LockProfiler.h"
 
 constexpr int MAX_CLIENT = 10000;
 
+struct TENANT;
+
 class SocketManager {
 public:
-    SocketManager(boost::asio::io_context& io);
+    // Serves tenant (Tenant.h); nullptr for tenant 0
+    SocketManager(boost::asio::io_context& io, TENANT* tenant = nullptr);
     ~SocketManager();
 
     bool start(uint16_t port);
+    bool start_native(int native_socket);   // Listening socket inherited from another process
     void stop();
+    void stop_accepting();                  // Keep sessions, leave new connections to the successor
     
     std::shared_ptr<ClientSession> get_session(int index);
     int get_active_count() const;
+    uint16_t port() const { return port_; }
+    int native_handle() { return acceptor_.native_handle(); }
     uint32_t get_queue_size() const;
+    TENANT* tenant() const { return tenant_; }
 
 private:
     void start_accept();
     void handle_accept(std::shared_ptr<ClientSession> session,
                       const boost::system::error_code& error);
     
+    void park_session(const std::shared_ptr<ClientSession>& session);
     int find_free_index();
-    bool check_ip_limit(const std::string& ip);
+    bool check_ip_limit(const char* ip);
 
     boost::asio::io_context& io_context_;
+    TENANT* tenant_;
+    int index_base_;                        // First session index of the tenant
     boost::asio::ip::tcp::acceptor acceptor_;
+    HandlerMemory accept_memory_;
     
     std::vector<std::shared_ptr<ClientSession>> sessions_;
-    mutable std::mutex sessions_mutex_;
+    mutable ProfiledMutex sessions_mutex_;
     
     bool running_;
+    std::atomic<bool> accepting_;
     uint16_t port_;
+
+    std::atomic<int64_t>* accept_count_;
+    std::atomic<int64_t>* reject_count_;
 };
 
 extern SocketManager* g_socket_manager;
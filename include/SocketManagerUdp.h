@@ -2,34 +2,50 @@
 
 #include <boost/asio.hpp>
 #include <array>
+#include <atomic>
 #include <cstdint>
 
 constexpr size_t MAX_UDP_PACKET_SIZE = 4096;
 
+struct TENANT;
+
 class SocketManagerUdp {
 public:
-    SocketManagerUdp(boost::asio::io_context& io);
+    // Heartbeats update tenant's server list (Tenant.h); nullptr for tenant 0
+    SocketManagerUdp(boost::asio::io_context& io, TENANT* tenant = nullptr);
     ~SocketManagerUdp();
 
     bool start(uint16_t port);
-    void stop();
+    bool start_native(int native_socket);   // Bound socket inherited from another process
+    void stop();    // Any thread; returns once the socket is closed on its io_context
+    uint16_t port() const { return port_; }
+    int native_handle() { return socket_.native_handle(); }
     
     void async_send(const uint8_t* data, size_t size,
                    const std::string& ip, uint16_t port);
 
 private:
     void start_receive();
+    void handle_readable(const boost::system::error_code& error);
     void handle_receive(const boost::system::error_code& error, size_t bytes);
     bool parse_udp_packets(const uint8_t* data, size_t size);
 
     boost::asio::io_context& io_context_;
+    TENANT* tenant_;
     boost::asio::ip::udp::socket socket_;
     boost::asio::ip::udp::endpoint remote_endpoint_;
 
     std::array<uint8_t, MAX_UDP_PACKET_SIZE> recv_buffer_;
     
-    bool running_;
+    std::atomic<bool> running_;
     uint16_t port_;
+
+    bool timestamped_;              // Kernel receive timestamps (ReceiveTimestamps.h)
+    uint64_t receive_queue_ns_;     // Of the datagram being handled
+
+    std::atomic<int64_t>* heartbeat_count_;
+    std::atomic<int64_t>* heartbeat_process_us_;
+    std::atomic<int64_t>* heartbeat_process_max_us_;
 };
 
 extern SocketManagerUdp* g_socket_manager_udp;
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "StatsReader.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+class CSharedServerTable;
+
+// Writer side of the stats segment (StatsReader.h). Publish() runs as a
+// control-plane task: it gathers the server tables of every tenant, the
+// metrics counters and the io thread stats into a private staging copy,
+// then copies that into the mapping inside one seqlock write. The io
+// threads only ever bump the counters they already had.
+
+class CStatsExport
+{
+public:
+    CStatsExport();
+    ~CStatsExport();
+
+    bool Open(const char* path);
+    void Close();
+    bool IsOpen() { return (this->m_Segment != nullptr); }
+
+    // Prefork mode: sessions and client counters live in the workers
+    void SetSharedTable(CSharedServerTable* lpTable) { this->m_SharedTable = lpTable; }
+
+    void Publish();
+
+private:
+    void Gather(STATS_SEGMENT* lpStaging);
+
+    STATS_SEGMENT* m_Segment;
+    std::unique_ptr<STATS_SEGMENT> m_Staging;
+    int m_Handle;
+    CSharedServerTable* m_SharedTable;
+
+    std::atomic<int64_t>* m_Accepts;
+    std::atomic<int64_t>* m_Rejects;
+    std::atomic<int64_t>* m_Packets;
+    std::atomic<int64_t>* m_Heartbeats;
+    std::atomic<int64_t>* m_IoLag;
+    std::atomic<int64_t>* m_ControlPlaneLag;
+
+    uint64_t m_LastPackets;
+    std::chrono::steady_clock::time_point m_LastPublish;
+};
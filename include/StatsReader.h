@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Stats segment: the server publishes its server table, global counters and
+// io thread stats into a memory-mapped file ([Stats] Path, e.g. under
+// /dev/shm) from a control-plane task. Monitoring agents, launcher backends
+// and scripts map it read-only and poll it as often as they like; nothing
+// they do reaches the io threads.
+//
+// This header is the whole reader library: the layout plus CStatsReader,
+// with no dependency on the rest of the server. The writer is the only one
+// to change Sequence; it is odd while a snapshot is being written, so a
+// reader copies the segment and retries if Sequence moved meanwhile.
+// Version changes whenever the layout does; HeaderSize/EntrySize let a
+// reader reject a segment from a different build. A restarted server
+// creates a new file under the same path, so a reader whose UpdateTime
+// stops moving opens the path again.
+
+#define STATS_SEGMENT_MAGIC 0x54415453 // "STAT"
+#define STATS_SEGMENT_VERSION 1
+
+#define STATS_MAX_SERVERS 1024
+#define STATS_MAX_THREADS 32
+
+#define STATS_NO_HEARTBEAT 0xFFFFFFFF
+
+// Read attempts before CStatsReader::Read gives up on a busy writer
+#define STATS_READ_RETRIES 1000
+
+enum STATS_SERVER_STATE
+{
+    STATS_SERVER_OFFLINE = 0,
+    STATS_SERVER_ONLINE = 1,
+    STATS_SERVER_SUSPECT = 2,
+};
+
+struct STATS_COUNTERS
+{
+    uint64_t Sessions;              // Open client sessions (all workers in prefork mode)
+    uint64_t Accepts;               // Since start
+    uint64_t Rejects;               // Refused by the per-IP limit
+    uint64_t Packets;               // Client packets handled
+    uint64_t PacketsPerSecond;      // Over the last publish interval
+    uint64_t Heartbeats;            // GameServer/JoinServer datagrams
+    uint64_t IoLagUs;               // io thread scheduling lag (probe)
+    uint64_t ControlPlaneLagUs;
+};
+
+struct STATS_SERVER_ENTRY
+{
+    uint16_t ServerCode;
+    uint8_t Tenant;
+    uint8_t State;                  // STATS_SERVER_STATE
+    uint8_t Visible;                // Listed to clients (ServerList "SHOW")
+    uint8_t UserTotal;              // Load in percent
+    uint16_t UserCount;
+    uint16_t MaxUserCount;
+    uint16_t Reserved;
+    uint32_t HeartbeatAgeMs;        // STATS_NO_HEARTBEAT while offline
+    char ServerName[32];
+};
+
+struct STATS_THREAD_ENTRY
+{
+    char Name[16];
+    uint32_t ThreadId;
+    uint32_t Utilization;           // % busy over the last second
+    uint64_t Handlers;
+    uint64_t MaxHandlerUs;
+    uint64_t CurrentHandlerUs;      // Age of the running handler, 0 if idle
+};
+
+struct STATS_SEGMENT
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t HeaderSize;            // offsetof(STATS_SEGMENT, Server)
+    uint32_t EntrySize;             // sizeof(STATS_SERVER_ENTRY)
+    std::atomic<uint32_t> Sequence; // Odd while a snapshot is written
+    uint32_t Pid;
+    uint64_t StartTime;             // Wall clock ms since epoch
+    uint64_t UpdateTime;
+    uint64_t UpdateCount;
+
+    STATS_COUNTERS Counters;
+
+    uint8_t JoinServerState;        // STATS_SERVER_STATE
+    uint8_t Reserved[3];
+    uint32_t JoinServerQueueSize;
+
+    uint32_t ThreadCount;
+    uint32_t ServerCount;
+    STATS_THREAD_ENTRY Thread[STATS_MAX_THREADS];
+    STATS_SERVER_ENTRY Server[STATS_MAX_SERVERS];
+};
+
+// Consistent copy of the segment; Server[] is valid up to ServerCount
+struct STATS_SNAPSHOT
+{
+    uint64_t Sequence;
+    STATS_SEGMENT Data;
+};
+
+class CStatsReader
+{
+public:
+    CStatsReader() : m_Segment(nullptr), m_Size(0) {}
+    ~CStatsReader() { this->Close(); }
+
+    CStatsReader(const CStatsReader&) = delete;
+    CStatsReader& operator=(const CStatsReader&) = delete;
+
+    bool Open(const char* path)
+    {
+#ifdef _WIN32
+        return false;
+#else
+        this->Close();
+
+        int handle = open(path, O_RDONLY);
+
+        if (handle == -1)
+        {
+            return false;
+        }
+
+        struct stat info;
+
+        if (fstat(handle, &info) != 0 || info.st_size < (off_t)sizeof(STATS_SEGMENT))
+        {
+            close(handle);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, sizeof(STATS_SEGMENT), PROT_READ, MAP_SHARED, handle, 0);
+
+        close(handle);
+
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        this->m_Segment = static_cast<const STATS_SEGMENT*>(mapping);
+        this->m_Size = sizeof(STATS_SEGMENT);
+
+        if (this->m_Segment->Magic != STATS_SEGMENT_MAGIC || this->m_Segment->Version != STATS_SEGMENT_VERSION ||
+            this->m_Segment->HeaderSize != offsetof(STATS_SEGMENT, Server) ||
+            this->m_Segment->EntrySize != sizeof(STATS_SERVER_ENTRY))
+        {
+            this->Close();
+            return false;
+        }
+
+        return true;
+#endif
+    }
+
+    void Close()
+    {
+#ifndef _WIN32
+        if (this->m_Segment != nullptr)
+        {
+            munmap((void*)this->m_Segment, this->m_Size);
+            this->m_Segment = nullptr;
+        }
+#endif
+    }
+
+    bool IsOpen() const { return (this->m_Segment != nullptr); }
+
+    // Sequence of the last complete snapshot; poll this to see whether
+    // anything was published since the last Read
+    uint32_t GetSequence() const { return this->m_Segment->Sequence.load(std::memory_order_acquire) & ~1u; }
+
+    // Copies one consistent snapshot; false if the writer kept it busy
+    bool Read(STATS_SNAPSHOT* lpSnapshot) const
+    {
+        const STATS_SEGMENT* lpSegment = this->m_Segment;
+
+        for (int attempt = 0; attempt < STATS_READ_RETRIES; attempt++)
+        {
+            uint32_t sequence = lpSegment->Sequence.load(std::memory_order_acquire);
+
+            if ((sequence & 1) != 0)
+            {
+                continue;
+            }
+
+            // Header, counters and threads, then only the servers in use
+            memcpy((void*)&lpSnapshot->Data, (const void*)lpSegment, offsetof(STATS_SEGMENT, Server));
+
+            uint32_t count = lpSnapshot->Data.ServerCount;
+
+            if (count > STATS_MAX_SERVERS)
+            {
+                continue;
+            }
+
+            memcpy(lpSnapshot->Data.Server, lpSegment->Server, count * sizeof(STATS_SERVER_ENTRY));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (lpSegment->Sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                lpSnapshot->Sequence = sequence;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    const STATS_SEGMENT* m_Segment;
+    size_t m_Size;
+};
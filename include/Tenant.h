@@ -0,0 +1,44 @@
+#pragma once
+
+#include "SocketManager.h"
+
+// Multi-tenant mode: one process serves several listener pairs (TCP + UDP),
+// one per game version or region ([Tenants] in the config). Each tenant has
+// its own server table (CServerList), IP limits (CIpManager) and session
+// table; all tenants share the io threads, the control plane, handler
+// memory pools and metrics.
+// Tenant 0 is the classic single server: gServerList, gIpManager and the
+// [ConnectServerInfo] ports. Session indexes are unique across tenants:
+// tenant t owns [t * MAX_CLIENT, (t + 1) * MAX_CLIENT), so protocol code
+// finds a session's server list and listener from its index alone.
+
+class CServerList;
+class CIpManager;
+class SocketManagerUdp;
+
+constexpr int MAX_TENANTS = 8;
+constexpr int MAX_TENANT_NAME = 32;
+
+struct TENANT
+{
+    int Id;
+    char Name[MAX_TENANT_NAME];
+    CServerList* ServerList;
+    CIpManager* IpManager;
+    SocketManager* Tcp;         // Set by the SocketManager serving the tenant
+    SocketManagerUdp* Udp;
+};
+
+extern TENANT gTenants[MAX_TENANTS];
+
+// Tenant 0 always exists; the others are created at startup, from config
+TENANT* CreateTenant(const char* name, CServerList* server_list, CIpManager* ip_manager);
+int GetTenantCount();
+
+inline TENANT* GetTenant(int id) {
+    return (id >= 0 && id < MAX_TENANTS) ? &gTenants[id] : nullptr;
+}
+
+inline TENANT* GetSessionTenant(int index) {
+    return GetTenant(index / MAX_CLIENT);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// io thread health. Every worker running the shared io_context registers a
+// slot; AllocHandler (HandlerAllocator.h) stamps each handler's start and
+// end into the calling thread's slot, which gives per-thread handler counts,
+// busy time and utilization.
+//  - Loop lag: a probe timer on the io_context measures how late a due
+//    handler starts, i.e. how long new work waits for a free worker.
+//  - Watchdog: a separate thread checks the slots every probe interval; a
+//    handler running longer than [Watchdog] LongHandlerMs gets its thread's
+//    stack captured (signal + backtrace on Linux) and logged once.
+// "threads" on the console shows the per-thread view; io.lag_*,
+// threads.long_handlers and thread.<name>.busy_pct appear under "metrics".
+
+constexpr int MAX_MONITORED_THREADS = 32;
+constexpr int WATCHDOG_STACK_DEPTH = 32;
+
+struct WATCHDOG_CONFIG
+{
+    uint32_t ProbeIntervalMs;
+    uint32_t LongHandlerMs;     // 0 = no long-handler watchdog
+};
+
+struct THREAD_SLOT
+{
+    char Name[16];
+    uint32_t ThreadId;
+    uintptr_t Handle;                       // pthread_t on Linux
+    int Depth;                              // Nested handler calls, owner only
+    std::atomic<uint64_t> BusySince;        // ns, 0 while idle
+    std::atomic<uint64_t> Handlers;
+    std::atomic<uint64_t> BusyNs;           // Finished handlers
+    std::atomic<uint64_t> MaxHandlerNs;
+    // Watchdog only
+    uint64_t ReportedSince;                 // BusySince of the handler last reported
+    uint64_t WindowBusyNs;
+    uint64_t WindowAt;
+    std::atomic<int> Utilization;           // % busy over the last second
+    std::atomic<int64_t>* BusyMetric;
+    // Written by the thread itself in the capture signal handler
+    void* Stack[WATCHDOG_STACK_DEPTH];
+    std::atomic<int> StackDepth;            // -1 until captured
+};
+
+struct THREAD_STATS
+{
+    const char* Name;
+    uint32_t ThreadId;
+    uint64_t Handlers;
+    int Utilization;
+    uint64_t MaxHandlerNs;
+    uint64_t CurrentNs;                     // Age of the running handler, 0 if idle
+};
+
+class ThreadMonitor {
+public:
+    // Called by each worker thread before io_context::run
+    static void register_thread(const char* name);
+
+    // Start the lag probe on io and the watchdog thread
+    static void start(boost::asio::io_context& io, const WATCHDOG_CONFIG& config);
+
+    // After the io threads have stopped, before io is destroyed
+    static void stop();
+
+    static int snapshot(THREAD_STATS* stats, int max);
+
+    // The "threads" view, to the log
+    static void report();
+
+    // Thread and stack of the most recent long handler, as logged
+    static std::string last_long_handler();
+
+    static inline uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static inline THREAD_SLOT* handler_begin() {
+        THREAD_SLOT* slot = t_slot_;
+
+        // Unmonitored thread, or a handler run inline from another one
+        if (slot == nullptr || slot->Depth++ != 0) {
+            return nullptr;
+        }
+
+        slot->BusySince.store(now(), std::memory_order_relaxed);
+        return slot;
+    }
+
+    static inline void handler_end(THREAD_SLOT* slot) {
+        uint64_t elapsed = now() - slot->BusySince.load(std::memory_order_relaxed);
+
+        slot->BusySince.store(0, std::memory_order_relaxed);
+        slot->BusyNs.fetch_add(elapsed, std::memory_order_relaxed);
+        slot->Handlers.fetch_add(1, std::memory_order_relaxed);
+
+        if (elapsed > slot->MaxHandlerNs.load(std::memory_order_relaxed)) {
+            slot->MaxHandlerNs.store(elapsed, std::memory_order_relaxed);
+        }
+
+        slot->Depth = 0;
+    }
+
+    // Nested handler_begin that returned nullptr on a monitored thread
+    static inline void handler_leave() {
+        if (t_slot_ != nullptr) {
+            t_slot_->Depth--;
+        }
+    }
+
+private:
+    static inline thread_local THREAD_SLOT* t_slot_ = nullptr;
+
+    friend void CaptureThreadStack(int);
+};
+
+// Scope of one completion handler (see AllocHandler)
+class HandlerScope {
+public:
+    HandlerScope() : slot_(ThreadMonitor::handler_begin()) {}
+
+    ~HandlerScope() {
+        if (slot_ != nullptr) {
+            ThreadMonitor::handler_end(slot_);
+        } else {
+            ThreadMonitor::handler_leave();
+        }
+    }
+
+    HandlerScope(const HandlerScope&) = delete;
+    HandlerScope& operator=(const HandlerScope&) = delete;
+
+private:
+    THREAD_SLOT* slot_;
+};
@@ -2,34 +2,111 @@
 
 #include <boost/asio.hpp>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Periodic and one-shot task scheduler. All tasks share one steady_timer
+// on the scheduler's io_context (the control plane); every wakeup runs all
+// tasks due within TIMER_COALESCE_MS, so many tasks cost one wakeup.
+// Periodic tasks are fixed-rate: run n is due at start + n * period, no
+// matter how late or long earlier runs were, so the period does not drift;
+// periods missed entirely (or still running) are skipped and counted, never
+// run back to back. Optional jitter delays each run by up to that much
+// without moving the schedule. A task runs inline on the scheduler thread
+// or is posted to its own executor (e.g. the io pool). "tasks" on the
+// console lists runs, skips, lateness and execution times per task.
+
+constexpr int MAX_TIMER_TASK_NAME = 32;
+constexpr int TIMER_COALESCE_MS = 2;
+
+struct TIMER_TASK_STATS
+{
+    char Name[MAX_TIMER_TASK_NAME];
+    uint32_t Id;
+    uint64_t PeriodMs;      // 0 for a one-shot task
+    uint64_t Runs;
+    uint64_t Skipped;       // Periods missed or overlapping a running run
+    uint64_t TotalNs;       // Execution time
+    uint64_t MaxNs;
+    uint64_t LastNs;
+    uint64_t MaxLateNs;     // Start time past the due time
+};
 
 class TimerManager {
 public:
+    using Clock = std::chrono::steady_clock;
+
     TimerManager(boost::asio::io_context& io);
     ~TimerManager();
 
     void start();
-    void stop();
-    
-    // Set callback for 1-second timer
-    void set_1s_callback(std::function<void()> callback);
-    
-    // Set callback for 5-second timer
-    void set_5s_callback(std::function<void()> callback);
+    void stop();    // Any thread; returns once the timer is cancelled on the scheduler thread
+
+    // Run task every period, the first time one period from now. executor
+    // nullptr runs it on the scheduler thread. Returns an id for cancel().
+    uint32_t schedule_every(const char* name, std::chrono::milliseconds period, std::function<void()> task,
+                            boost::asio::io_context* executor = nullptr,
+                            std::chrono::milliseconds jitter = std::chrono::milliseconds(0));
+
+    // Run task once after delay
+    uint32_t schedule_once(const char* name, std::chrono::milliseconds delay, std::function<void()> task,
+                           boost::asio::io_context* executor = nullptr);
+
+    // False if the task is unknown or a one-shot that already ran; a run in
+    // progress completes
+    bool cancel(uint32_t id);
+
+    // Stats of every task in schedule order
+    int snapshot(TIMER_TASK_STATS* stats, int max);
+
+    // Write the task table to the log
+    void report();
 
 private:
-    void schedule_1s_timer();
-    void schedule_5s_timer();
+    struct TASK
+    {
+        uint32_t Id;
+        char Name[MAX_TIMER_TASK_NAME];
+        std::function<void()> Function;
+        boost::asio::io_context* Executor;
+        Clock::duration Period;         // Zero for one-shot
+        Clock::duration Jitter;
+        Clock::time_point Base;         // Schedule slot of the next run
+        Clock::time_point Due;          // Base plus this run's jitter
+        std::atomic<bool> Running;
+
+        std::atomic<uint64_t> Runs;
+        std::atomic<uint64_t> Skipped;
+        std::atomic<uint64_t> TotalNs;
+        std::atomic<uint64_t> MaxNs;
+        std::atomic<uint64_t> LastNs;
+        std::atomic<uint64_t> MaxLateNs;
+    };
+
+    uint32_t add(const char* name, Clock::duration period, Clock::duration delay, Clock::duration jitter,
+                 std::function<void()> task, boost::asio::io_context* executor);
+    void arm();
+    void handle_timer(const boost::system::error_code& error);
+    void dispatch(const std::shared_ptr<TASK>& task, Clock::time_point due);
+    Clock::duration next_jitter(Clock::duration jitter);
+
+    static void execute(const std::shared_ptr<TASK>& task, Clock::time_point due);
 
     boost::asio::io_context& io_context_;
-    boost::asio::steady_timer timer_1s_;
-    boost::asio::steady_timer timer_5s_;
-    
+    boost::asio::steady_timer timer_;
     std::atomic<bool> running_;
-    
-    std::function<void()> callback_1s_;
-    std::function<void()> callback_5s_;
+
+    std::mutex tasks_mutex_;
+    std::vector<std::shared_ptr<TASK>> tasks_;
+    uint32_t next_id_;
+    uint64_t jitter_state_;
+
+    std::atomic<int64_t>* wakeups_;
+    std::atomic<int64_t>* runs_;
 };
 
 extern TimerManager* g_timer_manager;
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "RecordRing.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Traffic recorder: framed TCP packets (both directions), session opens and
+// closes and UDP datagrams go to a binary capture file that tools/cs_replay
+// plays back against a server.
+// Network threads append records to a RecordRing (one CAS to reserve, one
+// release store to publish); a writer thread drains it to the file every
+// 10 ms, or as soon as the ring is half full. When the ring is full the record
+// is dropped and counted rather than blocking the caller.
+
+#define TRAFFIC_CAPTURE_MAGIC 0x52545343 // "CSTR"
+#define TRAFFIC_CAPTURE_VERSION 1
+
+enum eTrafficKind : uint8_t
+{
+    TRAFFIC_TCP_OPEN = 0,   // Session accepted; data is the client IP
+    TRAFFIC_TCP_RECV = 1,   // One framed packet from the client
+    TRAFFIC_TCP_SEND = 2,   // One packet queued to the client
+    TRAFFIC_TCP_CLOSE = 3,
+    TRAFFIC_UDP_RECV = 4,   // One datagram; Session is the sender's IPv4 address
+};
+
+struct TRAFFIC_CAPTURE_HEADER
+{
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t RecordSize;    // sizeof(TRAFFIC_RECORD) of the writer
+    uint64_t StartTime;     // Wall clock (ms since epoch) of Timestamp 0
+};
+
+// Followed by Size bytes of payload, no padding
+struct TRAFFIC_RECORD
+{
+    uint64_t Timestamp;     // ns since the capture started
+    uint32_t Session;       // Client index for TCP
+    uint8_t Kind;
+    uint8_t Reserved;
+    uint16_t Size;
+};
+
+class TrafficRecorder {
+public:
+    TrafficRecorder();
+    ~TrafficRecorder();
+
+    // buffer_size is rounded up to a power of two; the ring is allocated on
+    // the first start and kept until destruction
+    bool start(const char* path, size_t buffer_size);
+    void stop();
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void record(uint8_t kind, uint32_t session, const uint8_t* data, size_t size) {
+        if (enabled()) {
+            append(kind, session, data, size);
+        }
+    }
+
+private:
+    void append(uint8_t kind, uint32_t session, const uint8_t* data, size_t size);
+    void run_writer();
+    size_t drain();
+
+    std::atomic<bool> enabled_;
+    RecordRing ring_;
+
+    std::atomic<int64_t> started_;  // steady_clock ns of Timestamp 0
+    FILE* file_;
+    std::thread writer_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_wakeup_;
+    bool writer_stop_;
+    std::atomic<bool> writer_kicked_;
+
+    std::atomic<int64_t>* records_;
+    std::atomic<int64_t>* bytes_;
+    std::atomic<int64_t>* dropped_;
+};
+
+extern TrafficRecorder g_traffic_recorder;
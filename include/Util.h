@@ -2,6 +2,13 @@
 
 #include <cstdint>
 #include <chrono>
+#include "Simulation.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 // Forward declarations
 enum class Color;
@@ -24,13 +31,32 @@ int GetFreeClientIndex();
 // Search for free client index
 int SearchFreeClientIndex(int* index, int MinIndex, int MaxIndex, uint32_t MinTime);
 
+// Format a host-order IPv4 address as dotted decimal without allocating
+void IpAddressToString(uint32_t address, char* buffer, int size);
+
 // Cross-platform GetTickCount replacement
+#ifdef CS_SIMULATION
+inline uint32_t GetTickCountCross() {
+    return gSimulationTick.load(std::memory_order_relaxed);
+}
+#else
 inline uint32_t GetTickCountCross() {
     auto now = std::chrono::steady_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
         now.time_since_epoch());
     return static_cast<uint32_t>(ms.count());
 }
+#endif
+
+// Cheapest monotonic tick source for short intervals: the TSC on x86 (ticks
+// are not ns; calibrate against steady_clock), steady_clock ns elsewhere
+inline uint64_t ReadTimestampCounter() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
 
 // Compatibility macro for original code
 #ifndef _WIN32
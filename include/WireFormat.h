@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Compile-time wire layouts. A packet is a struct of constexpr field
+// descriptors, each at a fixed offset with an explicit byte order, and a
+// constant Size. Encoding writes the fields straight into the output buffer
+// and decoding reads them back from the received bytes, so the bytes on the
+// wire never depend on how the compiler pads or orders a struct:
+//
+//   struct PMSG_EXAMPLE
+//   {
+//       static constexpr WireHeader Header{0xC1, 0xF4, 0x07};
+//       static constexpr WireInt<uint16_t> Value{Header.Size};
+//       static constexpr size_t Size = Value.End;
+//   };
+//   static_assert(PMSG_EXAMPLE::Size == 6, "C1:F4:07 is 6 bytes");
+
+enum WIRE_BYTE_ORDER
+{
+    WIRE_LITTLE_ENDIAN,
+    WIRE_BIG_ENDIAN,
+};
+
+template <typename T, WIRE_BYTE_ORDER Order = WIRE_LITTLE_ENDIAN>
+struct WireInt
+{
+    static_assert(std::is_unsigned<T>::value, "wire integers are unsigned");
+
+    static constexpr size_t Size = sizeof(T);
+
+    constexpr explicit WireInt(size_t offset) : Offset(offset), End(offset + Size) {}
+
+    void put(uint8_t* packet, T value) const
+    {
+        for (size_t n = 0; n < Size; n++)
+        {
+            packet[this->Offset + n] = (uint8_t)(value >> (Shift(n) * 8));
+        }
+    }
+
+    T get(const uint8_t* packet) const
+    {
+        T value = 0;
+
+        for (size_t n = 0; n < Size; n++)
+        {
+            value |= (T)((T)packet[this->Offset + n] << (Shift(n) * 8));
+        }
+
+        return value;
+    }
+
+    const size_t Offset;
+    const size_t End;
+
+private:
+    static constexpr size_t Shift(size_t n) { return (Order == WIRE_BIG_ENDIAN) ? Size - 1 - n : n; }
+};
+
+// Fixed-size text: always terminated on the wire, the rest zero-filled
+template <size_t N>
+struct WireChars
+{
+    static_assert(N > 0, "room for the terminator");
+
+    static constexpr size_t Size = N;
+
+    constexpr explicit WireChars(size_t offset) : Offset(offset), End(offset + Size) {}
+
+    void put(uint8_t* packet, const char* text) const
+    {
+        size_t length = strnlen(text, N - 1);
+
+        memcpy(packet + this->Offset, text, length);
+        memset(packet + this->Offset + length, 0, N - length);
+    }
+
+    void get(const uint8_t* packet, char (&text)[N]) const
+    {
+        memcpy(text, packet + this->Offset, N);
+        text[N - 1] = '\0';
+    }
+
+    const size_t Offset;
+    const size_t End;
+};
+
+// Bytes a peer's struct layout leaves unused; written as zero
+template <size_t N>
+struct WirePad
+{
+    static constexpr size_t Size = N;
+
+    constexpr explicit WirePad(size_t offset) : Offset(offset), End(offset + Size) {}
+
+    void put(uint8_t* packet) const { memset(packet + this->Offset, 0, N); }
+
+    const size_t Offset;
+    const size_t End;
+};
+
+// C1/C3: type, size, head[, subhead]. C2/C4: type, size (big-endian, two
+// bytes), head[, subhead]. The size is the whole packet's; a reply with a
+// variable part is encoded after Header.Size and the header written last.
+struct WireHeader
+{
+    constexpr WireHeader(uint8_t type, uint8_t head)
+        : Type(type), Head(head), Subhead(0), HasSubhead(false), Size(SizeBytes(type) + 2), MaxSize(MaxPacket(type))
+    {
+    }
+
+    constexpr WireHeader(uint8_t type, uint8_t head, uint8_t subhead)
+        : Type(type), Head(head), Subhead(subhead), HasSubhead(true), Size(SizeBytes(type) + 3), MaxSize(MaxPacket(type))
+    {
+    }
+
+    void put(uint8_t* packet, size_t size) const
+    {
+        size_t at = 0;
+
+        packet[at++] = this->Type;
+
+        if (SizeBytes(this->Type) == 2)
+        {
+            packet[at++] = (uint8_t)(size >> 8);
+        }
+
+        packet[at++] = (uint8_t)size;
+        packet[at++] = this->Head;
+
+        if (this->HasSubhead)
+        {
+            packet[at++] = this->Subhead;
+        }
+    }
+
+    // A received frame laid out like this header (C1/C3 or C2/C4) with at
+    // least size bytes, so a schema's fields can be read from it
+    bool fits(const uint8_t* packet, size_t received, size_t size) const
+    {
+        return received >= size && SizeBytes(packet[0]) == SizeBytes(this->Type);
+    }
+
+    static constexpr size_t SizeBytes(uint8_t type) { return (type == 0xC2 || type == 0xC4) ? 2 : 1; }
+    static constexpr size_t MaxPacket(uint8_t type) { return (SizeBytes(type) == 2) ? 0xFFFF : 0xFF; }
+
+    const uint8_t Type;
+    const uint8_t Head;
+    const uint8_t Subhead;
+    const bool HasSubhead;
+    const size_t Size;
+    const size_t MaxSize;
+};
+
+// Offset of the head / subhead byte in a received frame of either kind
+inline size_t WireHeadOffset(const uint8_t* packet)
+{
+    return 1 + WireHeader::SizeBytes(packet[0]);
+}
+
+inline size_t WireSubheadOffset(const uint8_t* packet)
+{
+    return 2 + WireHeader::SizeBytes(packet[0]);
+}
+
+// Size of a list reply: a fixed part, then count entries
+template <typename Packet, typename Entry>
+constexpr size_t WireListSize(size_t count)
+{
+    return Packet::Size + count * Entry::Size;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "ServerList.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Zero-downtime restart.
+// The running process serves handoff requests on a Unix socket. A new process
+// connects, receives duplicates of the TCP and UDP listening sockets and, if
+// one is open, the HTTP status listener (SCM_RIGHTS) plus the live server
+// table, starts on them and acks. Only then
+// does the old process stop accepting and drain, so connect attempts and
+// heartbeats queue in the shared kernel sockets instead of being refused.
+// The old process confirms that it let go; a successor that acked after the
+// old one gave up waiting gets no confirmation and must not serve.
+// Sockets can also come from systemd socket activation (LISTEN_FDS).
+
+constexpr uint32_t HANDOFF_MAGIC = 0x48535343;  // "CSSH"
+constexpr uint32_t HANDOFF_VERSION = 2;
+constexpr int HANDOFF_TIMEOUT_MS = 5000;
+
+// Wire format on the handoff socket (same host, same build family):
+// new -> old  HANDOFF_REQUEST
+// old -> new  HANDOFF_HEADER + SCM_RIGHTS {tcp, udp[, http]}, then SnapshotCount entries
+// new -> old  one byte, 1 = started on the sockets, anything else = abort
+// old -> new  one byte, 1 = released the sockets (after a started ack only)
+
+struct HANDOFF_REQUEST {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Pid;
+};
+
+struct HANDOFF_HEADER {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t SnapshotCount;
+    uint32_t SnapshotSize;  // sizeof(SERVER_LIVE_SNAPSHOT); a mismatching build is refused
+};
+
+struct HANDOFF_SOCKETS {
+    int TcpSocket;
+    int UdpSocket;
+    int HttpSocket;     // -1 if the predecessor served no HTTP status endpoint
+};
+
+class ListenerHandoff {
+public:
+    ListenerHandoff(boost::asio::io_context& io, CServerList& server_list);
+    ~ListenerHandoff();
+
+    // Sockets passed by systemd socket activation, if any
+    static bool receive_from_systemd(HANDOFF_SOCKETS* sockets);
+
+    // New process: take the sockets and server table over from whoever serves
+    // path. Returns false if nobody does. Call complete() once started.
+    bool request(const char* path, HANDOFF_SOCKETS* sockets);
+    // False if started but the predecessor did not release the sockets (it
+    // gave up waiting and still serves on them): exit instead of serving
+    bool complete(bool started);
+
+    // Running process: hand our sockets to the next one. Requests are served
+    // asynchronously on the io_context, where on_handed_off runs once the
+    // successor acked; stop using the sockets there. http_socket may be -1.
+    bool listen(const char* path, int tcp_socket, int udp_socket, int http_socket,
+                std::function<void()> on_handed_off);
+    void stop();    // Any thread; returns once the listener is closed on the io_context
+
+private:
+    void start_accept();
+    void handle_request(const boost::system::error_code& error);
+    void handle_ack(const boost::system::error_code& error);
+    void arm_timeout();
+    void finish_connection();
+    void close();
+
+    boost::asio::io_context& io_context_;
+    CServerList& server_list_;
+
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    boost::asio::local::stream_protocol::socket peer_;
+    boost::asio::steady_timer timeout_;     // Of the current step with peer_
+    std::atomic<bool> listening_;
+    std::string path_;
+    int tcp_socket_;
+    int udp_socket_;
+    int http_socket_;
+    std::function<void()> on_handed_off_;
+
+    HANDOFF_REQUEST request_;
+    std::vector<SERVER_LIVE_SNAPSHOT> snapshot_;
+    uint8_t ack_;
+
+    int request_connection_;
+};
+
+#endif // __linux__
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "SharedServerTable.h"
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+
+// Prefork mode ([Prefork] Workers=N).
+// The supervisor (the process started by the admin) opens the TCP listening
+// socket but never accepts on it; it forks and execs N copies of itself as
+// workers that inherit the socket and the shared server table. The
+// supervisor keeps the UDP heartbeat socket, the liveness timers, the
+// console and everything else, and mirrors its server table into shared
+// memory; workers accept clients and answer straight from that table.
+// A worker that dies is restarted (after a second if it crashed right after
+// starting), its per-IP counts are released and the other workers' sessions
+// are untouched.
+
+constexpr const char* PREFORK_WORKER_ARG = "--prefork-worker";
+constexpr int PREFORK_STOP_TIMEOUT_MS = 5000;
+constexpr int PREFORK_RESTART_DELAY_MS = 1000;
+
+struct PREFORK_WORKER_ARGS {
+    int Worker;
+    int TcpSocket;
+    int SharedTable;
+};
+
+class PreforkSupervisor {
+public:
+    PreforkSupervisor(CSharedServerTable& table);
+    ~PreforkSupervisor();
+
+    // Listening socket for the workers, -1 on failure
+    static int open_listener(uint16_t port);
+
+    // Worker side: true (and args) if argv starts a worker process
+    static bool parse_worker_args(int argc, char* argv[], PREFORK_WORKER_ARGS* args);
+
+    // Worker process body: accept on the inherited socket with threads io
+    // threads until g_running clears or the supervisor goes away
+    static int run_worker(const PREFORK_WORKER_ARGS& args, int threads);
+
+    bool start(int tcp_socket, int workers);
+    void stop();
+
+    // Collect exited workers and restart them; call periodically
+    void reap();
+
+    int worker_count() const { return count_; }
+    pid_t worker_pid(int worker) const;
+    void report();
+
+private:
+    struct WORKER {
+        pid_t Pid;
+        std::chrono::steady_clock::time_point Started;
+        std::chrono::steady_clock::time_point RestartAt;
+    };
+
+    bool spawn(int worker);
+    void exited(int worker, int status);
+
+    CSharedServerTable& table_;
+    WORKER workers_[MAX_PREFORK_WORKERS];
+    int count_;
+    int tcp_socket_;
+    bool stopping_;
+};
+
+#endif // __linux__
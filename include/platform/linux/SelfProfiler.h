@@ -0,0 +1,93 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// In-process CPU profiler for hosts where perf cannot be attached.
+// Opens a CPU-clock perf event on every thread of the process, lets the
+// kernel walk the user stack by frame pointers (ENABLE_FRAME_POINTERS), and
+// aggregates the samples in memory. When the run ends the stacks are
+// symbolized with dladdr and written as folded stacks
+// ("thread;main;...;leaf count") for flamegraph.pl / speedscope.
+//
+// Overhead is bounded by construction: at most PROFILER_MAX_FREQUENCY samples
+// per second per thread, PROFILER_MAX_STACKS distinct stacks (the rest are
+// counted as [truncated]) and one collector thread that wakes on sample
+// batches; its CPU time is measured and reported with the result.
+
+constexpr int PROFILER_DEFAULT_FREQUENCY = 99;
+constexpr int PROFILER_MAX_FREQUENCY = 999;
+constexpr int PROFILER_MAX_SECONDS = 300;
+constexpr int PROFILER_MAX_STACKS = 50000;
+constexpr int PROFILER_MAX_DEPTH = 127;
+
+struct PROFILE_RESULT
+{
+    bool Completed;
+    int Threads;                // Threads sampled
+    uint64_t Samples;
+    uint64_t Lost;              // Dropped by the kernel (ring full)
+    uint64_t Truncated;         // Samples past PROFILER_MAX_STACKS
+    int Stacks;                 // Distinct stacks written
+    double Seconds;
+    double CollectorCpuMs;      // CPU time of the collector thread
+    std::string Path;
+    std::string Error;
+};
+
+// One sampled thread: its perf event and the event's mmap'd sample ring
+struct PROFILE_EVENT
+{
+    int Fd;
+    uint8_t* Ring;              // Metadata page followed by the data pages
+    size_t RingSize;
+    uint32_t ThreadId;
+    char Name[16];
+};
+
+class SelfProfiler {
+public:
+    SelfProfiler();
+    ~SelfProfiler();
+
+    // Sample for seconds at frequency Hz, then write folded stacks to path.
+    // Runs on its own thread; false if a run is active or the kernel refuses
+    // perf events (error says why; see kernel.perf_event_paranoid).
+    bool start(int seconds, const char* path, int frequency, std::string* error);
+
+    // End the current run early (it still writes its output)
+    void stop();
+
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    // Wait for the current run to finish and return its result
+    PROFILE_RESULT wait();
+
+    // Outcome of the last finished run
+    PROFILE_RESULT last_result();
+
+private:
+    void run(int seconds, std::string path, int frequency);
+    void close_events();
+
+    std::vector<PROFILE_EVENT> events_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+    std::mutex result_mutex_;
+    PROFILE_RESULT result_;
+
+    std::atomic<int64_t>* samples_;
+    std::atomic<int64_t>* lost_;
+    std::atomic<int64_t>* runs_;
+};
+
+extern SelfProfiler g_self_profiler;
+
+#endif // __linux__
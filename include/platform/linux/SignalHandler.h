@@ -10,6 +10,7 @@ public:
 private:
     static void signal_handler(int sig);
     static void write_backtrace();
+    static void write_flight_dump(int sig);
 };
 
 #endif // __linux__
@@ -0,0 +1,13 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <string>
+
+// Name of the function containing address: the demangled symbol when the
+// binary exports it (ENABLE_EXPORTS), else module+offset for addr2line.
+// Not async-signal-safe (dladdr takes the loader lock).
+std::string SymbolizeAddress(uint64_t address);
+
+#endif // __linux__
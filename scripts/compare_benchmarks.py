@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Compare two Google Benchmark JSON reports (make run_benchmarks writes one)
+Prints the real-time change per benchmark; exits 1 if any benchmark got
+slower than the threshold (default 10%)
+
+    scripts/compare_benchmarks.py baseline.json benchmarks.json [--threshold 5]
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+
+    results = {}
+    for bench in report.get("benchmarks", []):
+        # Skip mean/median/stddev rows of --benchmark_repetitions runs
+        if bench.get("run_type") == "aggregate":
+            continue
+        results[bench["name"]] = (bench["real_time"], bench.get("time_unit", "ns"))
+    return results
+
+
+def main(argv):
+    args = [a for a in argv[1:]]
+    threshold = 10.0
+
+    if "--threshold" in args:
+        i = args.index("--threshold")
+        threshold = float(args[i + 1])
+        del args[i:i + 2]
+
+    if len(args) != 2:
+        print(__doc__.strip())
+        return 2
+
+    old = load(args[0])
+    new = load(args[1])
+    regressions = 0
+
+    print(f"{'Benchmark':<44} {'Old':>12} {'New':>12} {'Change':>9}")
+
+    for name, (new_time, unit) in new.items():
+        if name not in old:
+            print(f"{name:<44} {'-':>12} {new_time:>10.1f}{unit} {'new':>9}")
+            continue
+
+        old_time = old[name][0]
+        change = (new_time - old_time) / old_time * 100.0 if old_time else 0.0
+        mark = ""
+
+        if change > threshold:
+            mark = "  SLOWER"
+            regressions += 1
+        elif change < -threshold:
+            mark = "  faster"
+
+        print(f"{name:<44} {old_time:>10.1f}{unit} {new_time:>10.1f}{unit} {change:>+8.1f}%{mark}")
+
+    for name in old:
+        if name not in new:
+            print(f"{name:<44} {'(removed)':>12}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower by more than {threshold:.0f}%")
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,210 @@
+#include "AllocAudit.h"
+#include "Util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+#ifndef CS_ALLOC_AUDIT
+#error "AllocAudit.cpp must be built with CS_ALLOC_AUDIT (cmake -DENABLE_ALLOC_AUDIT=ON)"
+#endif
+
+// Everything reachable from operator new below must not allocate itself:
+// counter blocks live in a static table and the thread slot is a trivial TLS pointer.
+static ALLOC_AUDIT_THREAD g_alloc_threads[MAX_ALLOC_AUDIT_THREADS];
+static std::atomic<int> g_alloc_thread_count{0};
+static std::atomic<uint32_t> g_alloc_sample_rate{0};
+static thread_local ALLOC_AUDIT_THREAD* t_alloc_thread = nullptr;
+static thread_local uint32_t t_alloc_sample_tick = 0;
+
+ALLOC_AUDIT_THREAD* AllocAudit::current_thread() {
+    if (t_alloc_thread == nullptr) {
+        int slot = g_alloc_thread_count.fetch_add(1, std::memory_order_relaxed);
+
+        // Threads beyond the table share the last slot
+        if (slot >= MAX_ALLOC_AUDIT_THREADS) {
+            slot = MAX_ALLOC_AUDIT_THREADS - 1;
+        }
+
+        t_alloc_thread = &g_alloc_threads[slot];
+    }
+
+    return t_alloc_thread;
+}
+
+void AllocAudit::set_thread_name(const char* name) {
+    ALLOC_AUDIT_THREAD* thread = current_thread();
+
+    strncpy(thread->name, name, sizeof(thread->name) - 1);
+    thread->name[sizeof(thread->name) - 1] = '\0';
+}
+
+void AllocAudit::set_sample_rate(uint32_t every_n) {
+    g_alloc_sample_rate.store(every_n, std::memory_order_relaxed);
+}
+
+uint64_t AllocAudit::total_allocations() {
+    int count = std::min(g_alloc_thread_count.load(std::memory_order_relaxed), MAX_ALLOC_AUDIT_THREADS);
+    uint64_t total = 0;
+
+    for (int i = 0; i < count; i++) {
+        total += g_alloc_threads[i].allocations.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void AllocAudit::reset() {
+    int count = std::min(g_alloc_thread_count.load(std::memory_order_relaxed), MAX_ALLOC_AUDIT_THREADS);
+
+    for (int i = 0; i < count; i++) {
+        g_alloc_threads[i].allocations.store(0, std::memory_order_relaxed);
+        g_alloc_threads[i].deallocations.store(0, std::memory_order_relaxed);
+        g_alloc_threads[i].bytes.store(0, std::memory_order_relaxed);
+        g_alloc_threads[i].sample_count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void AllocAudit::report() {
+    int count = std::min(g_alloc_thread_count.load(std::memory_order_relaxed), MAX_ALLOC_AUDIT_THREADS);
+
+    LogAdd(3, "[AllocAudit] %d thread(s), sample rate 1/%u", count,
+           g_alloc_sample_rate.load(std::memory_order_relaxed));
+
+    // Aggregate samples by call site (small fixed table, report path only)
+    constexpr int MAX_SITES = 16;
+    ALLOC_AUDIT_SAMPLE sites[MAX_SITES] = {};
+    uint32_t hits[MAX_SITES] = {};
+    int site_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        ALLOC_AUDIT_THREAD& thread = g_alloc_threads[i];
+
+        LogAdd(0, "[AllocAudit] Thread %d (%s): new=%llu delete=%llu bytes=%llu", i,
+               (thread.name[0] != '\0') ? thread.name : "-",
+               (unsigned long long)thread.allocations.load(std::memory_order_relaxed),
+               (unsigned long long)thread.deallocations.load(std::memory_order_relaxed),
+               (unsigned long long)thread.bytes.load(std::memory_order_relaxed));
+
+        uint32_t samples = std::min<uint32_t>(thread.sample_count.load(std::memory_order_relaxed),
+                                              MAX_ALLOC_AUDIT_SAMPLES);
+
+        for (uint32_t s = 0; s < samples; s++) {
+            int n = 0;
+
+            while (n < site_count && sites[n].site != thread.samples[s].site) {
+                n++;
+            }
+
+            if (n == site_count) {
+                if (site_count == MAX_SITES) {
+                    continue;
+                }
+                sites[site_count++] = thread.samples[s];
+            }
+
+            hits[n]++;
+        }
+    }
+
+    for (int n = 0; n < site_count; n++) {
+        // Module offset is what addr2line -f -C -e <binary> expects
+        const char* symbol = "?";
+        uintptr_t offset = (uintptr_t)sites[n].site;
+#ifdef __linux__
+        Dl_info info;
+        if (dladdr(sites[n].site, &info) != 0) {
+            offset -= (uintptr_t)info.dli_fbase;
+            if (info.dli_sname != nullptr) {
+                symbol = info.dli_sname;
+            }
+        }
+#endif
+        LogAdd(0, "[AllocAudit] Site +0x%zx (%s): %u sample(s), last size %zu",
+               (size_t)offset, symbol, hits[n], sites[n].size);
+    }
+}
+
+//**********************************************//
+//********* Global operator new/delete *********//
+//**********************************************//
+
+static inline void AllocAuditRecord(size_t size, void* site) {
+    ALLOC_AUDIT_THREAD* thread = AllocAudit::current_thread();
+
+    thread->allocations.fetch_add(1, std::memory_order_relaxed);
+    thread->bytes.fetch_add(size, std::memory_order_relaxed);
+
+    uint32_t rate = g_alloc_sample_rate.load(std::memory_order_relaxed);
+
+    if (rate != 0 && (++t_alloc_sample_tick % rate) == 0) {
+        uint32_t n = thread->sample_count.fetch_add(1, std::memory_order_relaxed);
+        ALLOC_AUDIT_SAMPLE& sample = thread->samples[n % MAX_ALLOC_AUDIT_SAMPLES];
+        sample.site = site;
+        sample.size = size;
+    }
+}
+
+static inline void AllocAuditRelease(void* ptr) {
+    if (ptr != nullptr) {
+        AllocAudit::current_thread()->deallocations.fetch_add(1, std::memory_order_relaxed);
+        free(ptr);
+    }
+}
+
+static inline void* AllocAuditAllocate(size_t size, void* site) {
+    AllocAuditRecord(size, site);
+    return malloc((size == 0) ? 1 : size);
+}
+
+void* operator new(size_t size) {
+    void* ptr = AllocAuditAllocate(size, __builtin_return_address(0));
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    void* ptr = AllocAuditAllocate(size, __builtin_return_address(0));
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return AllocAuditAllocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return AllocAuditAllocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void* ptr) noexcept {
+    AllocAuditRelease(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    AllocAuditRelease(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    AllocAuditRelease(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    AllocAuditRelease(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    AllocAuditRelease(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    AllocAuditRelease(ptr);
+}
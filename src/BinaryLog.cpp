@@ -0,0 +1,453 @@
+#include "BinaryLog.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+BinaryLog g_binary_log;
+
+static constexpr size_t RECORD_ALIGN = 8;
+static constexpr size_t MIN_SEGMENT_SIZE = 1024 * 1024;
+static constexpr size_t MAX_SITE_FORMAT = 4096;
+
+static size_t Padded(size_t size) {
+    return (size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+static uint64_t WallClockNanoseconds() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t CurrentThreadId() {
+    static thread_local uint32_t thread_id = 0;
+
+    if (thread_id == 0) {
+#ifdef _WIN32
+        thread_id = (uint32_t)GetCurrentThreadId();
+#else
+        thread_id = (uint32_t)syscall(SYS_gettid);
+#endif
+    }
+
+    return thread_id;
+}
+
+BinaryLog::BinaryLog()
+    : enabled_(false)
+    , sites_()
+    , fd_(-1)
+    , map_(nullptr)
+    , offset_(0)
+    , sequence_(0)
+    , segment_created_(0)
+    , writer_stop_(false)
+    , writer_kicked_(false)
+    , records_(Metrics::get("binlog.records"))
+    , bytes_(Metrics::get("binlog.bytes"))
+    , dropped_(Metrics::get("binlog.dropped"))
+    , segments_(Metrics::get("binlog.segments"))
+{
+}
+
+BinaryLog::~BinaryLog() {
+    stop();
+}
+
+bool BinaryLog::start(const BINARY_LOG_CONFIG& config) {
+#ifdef _WIN32
+    (void)config;
+    LogAdd(1, "[BinaryLog] File logging is not supported on this platform");
+    return false;
+#else
+    if (writer_.joinable()) {
+        LogAdd(1, "[BinaryLog] Already running");
+        return false;
+    }
+
+    config_ = config;
+    config_.SegmentSize = std::max(config_.SegmentSize, MIN_SEGMENT_SIZE);
+
+    if (config_.Directory.empty()) {
+        config_.Directory = ".";
+    }
+
+    if (mkdir(config_.Directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        LogAdd(1, "[BinaryLog] Could not create %s: %s", config_.Directory.c_str(), strerror(errno));
+        return false;
+    }
+
+    ring_.allocate(config_.BufferSize);
+
+    writer_stop_ = false;
+    writer_ = std::thread([this]() { run_writer(); });
+
+    enabled_.store(true, std::memory_order_release);
+
+    LogAdd(2, "[BinaryLog] Logging to %s (%zu MB segments, %u s rotation, %u file(s) kept)",
+           config_.Directory.c_str(), config_.SegmentSize >> 20, config_.RotateSeconds, config_.MaxFiles);
+
+    return true;
+#endif
+}
+
+void BinaryLog::stop() {
+    if (!writer_.joinable()) {
+        return;
+    }
+
+    enabled_.store(false, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_stop_ = true;
+    }
+
+    writer_wakeup_.notify_one();
+    writer_.join();
+}
+
+uint32_t BinaryLog::intern(const char* format) {
+    // Formats are string literals, so the pointer identifies the call site
+    size_t hash = (size_t)(((uintptr_t)format >> 3) * 0x9E3779B97F4A7C15ull);
+
+    for (int probe = 0; probe < MAX_BINLOG_SITES; probe++) {
+        size_t slot = (hash + probe) & (MAX_BINLOG_SITES - 1);
+        const char* current = sites_[slot].load(std::memory_order_acquire);
+
+        if (current == nullptr &&
+            sites_[slot].compare_exchange_strong(current, format, std::memory_order_acq_rel)) {
+            return (uint32_t)slot + 1;
+        }
+
+        if (current == format) {
+            return (uint32_t)slot + 1;
+        }
+    }
+
+    return 0;
+}
+
+void BinaryLog::append(int color, const char* format, va_list args) {
+    uint32_t site = intern(format);
+
+    if (site == 0) {
+        dropped_->fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Raw arguments only; cs_logcat does the formatting
+    uint8_t payload[MAX_BINLOG_ARGUMENTS];
+    size_t size = 0;
+    const char* cursor = format;
+    BINLOG_SPEC spec;
+
+    while (NextLogSpec(cursor, &spec)) {
+        if (size + (size_t)(spec.Stars + 1) * sizeof(uint64_t) > sizeof(payload)) {
+            break;
+        }
+
+        for (int n = 0; n < spec.Stars; n++) {
+            int64_t value = va_arg(args, int);
+            memcpy(payload + size, &value, sizeof(value));
+            size += sizeof(value);
+        }
+
+        uint64_t value = 0;
+
+        switch (spec.Argument) {
+            case BINLOG_ARG_SIGNED:
+                switch (spec.Length) {
+                    case BINLOG_LEN_HH: value = (uint64_t)(int64_t)(signed char)va_arg(args, int); break;
+                    case BINLOG_LEN_H: value = (uint64_t)(int64_t)(short)va_arg(args, int); break;
+                    case BINLOG_LEN_L: value = (uint64_t)(int64_t)va_arg(args, long); break;
+                    case BINLOG_LEN_LL: value = (uint64_t)(int64_t)va_arg(args, long long); break;
+                    case BINLOG_LEN_Z: value = (uint64_t)(int64_t)va_arg(args, ptrdiff_t); break;
+                    case BINLOG_LEN_J: value = (uint64_t)(int64_t)va_arg(args, intmax_t); break;
+                    case BINLOG_LEN_T: value = (uint64_t)(int64_t)va_arg(args, ptrdiff_t); break;
+                    default: value = (uint64_t)(int64_t)va_arg(args, int); break;
+                }
+                break;
+
+            case BINLOG_ARG_UNSIGNED:
+                switch (spec.Length) {
+                    case BINLOG_LEN_HH: value = (uint64_t)(unsigned char)va_arg(args, unsigned int); break;
+                    case BINLOG_LEN_H: value = (uint64_t)(unsigned short)va_arg(args, unsigned int); break;
+                    case BINLOG_LEN_L: value = (uint64_t)va_arg(args, unsigned long); break;
+                    case BINLOG_LEN_LL: value = (uint64_t)va_arg(args, unsigned long long); break;
+                    case BINLOG_LEN_Z: value = (uint64_t)va_arg(args, size_t); break;
+                    case BINLOG_LEN_J: value = (uint64_t)va_arg(args, uintmax_t); break;
+                    case BINLOG_LEN_T: value = (uint64_t)va_arg(args, ptrdiff_t); break;
+                    default: value = (uint64_t)va_arg(args, unsigned int); break;
+                }
+                break;
+
+            case BINLOG_ARG_DOUBLE: {
+                double number = (spec.Length == BINLOG_LEN_LONG_DOUBLE) ? (double)va_arg(args, long double)
+                                                                        : va_arg(args, double);
+                memcpy(&value, &number, sizeof(value));
+                break;
+            }
+
+            case BINLOG_ARG_POINTER:
+                value = (uint64_t)(uintptr_t)va_arg(args, void*);
+                break;
+
+            case BINLOG_ARG_STRING: {
+                const char* text = va_arg(args, const char*);
+
+                if (text == nullptr) {
+                    text = "(null)";
+                }
+
+                size_t length = strnlen(text, std::min(MAX_BINLOG_STRING, sizeof(payload) - size - 1));
+                payload[size++] = (uint8_t)length;
+                memcpy(payload + size, text, length);
+                size += length;
+                continue;
+            }
+        }
+
+        memcpy(payload + size, &value, sizeof(value));
+        size += sizeof(value);
+    }
+
+    uint8_t* slot = ring_.reserve(sizeof(BINLOG_RECORD) + size);
+
+    if (slot == nullptr) {
+        dropped_->fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    BINLOG_RECORD record;
+    record.Length = (uint16_t)(sizeof(record) + size);
+    record.Type = BINLOG_ENTRY;
+    record.Level = LogLevelOf(color);
+    record.Site = site;
+    record.Session = t_session_;
+    record.Thread = CurrentThreadId();
+    record.Time = WallClockNanoseconds();
+
+    memcpy(slot, &record, sizeof(record));
+    memcpy(slot + sizeof(record), payload, size);
+
+    ring_.publish(slot, sizeof(record) + size);
+
+    // Half full: wake the writer early, once, instead of waiting for its poll
+    if (ring_.used() > ring_.capacity() / 2 && !writer_kicked_.exchange(true, std::memory_order_relaxed)) {
+        writer_wakeup_.notify_one();
+    }
+}
+
+void BinaryLog::run_writer() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+
+    // Callers only signal when the ring runs half full; otherwise poll
+    while (!writer_stop_) {
+        writer_wakeup_.wait_for(lock, std::chrono::milliseconds(10));
+
+        lock.unlock();
+        writer_kicked_.store(false, std::memory_order_relaxed);
+
+        drain();
+
+        // Age rotation: the next record opens a fresh segment
+        if (map_ != nullptr && config_.RotateSeconds != 0 &&
+            WallClockNanoseconds() - segment_created_ >= (uint64_t)config_.RotateSeconds * 1000000000ull) {
+            close_segment();
+        }
+
+        lock.lock();
+    }
+
+    lock.unlock();
+
+    drain();
+    close_segment();
+}
+
+void BinaryLog::drain() {
+    ring_.drain([this](const uint8_t* record, size_t size) { write_record(record, size); });
+}
+
+void BinaryLog::write_record(const uint8_t* record, size_t size) {
+    BINLOG_RECORD entry;
+    memcpy(&entry, record, sizeof(entry));
+
+    const char* format = sites_[entry.Site - 1].load(std::memory_order_acquire);
+    size_t format_size = std::min(strlen(format), MAX_SITE_FORMAT) + 1;
+
+    // A segment must carry every format it uses, so a full one rotates
+    // before the site definition and the entry are split across two files
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t need = Padded(size);
+
+        if (map_ != nullptr && !defined_[entry.Site]) {
+            need += Padded(sizeof(BINLOG_RECORD) + format_size);
+        }
+
+        if (map_ != nullptr && offset_ + need <= config_.SegmentSize) {
+            break;
+        }
+
+        close_segment();
+
+        if (!open_segment()) {
+            dropped_->fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    if (!defined_[entry.Site]) {
+        BINLOG_RECORD definition;
+        memset(&definition, 0, sizeof(definition));
+        definition.Length = (uint16_t)(sizeof(definition) + format_size);
+        definition.Type = BINLOG_SITE;
+        definition.Site = entry.Site;
+        definition.Session = BINLOG_NO_SESSION;
+        definition.Time = entry.Time;
+
+        memcpy(map_ + offset_, &definition, sizeof(definition));
+        memcpy(map_ + offset_ + sizeof(definition), format, format_size - 1);
+        map_[offset_ + sizeof(definition) + format_size - 1] = '\0';
+        offset_ += Padded(definition.Length);
+
+        defined_[entry.Site] = 1;
+    }
+
+    memcpy(map_ + offset_, record, size);
+    offset_ += Padded(size);
+
+    records_->fetch_add(1, std::memory_order_relaxed);
+    bytes_->fetch_add((int64_t)size, std::memory_order_relaxed);
+}
+
+bool BinaryLog::open_segment() {
+#ifdef _WIN32
+    return false;
+#else
+    uint64_t now = WallClockNanoseconds();
+    time_t seconds = (time_t)(now / 1000000000ull);
+    struct tm tm_info;
+    localtime_r(&seconds, &tm_info);
+
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_info);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/cslog_%s_%06u.bin", stamp, sequence_);
+    segment_path_ = config_.Directory + name;
+
+    int fd = open(segment_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    // Allocate the blocks now: filling the mapping must not hit ENOSPC as
+    // SIGBUS later
+    if (posix_fallocate(fd, 0, (off_t)config_.SegmentSize) != 0 && ftruncate(fd, (off_t)config_.SegmentSize) != 0) {
+        close(fd);
+        unlink(segment_path_.c_str());
+        return false;
+    }
+
+    void* map = mmap(nullptr, config_.SegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        close(fd);
+        unlink(segment_path_.c_str());
+        return false;
+    }
+
+    fd_ = fd;
+    map_ = static_cast<uint8_t*>(map);
+    segment_created_ = now;
+
+    BINLOG_SEGMENT_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = BINARY_LOG_MAGIC;
+    header.Version = BINARY_LOG_VERSION;
+    header.RecordSize = sizeof(BINLOG_RECORD);
+    header.Pid = (uint32_t)getpid();
+    header.Sequence = sequence_++;
+    header.Created = now;
+    header.Capacity = config_.SegmentSize;
+
+    memcpy(map_, &header, sizeof(header));
+    offset_ = Padded(sizeof(header));
+
+    defined_.assign(MAX_BINLOG_SITES + 1, 0);
+    segments_->fetch_add(1, std::memory_order_relaxed);
+
+    remove_old_segments();
+    return true;
+#endif
+}
+
+void BinaryLog::close_segment() {
+#ifndef _WIN32
+    if (map_ == nullptr) {
+        return;
+    }
+
+    munmap(map_, config_.SegmentSize);
+    map_ = nullptr;
+
+    // Give back the unused preallocated tail
+    if (ftruncate(fd_, (off_t)offset_) != 0) {
+        LogAdd(1, "[BinaryLog] Could not trim %s", segment_path_.c_str());
+    }
+
+    close(fd_);
+    fd_ = -1;
+#endif
+}
+
+void BinaryLog::remove_old_segments() {
+#ifndef _WIN32
+    if (config_.MaxFiles == 0) {
+        return;
+    }
+
+    DIR* dir = opendir(config_.Directory.c_str());
+
+    if (dir == nullptr) {
+        return;
+    }
+
+    // Names sort by creation time
+    std::vector<std::string> segments;
+
+    while (struct dirent* entry = readdir(dir)) {
+        size_t length = strlen(entry->d_name);
+
+        if (strncmp(entry->d_name, "cslog_", 6) == 0 && length > 4 && strcmp(entry->d_name + length - 4, ".bin") == 0) {
+            segments.push_back(config_.Directory + "/" + entry->d_name);
+        }
+    }
+
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+
+    for (size_t n = 0; n + config_.MaxFiles < segments.size(); n++) {
+        if (segments[n] != segment_path_) {
+            unlink(segments[n].c_str());
+        }
+    }
+#endif
+}
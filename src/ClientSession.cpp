@@ -2,40 +2,120 @@
 #include "ProtocolDefines.h"
 #include "ConnectServerProtocol.h"
 #include "Console.h"
+#include "FlightRecorder.h"
 #include "IpManager.h"
+#include "Metrics.h"
+#include "TrafficRecorder.h"
+#include "Probes.h"
+#include "RateLimitedLog.h"
+#include "BinaryLog.h"
+#include "ReceiveTimestamps.h"
+#include "Tenant.h"
 #include "Util.h"
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 // Forward declaration
 void CCServerInitSend(int index, int result);
 
+// Client packets framed, by all sessions (tcp.packets)
+static std::atomic<int64_t>* PacketCount() {
+    static std::atomic<int64_t>* counter = Metrics::get("tcp.packets");
+    return counter;
+}
+
 ClientSession::ClientSession(boost::asio::io_context& io, int index)
     : socket_(io)
-    , strand_(boost::asio::make_strand(io))
+    , strand_(boost::asio::require(io.get_executor(),
+          boost::asio::execution::allocator(HandlerAllocator<void>(handler_memory_))))
     , recv_buffer_size_(0)
+    , timestamped_(false)
+    , read_queue_ns_(0)
+    , send_sizes_{0, 0}
+    , send_pending_(0)
+    , send_mutex_("ClientSession::send")
     , write_in_progress_(false)
+    , trace_open_(false)
+    , trace_count_(0)
+    , writes_started_(0)
+    , writes_completed_(0)
     , index_(index)
+    , ipv4_(0)
     , connected_(false)
+    , connect_time_(0)
+    , last_packet_time_(0)
 {
+    ip_address_[0] = '\0';
 }
 
 ClientSession::~ClientSession() {
     close();
 }
 
+void ClientSession::reset() {
+    // Called by SocketManager before a pooled session accepts again
+    std::lock_guard<ProfiledMutex> lock(send_mutex_);
+
+    recv_buffer_size_ = 0;
+    timestamped_ = false;
+    read_queue_ns_ = 0;
+    send_sizes_[0] = 0;
+    send_sizes_[1] = 0;
+    send_pending_ = 0;
+    write_in_progress_ = false;
+    trace_open_ = false;
+    trace_count_ = 0;
+    writes_started_ = 0;
+    writes_completed_ = 0;
+    ip_address_[0] = '\0';
+    ipv4_ = 0;
+}
+
+bool ClientSession::load_remote_address() {
+    boost::system::error_code ec;
+    auto endpoint = socket_.remote_endpoint(ec);
+
+    if (ec) {
+        return false;
+    }
+
+    auto address = endpoint.address();
+
+    if (address.is_v4()) {
+        ipv4_ = address.to_v4().to_uint();
+        IpAddressToString(address.to_v4().to_uint(), ip_address_, sizeof(ip_address_));
+    } else {
+        ipv4_ = 0;
+        std::string text = address.to_string();
+        strncpy(ip_address_, text.c_str(), sizeof(ip_address_) - 1);
+        ip_address_[sizeof(ip_address_) - 1] = '\0';
+    }
+
+    return true;
+}
+
 void ClientSession::start() {
+    BinaryLog::Session log_session((uint32_t)index_);
+
     try {
         // Get remote endpoint info
-        auto endpoint = socket_.remote_endpoint();
-        ip_address_ = endpoint.address().to_string();
+        if (ip_address_[0] == '\0' && !load_remote_address()) {
+            throw std::runtime_error("remote endpoint unavailable");
+        }
         connected_ = true;
+
+        timestamped_ = ReceiveTimestamps::enabled() && ReceiveTimestamps::enable_socket(socket_.native_handle());
         
         // Set timestamps
-        connect_time_ = std::chrono::steady_clock::now();
+        connect_time_ = GetTickCountCross();
         last_packet_time_ = connect_time_;
         
-        LogAdd(2, "[ClientSession] Client connected: Index=%d, IP=%s", 
-               index_, ip_address_.c_str());
+        LogAddLimited(2, "[ClientSession] Client connected: Index=%d, IP=%s", 
+               index_, ip_address_);
+
+        g_traffic_recorder.record(TRAFFIC_TCP_OPEN, index_, (const uint8_t*)ip_address_, strlen(ip_address_));
         
         // Send init packet to client
         CCServerInitSend(index_, 1);
@@ -44,7 +124,7 @@ void ClientSession::start() {
         start_read();
         
     } catch (const std::exception& e) {
-        LogAdd(1, "[ClientSession] Error starting session: %s", e.what());
+        LogAddLimited(1, "[ClientSession] Error starting session: %s", e.what());
         close();
     }
 }
@@ -55,23 +135,61 @@ void ClientSession::start_read() {
     }
     
     auto self = shared_from_this();
+
+    if (timestamped_) {
+        // Wait for readability, then recvmsg to get the kernel timestamp
+        socket_.async_wait(boost::asio::ip::tcp::socket::wait_read,
+            boost::asio::bind_executor(strand_, make_alloc_handler(handler_memory_,
+                [this, self](const boost::system::error_code& error) {
+                    handle_readable(error);
+                })));
+        return;
+    }
     
     socket_.async_read_some(
         boost::asio::buffer(recv_buffer_.data() + recv_buffer_size_, 
                            recv_buffer_.size() - recv_buffer_size_),
-        boost::asio::bind_executor(strand_,
+        boost::asio::bind_executor(strand_, make_alloc_handler(handler_memory_,
             [this, self](const boost::system::error_code& error, size_t bytes) {
                 handle_read(error, bytes);
-            })
+            }))
     );
 }
 
+void ClientSession::handle_readable(const boost::system::error_code& error) {
+    BinaryLog::Session log_session((uint32_t)index_);
+
+    if (error) {
+        handle_read(error, 0);
+        return;
+    }
+
+    uint64_t kernel_ns;
+    long bytes = ReceiveTimestamps::receive(socket_.native_handle(), recv_buffer_.data() + recv_buffer_size_,
+                                            recv_buffer_.size() - recv_buffer_size_, nullptr, nullptr, &kernel_ns);
+
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            start_read();
+        } else {
+            handle_read(boost::system::error_code(errno, boost::system::system_category()), 0);
+        }
+        return;
+    }
+
+    read_queue_ns_ = ReceiveTimestamps::queue_delay(kernel_ns);
+    handle_read(boost::system::error_code(), (size_t)bytes);
+}
+
 void ClientSession::handle_read(const boost::system::error_code& error, size_t bytes) {
+    BinaryLog::Session log_session((uint32_t)index_);
+
     if (error) {
         if (error != boost::asio::error::eof && 
             error != boost::asio::error::operation_aborted) {
-            LogAdd(1, "[ClientSession] Read error: Index=%d, Error=%s", 
+            LogAddLimited(1, "[ClientSession] Read error: Index=%d, Error=%s", 
                    index_, error.message().c_str());
+            FlightRecorder::record(FLIGHT_ERROR, index_, FLIGHT_ERROR_READ, 0, (uint64_t)error.value());
         }
         close();
         return;
@@ -83,7 +201,9 @@ void ClientSession::handle_read(const boost::system::error_code& error, size_t b
     }
     
     recv_buffer_size_ += bytes;
-    last_packet_time_ = std::chrono::steady_clock::now();
+    last_packet_time_ = GetTickCountCross();
+
+    CS_PROBE3(read, index_, bytes, recv_buffer_size_);
     
     // Parse and process packets
     if (parse_packets()) {
@@ -91,11 +211,22 @@ void ClientSession::handle_read(const boost::system::error_code& error, size_t b
         start_read();
     } else {
         // Parse error - disconnect
-        LogAdd(1, "[ClientSession] Packet parse error: Index=%d", index_);
+        LogAddLimited(1, "[ClientSession] Packet parse error: Index=%d", index_);
         close();
     }
 }
 
+bool ClientSession::receive(const uint8_t* data, size_t size) {
+    if (size > recv_buffer_.size() - recv_buffer_size_) {
+        return false;
+    }
+
+    std::memcpy(recv_buffer_.data() + recv_buffer_size_, data, size);
+    recv_buffer_size_ += size;
+
+    return parse_packets();
+}
+
 bool ClientSession::parse_packets() {
     size_t processed = 0;
     
@@ -121,13 +252,15 @@ bool ClientSession::parse_packets() {
             header_size = 3;
         } else {
             // Invalid header
-            LogAdd(1, "[ClientSession] Invalid packet header: 0x%02X", header);
+            LogAddLimited(1, "[ClientSession] Invalid packet header: 0x%02X", header);
+            FlightRecorder::record(FLIGHT_ERROR, index_, FLIGHT_ERROR_FRAME, 0, header);
             return false;
         }
         
         // Validate packet size
         if (packet_size < header_size || packet_size > MAX_PACKET_SIZE) {
-            LogAdd(1, "[ClientSession] Invalid packet size: %d", packet_size);
+            LogAddLimited(1, "[ClientSession] Invalid packet size: %d", packet_size);
+            FlightRecorder::record(FLIGHT_ERROR, index_, FLIGHT_ERROR_FRAME, 0, (uint64_t)packet_size);
             return false;
         }
         
@@ -136,14 +269,58 @@ bool ClientSession::parse_packets() {
             break; // Need more data
         }
         
+        // Request tracing starts at frame completion
+        bool traced = RequestTracer::enabled();
+        uint64_t frame_at = traced ? RequestTracer::now() : 0;
+
         // Extract packet head
         uint8_t head = buffer[header_size];
         
         // Log packet if enabled
         ConsoleProtocolLog(CON_PROTO_TCP_RECV, buffer, packet_size);
+        g_traffic_recorder.record(TRAFFIC_TCP_RECV, index_, buffer, packet_size);
+        CS_PROBE4(frame, index_, head, ProbeSubhead(buffer, packet_size), packet_size);
+        FlightRecorder::record(FLIGHT_FRAME, index_, head, ProbeSubhead(buffer, packet_size), packet_size);
+        PacketCount()->fetch_add(1, std::memory_order_relaxed);
         
         // Process packet
-        process_packet(head, buffer, packet_size);
+        if (traced) {
+            trace_.Head = head;
+            trace_.Subhead = ProbeSubhead(buffer, packet_size);
+            trace_.Size = (uint16_t)packet_size;
+            trace_.Frame = frame_at;
+            trace_.Enqueued = 0;
+            trace_.HandlerStart = RequestTracer::now();
+            trace_open_ = true;
+        }
+
+        if (timestamped_) {
+            uint64_t started = ReceiveTimestamps::monotonic_ns();
+
+            process_packet(head, buffer, packet_size);
+
+            ReceiveTimestamps::histogram(RECEIVE_TCP_SERVICE).record(ReceiveTimestamps::monotonic_ns() - started);
+            ReceiveTimestamps::histogram(RECEIVE_TCP_QUEUE).record(read_queue_ns_);
+        } else {
+            process_packet(head, buffer, packet_size);
+        }
+
+        if (traced) {
+            trace_open_ = false;
+            trace_.HandlerDone = RequestTracer::now();
+
+            if (trace_.Enqueued == 0 || !connected_) {
+                // No reply to wait for
+                trace_.Written = trace_.HandlerDone;
+                RequestTracer::finish(trace_, index_);
+            } else if (trace_count_ < MAX_PENDING_TRACES) {
+                traces_[trace_count_++] = trace_;
+            } else {
+                // Client pipelines deeper than we track: close at handler return
+                trace_.Written = trace_.HandlerDone;
+                RequestTracer::finish(trace_, index_);
+            }
+        }
         
         processed += packet_size;
     }
@@ -167,79 +344,144 @@ void ClientSession::process_packet(uint8_t head, const uint8_t* data, size_t siz
 }
 
 void ClientSession::async_send(const uint8_t* data, size_t size) {
-    if (!connected_ || size == 0 || size > MAX_PACKET_SIZE) {
-        return;
+    encode_send(size, [data, size](uint8_t* out) {
+        std::memcpy(out, data, size);
+        return size;
+    });
+}
+
+uint8_t* ClientSession::reserve_send(size_t max_size) {
+    auto& pending = send_buffers_[send_pending_];
+    size_t pending_size = send_sizes_[send_pending_];
+
+    if (pending_size + max_size > pending.size()) {
+        // Client is not draining its replies; don't buffer without bound
+        LogAddLimited(1, "[ClientSession] Send buffer full: Index=%d", index_);
+        FlightRecorder::record(FLIGHT_ERROR, index_, FLIGHT_ERROR_SEND_FULL, 0, max_size);
+        boost::asio::post(strand_, make_alloc_handler(handler_memory_,
+            [this, self = shared_from_this()]() {
+                close();
+            }));
+        return nullptr;
     }
-    
-    std::vector<uint8_t> packet(data, data + size);
-    
-    {
-        std::lock_guard<std::mutex> lock(send_mutex_);
-        send_queue_.push(std::move(packet));
+
+    return pending.data() + pending_size;
+}
+
+void ClientSession::commit_send(const uint8_t* data, size_t size) {
+    send_sizes_[send_pending_] += size;
+
+    // The pending buffer goes out with the next write started
+    if (trace_open_ && trace_.Enqueued == 0) {
+        trace_.Enqueued = RequestTracer::now();
+        trace_.WriteSeq = writes_started_ + 1;
     }
-    
-    // Log packet if enabled
+
+    // Log packet if enabled; still under send_mutex_, the bytes cannot be
+    // written out and reused yet
     ConsoleProtocolLog(CON_PROTO_TCP_SEND, data, size);
-    
+    g_traffic_recorder.record(TRAFFIC_TCP_SEND, index_, data, size);
+    CS_PROBE4(send, index_, ProbeHead(data, size), ProbeSubhead(data, size), size);
+    FlightRecorder::record(FLIGHT_SEND, index_, ProbeHead(data, size), ProbeSubhead(data, size), size);
+}
+
+void ClientSession::schedule_write() {
     // Start write if not already in progress
     auto self = shared_from_this();
-    boost::asio::post(strand_, [this, self]() {
+    boost::asio::post(strand_, make_alloc_handler(handler_memory_, [this, self]() {
         if (!write_in_progress_) {
             start_write();
         }
-    });
+    }));
 }
 
 void ClientSession::start_write() {
-    std::lock_guard<std::mutex> lock(send_mutex_);
+    std::lock_guard<ProfiledMutex> lock(send_mutex_);
     
-    if (send_queue_.empty() || !connected_) {
+    if (send_sizes_[send_pending_] == 0 || !connected_) {
         write_in_progress_ = false;
         return;
     }
     
     write_in_progress_ = true;
-    auto& packet = send_queue_.front();
+    writes_started_++;
+
+    // Flip buffers: everything queued so far goes out in one write
+    int active = send_pending_;
+    send_pending_ ^= 1;
     
     auto self = shared_from_this();
     
     boost::asio::async_write(
         socket_,
-        boost::asio::buffer(packet.data(), packet.size()),
-        boost::asio::bind_executor(strand_,
+        boost::asio::buffer(send_buffers_[active].data(), send_sizes_[active]),
+        boost::asio::bind_executor(strand_, make_alloc_handler(handler_memory_,
             [this, self](const boost::system::error_code& error, size_t bytes) {
                 handle_write(error, bytes);
-            })
+            }))
     );
 }
 
 void ClientSession::handle_write(const boost::system::error_code& error, size_t bytes) {
+    BinaryLog::Session log_session((uint32_t)index_);
+
     if (error) {
-        LogAdd(1, "[ClientSession] Write error: Index=%d, Error=%s", 
+        LogAddLimited(1, "[ClientSession] Write error: Index=%d, Error=%s", 
                index_, error.message().c_str());
+        FlightRecorder::record(FLIGHT_ERROR, index_, FLIGHT_ERROR_WRITE, 0, (uint64_t)error.value());
         close();
         return;
     }
+
+    CS_PROBE2(write__done, index_, bytes);
+
+    if (trace_count_ != 0) {
+        finish_traces(++writes_completed_);
+    } else {
+        writes_completed_++;
+    }
     
     {
-        std::lock_guard<std::mutex> lock(send_mutex_);
-        send_queue_.pop();
+        std::lock_guard<ProfiledMutex> lock(send_mutex_);
+        send_sizes_[send_pending_ ^ 1] = 0;
     }
     
     // Continue writing if there are more packets
     start_write();
 }
 
+void ClientSession::finish_traces(uint64_t writes_completed) {
+    uint64_t now = RequestTracer::now();
+    size_t kept = 0;
+
+    for (size_t n = 0; n < trace_count_; n++) {
+        if (traces_[n].WriteSeq <= writes_completed) {
+            traces_[n].Written = now;
+            RequestTracer::finish(traces_[n], index_);
+        } else {
+            traces_[kept++] = traces_[n];
+        }
+    }
+
+    trace_count_ = kept;
+}
+
 void ClientSession::close() {
+    BinaryLog::Session log_session((uint32_t)index_);
+
     if (!connected_) {
         return;
     }
     
     connected_ = false;
+
+    g_traffic_recorder.record(TRAFFIC_TCP_CLOSE, index_, nullptr, 0);
+    CS_PROBE1(close, index_);
+    FlightRecorder::record(FLIGHT_CLOSE, index_);
     
     // Remove IP tracking
-    if (!ip_address_.empty()) {
-        gIpManager.RemoveIpAddress(ip_address_.c_str());
+    if (ip_address_[0] != '\0') {
+        GetSessionTenant(index_)->IpManager->RemoveIpAddress(ip_address_);
     }
     
     // Decrement client count
@@ -248,8 +490,8 @@ void ClientSession::close() {
     boost::system::error_code ec;
     socket_.close(ec);
     
-    LogAdd(2, "[ClientSession] Client disconnected: Index=%d, IP=%s", 
-           index_, ip_address_.c_str());
+    LogAddLimited(2, "[ClientSession] Client disconnected: Index=%d, IP=%s", 
+           index_, ip_address_);
 }
 
 bool ClientSession::check_timeout(uint32_t timeout_seconds) const {
@@ -257,9 +499,7 @@ bool ClientSession::check_timeout(uint32_t timeout_seconds) const {
         return false;
     }
     
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-        now - last_packet_time_).count();
+    uint32_t elapsed = GetTickCountCross() - last_packet_time_;
     
-    return elapsed >= timeout_seconds;
+    return elapsed >= timeout_seconds * 1000;
 }
@@ -108,3 +108,11 @@ bool ConfigManager::has_key(const std::string& section, const std::string& key)
     }
     return sec_it->second.find(key) != sec_it->second.end();
 }
+
+std::map<std::string, std::string> ConfigManager::get_section(const std::string& section) const {
+    auto sec_it = config_.find(section);
+    if (sec_it == config_.end()) {
+        return {};
+    }
+    return sec_it->second;
+}
@@ -1,16 +1,56 @@
 #include "ConnectServerProtocol.h"
+#include "FlightRecorder.h"
 #include "ServerList.h"
+#include "SharedServerTable.h"
 #include "SocketManager.h"
+#include "Tenant.h"
 #include "Console.h"
 #include "Util.h"
+#include "Probes.h"
+#include <algorithm>
 #include <cstring>
 
+// Encodes a reply of at most maxSize bytes straight into the session's
+// pending send buffer; encode(lpMsg) returns the size it wrote
+template <typename Encode>
+static void DataSendEncoded(int index, size_t maxSize, Encode&& encode)
+{
+#ifdef CS_SIMULATION
+    if (gSimulationTransport != nullptr)
+    {
+        uint8_t send[MAX_PACKET_SIZE];
+        size_t size = encode(send);
+
+        if (size != 0)
+        {
+            gSimulationTransport->ClientSend(index, send, (int)size);
+        }
+        return;
+    }
+#endif
+
+    SocketManager* listener = GetSessionTenant(index)->Tcp;
+    auto session = (listener != nullptr) ? listener->get_session(index) : nullptr;
+
+    if (session)
+    {
+        session->encode_send(maxSize, encode);
+    }
+    else
+    {
+        LogAdd(1, "[Protocol] Failed to get session %d for send", index);
+    }
+}
+
 void ConnectServerProtocolCore(int index, uint8_t head, const uint8_t* lpMsg, int size)
 {
     ConsoleProtocolLog(CON_PROTO_TCP_RECV, lpMsg, size);
     
     LogAdd(2, "[Protocol] Received packet: Index=%d, Head=0x%02X, Size=%d", index, head, size);
 
+    CS_PROBE4(handler__entry, index, head, ProbeSubhead(lpMsg, size), size);
+    FlightRecorder::record(FLIGHT_HANDLER_ENTER, index, head, ProbeSubhead(lpMsg, size), size);
+
     // Update packet time for timeout tracking
     // TODO: Will be implemented when we add timeout tracking to ClientSession
 
@@ -18,7 +58,13 @@ void ConnectServerProtocolCore(int index, uint8_t head, const uint8_t* lpMsg, in
     {
         case 0xF4:
         {
-            uint8_t subhead = lpMsg[3];
+            if (size <= (int)WireSubheadOffset(lpMsg))
+            {
+                LogAdd(1, "[Protocol] 0xF4 packet without a subhead");
+                break;
+            }
+
+            uint8_t subhead = lpMsg[WireSubheadOffset(lpMsg)];
             LogAdd(2, "[Protocol] 0xF4 packet, subhead=0x%02X", subhead);
             
             switch (subhead)
@@ -27,14 +73,14 @@ void ConnectServerProtocolCore(int index, uint8_t head, const uint8_t* lpMsg, in
                 {
                     LogAdd(2, "[Protocol] Server list request from client %d", index);
                     CCCustomServerListSend(index);
-                    CCServerListRecv((PMSG_SERVER_LIST_RECV*)lpMsg, index);
+                    CCServerListRecv(index);
                     break;
                 }
 
                 case 0x03:
                 {
                     LogAdd(2, "[Protocol] Server info request from client %d", index);
-                    CCServerInfoRecv((PMSG_SERVER_INFO_RECV*)lpMsg, index);
+                    CCServerInfoRecv(lpMsg, size, index);
                     break;
                 }
                 
@@ -54,116 +100,151 @@ void ConnectServerProtocolCore(int index, uint8_t head, const uint8_t* lpMsg, in
             break;
         }
     }
+
+    CS_PROBE3(handler__return, index, head, ProbeSubhead(lpMsg, size));
+    FlightRecorder::record(FLIGHT_HANDLER_EXIT, index, head, ProbeSubhead(lpMsg, size));
 }
 
-void CCServerInitSend(int index, int result)
+void DataSend(int index, const uint8_t* lpMsg, int size)
 {
-    PMSG_SERVER_INIT_SEND pMsg;
-
-    pMsg.header.set(0x00, sizeof(pMsg));
-    pMsg.result = result;
+#ifdef CS_SIMULATION
+    if (gSimulationTransport != nullptr)
+    {
+        gSimulationTransport->ClientSend(index, lpMsg, size);
+        return;
+    }
+#endif
 
-    LogAdd(2, "[Protocol] Sending init packet to client %d, result=%d", index, result);
+    SocketManager* listener = GetSessionTenant(index)->Tcp;
+    auto session = (listener != nullptr) ? listener->get_session(index) : nullptr;
 
-    auto session = g_socket_manager->get_session(index);
-    if (session) {
-        session->async_send((uint8_t*)&pMsg, pMsg.header.size);
-    } else {
-        LogAdd(1, "[Protocol] Failed to get session %d for init send", index);
+    if (session)
+    {
+        session->async_send(lpMsg, size);
+    }
+    else
+    {
+        LogAdd(1, "[Protocol] Failed to get session %d for send", index);
     }
 }
 
-void CCCustomServerListSend(int index)
+void CCServerInitSend(int index, int result)
 {
-    uint8_t send[2048];
+    LogAdd(2, "[Protocol] Sending init packet to client %d, result=%d", index, result);
 
-    PMSG_CUSTOM_SERVER_LIST_SEND pMsg;
+    DataSendEncoded(index, PMSG_SERVER_INIT_SEND::Size, [result](uint8_t* lpMsg)
+    {
+        PMSG_SERVER_INIT_SEND::Header.put(lpMsg, PMSG_SERVER_INIT_SEND::Size);
+        PMSG_SERVER_INIT_SEND::Result.put(lpMsg, (uint8_t)result);
 
-    pMsg.header.set(0xF4, 0x04, 0);
+        return PMSG_SERVER_INIT_SEND::Size;
+    });
+}
 
-    int size = sizeof(pMsg);
+void CCCustomServerListSend(int index)
+{
+    CServerList* lpServerList = GetSessionTenant(index)->ServerList;
 
-    int count = gServerList.GenerateCustomServerList(send, &size);
+    int servers = (gSharedServerTable != nullptr) ? gSharedServerTable->GetServerCount() : lpServerList->GetServerCount();
+    size_t maxSize = std::min(WireListSize<PMSG_CUSTOM_SERVER_LIST_SEND, PMSG_CUSTOM_SERVER_LIST>(servers), MAX_PACKET_SIZE);
 
-    pMsg.count[0] = SET_NUMBERHB(count);
-    pMsg.count[1] = SET_NUMBERLB(count);
+    DataSendEncoded(index, maxSize, [lpServerList, maxSize](uint8_t* lpMsg)
+    {
+        int size = PMSG_CUSTOM_SERVER_LIST_SEND::Size;
 
-    pMsg.header.size[0] = SET_NUMBERHB(size);
-    pMsg.header.size[1] = SET_NUMBERLB(size);
+        int count = (gSharedServerTable != nullptr)
+            ? gSharedServerTable->GenerateCustomServerList(lpMsg, &size, (int)maxSize)
+            : lpServerList->GenerateCustomServerList(lpMsg, &size, (int)maxSize);
 
-    memcpy(send, &pMsg, sizeof(pMsg));
+        PMSG_CUSTOM_SERVER_LIST_SEND::Header.put(lpMsg, size);
+        PMSG_CUSTOM_SERVER_LIST_SEND::Count.put(lpMsg, (uint16_t)count);
 
-    auto session = g_socket_manager->get_session(index);
-    if (session) {
-        session->async_send(send, size);
-    }
+        return (size_t)size;
+    });
 }
 
-void CCServerListRecv(PMSG_SERVER_LIST_RECV* lpMsg, int index)
+void CCServerListRecv(int index)
 {
-    uint8_t send[2048];
+    CServerList* lpServerList = GetSessionTenant(index)->ServerList;
 
-    PMSG_SERVER_LIST_SEND pMsg;
+    // Count is one byte: never more than 255 entries
+    int servers = (gSharedServerTable != nullptr) ? gSharedServerTable->GetServerCount() : lpServerList->GetServerCount();
+    size_t maxSize = std::min(WireListSize<PMSG_SERVER_LIST_SEND, PMSG_SERVER_LIST>(std::min(servers, 255)), MAX_PACKET_SIZE);
+    int count = 0;
 
-    pMsg.header.set(0xF4, 0x02, 0);
+    DataSendEncoded(index, maxSize, [lpServerList, maxSize, &count](uint8_t* lpMsg)
+    {
+        int size = PMSG_SERVER_LIST_SEND::Size;
 
-    int size = sizeof(pMsg);
+        count = (gSharedServerTable != nullptr)
+            ? gSharedServerTable->GenerateServerList(lpMsg, &size, (int)maxSize)
+            : lpServerList->GenerateServerList(lpMsg, &size, (int)maxSize);
 
-    int count = gServerList.GenerateServerList(send, &size);
+        PMSG_SERVER_LIST_SEND::Header.put(lpMsg, size);
+        PMSG_SERVER_LIST_SEND::Count.put(lpMsg, (uint8_t)count);
 
-    LogAdd(2, "[Protocol] Sending server list to client %d: count=%d, size=%d", index, count, size);
+        return (size_t)size;
+    });
 
-    pMsg.count = count;
+    LogAdd(2, "[Protocol] Sent server list to client %d: count=%d", index, count);
+}
 
-    pMsg.header.size[0] = SET_NUMBERHB(size);
-    pMsg.header.size[1] = SET_NUMBERLB(size);
+void CCServerInfoRecv(const uint8_t* lpMsg, int size, int index)
+{
+    if (!PMSG_SERVER_INFO_RECV::Header.fits(lpMsg, size, PMSG_SERVER_INFO_RECV::Size))
+    {
+        LogAdd(1, "[Protocol] Short server info request from client %d", index);
+        return;
+    }
 
-    memcpy(send, &pMsg, sizeof(pMsg));
+    int ServerCode = PMSG_SERVER_INFO_RECV::ServerCode.get(lpMsg);
 
-    auto session = g_socket_manager->get_session(index);
-    if (session) {
-        session->async_send(send, size);
-    } else {
-        LogAdd(1, "[Protocol] Failed to get session %d for server list send", index);
-    }
-}
+    LogAdd(2, "[Protocol] Server info request for ServerCode=%d from client %d", ServerCode, index);
 
-void CCServerInfoRecv(PMSG_SERVER_INFO_RECV* lpMsg, int index)
-{
-    LogAdd(2, "[Protocol] Server info request for ServerCode=%d from client %d", lpMsg->ServerCode, index);
+    SERVER_LIST_INFO SharedInfo;
+    SERVER_LIST_INFO* lpServerListInfo;
+    bool available;
 
-    SERVER_LIST_INFO* lpServerListInfo = gServerList.GetServerListInfo(lpMsg->ServerCode);
+    if (gSharedServerTable != nullptr)
+    {
+        // Prefork worker: a consistent copy of the supervisor's entry
+        lpServerListInfo = gSharedServerTable->GetServerInfo(ServerCode, &SharedInfo, &available) ? &SharedInfo : nullptr;
+    }
+    else
+    {
+        CServerList* lpServerList = GetSessionTenant(index)->ServerList;
+
+        lpServerListInfo = lpServerList->GetServerListInfo(ServerCode);
+        available = lpServerList->CheckServerState(ServerCode);
+    }
 
     if (lpServerListInfo == nullptr)
     {
-        LogAdd(1, "[Protocol] Server code %d not found", lpMsg->ServerCode);
+        LogAdd(1, "[Protocol] Server code %d not found", ServerCode);
         return;
     }
 
-    // Temporarily allow offline servers for testing
-    // TODO: Re-enable these checks when GameServer is running
-    // if (lpServerListInfo->ServerShow == 0 || lpServerListInfo->ServerState == 0)
     if (lpServerListInfo->ServerShow == 0)
     {
-        LogAdd(1, "[Protocol] Server %d is hidden", lpMsg->ServerCode);
+        LogAdd(1, "[Protocol] Server %d is hidden", ServerCode);
         return;
     }
 
-    PMSG_SERVER_INFO_SEND pMsg;
-
-    pMsg.header.set(0xF4, 0x03, sizeof(pMsg));
-
-    memcpy(pMsg.ServerAddress, lpServerListInfo->ServerAddress, sizeof(pMsg.ServerAddress));
+    if (available == false)
+    {
+        LogAdd(1, "[Protocol] Server %d is not online", ServerCode);
+        return;
+    }
 
-    pMsg.ServerPort = lpServerListInfo->ServerPort;
+    LogAdd(2, "[Protocol] Sending server info to client %d: %s:%d",
+           index, lpServerListInfo->ServerAddress, lpServerListInfo->ServerPort);
 
-    LogAdd(2, "[Protocol] Sending server info to client %d: %s:%d", 
-           index, pMsg.ServerAddress, pMsg.ServerPort);
+    DataSendEncoded(index, PMSG_SERVER_INFO_SEND::Size, [lpServerListInfo](uint8_t* lpMsg)
+    {
+        PMSG_SERVER_INFO_SEND::Header.put(lpMsg, PMSG_SERVER_INFO_SEND::Size);
+        PMSG_SERVER_INFO_SEND::ServerAddress.put(lpMsg, lpServerListInfo->ServerAddress);
+        PMSG_SERVER_INFO_SEND::ServerPort.put(lpMsg, lpServerListInfo->ServerPort);
 
-    auto session = g_socket_manager->get_session(index);
-    if (session) {
-        session->async_send((uint8_t*)&pMsg, pMsg.header.size);
-    } else {
-        LogAdd(1, "[Protocol] Failed to get session %d for server info send", index);
-    }
+        return PMSG_SERVER_INFO_SEND::Size;
+    });
 }
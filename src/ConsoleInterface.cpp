@@ -2,12 +2,10 @@
 #include <iostream>
 #include <chrono>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
 
 ConsoleInterface* g_console_interface = nullptr;
 
-ConsoleInterface::ConsoleInterface() : running_(false) {
+ConsoleInterface::ConsoleInterface() : output_mutex_("ConsoleInterface::output"), running_(false) {
 }
 
 ConsoleInterface::~ConsoleInterface() {
@@ -29,11 +27,18 @@ void ConsoleInterface::print_banner() {
 }
 
 void ConsoleInterface::log(Color color, const std::string& message) {
-    std::lock_guard<std::mutex> lock(output_mutex_);
+    log(color, message.c_str());
+}
+
+void ConsoleInterface::log(Color color, const char* message) {
+    char timestamp[16];
+    get_timestamp(timestamp, sizeof(timestamp));
+
+    std::lock_guard<ProfiledMutex> lock(output_mutex_);
     
     // ANSI color codes
     std::cout << "\033[" << static_cast<int>(color) << "m"
-              << get_timestamp() << " " << message
+              << timestamp << " " << message
               << "\033[0m" << std::endl;
 }
 
@@ -43,13 +48,17 @@ void ConsoleInterface::update_status(const std::string& status, size_t queue_siz
               << " (Queue: " << queue_size << ")\007" << std::flush;
 }
 
-std::string ConsoleInterface::get_timestamp() {
+void ConsoleInterface::get_timestamp(char* buffer, size_t size) {
     auto now = std::chrono::system_clock::now();
     auto time = std::chrono::system_clock::to_time_t(now);
     
-    std::stringstream ss;
-    ss << "[" << std::put_time(std::localtime(&time), "%H:%M:%S") << "]";
-    return ss.str();
+    struct tm tm_info;
+#ifdef _WIN32
+    localtime_s(&tm_info, &time);
+#else
+    localtime_r(&time, &tm_info);
+#endif
+    strftime(buffer, size, "[%H:%M:%S]", &tm_info);
 }
 
 void ConsoleInterface::start_input_loop() {
@@ -126,10 +135,22 @@ void ConsoleInterface::show_help() {
     std::cout << "║ help, ?          - Show this help        ║\n";
     std::cout << "║ status           - Show server status    ║\n";
     std::cout << "║ reload           - Reload ServerList.dat ║\n";
+    std::cout << "║ metrics          - Show runtime metrics ║\n";
     std::cout << "║ log tcp_recv on  - Enable TCP recv log  ║\n";
     std::cout << "║ log tcp_recv off - Disable TCP recv log ║\n";
     std::cout << "║ log tcp_send on  - Enable TCP send log  ║\n";
     std::cout << "║ log tcp_send off - Disable TCP send log ║\n";
+    std::cout << "║ record start <f> - Capture traffic      ║\n";
+    std::cout << "║ record stop      - Stop the capture     ║\n";
+    std::cout << "║ flight [f]       - Dump flight recorder ║\n";
+    std::cout << "║ locks [reset]    - Lock contention      ║\n";
+    std::cout << "║ threads          - io thread load/lag   ║\n";
+    std::cout << "║ tasks            - Scheduled tasks      ║\n";
+    std::cout << "║ tenants          - Listener pairs       ║\n";
+    std::cout << "║ workers          - Prefork workers      ║\n";
+    std::cout << "║ trace [reset]    - Request stage times  ║\n";
+    std::cout << "║ latency [reset]  - Queue/service times  ║\n";
+    std::cout << "║ profile <s> [f]  - CPU profile (folded) ║\n";
     std::cout << "║ clear, cls       - Clear screen         ║\n";
     std::cout << "║ exit, quit       - Shutdown server      ║\n";
     std::cout << "╚══════════════════════════════════════════╝\n\n";
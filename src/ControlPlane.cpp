@@ -0,0 +1,111 @@
+#include "ControlPlane.h"
+#include "FlightRecorder.h"
+#include "Metrics.h"
+#include "Util.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ControlPlane* g_control_plane = nullptr;
+
+ControlPlane::ControlPlane()
+    : work_guard_(boost::asio::make_work_guard(io_context_))
+    , probe_timer_(io_context_)
+    , probe_interval_(100)
+    , running_(false)
+    , lag_us_(Metrics::get("controlplane.lag_us"))
+    , lag_max_us_(Metrics::get("controlplane.lag_max_us"))
+{
+}
+
+ControlPlane::~ControlPlane() {
+    stop();
+}
+
+void ControlPlane::start(int cpu, uint32_t probe_interval_ms) {
+    if (running_) {
+        return;
+    }
+
+    running_ = true;
+    probe_interval_ = std::chrono::milliseconds(probe_interval_ms);
+
+    thread_ = std::thread([this]() {
+        FlightRecorder::set_thread_name("cs-control");
+        io_context_.run();
+    });
+
+#ifdef __linux__
+    pthread_setname_np(thread_.native_handle(), "cs-control");
+
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+
+        if (pthread_setaffinity_np(thread_.native_handle(), sizeof(cpuset), &cpuset) != 0) {
+            LogAdd(1, "[ControlPlane] Could not pin control thread to CPU %d", cpu);
+        } else {
+            LogAdd(2, "[ControlPlane] Control thread pinned to CPU %d", cpu);
+        }
+    }
+#endif
+
+    boost::asio::post(io_context_, [this]() {
+        probe_expected_ = std::chrono::steady_clock::now();
+        schedule_probe();
+    });
+
+    LogAdd(2, "[ControlPlane] Control plane started");
+}
+
+void ControlPlane::stop() {
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+
+    boost::asio::post(io_context_, [this]() {
+        probe_timer_.cancel();
+    });
+
+    work_guard_.reset();
+    io_context_.stop();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    LogAdd(2, "[ControlPlane] Control plane stopped");
+}
+
+void ControlPlane::schedule_probe() {
+    if (!running_) {
+        return;
+    }
+
+    probe_expected_ += probe_interval_;
+
+    probe_timer_.expires_at(probe_expected_);
+    probe_timer_.async_wait([this](const boost::system::error_code& error) {
+        if (error) {
+            return;
+        }
+
+        auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - probe_expected_).count();
+
+        lag_us_->store(lag, std::memory_order_relaxed);
+        Metrics::update_max(lag_max_us_, lag);
+
+        // After a long stall, measure from now instead of replaying missed probes
+        if (lag > std::chrono::duration_cast<std::chrono::microseconds>(probe_interval_).count()) {
+            probe_expected_ = std::chrono::steady_clock::now();
+        }
+
+        schedule_probe();
+    });
+}
@@ -1,11 +1,9 @@
 #include "CriticalSection.h"
 
-CCriticalSection::CCriticalSection() {
-    // std::recursive_mutex constructor handles initialization
+CCriticalSection::CCriticalSection(const char* site) : m_mutex(site) {
 }
 
 CCriticalSection::~CCriticalSection() {
-    // std::recursive_mutex destructor handles cleanup
 }
 
 void CCriticalSection::lock() {
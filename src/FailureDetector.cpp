@@ -0,0 +1,145 @@
+#include "FailureDetector.h"
+#include <algorithm>
+#include <cmath>
+
+CFailureDetector::CFailureDetector()
+{
+    this->Reset();
+}
+
+void CFailureDetector::Reset()
+{
+    this->m_IntervalCount = 0;
+    this->m_IntervalIndex = 0;
+    this->m_IntervalSum = 0;
+    this->m_IntervalSquareSum = 0;
+    this->m_LastHeartbeat = 0;
+    this->m_Started = false;
+}
+
+void CFailureDetector::Heartbeat(uint32_t now)
+{
+    if (this->m_Started != false)
+    {
+        uint32_t interval = std::min<uint32_t>(now - this->m_LastHeartbeat, 0xFFFF);
+
+        if (this->m_IntervalCount == FAILURE_DETECTOR_WINDOW)
+        {
+            uint32_t oldest = this->m_Interval[this->m_IntervalIndex];
+
+            this->m_IntervalSum -= oldest;
+            this->m_IntervalSquareSum -= (uint64_t)oldest * oldest;
+        }
+        else
+        {
+            this->m_IntervalCount++;
+        }
+
+        this->m_Interval[this->m_IntervalIndex] = (uint16_t)interval;
+        this->m_IntervalIndex = (this->m_IntervalIndex + 1) % FAILURE_DETECTOR_WINDOW;
+
+        this->m_IntervalSum += interval;
+        this->m_IntervalSquareSum += (uint64_t)interval * interval;
+    }
+
+    this->m_LastHeartbeat = now;
+    this->m_Started = true;
+}
+
+bool CFailureDetector::IsValid() const
+{
+    if (this->m_IntervalCount < 0 || this->m_IntervalCount > FAILURE_DETECTOR_WINDOW ||
+        this->m_IntervalIndex < 0 || this->m_IntervalIndex >= FAILURE_DETECTOR_WINDOW)
+    {
+        return false;
+    }
+
+    // Until the window is full the samples fill it from the start
+    if (this->m_IntervalCount < FAILURE_DETECTOR_WINDOW && this->m_IntervalIndex != this->m_IntervalCount)
+    {
+        return false;
+    }
+
+    uint32_t sum = 0;
+    uint64_t square_sum = 0;
+
+    for (int n = 0; n < this->m_IntervalCount; n++)
+    {
+        sum += this->m_Interval[n];
+        square_sum += (uint64_t)this->m_Interval[n] * this->m_Interval[n];
+    }
+
+    return sum == this->m_IntervalSum && square_sum == this->m_IntervalSquareSum;
+}
+
+double CFailureDetector::GetPhiElapsed(uint32_t elapsed, const FAILURE_DETECTOR_CONFIG& config) const
+{
+    double mean;
+    double deviation;
+
+    if (this->m_IntervalCount == 0)
+    {
+        mean = config.FirstInterval;
+        deviation = config.FirstInterval / 4.0;
+    }
+    else
+    {
+        mean = (double)this->m_IntervalSum / this->m_IntervalCount;
+        deviation = std::sqrt(std::max(0.0, (double)this->m_IntervalSquareSum / this->m_IntervalCount - mean * mean));
+    }
+
+    mean += config.AcceptablePause;
+    deviation = std::max(deviation, (double)config.MinStdDeviation);
+
+    // Logistic approximation of the normal CDF (as used by Akka)
+    double y = (elapsed - mean) / deviation;
+    double e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+
+    if (elapsed > mean)
+    {
+        return -std::log10(e / (1.0 + e));
+    }
+    else
+    {
+        return -std::log10(1.0 - 1.0 / (1.0 + e));
+    }
+}
+
+double CFailureDetector::GetPhi(uint32_t now, const FAILURE_DETECTOR_CONFIG& config) const
+{
+    if (this->m_Started == false)
+    {
+        return 0.0;
+    }
+
+    return this->GetPhiElapsed(now - this->m_LastHeartbeat, config);
+}
+
+uint32_t CFailureDetector::GetDeadline(double phi, const FAILURE_DETECTOR_CONFIG& config) const
+{
+    // phi grows monotonically with elapsed time: bisect for the crossing point,
+    // never later than the hard MaxHeartbeatPause limit
+    uint32_t low = 0;
+    uint32_t high = config.MaxHeartbeatPause;
+
+    if (this->GetPhiElapsed(high, config) < phi)
+    {
+        return this->m_LastHeartbeat + high;
+    }
+
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (this->GetPhiElapsed(middle, config) >= phi)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle;
+        }
+    }
+
+    return this->m_LastHeartbeat + high;
+}
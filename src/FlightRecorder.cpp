@@ -0,0 +1,169 @@
+#include "FlightRecorder.h"
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Rings live in static storage so the crash handler never has to follow a
+// heap pointer; pages of unused slots are never touched.
+static FLIGHT_RING g_flight_rings[MAX_FLIGHT_THREADS];
+static std::atomic<int> g_flight_ring_count{0};
+
+// Threads beyond the table record here; it is never dumped
+static FLIGHT_RING g_flight_overflow;
+
+static uint64_t WallClockNanoseconds() {
+#ifdef _WIN32
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+#else
+    // clock_gettime is async-signal-safe, system_clock is not promised to be
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static const uint64_t g_flight_start_tsc = FlightRecorder::timestamp();
+static const uint64_t g_flight_start_time = WallClockNanoseconds();
+
+static bool WriteAll(int fd, const void* data, size_t size) {
+    const char* cursor = static_cast<const char*>(data);
+
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(fd, cursor, (unsigned int)size);
+#else
+        ssize_t written = write(fd, cursor, size);
+#endif
+
+        if (written <= 0) {
+            return false;
+        }
+
+        cursor += written;
+        size -= (size_t)written;
+    }
+
+    return true;
+}
+
+FLIGHT_RING* FlightRecorder::attach() {
+    int slot = g_flight_ring_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (slot >= MAX_FLIGHT_THREADS) {
+        g_flight_ring_count.store(MAX_FLIGHT_THREADS, std::memory_order_relaxed);
+        t_ring_ = &g_flight_overflow;
+        return t_ring_;
+    }
+
+    FLIGHT_RING* ring = &g_flight_rings[slot];
+
+#ifdef _WIN32
+    ring->ThreadId = (uint32_t)GetCurrentThreadId();
+#else
+    ring->ThreadId = (uint32_t)syscall(SYS_gettid);
+#endif
+
+    t_ring_ = ring;
+    return ring;
+}
+
+void FlightRecorder::set_thread_name(const char* name) {
+    FLIGHT_RING* ring = t_ring_ != nullptr ? t_ring_ : attach();
+
+    strncpy(ring->Name, name, sizeof(ring->Name) - 1);
+    ring->Name[sizeof(ring->Name) - 1] = '\0';
+}
+
+bool FlightRecorder::dump(const char* path) {
+#ifdef _WIN32
+    int fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+    if (fd == -1) {
+        return false;
+    }
+
+    bool written = dump_fd(fd, 0);
+
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+
+    return written;
+}
+
+bool FlightRecorder::dump_fd(int fd, int signal) {
+    // Only atomics, static storage and write(2) from here on: this runs in
+    // the crash handler, possibly while another thread holds any lock
+    int count = g_flight_ring_count.load(std::memory_order_acquire);
+
+    if (count > MAX_FLIGHT_THREADS) {
+        count = MAX_FLIGHT_THREADS;
+    }
+
+    FLIGHT_DUMP_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = FLIGHT_DUMP_MAGIC;
+    header.Version = FLIGHT_DUMP_VERSION;
+    header.EventSize = sizeof(FLIGHT_EVENT);
+    header.RingSize = FLIGHT_RING_SIZE;
+    header.Threads = (uint32_t)count;
+    header.Signal = signal;
+#ifdef _WIN32
+    header.Pid = (uint32_t)_getpid();
+#else
+    header.Pid = (uint32_t)getpid();
+#endif
+    header.StartTsc = g_flight_start_tsc;
+    header.StartTime = g_flight_start_time;
+    header.DumpTsc = timestamp();
+    header.DumpTime = WallClockNanoseconds();
+
+    if (!WriteAll(fd, &header, sizeof(header))) {
+        return false;
+    }
+
+    for (int n = 0; n < count; n++) {
+        const FLIGHT_RING& ring = g_flight_rings[n];
+        uint64_t head = ring.Head.load(std::memory_order_acquire);
+        uint64_t events = (head < (uint64_t)FLIGHT_RING_SIZE) ? head : (uint64_t)FLIGHT_RING_SIZE;
+
+        FLIGHT_DUMP_THREAD thread;
+        memset(&thread, 0, sizeof(thread));
+        thread.ThreadId = ring.ThreadId;
+        thread.Events = (uint32_t)events;
+        thread.Head = head;
+        memcpy(thread.Name, ring.Name, sizeof(thread.Name));
+        thread.Name[sizeof(thread.Name) - 1] = '\0';
+
+        if (!WriteAll(fd, &thread, sizeof(thread))) {
+            return false;
+        }
+
+        // Oldest first, in at most two pieces. A live thread may overwrite
+        // the oldest slots meanwhile; the decoder orders by timestamp.
+        size_t first = (size_t)((head - events) & (FLIGHT_RING_SIZE - 1));
+        size_t run = ((size_t)FLIGHT_RING_SIZE - first < events) ? (size_t)FLIGHT_RING_SIZE - first : (size_t)events;
+
+        if (!WriteAll(fd, &ring.Events[first], run * sizeof(FLIGHT_EVENT)) ||
+            !WriteAll(fd, &ring.Events[0], ((size_t)events - run) * sizeof(FLIGHT_EVENT))) {
+            return false;
+        }
+    }
+
+    return true;
+}
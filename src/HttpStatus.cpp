@@ -0,0 +1,586 @@
+#include "HttpStatus.h"
+#include "Metrics.h"
+#include "RateLimitedLog.h"
+#include "ServerList.h"
+#include "StatsReader.h"
+#include "Tenant.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+class HttpSession : public std::enable_shared_from_this<HttpSession> {
+public:
+    HttpSession(HttpStatusServer& server, boost::asio::io_context& io, std::shared_ptr<std::atomic<int>> connections)
+        : server_(server)
+        , connections_(std::move(connections))
+        , strand_(boost::asio::make_strand(io))
+        , socket_(strand_)
+        , timer_(strand_)
+        , request_(HTTP_MAX_REQUEST)
+        , keep_alive_(false)
+        , head_only_(false)
+        , waiting_(false)
+    {
+    }
+
+    ~HttpSession() {
+        connections_->fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    boost::asio::ip::tcp::socket& socket() { return socket_; }
+
+    void start() {
+        read_request();
+    }
+
+    // From render(), any thread: the body changed
+    void wake() {
+        boost::asio::post(strand_, [self = shared_from_this()]() {
+            if (self->waiting_) {
+                self->timer_.cancel();
+            }
+        });
+    }
+
+private:
+    void read_request() {
+        auto self = shared_from_this();
+
+        timer_.expires_after(std::chrono::milliseconds(HTTP_IDLE_TIMEOUT_MS));
+        timer_.async_wait([self](const boost::system::error_code& error) {
+            if (!error) {
+                self->close();
+            }
+        });
+
+        boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+            [self](const boost::system::error_code& error, size_t size) {
+                self->timer_.cancel();
+
+                if (error) {
+                    // Over HTTP_MAX_REQUEST, or the client went away
+                    self->close();
+                    return;
+                }
+
+                self->handle_request(size);
+            });
+    }
+
+    void handle_request(size_t size) {
+        std::string text(boost::asio::buffers_begin(request_.data()), boost::asio::buffers_begin(request_.data()) + size);
+        request_.consume(size);
+
+        server_.request_count_->fetch_add(1, std::memory_order_relaxed);
+
+        // Request line
+        size_t line_end = text.find("\r\n");
+        std::string line = text.substr(0, line_end);
+        size_t first = line.find(' ');
+        size_t second = (first == std::string::npos) ? std::string::npos : line.find(' ', first + 1);
+
+        if (second == std::string::npos) {
+            keep_alive_ = false;
+            send_status(400, "Bad Request");
+            return;
+        }
+
+        std::string method = line.substr(0, first);
+        std::string target = line.substr(first + 1, second - first - 1);
+        std::string version = line.substr(second + 1);
+
+        // Headers we care about
+        std::string if_none_match;
+        std::string connection;
+        bool has_body = false;
+
+        for (size_t at = line_end + 2; at < text.size();) {
+            size_t end = text.find("\r\n", at);
+
+            if (end == std::string::npos || end == at) {
+                break;
+            }
+
+            std::string header = text.substr(at, end - at);
+            size_t colon = header.find(':');
+            at = end + 2;
+
+            if (colon == std::string::npos) {
+                continue;
+            }
+
+            std::string name = header.substr(0, colon);
+            size_t value_at = header.find_first_not_of(" \t", colon + 1);
+            std::string value = (value_at == std::string::npos) ? "" : header.substr(value_at);
+
+            if (strcasecmp(name.c_str(), "If-None-Match") == 0) {
+                if_none_match = value;
+            } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+                connection = value;
+            } else if (strcasecmp(name.c_str(), "Content-Length") == 0 || strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+                has_body = (value != "0");
+            }
+        }
+
+        keep_alive_ = (version == "HTTP/1.1") ? (strcasecmp(connection.c_str(), "close") != 0)
+                                              : (strcasecmp(connection.c_str(), "keep-alive") == 0);
+
+        // Requests carry no body here; one we do not read would desync the connection
+        if (has_body) {
+            keep_alive_ = false;
+        }
+
+        head_only_ = (method == "HEAD");
+
+        if (method != "GET" && method != "HEAD") {
+            send_status(405, "Method Not Allowed");
+            return;
+        }
+
+        size_t query = target.find('?');
+        std::string path = target.substr(0, query);
+
+        if (path != "/serverlist" && path != "/serverlist.json") {
+            send_status(404, "Not Found");
+            return;
+        }
+
+        uint32_t wait = 0;
+
+        if (query != std::string::npos) {
+            size_t parameter = target.find("wait=", query);
+
+            if (parameter != std::string::npos) {
+                wait = std::min((uint32_t)strtoul(target.c_str() + parameter + 5, nullptr, 10), server_.max_wait_seconds());
+            }
+        }
+
+        std::shared_ptr<const HTTP_BODY> body = server_.body();
+
+        if (!matches(if_none_match, body->ETag)) {
+            send_body(body);
+            return;
+        }
+
+        if (wait == 0) {
+            send_not_modified(body);
+            return;
+        }
+
+        // Long poll until the tag moves on or the wait is over
+        waited_etag_ = body->ETag;
+        wait_deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(wait);
+        wait_for_change();
+    }
+
+    void wait_for_change() {
+        if (!server_.register_waiter(shared_from_this(), waited_etag_)) {
+            send_body(server_.body());
+            return;
+        }
+
+        auto self = shared_from_this();
+
+        waiting_ = true;
+        timer_.expires_at(wait_deadline_);
+        timer_.async_wait([self](const boost::system::error_code&) {
+            self->waiting_ = false;
+
+            std::shared_ptr<const HTTP_BODY> body = self->server_.body();
+
+            if (body->ETag != self->waited_etag_) {
+                self->send_body(body);
+            } else if (std::chrono::steady_clock::now() >= self->wait_deadline_) {
+                self->send_not_modified(body);
+            } else {
+                // Woken by a render that changed nothing we sent
+                self->wait_for_change();
+            }
+        });
+    }
+
+    static bool matches(const std::string& if_none_match, const std::string& etag) {
+        if (if_none_match.empty()) {
+            return false;
+        }
+
+        if (if_none_match == "*") {
+            return true;
+        }
+
+        // A list of tags; weak comparison, as RFC 9110 asks for If-None-Match
+        size_t at = 0;
+
+        while (at < if_none_match.size()) {
+            size_t end = if_none_match.find(',', at);
+            std::string tag = if_none_match.substr(at, (end == std::string::npos) ? std::string::npos : end - at);
+
+            size_t begin = tag.find_first_not_of(" \t");
+            size_t last = tag.find_last_not_of(" \t");
+            tag = (begin == std::string::npos) ? "" : tag.substr(begin, last - begin + 1);
+
+            if (tag.compare(0, 2, "W/") == 0) {
+                tag = tag.substr(2);
+            }
+
+            if (tag == etag) {
+                return true;
+            }
+
+            if (end == std::string::npos) {
+                break;
+            }
+
+            at = end + 1;
+        }
+
+        return false;
+    }
+
+    void send_body(std::shared_ptr<const HTTP_BODY> body) {
+        char headers[256];
+
+        snprintf(headers, sizeof(headers),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Content-Length: %zu\r\n"
+                 "ETag: %s\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Access-Control-Allow-Origin: *\r\n"
+                 "Access-Control-Expose-Headers: ETag\r\n"
+                 "Connection: %s\r\n\r\n",
+                 body->Json.size(), body->ETag.c_str(), keep_alive_ ? "keep-alive" : "close");
+
+        headers_ = headers;
+        body_ = std::move(body);
+        write(!head_only_);
+    }
+
+    void send_not_modified(const std::shared_ptr<const HTTP_BODY>& body) {
+        char headers[192];
+
+        server_.not_modified_count_->fetch_add(1, std::memory_order_relaxed);
+
+        snprintf(headers, sizeof(headers),
+                 "HTTP/1.1 304 Not Modified\r\n"
+                 "ETag: %s\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Access-Control-Allow-Origin: *\r\n"
+                 "Connection: %s\r\n\r\n",
+                 body->ETag.c_str(), keep_alive_ ? "keep-alive" : "close");
+
+        headers_ = headers;
+        body_.reset();
+        write(false);
+    }
+
+    void send_status(int status, const char* reason) {
+        char headers[160];
+
+        snprintf(headers, sizeof(headers),
+                 "HTTP/1.1 %d %s\r\n"
+                 "Content-Length: 0\r\n"
+                 "Connection: %s\r\n\r\n",
+                 status, reason, keep_alive_ ? "keep-alive" : "close");
+
+        headers_ = headers;
+        body_.reset();
+        write(false);
+    }
+
+    void write(bool with_body) {
+        auto self = shared_from_this();
+
+        // The body is the shared rendering; only the headers are per response
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.push_back(boost::asio::buffer(headers_));
+
+        if (with_body && body_) {
+            buffers.push_back(boost::asio::buffer(body_->Json));
+        }
+
+        boost::asio::async_write(socket_, buffers, [self](const boost::system::error_code& error, size_t) {
+            self->body_.reset();
+
+            if (error || !self->keep_alive_) {
+                self->close();
+                return;
+            }
+
+            self->read_request();
+        });
+    }
+
+    void close() {
+        boost::system::error_code error;
+        timer_.cancel();
+        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+        socket_.close(error);
+    }
+
+    HttpStatusServer& server_;
+    std::shared_ptr<std::atomic<int>> connections_;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    boost::asio::streambuf request_;
+
+    bool keep_alive_;
+    bool head_only_;
+    bool waiting_;
+    std::string waited_etag_;
+    std::chrono::steady_clock::time_point wait_deadline_;
+
+    std::string headers_;
+    std::shared_ptr<const HTTP_BODY> body_;
+};
+
+HttpStatusServer::HttpStatusServer(boost::asio::io_context& io)
+    : io_context_(io)
+    , acceptor_(io)
+    , config_{0, 0, 0}
+    , port_(0)
+    , running_(false)
+    , render_servers_(new STATS_SERVER_ENTRY[STATS_MAX_SERVERS])
+    , connections_(std::make_shared<std::atomic<int>>(0))
+    , request_count_(Metrics::get("http.requests"))
+    , not_modified_count_(Metrics::get("http.not_modified"))
+    , render_count_(Metrics::get("http.renders"))
+{
+    auto empty = std::make_shared<HTTP_BODY>();
+    empty->Json = "{\"tenants\":[]}";
+    empty->ETag = "\"0\"";
+    empty->Version = 0;
+    body_ = empty;
+}
+
+HttpStatusServer::~HttpStatusServer() {
+    stop();
+}
+
+bool HttpStatusServer::start(const HTTP_STATUS_CONFIG& config) {
+    config_ = config;
+
+    try {
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), config.Port);
+
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+        port_ = acceptor_.local_endpoint().port();
+    } catch (const std::exception& e) {
+        LogAdd(1, "[HttpStatus] Failed to listen on port %d: %s", config.Port, e.what());
+        return false;
+    }
+
+    run();
+    return true;
+}
+
+bool HttpStatusServer::start_native(const HTTP_STATUS_CONFIG& config, int native_socket) {
+    config_ = config;
+
+    try {
+        acceptor_.assign(boost::asio::ip::tcp::v4(), native_socket);
+        port_ = acceptor_.local_endpoint().port();
+    } catch (const std::exception& e) {
+        LogAdd(1, "[HttpStatus] Failed to take over listening socket: %s", e.what());
+        return false;
+    }
+
+    LogAdd(2, "[HttpStatus] Took over port %d (fd %d)", port_, native_socket);
+
+    run();
+    return true;
+}
+
+void HttpStatusServer::run() {
+    running_ = true;
+    render();
+    start_accept();
+
+    LogAdd(2, "[HttpStatus] Serving /serverlist on port %d", port_);
+}
+
+void HttpStatusServer::stop() {
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+
+    boost::system::error_code error;
+    acceptor_.close(error);
+
+    LogAdd(2, "[HttpStatus] Stopped");
+}
+
+void HttpStatusServer::start_accept() {
+    auto session = std::make_shared<HttpSession>(*this, io_context_, connections_);
+    connections_->fetch_add(1, std::memory_order_relaxed);
+
+    acceptor_.async_accept(session->socket(), [this, session](const boost::system::error_code& error) {
+        if (error) {
+            if (error != boost::asio::error::operation_aborted) {
+                LogAddLimited(1, "[HttpStatus] Accept error: %s", error.message().c_str());
+                start_accept();
+            }
+            return;
+        }
+
+        // Counts this session but not yet the next pending accept
+        if (connections_->load(std::memory_order_relaxed) > (int)config_.MaxConnections) {
+            LogAddLimited(1, "[HttpStatus] %d connections, refusing more", (int)config_.MaxConnections);
+            boost::system::error_code ec;
+            session->socket().close(ec);
+        } else {
+            session->start();
+        }
+
+        start_accept();
+    });
+}
+
+std::shared_ptr<const HTTP_BODY> HttpStatusServer::body() {
+    std::lock_guard<std::mutex> lock(body_mutex_);
+    return body_;
+}
+
+bool HttpStatusServer::register_waiter(const std::shared_ptr<HttpSession>& session, const std::string& etag) {
+    // render() swaps the body before it takes this lock: a waiter that still
+    // sees the old tag in here is in the list render() collects next
+    std::lock_guard<std::mutex> lock(waiters_mutex_);
+
+    if (body()->ETag != etag) {
+        return false;
+    }
+
+    // Waiters re-register after a spurious wake; drop the dead ones now and then
+    if (waiters_.size() >= 2 * (size_t)std::max(connections(), 16)) {
+        waiters_.erase(std::remove_if(waiters_.begin(), waiters_.end(),
+            [](const std::weak_ptr<HttpSession>& waiter) { return waiter.expired(); }), waiters_.end());
+    }
+
+    waiters_.push_back(session);
+    return true;
+}
+
+static void AppendJsonString(std::string& out, const char* text, size_t max) {
+    out += '"';
+
+    for (size_t n = 0; n < max && text[n] != '\0'; n++) {
+        unsigned char c = (unsigned char)text[n];
+
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += (char)c;
+        }
+    }
+
+    out += '"';
+}
+
+static const char* StateName(uint8_t state) {
+    switch (state) {
+        case STATS_SERVER_ONLINE: return "online";
+        case STATS_SERVER_SUSPECT: return "suspect";
+    }
+
+    return "offline";
+}
+
+bool HttpStatusServer::render() {
+    STATS_SERVER_ENTRY* servers = render_servers_.get();
+    std::string& json = render_buffer_;
+    char number[160];
+
+    json.clear();
+    json += "{\"tenants\":[";
+
+    for (int t = 0; t < GetTenantCount(); t++) {
+        TENANT* tenant = GetTenant(t);
+        uint32_t queue = 0;
+        uint8_t join_state = tenant->ServerList->GetJoinServerStats(&queue);
+
+        snprintf(number, sizeof(number), "%s{\"id\":%d,\"name\":", (t == 0) ? "" : ",", tenant->Id);
+        json += number;
+        AppendJsonString(json, tenant->Name, sizeof(tenant->Name));
+
+        snprintf(number, sizeof(number), ",\"joinserver\":{\"online\":%s,\"queue\":%u},\"servers\":[",
+                 (join_state == STATS_SERVER_ONLINE) ? "true" : "false", queue);
+        json += number;
+
+        int count = tenant->ServerList->ExportStats(servers, STATS_MAX_SERVERS, (uint8_t)t);
+
+        for (int n = 0; n < count; n++) {
+            const STATS_SERVER_ENTRY& server = servers[n];
+
+            snprintf(number, sizeof(number), "%s{\"code\":%u,\"name\":", (n == 0) ? "" : ",", server.ServerCode);
+            json += number;
+            AppendJsonString(json, server.ServerName, sizeof(server.ServerName));
+
+            snprintf(number, sizeof(number),
+                     ",\"visible\":%s,\"state\":\"%s\",\"load\":%u,\"users\":%u,\"max_users\":%u}",
+                     server.Visible ? "true" : "false", StateName(server.State), server.UserTotal,
+                     server.UserCount, server.MaxUserCount);
+            json += number;
+        }
+
+        json += "]}";
+    }
+
+    json += "]}";
+
+    if (json == body()->Json) {
+        return false;
+    }
+
+    // FNV-1a over the body: the same list always gets the same tag, also
+    // across restarts and between nodes
+    uint64_t hash = 14695981039346656037ull;
+
+    for (unsigned char c : json) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+
+    auto next = std::make_shared<HTTP_BODY>();
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)hash);
+
+    next->Json = json;
+    next->ETag = etag;
+
+    std::vector<std::weak_ptr<HttpSession>> waiters;
+
+    {
+        std::lock_guard<std::mutex> lock(body_mutex_);
+        next->Version = body_->Version + 1;
+        body_ = next;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(waiters_mutex_);
+        waiters.swap(waiters_);
+    }
+
+    for (std::weak_ptr<HttpSession>& waiter : waiters) {
+        if (std::shared_ptr<HttpSession> session = waiter.lock()) {
+            session->wake();
+        }
+    }
+
+    render_count_->fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "IpManager.h"
+#include "SharedServerTable.h"
 #include <cstring>
 
 CIpManager gIpManager;
@@ -6,56 +7,149 @@ int MaxIpConnection = 0;  // Will be set from configuration
 
 CIpManager::CIpManager()
 {
+    memset(this->m_IpAddressInfo, 0, sizeof(this->m_IpAddressInfo));
+    this->m_MaxIpConnection = -1;
+    this->m_SharedTable = nullptr;
+    this->m_SharedWorker = -1;
 }
 
 CIpManager::~CIpManager()
 {
 }
 
+void CIpManager::SetSharedTable(CSharedServerTable* lpTable, int worker)
+{
+    this->m_SharedTable = lpTable;
+    this->m_SharedWorker = worker;
+}
+
+int CIpManager::GetHomeSlot(const char* IpAddress)
+{
+    // FNV-1a over the dotted string
+    uint32_t hash = 2166136261u;
+
+    for (int n = 0; n < 16 && IpAddress[n] != '\0'; n++)
+    {
+        hash = (hash ^ (uint8_t)IpAddress[n]) * 16777619u;
+    }
+
+    return hash & (MAX_IP_ADDRESS_TABLE - 1);
+}
+
+int CIpManager::FindIpAddress(const char* IpAddress, bool* found)
+{
+    // Linear probing from the home slot
+    int slot = this->GetHomeSlot(IpAddress);
+
+    for (int n = 0; n < MAX_IP_ADDRESS_TABLE; n++)
+    {
+        IP_ADDRESS_INFO* info = &this->m_IpAddressInfo[slot];
+
+        if (info->IpAddressCount == 0)
+        {
+            *found = false;
+            return slot;
+        }
+
+        if (strncmp(info->IpAddress, IpAddress, sizeof(info->IpAddress)) == 0)
+        {
+            *found = true;
+            return slot;
+        }
+
+        slot = (slot + 1) & (MAX_IP_ADDRESS_TABLE - 1);
+    }
+
+    *found = false;
+    return -1;
+}
+
 bool CIpManager::CheckIpAddress(const char* IpAddress)
 {
-    auto it = this->m_IpAddressInfo.find(std::string(IpAddress));
+    if (this->m_SharedTable != nullptr)
+    {
+        return this->m_SharedTable->CheckIpAddress(IpAddress, this->GetMaxIpConnection());
+    }
 
-    if (it == this->m_IpAddressInfo.end())
+    bool found;
+
+    int slot = this->FindIpAddress(IpAddress, &found);
+
+    if (found == false)
     {
-        return ((MaxIpConnection == 0) ? true : true);  // Allow if not in map
+        return (slot != -1);  // Allow if not in table
     }
     else
     {
-        return ((it->second.IpAddressCount >= MaxIpConnection) ? false : true);
+        return ((this->m_IpAddressInfo[slot].IpAddressCount >= this->GetMaxIpConnection()) ? false : true);
     }
 }
 
 void CIpManager::InsertIpAddress(const char* IpAddress)
 {
-    IP_ADDRESS_INFO info;
+    if (this->m_SharedTable != nullptr)
+    {
+        this->m_SharedTable->InsertIpAddress(IpAddress, this->m_SharedWorker);
+        return;
+    }
 
-    strncpy(info.IpAddress, IpAddress, sizeof(info.IpAddress) - 1);
-    info.IpAddress[sizeof(info.IpAddress) - 1] = '\0';
+    bool found;
 
-    info.IpAddressCount = 1;
+    int slot = this->FindIpAddress(IpAddress, &found);
 
-    auto it = this->m_IpAddressInfo.find(std::string(IpAddress));
+    if (slot == -1)
+    {
+        return;
+    }
 
-    if (it == this->m_IpAddressInfo.end())
+    IP_ADDRESS_INFO* info = &this->m_IpAddressInfo[slot];
+
+    if (found == false)
     {
-        this->m_IpAddressInfo.insert(std::pair<std::string, IP_ADDRESS_INFO>(std::string(IpAddress), info));
+        strncpy(info->IpAddress, IpAddress, sizeof(info->IpAddress) - 1);
+        info->IpAddress[sizeof(info->IpAddress) - 1] = '\0';
+
+        info->IpAddressCount = 1;
     }
     else
     {
-        it->second.IpAddressCount++;
+        info->IpAddressCount++;
     }
 }
 
 void CIpManager::RemoveIpAddress(const char* IpAddress)
 {
-    auto it = this->m_IpAddressInfo.find(std::string(IpAddress));
+    if (this->m_SharedTable != nullptr)
+    {
+        this->m_SharedTable->RemoveIpAddress(IpAddress, this->m_SharedWorker);
+        return;
+    }
+
+    bool found;
 
-    if (it != this->m_IpAddressInfo.end())
+    int slot = this->FindIpAddress(IpAddress, &found);
+
+    if (found == false || (--this->m_IpAddressInfo[slot].IpAddressCount) != 0)
     {
-        if ((--it->second.IpAddressCount) == 0)
+        return;
+    }
+
+    // Backward-shift deletion keeps every probe chain unbroken without tombstones
+    int hole = slot;
+    int next = (slot + 1) & (MAX_IP_ADDRESS_TABLE - 1);
+
+    while (this->m_IpAddressInfo[next].IpAddressCount != 0)
+    {
+        int home = this->GetHomeSlot(this->m_IpAddressInfo[next].IpAddress);
+
+        if (((next - home) & (MAX_IP_ADDRESS_TABLE - 1)) >= ((next - hole) & (MAX_IP_ADDRESS_TABLE - 1)))
         {
-            this->m_IpAddressInfo.erase(it);
+            this->m_IpAddressInfo[hole] = this->m_IpAddressInfo[next];
+            hole = next;
         }
+
+        next = (next + 1) & (MAX_IP_ADDRESS_TABLE - 1);
     }
+
+    memset(&this->m_IpAddressInfo[hole], 0, sizeof(this->m_IpAddressInfo[hole]));
 }
@@ -0,0 +1,84 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+uint64_t LatencyHistogram::bucket_floor(int bucket) {
+    if (bucket < 16) {
+        return (uint64_t)bucket;
+    }
+
+    int exponent = 4 + (bucket - 16) / (1 << LATENCY_SUB_BUCKET_BITS);
+    uint64_t sub = (uint64_t)((bucket - 16) % (1 << LATENCY_SUB_BUCKET_BITS));
+
+    return ((1ull << LATENCY_SUB_BUCKET_BITS) + sub) << (exponent - LATENCY_SUB_BUCKET_BITS);
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    uint64_t total = 0;
+
+    for (int n = 0; n < LATENCY_BUCKETS; n++) {
+        total += buckets_[n].load(std::memory_order_relaxed);
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(total * fraction);
+    uint64_t seen = 0;
+
+    for (int n = 0; n < LATENCY_BUCKETS - 1; n++) {
+        seen += buckets_[n].load(std::memory_order_relaxed);
+
+        if (seen > target) {
+            // Never report past the largest value actually seen
+            uint64_t edge = bucket_floor(n + 1) - 1;
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            return (edge < max) ? edge : max;
+        }
+    }
+
+    return max_.load(std::memory_order_relaxed);
+}
+
+LATENCY_SUMMARY LatencyHistogram::summary() const {
+    LATENCY_SUMMARY summary;
+    summary.count = count_.load(std::memory_order_relaxed);
+    summary.mean_ns = summary.count ? sum_.load(std::memory_order_relaxed) / summary.count : 0;
+    summary.p50_ns = percentile(0.50);
+    summary.p90_ns = percentile(0.90);
+    summary.p99_ns = percentile(0.99);
+    summary.p999_ns = percentile(0.999);
+    summary.max_ns = max_.load(std::memory_order_relaxed);
+    return summary;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int n = 0; n < LATENCY_BUCKETS; n++) {
+        uint64_t value = other.buckets_[n].load(std::memory_order_relaxed);
+
+        if (value != 0) {
+            buckets_[n].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+
+    count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    uint64_t max = other.max_.load(std::memory_order_relaxed);
+    uint64_t current = max_.load(std::memory_order_relaxed);
+    while (max > current && !max_.compare_exchange_weak(current, max, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (int n = 0; n < LATENCY_BUCKETS; n++) {
+        buckets_[n].store(0, std::memory_order_relaxed);
+    }
+
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
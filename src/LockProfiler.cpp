@@ -0,0 +1,163 @@
+#include "LockProfiler.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static LOCK_SITE g_lock_sites[MAX_LOCK_SITES];
+static std::atomic<int> g_lock_site_count{0};
+static std::mutex g_lock_site_mutex;    // Registration only; not profiled itself
+
+// Sites past the table share this one; it is not reported
+static LOCK_SITE g_lock_site_overflow;
+
+// TSC calibration: ticks and steady_clock ns at startup, compared at report
+static const uint64_t g_lock_start_ticks = ReadTimestampCounter();
+static const std::chrono::steady_clock::time_point g_lock_start_time = std::chrono::steady_clock::now();
+
+static double NanosecondsPerTick() {
+    uint64_t ticks = ReadTimestampCounter() - g_lock_start_ticks;
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - g_lock_start_time).count();
+
+    return (ticks > 0 && elapsed > 0) ? (double)elapsed / (double)ticks : 1.0;
+}
+
+// Upper bound of the bucket holding the given fraction of samples
+static uint64_t HistogramPercentile(const std::atomic<uint64_t>* histogram, double fraction, double ns_per_tick) {
+    uint64_t total = 0;
+
+    for (int n = 0; n < LOCK_HISTOGRAM_BUCKETS; n++) {
+        total += histogram[n].load(std::memory_order_relaxed);
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(total * fraction);
+    uint64_t seen = 0;
+
+    for (int n = 0; n < LOCK_HISTOGRAM_BUCKETS; n++) {
+        seen += histogram[n].load(std::memory_order_relaxed);
+
+        if (seen > target) {
+            return (uint64_t)((double)(2ull << n) * ns_per_tick);
+        }
+    }
+
+    return (uint64_t)((double)(2ull << (LOCK_HISTOGRAM_BUCKETS - 1)) * ns_per_tick);
+}
+
+static void ClearSite(LOCK_SITE* site) {
+    site->wait_ticks.store(0, std::memory_order_relaxed);
+    site->hold_ticks.store(0, std::memory_order_relaxed);
+    site->max_wait_ticks.store(0, std::memory_order_relaxed);
+    site->max_hold_ticks.store(0, std::memory_order_relaxed);
+    site->spin_wins.store(0, std::memory_order_relaxed);
+
+    for (int n = 0; n < LOCK_HISTOGRAM_BUCKETS; n++) {
+        site->wait_histogram[n].store(0, std::memory_order_relaxed);
+        site->hold_histogram[n].store(0, std::memory_order_relaxed);
+    }
+}
+
+LOCK_SITE* LockProfiler::site(const char* name) {
+    std::lock_guard<std::mutex> lock(g_lock_site_mutex);
+
+    int count = g_lock_site_count.load(std::memory_order_relaxed);
+
+    for (int n = 0; n < count; n++) {
+        if (strncmp(g_lock_sites[n].name, name, MAX_LOCK_SITE_NAME) == 0) {
+            return &g_lock_sites[n];
+        }
+    }
+
+    if (count == MAX_LOCK_SITES) {
+        if (g_lock_site_overflow.acquisitions == nullptr) {
+            g_lock_site_overflow.acquisitions = Metrics::get("lock.overflow.acquired");
+            g_lock_site_overflow.contended = Metrics::get("lock.overflow.contended");
+            g_lock_site_overflow.spin_budget.store(LOCK_SPIN_MIN, std::memory_order_relaxed);
+        }
+
+        LogAdd(1, "[LockProfiler] Site table full, '%s' not tracked", name);
+        return &g_lock_site_overflow;
+    }
+
+    LOCK_SITE* site = &g_lock_sites[count];
+    char metric[MAX_METRIC_NAME];
+
+    strncpy(site->name, name, MAX_LOCK_SITE_NAME - 1);
+    site->name[MAX_LOCK_SITE_NAME - 1] = '\0';
+
+    snprintf(metric, sizeof(metric), "lock.%s.acquired", site->name);
+    site->acquisitions = Metrics::get(metric);
+    snprintf(metric, sizeof(metric), "lock.%s.contended", site->name);
+    site->contended = Metrics::get(metric);
+
+    site->spin_budget.store(LOCK_SPIN_MIN * 4, std::memory_order_relaxed);
+    ClearSite(site);
+
+    g_lock_site_count.store(count + 1, std::memory_order_release);
+
+    return site;
+}
+
+int LockProfiler::snapshot(LOCK_SITE_STATS* stats, int max) {
+    int count = std::min(g_lock_site_count.load(std::memory_order_acquire), max);
+    double ns_per_tick = NanosecondsPerTick();
+
+    for (int n = 0; n < count; n++) {
+        LOCK_SITE* site = &g_lock_sites[n];
+        LOCK_SITE_STATS& entry = stats[n];
+
+        entry.name = site->name;
+        entry.acquisitions = (uint64_t)site->acquisitions->load(std::memory_order_relaxed);
+        entry.contended = (uint64_t)site->contended->load(std::memory_order_relaxed);
+        entry.spin_wins = site->spin_wins.load(std::memory_order_relaxed);
+        entry.wait_ns = (uint64_t)(site->wait_ticks.load(std::memory_order_relaxed) * ns_per_tick);
+        entry.hold_ns = (uint64_t)(site->hold_ticks.load(std::memory_order_relaxed) * ns_per_tick);
+        entry.max_wait_ns = (uint64_t)(site->max_wait_ticks.load(std::memory_order_relaxed) * ns_per_tick);
+        entry.max_hold_ns = (uint64_t)(site->max_hold_ticks.load(std::memory_order_relaxed) * ns_per_tick);
+        entry.wait_p50_ns = HistogramPercentile(site->wait_histogram, 0.50, ns_per_tick);
+        entry.wait_p99_ns = HistogramPercentile(site->wait_histogram, 0.99, ns_per_tick);
+        entry.hold_p50_ns = HistogramPercentile(site->hold_histogram, 0.50, ns_per_tick);
+        entry.hold_p99_ns = HistogramPercentile(site->hold_histogram, 0.99, ns_per_tick);
+    }
+
+    std::sort(stats, stats + count, [](const LOCK_SITE_STATS& a, const LOCK_SITE_STATS& b) {
+        return a.wait_ns > b.wait_ns;
+    });
+
+    return count;
+}
+
+void LockProfiler::report() {
+    LOCK_SITE_STATS stats[MAX_LOCK_SITES];
+    int count = snapshot(stats, MAX_LOCK_SITES);
+
+    LogAdd(3, "[LockProfiler] %d lock site(s) by total wait; wait/hold p50 p99 max in us", count);
+
+    for (int n = 0; n < count; n++) {
+        const LOCK_SITE_STATS& entry = stats[n];
+        double contended = entry.acquisitions ? 100.0 * entry.contended / entry.acquisitions : 0.0;
+
+        LogAdd(0, "[LockProfiler] %-26s acq %llu, contended %llu (%.2f%%, %llu spun), wait %.1f ms "
+                  "[%.1f %.1f %.1f], hold %.1f ms [%.1f %.1f %.1f]",
+               entry.name, (unsigned long long)entry.acquisitions, (unsigned long long)entry.contended, contended,
+               (unsigned long long)entry.spin_wins, entry.wait_ns / 1e6, entry.wait_p50_ns / 1e3,
+               entry.wait_p99_ns / 1e3, entry.max_wait_ns / 1e3, entry.hold_ns / 1e6, entry.hold_p50_ns / 1e3,
+               entry.hold_p99_ns / 1e3, entry.max_hold_ns / 1e3);
+    }
+}
+
+void LockProfiler::reset() {
+    int count = g_lock_site_count.load(std::memory_order_acquire);
+
+    for (int n = 0; n < count; n++) {
+        g_lock_sites[n].acquisitions->store(0, std::memory_order_relaxed);
+        g_lock_sites[n].contended->store(0, std::memory_order_relaxed);
+        ClearSite(&g_lock_sites[n]);
+    }
+}
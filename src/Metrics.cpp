@@ -0,0 +1,65 @@
+#include "Metrics.h"
+#include "Util.h"
+#include <cstring>
+#include <mutex>
+
+static METRIC_INFO g_metrics[MAX_METRICS];
+static std::atomic<int> g_metric_count{0};
+static std::mutex g_metric_mutex;
+
+// Overflow sink so callers never get a null pointer
+static std::atomic<int64_t> g_metric_overflow{0};
+
+std::atomic<int64_t>* Metrics::get(const char* name) {
+    std::lock_guard<std::mutex> lock(g_metric_mutex);
+
+    int count = g_metric_count.load(std::memory_order_relaxed);
+
+    for (int n = 0; n < count; n++) {
+        if (strncmp(g_metrics[n].name, name, MAX_METRIC_NAME) == 0) {
+            return &g_metrics[n].value;
+        }
+    }
+
+    if (count == MAX_METRICS) {
+        LogAdd(1, "[Metrics] Metric table full, '%s' not registered", name);
+        return &g_metric_overflow;
+    }
+
+    strncpy(g_metrics[count].name, name, MAX_METRIC_NAME - 1);
+    g_metrics[count].name[MAX_METRIC_NAME - 1] = '\0';
+    g_metrics[count].value.store(0, std::memory_order_relaxed);
+
+    // Publish the entry only once it is fully written
+    g_metric_count.store(count + 1, std::memory_order_release);
+
+    return &g_metrics[count].value;
+}
+
+int Metrics::snapshot(const char** names, int64_t* values, int max) {
+    int count = g_metric_count.load(std::memory_order_acquire);
+
+    if (count > max) {
+        count = max;
+    }
+
+    for (int n = 0; n < count; n++) {
+        names[n] = g_metrics[n].name;
+        values[n] = g_metrics[n].value.load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void Metrics::report() {
+    const char* names[MAX_METRICS];
+    int64_t values[MAX_METRICS];
+
+    int count = snapshot(names, values, MAX_METRICS);
+
+    LogAdd(3, "[Metrics] %d metric(s)", count);
+
+    for (int n = 0; n < count; n++) {
+        LogAdd(0, "[Metrics] %-40s %lld", names[n], (long long)values[n]);
+    }
+}
@@ -1,14 +1,14 @@
 #include "Queue.h"
 #include <chrono>
 
-CQueue::CQueue() {
+CQueue::CQueue() : m_mutex("CQueue") {
 }
 
 CQueue::~CQueue() {
 }
 
 void CQueue::ClearQueue() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<ProfiledMutex> lock(m_mutex);
     
     // Clear the queue by swapping with empty queue
     std::queue<QUEUE_INFO> empty;
@@ -16,12 +16,12 @@ void CQueue::ClearQueue() {
 }
 
 uint32_t CQueue::GetQueueSize() const {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<ProfiledMutex> lock(m_mutex);
     return static_cast<uint32_t>(m_queue.size());
 }
 
 bool CQueue::AddToQueue(const QUEUE_INFO& info) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<ProfiledMutex> lock(m_mutex);
     
     // Check if queue is full
     if (m_queue.size() >= MAX_QUEUE_SIZE) {
@@ -38,7 +38,7 @@ bool CQueue::AddToQueue(const QUEUE_INFO& info) {
 }
 
 bool CQueue::GetFromQueue(QUEUE_INFO& info, int timeout_ms) {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    std::unique_lock<ProfiledMutex> lock(m_mutex);
     
     if (timeout_ms < 0) {
         // Infinite wait
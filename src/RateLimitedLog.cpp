@@ -0,0 +1,127 @@
+#include "RateLimitedLog.h"
+#include "Metrics.h"
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+struct LOG_LIMIT
+{
+    char Prefix[MAX_LOG_PREFIX];
+    uint32_t PerSecond;
+};
+
+static LOG_LIMIT g_log_limits[MAX_LOG_LIMITS];
+static int g_log_limit_count = 0;
+static uint32_t g_log_limit_default = LOG_LIMIT_DEFAULT;
+static std::mutex g_log_limit_mutex;
+
+// Sites are pushed once and never removed (they are function statics)
+static std::atomic<LOG_SITE*> g_log_sites{nullptr};
+
+static std::chrono::steady_clock::time_point g_log_window_start = std::chrono::steady_clock::now();
+
+// "[ClientSession] ..." -> "ClientSession"; false without a prefix
+static bool FormatPrefix(const char* format, char* prefix, size_t size) {
+    if (format[0] != '[') {
+        return false;
+    }
+
+    const char* end = strchr(format, ']');
+
+    if (end == nullptr || (size_t)(end - format - 1) >= size) {
+        return false;
+    }
+
+    memcpy(prefix, format + 1, end - format - 1);
+    prefix[end - format - 1] = '\0';
+    return true;
+}
+
+void RateLimitedLog::set_limit(const char* prefix, uint32_t per_second) {
+    std::lock_guard<std::mutex> lock(g_log_limit_mutex);
+
+    if (prefix[0] == '\0') {
+        g_log_limit_default = per_second;
+        return;
+    }
+
+    for (int n = 0; n < g_log_limit_count; n++) {
+        if (strcmp(g_log_limits[n].Prefix, prefix) == 0) {
+            g_log_limits[n].PerSecond = per_second;
+            return;
+        }
+    }
+
+    if (g_log_limit_count < MAX_LOG_LIMITS && strlen(prefix) < MAX_LOG_PREFIX) {
+        strcpy(g_log_limits[g_log_limit_count].Prefix, prefix);
+        g_log_limits[g_log_limit_count].PerSecond = per_second;
+        g_log_limit_count++;
+    }
+}
+
+void RateLimitedLog::open_window(LOG_SITE* site) {
+    int linked = 0;
+
+    if (site->Linked.load(std::memory_order_acquire) == 0 &&
+        site->Linked.compare_exchange_strong(linked, 1, std::memory_order_acq_rel)) {
+        LOG_SITE* head = g_log_sites.load(std::memory_order_relaxed);
+
+        do {
+            site->Next = head;
+        } while (!g_log_sites.compare_exchange_weak(head, site, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Looked up again every window, so limit changes apply within a second
+    char prefix[MAX_LOG_PREFIX];
+    uint32_t limit;
+
+    {
+        std::lock_guard<std::mutex> lock(g_log_limit_mutex);
+        limit = g_log_limit_default;
+
+        if (FormatPrefix(site->Format, prefix, sizeof(prefix))) {
+            for (int n = 0; n < g_log_limit_count; n++) {
+                if (strcmp(g_log_limits[n].Prefix, prefix) == 0) {
+                    limit = g_log_limits[n].PerSecond;
+                    break;
+                }
+            }
+        }
+    }
+
+    site->Limit.store(limit, std::memory_order_relaxed);
+}
+
+void RateLimitedLog::flush() {
+    static std::atomic<int64_t>* suppressed_metric = Metrics::get("log.suppressed");
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - g_log_window_start).count();
+    g_log_window_start = now;
+
+    for (LOG_SITE* site = g_log_sites.load(std::memory_order_acquire); site != nullptr; site = site->Next) {
+        uint32_t count = site->Count.exchange(0, std::memory_order_relaxed);
+        uint32_t limit = site->Limit.load(std::memory_order_relaxed);
+
+        if (count <= limit) {
+            continue;
+        }
+
+        uint32_t suppressed = count - limit;
+        suppressed_metric->fetch_add(suppressed, std::memory_order_relaxed);
+
+        char prefix[MAX_LOG_PREFIX];
+        const char* text = site->Format;
+        const char* file = strrchr(site->File, '/');
+
+        if (FormatPrefix(site->Format, prefix, sizeof(prefix))) {
+            text = strchr(site->Format, ']') + 1;
+            text += (*text == ' ') ? 1 : 0;
+        } else {
+            strcpy(prefix, "Log");
+        }
+
+        LogAdd(site->Color, "[%s] Suppressed %u similar message(s) in %.1f s (%s:%d): %s", prefix, suppressed,
+               seconds, file != nullptr ? file + 1 : site->File, site->Line, text);
+    }
+}
@@ -0,0 +1,127 @@
+#include "ReceiveTimestamps.h"
+#include "Util.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
+static std::atomic<bool> g_receive_timestamps{false};
+static LatencyHistogram g_receive_histograms[RECEIVE_HISTOGRAMS];
+
+static const char* const g_receive_histogram_names[RECEIVE_HISTOGRAMS] = {
+    "tcp queue", "tcp service", "udp queue", "udp service",
+};
+
+void ReceiveTimestamps::set_enabled(bool enabled) {
+    g_receive_timestamps.store(enabled, std::memory_order_relaxed);
+}
+
+bool ReceiveTimestamps::enabled() {
+    return g_receive_timestamps.load(std::memory_order_relaxed);
+}
+
+bool ReceiveTimestamps::enable_socket(int fd) {
+#ifdef __linux__
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+#else
+    return false;
+#endif
+}
+
+long ReceiveTimestamps::receive(int fd, void* data, size_t size, sockaddr* from, unsigned int* from_size,
+                                uint64_t* kernel_ns) {
+    *kernel_ns = 0;
+
+#ifdef __linux__
+    iovec vector;
+    vector.iov_base = data;
+    vector.iov_len = size;
+
+    // Room for one SCM_TIMESTAMPNS control message
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))];
+
+    msghdr message = {};
+    message.msg_name = from;
+    message.msg_namelen = (from_size != nullptr) ? *from_size : 0;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t bytes = recvmsg(fd, &message, MSG_DONTWAIT);
+
+    if (bytes < 0) {
+        return -1;
+    }
+
+    if (from_size != nullptr) {
+        *from_size = message.msg_namelen;
+    }
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec stamp;
+            memcpy(&stamp, CMSG_DATA(header), sizeof(stamp));
+            *kernel_ns = (uint64_t)stamp.tv_sec * 1000000000ull + (uint64_t)stamp.tv_nsec;
+        }
+    }
+
+    return (long)bytes;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+uint64_t ReceiveTimestamps::realtime_ns() {
+#ifdef __linux__
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint64_t ReceiveTimestamps::monotonic_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t ReceiveTimestamps::queue_delay(uint64_t kernel_ns) {
+    uint64_t now = realtime_ns();
+
+    // A wall clock step backwards must not read as an 584-year wait
+    return (kernel_ns != 0 && now > kernel_ns) ? now - kernel_ns : 0;
+}
+
+LatencyHistogram& ReceiveTimestamps::histogram(int which) {
+    return g_receive_histograms[which];
+}
+
+void ReceiveTimestamps::report() {
+    LogAdd(3, "[ReceiveTimestamps] Receive timestamps %s; per request, in us: p50 p90 p99 p99.9 max",
+           enabled() ? "on" : "off");
+
+    for (int n = 0; n < RECEIVE_HISTOGRAMS; n++) {
+        LATENCY_SUMMARY summary = g_receive_histograms[n].summary();
+
+        LogAdd(0, "[ReceiveTimestamps] %-11s %10llu req, mean %.1f [%.1f %.1f %.1f %.1f %.1f]",
+               g_receive_histogram_names[n], (unsigned long long)summary.count, summary.mean_ns / 1e3,
+               summary.p50_ns / 1e3, summary.p90_ns / 1e3, summary.p99_ns / 1e3, summary.p999_ns / 1e3,
+               summary.max_ns / 1e3);
+    }
+}
+
+void ReceiveTimestamps::reset() {
+    for (int n = 0; n < RECEIVE_HISTOGRAMS; n++) {
+        g_receive_histograms[n].reset();
+    }
+}
@@ -0,0 +1,62 @@
+#include "RecordRing.h"
+#include <cstring>
+
+static constexpr size_t MIN_RING_SIZE = 64 * 1024;
+
+RecordRing::RecordRing()
+    : capacity_(0)
+    , head_(0)
+    , tail_(0)
+{
+}
+
+void RecordRing::allocate(size_t size) {
+    if (ring_ != nullptr) {
+        return;
+    }
+
+    capacity_ = MIN_RING_SIZE;
+
+    while (capacity_ < size) {
+        capacity_ <<= 1;
+    }
+
+    ring_.reset(new uint8_t[capacity_]());
+}
+
+uint8_t* RecordRing::reserve(size_t size) {
+    size_t need = slot_size(size);
+
+    if (size == 0 || need > capacity_ / 2) {
+        return nullptr;
+    }
+
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    size_t offset;
+    size_t total;
+
+    do {
+        offset = (size_t)(head & (capacity_ - 1));
+        total = (offset + need > capacity_) ? (capacity_ - offset) + need : need;
+
+        if (head + total - tail_.load(std::memory_order_acquire) > capacity_) {
+            return nullptr;
+        }
+    } while (!head_.compare_exchange_weak(head, head + total, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    if (total != need) {
+        SLOT* pad = reinterpret_cast<SLOT*>(ring_.get() + offset);
+        pad->Size = 0;
+        pad->Length.store((uint32_t)(capacity_ - offset), std::memory_order_release);
+        offset = 0;
+    }
+
+    return ring_.get() + offset + sizeof(SLOT);
+}
+
+void RecordRing::publish(uint8_t* record, size_t size) {
+    SLOT* slot = reinterpret_cast<SLOT*>(record - sizeof(SLOT));
+
+    slot->Size = (uint32_t)size;
+    slot->Length.store((uint32_t)slot_size(size), std::memory_order_release);
+}
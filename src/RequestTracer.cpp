@@ -0,0 +1,328 @@
+#include "RequestTracer.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Thread tables are allocated once per io thread and never freed; threads
+// past the table share the overflow one (its routes are claimed by CAS)
+static std::atomic<TRACE_THREAD*> g_trace_threads[MAX_TRACE_THREADS];
+static std::atomic<int> g_trace_thread_count{0};
+static TRACE_THREAD g_trace_overflow;
+
+static constexpr uint32_t TRACE_OTHER_KEY = 0xFFFFFFFF;
+
+static TRACE_CONFIG g_trace_config = {false, 0, 1, 10};
+
+static std::atomic<uint64_t> g_trace_slow_seen{0};
+static std::atomic<int64_t> g_trace_log_second{0};
+static std::atomic<uint32_t> g_trace_log_count{0};
+static std::atomic<uint64_t> g_trace_suppressed{0};
+
+static const char* const g_trace_stage_names[TRACE_STAGES] = {"dispatch", "handler", "write", "total"};
+
+static inline uint32_t RouteKey(uint8_t head, uint8_t subhead) {
+    return 0x10000u | ((uint32_t)head << 8) | subhead;
+}
+
+void RequestTracer::configure(const TRACE_CONFIG& config) {
+    g_trace_config = config;
+    g_trace_config.SlowSampleRate = std::max(1u, config.SlowSampleRate);
+    enabled_.store(config.Enabled, std::memory_order_relaxed);
+}
+
+TRACE_THREAD* RequestTracer::attach() {
+    int slot = g_trace_thread_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (slot >= MAX_TRACE_THREADS) {
+        g_trace_thread_count.store(MAX_TRACE_THREADS, std::memory_order_relaxed);
+        t_thread_ = &g_trace_overflow;
+        return t_thread_;
+    }
+
+    TRACE_THREAD* thread = new TRACE_THREAD();
+
+#ifdef _WIN32
+    thread->ThreadId = (uint32_t)GetCurrentThreadId();
+#else
+    thread->ThreadId = (uint32_t)syscall(SYS_gettid);
+#endif
+
+    g_trace_threads[slot].store(thread, std::memory_order_release);
+    t_thread_ = thread;
+    return thread;
+}
+
+LatencyHistogram* RequestTracer::route(uint8_t head, uint8_t subhead) {
+    TRACE_THREAD* thread = t_thread_ != nullptr ? t_thread_ : attach();
+    uint32_t key = RouteKey(head, subhead);
+
+    for (int n = 0; n < MAX_TRACE_ROUTES; n++) {
+        TRACE_ROUTE& route = thread->Routes[n];
+        uint32_t current = route.Key.load(std::memory_order_acquire);
+
+        if (current == 0) {
+            // Claim a free slot; the last one is the catch-all
+            uint32_t claim = (n == MAX_TRACE_ROUTES - 1) ? TRACE_OTHER_KEY : key;
+
+            if (route.Key.compare_exchange_strong(current, claim, std::memory_order_acq_rel)) {
+                route.Histograms.store(new TRACE_ROUTE_HISTOGRAMS(), std::memory_order_release);
+                current = claim;
+            }
+        }
+
+        if (current == key || current == TRACE_OTHER_KEY) {
+            TRACE_ROUTE_HISTOGRAMS* histograms = route.Histograms.load(std::memory_order_acquire);
+
+            // Another thread sharing the overflow table is still allocating
+            return (histograms != nullptr) ? histograms->Stages : nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+void RequestTracer::finish(const REQUEST_TRACE& trace, int session) {
+    uint64_t enqueued = (trace.Enqueued != 0) ? trace.Enqueued : trace.HandlerDone;
+    uint64_t stages[TRACE_STAGES];
+
+    stages[TRACE_DISPATCH] = trace.HandlerStart - trace.Frame;
+    stages[TRACE_HANDLER] = enqueued - trace.HandlerStart;
+    stages[TRACE_WRITE] = (trace.Written > enqueued) ? trace.Written - enqueued : 0;
+    stages[TRACE_TOTAL] = trace.Written - trace.Frame;
+
+    LatencyHistogram* histograms = route(trace.Head, trace.Subhead);
+
+    if (histograms != nullptr) {
+        for (int n = 0; n < TRACE_STAGES; n++) {
+            histograms[n].record(stages[n]);
+        }
+    }
+
+    if (g_trace_config.SlowRequestNs != 0 && stages[TRACE_TOTAL] >= g_trace_config.SlowRequestNs) {
+        log_slow(trace, session, stages);
+    }
+}
+
+void RequestTracer::log_slow(const REQUEST_TRACE& trace, int session, const uint64_t* stages) {
+    static std::atomic<int64_t>* slow = Metrics::get("trace.slow");
+    slow->fetch_add(1, std::memory_order_relaxed);
+
+    if (g_trace_slow_seen.fetch_add(1, std::memory_order_relaxed) % g_trace_config.SlowSampleRate != 0) {
+        return;
+    }
+
+    // Fixed one-second windows; the first line of a window resets the budget
+    int64_t second = (int64_t)(trace.Written / 1000000000ull);
+    int64_t window = g_trace_log_second.load(std::memory_order_relaxed);
+
+    if (second != window && g_trace_log_second.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        g_trace_log_count.store(0, std::memory_order_relaxed);
+    }
+
+    if (g_trace_log_count.fetch_add(1, std::memory_order_relaxed) >= g_trace_config.SlowLogPerSecond) {
+        g_trace_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t suppressed = g_trace_suppressed.exchange(0, std::memory_order_relaxed);
+    char held_back[48] = "";
+
+    if (suppressed != 0) {
+        snprintf(held_back, sizeof(held_back), ", %llu more not logged", (unsigned long long)suppressed);
+    }
+
+    LogAdd(1, "[RequestTracer] Slow request: Index=%d, %02X:%02X, %u bytes, total %.3f ms "
+              "(dispatch %.3f, handler %.3f, write %.3f)%s",
+           session, trace.Head, trace.Subhead, trace.Size, stages[TRACE_TOTAL] / 1e6, stages[TRACE_DISPATCH] / 1e6,
+           stages[TRACE_HANDLER] / 1e6, stages[TRACE_WRITE] / 1e6, held_back);
+}
+
+int RequestTracer::snapshot_routes(TRACE_ROUTE_STATS* stats, int max) {
+    // Merge by key into scratch histograms; one per distinct route
+    static constexpr int MAX_MERGED = MAX_TRACE_ROUTES * 4;
+    std::unique_ptr<TRACE_ROUTE_HISTOGRAMS[]> merged(new TRACE_ROUTE_HISTOGRAMS[MAX_MERGED]);
+    uint32_t keys[MAX_MERGED];
+    int count = 0;
+
+    int threads = std::min(g_trace_thread_count.load(std::memory_order_acquire), MAX_TRACE_THREADS);
+
+    for (int t = 0; t <= threads; t++) {
+        TRACE_THREAD* thread = (t < threads) ? g_trace_threads[t].load(std::memory_order_acquire) : &g_trace_overflow;
+
+        if (thread == nullptr) {
+            continue;
+        }
+
+        for (int n = 0; n < MAX_TRACE_ROUTES; n++) {
+            uint32_t key = thread->Routes[n].Key.load(std::memory_order_acquire);
+            TRACE_ROUTE_HISTOGRAMS* histograms = thread->Routes[n].Histograms.load(std::memory_order_acquire);
+
+            if (key == 0 || histograms == nullptr) {
+                continue;
+            }
+
+            int slot = 0;
+            while (slot < count && keys[slot] != key) {
+                slot++;
+            }
+
+            if (slot == count) {
+                if (count == MAX_MERGED) {
+                    continue;
+                }
+                keys[count++] = key;
+            }
+
+            for (int s = 0; s < TRACE_STAGES; s++) {
+                merged[slot].Stages[s].merge(histograms->Stages[s]);
+            }
+        }
+    }
+
+    int written = std::min(count, max);
+    std::vector<int> order(count);
+
+    for (int n = 0; n < count; n++) {
+        order[n] = n;
+    }
+
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return merged[a].Stages[TRACE_TOTAL].count() > merged[b].Stages[TRACE_TOTAL].count();
+    });
+
+    for (int n = 0; n < written; n++) {
+        uint32_t key = keys[order[n]];
+
+        stats[n].Other = (key == TRACE_OTHER_KEY);
+        stats[n].Head = stats[n].Other ? 0 : (uint8_t)(key >> 8);
+        stats[n].Subhead = stats[n].Other ? 0 : (uint8_t)key;
+
+        for (int s = 0; s < TRACE_STAGES; s++) {
+            stats[n].Stages[s] = merged[order[n]].Stages[s].summary();
+        }
+    }
+
+    return written;
+}
+
+bool RequestTracer::thread_total(int index, uint32_t* thread_id, LATENCY_SUMMARY* total) {
+    int threads = std::min(g_trace_thread_count.load(std::memory_order_acquire), MAX_TRACE_THREADS);
+    TRACE_THREAD* thread = (index < threads) ? g_trace_threads[index].load(std::memory_order_acquire) : nullptr;
+
+    if (thread == nullptr) {
+        return false;
+    }
+
+    std::unique_ptr<LatencyHistogram> merged(new LatencyHistogram());
+
+    for (int n = 0; n < MAX_TRACE_ROUTES; n++) {
+        TRACE_ROUTE_HISTOGRAMS* histograms = thread->Routes[n].Histograms.load(std::memory_order_acquire);
+
+        if (histograms != nullptr) {
+            merged->merge(histograms->Stages[TRACE_TOTAL]);
+        }
+    }
+
+    *thread_id = thread->ThreadId;
+    *total = merged->summary();
+    return true;
+}
+
+void RequestTracer::report() {
+    TRACE_ROUTE_STATS stats[MAX_TRACE_ROUTES * 4];
+    int count = snapshot_routes(stats, MAX_TRACE_ROUTES * 4);
+
+    LogAdd(3, "[RequestTracer] Tracing %s; %d route(s), per stage p50 p99 p99.9 max in us",
+           enabled() ? "on" : "off", count);
+
+    for (int n = 0; n < count; n++) {
+        const TRACE_ROUTE_STATS& route = stats[n];
+        char name[8];
+
+        if (route.Other) {
+            snprintf(name, sizeof(name), "other");
+        } else {
+            snprintf(name, sizeof(name), "%02X:%02X", route.Head, route.Subhead);
+        }
+
+        LogAdd(0, "[RequestTracer] %-5s %10llu req", name, (unsigned long long)route.Stages[TRACE_TOTAL].count);
+
+        for (int s = 0; s < TRACE_STAGES; s++) {
+            const LATENCY_SUMMARY& stage = route.Stages[s];
+
+            LogAdd(0, "[RequestTracer]   %-8s [%.1f %.1f %.1f %.1f]", g_trace_stage_names[s], stage.p50_ns / 1e3,
+                   stage.p99_ns / 1e3, stage.p999_ns / 1e3, stage.max_ns / 1e3);
+        }
+    }
+
+    for (int t = 0; t < MAX_TRACE_THREADS; t++) {
+        uint32_t thread_id;
+        LATENCY_SUMMARY total;
+
+        if (!thread_total(t, &thread_id, &total)) {
+            break;
+        }
+
+        LogAdd(0, "[RequestTracer] thread %-7u %10llu req, total [%.1f %.1f %.1f %.1f]", thread_id,
+               (unsigned long long)total.count, total.p50_ns / 1e3, total.p99_ns / 1e3, total.p999_ns / 1e3,
+               total.max_ns / 1e3);
+    }
+}
+
+void RequestTracer::publish() {
+    static std::atomic<int64_t>* requests = Metrics::get("trace.requests");
+    static std::atomic<int64_t>* p50 = Metrics::get("trace.total_p50_us");
+    static std::atomic<int64_t>* p99 = Metrics::get("trace.total_p99_us");
+    static std::atomic<int64_t>* p999 = Metrics::get("trace.total_p999_us");
+    static std::atomic<int64_t>* max = Metrics::get("trace.total_max_us");
+
+    std::unique_ptr<LatencyHistogram> merged(new LatencyHistogram());
+    int threads = std::min(g_trace_thread_count.load(std::memory_order_acquire), MAX_TRACE_THREADS);
+
+    for (int t = 0; t <= threads; t++) {
+        TRACE_THREAD* thread = (t < threads) ? g_trace_threads[t].load(std::memory_order_acquire) : &g_trace_overflow;
+
+        for (int n = 0; thread != nullptr && n < MAX_TRACE_ROUTES; n++) {
+            TRACE_ROUTE_HISTOGRAMS* histograms = thread->Routes[n].Histograms.load(std::memory_order_acquire);
+
+            if (histograms != nullptr) {
+                merged->merge(histograms->Stages[TRACE_TOTAL]);
+            }
+        }
+    }
+
+    LATENCY_SUMMARY total = merged->summary();
+
+    requests->store((int64_t)total.count, std::memory_order_relaxed);
+    p50->store((int64_t)(total.p50_ns / 1000), std::memory_order_relaxed);
+    p99->store((int64_t)(total.p99_ns / 1000), std::memory_order_relaxed);
+    p999->store((int64_t)(total.p999_ns / 1000), std::memory_order_relaxed);
+    max->store((int64_t)(total.max_ns / 1000), std::memory_order_relaxed);
+}
+
+void RequestTracer::reset() {
+    int threads = std::min(g_trace_thread_count.load(std::memory_order_acquire), MAX_TRACE_THREADS);
+
+    for (int t = 0; t <= threads; t++) {
+        TRACE_THREAD* thread = (t < threads) ? g_trace_threads[t].load(std::memory_order_acquire) : &g_trace_overflow;
+
+        for (int n = 0; thread != nullptr && n < MAX_TRACE_ROUTES; n++) {
+            TRACE_ROUTE_HISTOGRAMS* histograms = thread->Routes[n].Histograms.load(std::memory_order_acquire);
+
+            for (int s = 0; histograms != nullptr && s < TRACE_STAGES; s++) {
+                histograms->Stages[s].reset();
+            }
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#include "ServerCheckpoint.h"
+#include "Util.h"
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CServerCheckpoint gServerCheckpoint;
+
+static uint64_t GetWallTime()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+CServerCheckpoint::CServerCheckpoint()
+{
+    this->m_File = nullptr;
+    this->m_Handle = -1;
+}
+
+CServerCheckpoint::~CServerCheckpoint()
+{
+    this->Close();
+}
+
+bool CServerCheckpoint::Open(const char* path)
+{
+#ifdef _WIN32
+    LogAdd(1, "[ServerCheckpoint] Not supported on this platform (%s)", path);
+    return false;
+#else
+    this->Close();
+
+    int handle = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (handle == -1)
+    {
+        LogAdd(1, "[ServerCheckpoint] Could not open %s", path);
+        return false;
+    }
+
+    // A file of another size belongs to another layout; start it over
+    struct stat info;
+
+    if (fstat(handle, &info) != 0 || info.st_size != (off_t)sizeof(SERVER_CHECKPOINT_FILE))
+    {
+        if (ftruncate(handle, 0) != 0 || ftruncate(handle, sizeof(SERVER_CHECKPOINT_FILE)) != 0)
+        {
+            LogAdd(1, "[ServerCheckpoint] Could not size %s", path);
+            close(handle);
+            return false;
+        }
+    }
+
+    void* mapping = mmap(nullptr, sizeof(SERVER_CHECKPOINT_FILE), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        LogAdd(1, "[ServerCheckpoint] Could not map %s", path);
+        close(handle);
+        return false;
+    }
+
+    this->m_File = static_cast<SERVER_CHECKPOINT_FILE*>(mapping);
+    this->m_Handle = handle;
+
+    LogAdd(2, "[ServerCheckpoint] Checkpointing server state to %s", path);
+
+    return true;
+#endif
+}
+
+void CServerCheckpoint::Close()
+{
+#ifndef _WIN32
+    if (this->m_File != nullptr)
+    {
+        munmap(this->m_File, sizeof(SERVER_CHECKPOINT_FILE));
+        this->m_File = nullptr;
+    }
+
+    if (this->m_Handle != -1)
+    {
+        close(this->m_Handle);
+        this->m_Handle = -1;
+    }
+#endif
+}
+
+int CServerCheckpoint::Restore(CServerList* lpServerList)
+{
+    if (this->m_File == nullptr)
+    {
+        return 0;
+    }
+
+    SERVER_CHECKPOINT_FILE* lpFile = this->m_File;
+
+    uint32_t sequence = lpFile->Sequence.load(std::memory_order_acquire);
+
+    // Written by another layout, or the writer died halfway through a save
+    if (lpFile->Magic != SERVER_CHECKPOINT_MAGIC || lpFile->Version != SERVER_CHECKPOINT_VERSION ||
+        lpFile->EntrySize != sizeof(SERVER_LIVE_SNAPSHOT) || (sequence & 1) != 0 || lpFile->EntryCount > MAX_SERVER_LIST + 1)
+    {
+        LogAdd(1, "[ServerCheckpoint] No usable checkpoint, starting cold");
+        return 0;
+    }
+
+    std::vector<SERVER_LIVE_SNAPSHOT> snapshot(lpFile->Entry, lpFile->Entry + lpFile->EntryCount);
+
+    // Ages were taken at save time; add the time we were down
+    uint64_t now = GetWallTime();
+    uint64_t downtime = (now > lpFile->CheckpointTime) ? (now - lpFile->CheckpointTime) : 0;
+
+    for (SERVER_LIVE_SNAPSHOT& info : snapshot)
+    {
+        uint64_t age = info.HeartbeatAge + downtime;
+        info.HeartbeatAge = (age > UINT32_MAX) ? UINT32_MAX : (uint32_t)age;
+    }
+
+    int restored = lpServerList->ImportLiveSnapshot(snapshot.data(), (int)snapshot.size(), true);
+
+    LogAdd(2, "[ServerCheckpoint] Restored %d of %d server(s) from a checkpoint %llu ms old",
+           restored, (int)snapshot.size(), (unsigned long long)downtime);
+
+    return restored;
+}
+
+void CServerCheckpoint::Save(CServerList* lpServerList)
+{
+    if (this->m_File == nullptr)
+    {
+        return;
+    }
+
+    SERVER_CHECKPOINT_FILE* lpFile = this->m_File;
+
+    // Seqlock-style: an odd sequence marks the entries as being rewritten
+    uint32_t sequence = lpFile->Sequence.load(std::memory_order_relaxed) | 1;
+
+    lpFile->Sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    lpFile->Magic = SERVER_CHECKPOINT_MAGIC;
+    lpFile->Version = SERVER_CHECKPOINT_VERSION;
+    lpFile->EntrySize = sizeof(SERVER_LIVE_SNAPSHOT);
+    lpFile->EntryCount = lpServerList->ExportLiveSnapshot(lpFile->Entry, MAX_SERVER_LIST + 1);
+    lpFile->CheckpointTime = GetWallTime();
+
+    lpFile->Sequence.store(sequence + 1, std::memory_order_release);
+}
@@ -0,0 +1,249 @@
+#include "ServerCluster.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <cstring>
+#include <future>
+#include <sstream>
+
+ServerCluster* g_server_cluster = nullptr;
+
+ServerCluster::ServerCluster(boost::asio::io_context& io, CServerList& server_list)
+    : io_context_(io)
+    , server_list_(server_list)
+    , socket_(io)
+    , round_timer_(io)
+    , running_(false)
+    , port_(0)
+    , bytes_sent_(Metrics::get("cluster.bytes_sent"))
+    , bytes_received_(Metrics::get("cluster.bytes_received"))
+    , entries_merged_(Metrics::get("cluster.entries_merged"))
+    , convergence_ms_(Metrics::get("cluster.convergence_ms"))
+    , convergence_max_ms_(Metrics::get("cluster.convergence_max_ms"))
+{
+}
+
+ServerCluster::~ServerCluster() {
+    stop();
+}
+
+bool ServerCluster::parse_peers(const std::string& list, std::vector<boost::asio::ip::udp::endpoint>* peers) {
+    std::stringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+
+        if (item.empty()) {
+            continue;
+        }
+
+        size_t colon = item.rfind(':');
+        boost::system::error_code ec;
+
+        if (colon == std::string::npos) {
+            LogAdd(1, "[ServerCluster] Peer without port: %s", item.c_str());
+            return false;
+        }
+
+        auto address = boost::asio::ip::make_address(item.substr(0, colon), ec);
+        int port = atoi(item.c_str() + colon + 1);
+
+        if (ec || port <= 0 || port > 65535) {
+            LogAdd(1, "[ServerCluster] Invalid peer: %s", item.c_str());
+            return false;
+        }
+
+        peers->emplace_back(address, (uint16_t)port);
+    }
+
+    return true;
+}
+
+bool ServerCluster::start(const CLUSTER_CONFIG& config) {
+    try {
+        config_ = config;
+
+        boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::udp::v4(), config.Port);
+
+        // Reusable so a restart successor can bind while we are still draining
+        socket_.open(endpoint.protocol());
+        socket_.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+        socket_.bind(endpoint);
+        port_ = socket_.local_endpoint().port();
+
+        server_list_.SetClusterNode(config.NodeId);
+
+        running_ = true;
+        next_full_sync_ = std::chrono::steady_clock::now();
+
+        LogAdd(2, "[ServerCluster] Node %d gossiping on port %d with %zu peer(s)",
+               config.NodeId, port_, config.Peers.size());
+
+        start_receive();
+        schedule_round();
+
+        return true;
+
+    } catch (const std::exception& e) {
+        LogAdd(1, "[ServerCluster] Failed to start cluster node: %s", e.what());
+        return false;
+    }
+}
+
+void ServerCluster::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    // The timer and socket belong to the control plane, which may be running
+    // a round or re-arming a receive: close them there and wait. Nobody runs
+    // a stopped io_context, so there they are ours to close.
+    auto close = [this]() {
+        boost::system::error_code ec;
+        round_timer_.cancel();
+        socket_.close(ec);
+    };
+
+    if (io_context_.get_executor().running_in_this_thread() || io_context_.stopped()) {
+        close();
+    } else {
+        std::promise<void> closed;
+
+        boost::asio::post(io_context_, [&close, &closed]() {
+            close();
+            closed.set_value();
+        });
+
+        closed.get_future().wait();
+    }
+
+    LogAdd(2, "[ServerCluster] Cluster node stopped");
+}
+
+void ServerCluster::schedule_round() {
+    round_timer_.expires_after(std::chrono::milliseconds(config_.Interval));
+    round_timer_.async_wait([this](const boost::system::error_code& error) {
+        if (error || !running_) {
+            return;
+        }
+
+        run_round();
+        schedule_round();
+    });
+}
+
+void ServerCluster::run_round() {
+    auto now = std::chrono::steady_clock::now();
+    bool full_sync = (now >= next_full_sync_);
+
+    if (full_sync) {
+        next_full_sync_ = now + std::chrono::milliseconds(config_.FullSyncInterval);
+    }
+
+    int count = server_list_.ExportClusterEntries(entries_.data(), (int)entries_.size(), !full_sync);
+
+    if (count > 0) {
+        send_entries(count);
+    }
+}
+
+void ServerCluster::send_entries(int count) {
+    // Split into datagrams that fit MAX_UDP_PACKET_SIZE
+    for (int offset = 0; offset < count; offset += MAX_CLUSTER_GOSSIP_ENTRIES) {
+        int chunk = std::min(count - offset, MAX_CLUSTER_GOSSIP_ENTRIES);
+        size_t size = sizeof(SDHP_CLUSTER_GOSSIP) + chunk * sizeof(SERVER_CLUSTER_ENTRY);
+
+        SDHP_CLUSTER_GOSSIP head;
+        head.header.set(CLUSTER_GOSSIP_HEAD, (uint16_t)size);
+        head.NodeId = config_.NodeId;
+        head.Count = (uint16_t)chunk;
+        head.ClusterKey = config_.ClusterKey;
+
+        memcpy(send_buffer_.data(), &head, sizeof(head));
+        memcpy(send_buffer_.data() + sizeof(head), &entries_[offset], chunk * sizeof(SERVER_CLUSTER_ENTRY));
+
+        for (const auto& peer : config_.Peers) {
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(send_buffer_.data(), size), peer, 0, ec);
+
+            if (ec) {
+                LogAdd(1, "[ServerCluster] Send to peer failed: %s", ec.message().c_str());
+                continue;
+            }
+
+            bytes_sent_->fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ServerCluster::start_receive() {
+    if (!running_) {
+        return;
+    }
+
+    socket_.async_receive_from(
+        boost::asio::buffer(recv_buffer_.data(), recv_buffer_.size()),
+        remote_endpoint_,
+        [this](const boost::system::error_code& error, size_t bytes) {
+            handle_receive(error, bytes);
+        });
+}
+
+bool ServerCluster::is_peer(const boost::asio::ip::udp::endpoint& endpoint) const {
+    for (const auto& peer : config_.Peers) {
+        if (peer.address() == endpoint.address()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ServerCluster::handle_receive(const boost::system::error_code& error, size_t bytes) {
+    if (error) {
+        if (error != boost::asio::error::operation_aborted) {
+            LogAdd(1, "[ServerCluster] Receive error: %s", error.message().c_str());
+        }
+        if (running_) {
+            start_receive();
+        }
+        return;
+    }
+
+    bytes_received_->fetch_add(bytes, std::memory_order_relaxed);
+
+    SDHP_CLUSTER_GOSSIP head;
+
+    if (bytes < sizeof(head) || !is_peer(remote_endpoint_)) {
+        start_receive();
+        return;
+    }
+
+    memcpy(&head, recv_buffer_.data(), sizeof(head));
+
+    size_t size = MAKEWORD(head.header.size[1], head.header.size[0]);
+
+    if (head.header.type != 0xC2 || head.header.head != CLUSTER_GOSSIP_HEAD || size != bytes ||
+        head.ClusterKey != config_.ClusterKey || head.NodeId == config_.NodeId ||
+        head.Count > MAX_CLUSTER_GOSSIP_ENTRIES ||
+        bytes != sizeof(head) + head.Count * sizeof(SERVER_CLUSTER_ENTRY)) {
+        LogAdd(1, "[ServerCluster] Dropped invalid gossip datagram (%zu bytes)", bytes);
+        start_receive();
+        return;
+    }
+
+    // Entries follow the 12-byte head unaligned; copy them out
+    memcpy(entries_.data(), recv_buffer_.data() + sizeof(head), head.Count * sizeof(SERVER_CLUSTER_ENTRY));
+
+    uint32_t lag = 0;
+    int merged = server_list_.MergeClusterEntries(entries_.data(), head.Count, &lag);
+
+    if (merged > 0) {
+        entries_merged_->fetch_add(merged, std::memory_order_relaxed);
+        convergence_ms_->store(lag, std::memory_order_relaxed);
+        Metrics::update_max(convergence_max_ms_, lag);
+    }
+
+    start_receive();
+}
@@ -1,17 +1,46 @@
 #include "ServerList.h"
 #include "ConnectServerProtocol.h"
+#include "FlightRecorder.h"
+#include "Probes.h"
 #include "ReadScript.h"
+#include "SharedServerTable.h"
+#include "StatsReader.h"
 #include "Util.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 CServerList gServerList;
 
-CServerList::CServerList()
+CServerList::CServerList() : m_LivenessMutex("CServerList::liveness")
 {
     this->m_JoinServerState = false;
     this->m_JoinServerStateTime = 0;
     this->m_JoinServerQueueSize = 0;
-    this->m_ServerListInfo.clear();
+    this->m_ServerCount = 0;
+    this->m_VisibleCount = 0;
+
+    memset(this->m_ServerSlot, 0xFF, sizeof(this->m_ServerSlot));
+    memset(this->m_Deadline, 0, sizeof(this->m_Deadline));
+    memset(this->m_Provisional, 0, sizeof(this->m_Provisional));
+
+    this->m_ClusterNode = 0;
+    memset(this->m_ClusterVersion, 0, sizeof(this->m_ClusterVersion));
+    memset(this->m_ClusterOrigin, 0, sizeof(this->m_ClusterOrigin));
+    memset(this->m_ClusterChanged, 0, sizeof(this->m_ClusterChanged));
+
+    this->m_DetectorConfig.SuspectPhi = 3.0;
+    this->m_DetectorConfig.OfflinePhi = 8.0;
+    this->m_DetectorConfig.MinStdDeviation = 200;
+    this->m_DetectorConfig.AcceptablePause = 0;
+    this->m_DetectorConfig.FirstInterval = 1000;
+    this->m_DetectorConfig.MaxHeartbeatPause = SERVER_HEARTBEAT_TIMEOUT;
+
+    this->m_ShowOfflineServers = true;
+    this->m_SharedTable = nullptr;
+    this->m_LivenessContext = nullptr;
+    this->m_LivenessTimerDeadline = 0;
 }
 
 CServerList::~CServerList()
@@ -35,7 +64,11 @@ void CServerList::Load(const char* path)
         return;
     }
 
-    this->m_ServerListInfo.clear();
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    memset(this->m_ServerSlot, 0xFF, sizeof(this->m_ServerSlot));
+    this->m_ServerCount = 0;
+    this->m_VisibleCount = 0;
 
     try
     {
@@ -64,14 +97,42 @@ void CServerList::Load(const char* path)
 
             info.ServerShow = (strcmp(lpReadScript->GetAsString(), "SHOW") == 0);
 
-            info.ServerState = false;
-            info.ServerStateTime = 0;
-            info.UserTotal = 0;
-            info.UserCount = 0;
-            info.AccountCount = 0;
-            info.MaxUserCount = 0;
+            if (this->m_ServerSlot[info.ServerCode] != SERVER_SLOT_NONE)
+            {
+                LogAdd(1, "[ServerList] Duplicate ServerCode %d ignored", info.ServerCode);
+                continue;
+            }
+
+            if (this->m_ServerCount >= MAX_SERVER_LIST)
+            {
+                LogAdd(1, "[ServerList] More than %d servers, ServerCode %d ignored", MAX_SERVER_LIST, info.ServerCode);
+                continue;
+            }
+
+            int slot = this->m_ServerCount++;
+
+            this->m_ServerSlot[info.ServerCode] = slot;
+            this->m_ServerListInfo[slot] = info;
+
+            this->m_ServerState[slot] = 0;
+            this->m_ServerStateTime[slot] = 0;
+            this->m_UserTotal[slot] = 0;
+            this->m_UserCount[slot] = 0;
+            this->m_AccountCount[slot] = 0;
+            this->m_MaxUserCount[slot] = 0;
+            this->m_Provisional[slot] = false;
+
+            this->m_ClusterVersion[slot] = 0;
+            this->m_ClusterOrigin[slot] = 0;
+            this->m_ClusterChanged[slot] = false;
+
+            this->m_Detector[slot].Reset();
+            this->m_Deadline[slot] = 0;
 
-            this->m_ServerListInfo.insert(std::pair<int, SERVER_LIST_INFO>(info.ServerCode, info));
+            if (info.ServerShow != false)
+            {
+                this->m_VisibleSlot[this->m_VisibleCount++] = slot;
+            }
         }
     }
     catch (...)
@@ -81,33 +142,576 @@ void CServerList::Load(const char* path)
 
     delete lpReadScript;
 
-    LogAdd(3, "[ServerList] ServerList loaded successfully (%d servers)", 
-           static_cast<int>(this->m_ServerListInfo.size()));
+    // List replies go out in ServerCode order
+    std::sort(this->m_VisibleSlot, this->m_VisibleSlot + this->m_VisibleCount, [this](uint16_t a, uint16_t b)
+    {
+        return this->m_ServerListInfo[a].ServerCode < this->m_ServerListInfo[b].ServerCode;
+    });
+
+    if (this->m_SharedTable != nullptr)
+    {
+        this->m_SharedTable->PublishLayout(this->m_ServerListInfo, this->m_ServerCount, this->m_VisibleSlot, this->m_VisibleCount, this->m_ShowOfflineServers);
+    }
+
+    LogAdd(3, "[ServerList] ServerList loaded successfully (%d servers)", this->m_ServerCount);
 }
 
 void CServerList::MainProc()
 {
-    // Check JoinServer timeout (10 seconds)
-    if (this->m_JoinServerState != false && (GetTickCountCross() - this->m_JoinServerStateTime) > 10000)
+    // Backstop for setups without the liveness timer (tools, tests)
+    if (this->m_LivenessTimer == nullptr)
     {
-        this->m_JoinServerState = false;
-        this->m_JoinServerStateTime = 0;
-        LogAdd(1, "[ServerList] JoinServer offline");
+        this->ProcessDeadlines(GetTickCountCross());
     }
+}
 
-    // Check GameServer timeouts (10 seconds)
-    for (auto it = this->m_ServerListInfo.begin(); it != this->m_ServerListInfo.end(); it++)
+void CServerList::SetFailureDetectorConfig(const FAILURE_DETECTOR_CONFIG& config)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    this->m_DetectorConfig = config;
+}
+
+void CServerList::SetSharedTable(CSharedServerTable* lpTable)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    this->m_SharedTable = lpTable;
+
+    if (lpTable == nullptr)
     {
-        if (it->second.ServerState != false && (GetTickCountCross() - it->second.ServerStateTime) > 10000)
+        return;
+    }
+
+    lpTable->PublishLayout(this->m_ServerListInfo, this->m_ServerCount, this->m_VisibleSlot, this->m_VisibleCount, this->m_ShowOfflineServers);
+
+    for (int n = 0; n < this->m_ServerCount; n++)
+    {
+        lpTable->PublishSlot(n, this->m_ServerState[n], this->m_UserTotal[n]);
+    }
+}
+
+int CServerList::ExportStats(STATS_SERVER_ENTRY* lpEntry, int maxCount, uint8_t tenant)
+{
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    int count = 0;
+
+    for (int n = 0; n < this->m_ServerCount && count < maxCount; n++)
+    {
+        STATS_SERVER_ENTRY* lpInfo = &lpEntry[count++];
+
+        lpInfo->ServerCode = this->m_ServerListInfo[n].ServerCode;
+        lpInfo->Tenant = tenant;
+        lpInfo->State = this->m_ServerState[n];
+        lpInfo->Visible = (this->m_ServerListInfo[n].ServerShow != false);
+        lpInfo->UserTotal = this->m_UserTotal[n];
+        lpInfo->UserCount = this->m_UserCount[n];
+        lpInfo->MaxUserCount = this->m_MaxUserCount[n];
+        lpInfo->Reserved = 0;
+        lpInfo->HeartbeatAgeMs = (this->m_ServerStateTime[n] == 0) ? STATS_NO_HEARTBEAT : (now - this->m_Detector[n].GetLastHeartbeat());
+
+        memcpy(lpInfo->ServerName, this->m_ServerListInfo[n].ServerName, sizeof(lpInfo->ServerName));
+        lpInfo->ServerName[sizeof(lpInfo->ServerName) - 1] = '\0';
+    }
+
+    return count;
+}
+
+uint8_t CServerList::GetJoinServerStats(uint32_t* lpQueueSize)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    (*lpQueueSize) = this->m_JoinServerQueueSize;
+
+    return (this->m_JoinServerState != false) ? STATS_SERVER_ONLINE : STATS_SERVER_OFFLINE;
+}
+
+void CServerList::StartLivenessTimer(boost::asio::io_context& io)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    this->m_LivenessTimer = std::make_unique<boost::asio::steady_timer>(io);
+    this->m_LivenessContext = &io;
+    this->m_LivenessTimerDeadline = 0;
+
+    this->ScheduleLivenessTimer(GetTickCountCross());
+}
+
+void CServerList::StopLivenessTimer()
+{
+    // Nothing reschedules the timer once it is out of m_LivenessTimer
+    std::shared_ptr<boost::asio::steady_timer> timer;
+    boost::asio::io_context* lpContext;
+
+    {
+        std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+        timer = std::move(this->m_LivenessTimer);
+        lpContext = this->m_LivenessContext;
+        this->m_LivenessContext = nullptr;
+    }
+
+    if (timer == nullptr)
+    {
+        return;
+    }
+
+    // steady_timer is not thread-safe and a handler may be running on the
+    // control plane: cancel and destroy it there
+    if (lpContext->get_executor().running_in_this_thread())
+    {
+        timer->cancel();
+        return;
+    }
+
+    boost::asio::post(*lpContext, [timer]()
+    {
+        timer->cancel();
+    });
+}
+
+void CServerList::ScheduleLivenessTimer(uint32_t now)
+{
+    // Caller holds m_LivenessMutex
+    if (this->m_LivenessTimer == nullptr)
+    {
+        return;
+    }
+
+    // Earliest pending deadline across the configured servers; with a few
+    // hundred entries one linear pass is cheaper than maintaining a heap
+    uint32_t next = UINT32_MAX;
+
+    for (int index = 0; index <= this->m_ServerCount; index++)
+    {
+        int n = this->GetLivenessSlot(index);
+        uint32_t remaining = (uint32_t)(this->m_Deadline[n] - now);
+
+        if ((int32_t)remaining < 0)
         {
-            it->second.ServerState = false;
-            it->second.ServerStateTime = 0;
-            LogAdd(0, "[ServerList] GameServer offline (%s) (%d)", 
-                   it->second.ServerName, it->second.ServerCode);
+            remaining = 0;
         }
+
+        next = (this->m_Deadline[n] != 0 && remaining < next) ? remaining : next;
+    }
+
+    if (next == UINT32_MAX)
+    {
+        this->m_LivenessTimerDeadline = 0;
+        this->m_LivenessTimer->cancel();
+        return;
+    }
+
+    this->m_LivenessTimerDeadline = now + next;
+
+    this->m_LivenessTimer->expires_after(std::chrono::milliseconds(next));
+    this->m_LivenessTimer->async_wait([this](const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            return;
+        }
+
+        this->ProcessDeadlines(GetTickCountCross());
+    });
+}
+
+uint32_t CServerList::ProcessDeadlines(uint32_t now)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    uint32_t next = this->ProcessDeadlinesLocked(now);
+
+    this->ScheduleLivenessTimer(now);
+
+    return next;
+}
+
+uint32_t CServerList::ProcessDeadlinesLocked(uint32_t now)
+{
+    uint32_t next = 0;
+
+    for (int index = 0; index <= this->m_ServerCount; index++)
+    {
+        int n = this->GetLivenessSlot(index);
+
+        if (this->m_Deadline[n] == 0)
+        {
+            continue;
+        }
+
+        if ((int32_t)(now - this->m_Deadline[n]) >= 0)
+        {
+            double phi = this->m_Detector[n].GetPhi(now, this->m_DetectorConfig);
+            uint32_t elapsed = now - this->m_Detector[n].GetLastHeartbeat();
+
+            if (phi >= this->m_DetectorConfig.OfflinePhi || elapsed >= this->m_DetectorConfig.MaxHeartbeatPause)
+            {
+                this->SetLivenessState(n, SERVER_STATE_OFFLINE);
+            }
+            else if (phi >= this->m_DetectorConfig.SuspectPhi)
+            {
+                this->SetLivenessState(n, SERVER_STATE_SUSPECT);
+            }
+
+            // Rounding left the deadline just short of the threshold: look again shortly
+            if (this->m_Deadline[n] != 0 && (int32_t)(now - this->m_Deadline[n]) >= 0)
+            {
+                this->m_Deadline[n] = now + 1;
+            }
+        }
+
+        if (this->m_Deadline[n] != 0 && (next == 0 || (int32_t)(this->m_Deadline[n] - next) < 0))
+        {
+            next = this->m_Deadline[n];
+        }
+    }
+
+    return next;
+}
+
+void CServerList::UpdateDeadline(int slot, uint8_t state)
+{
+    // Next transition: online -> suspect -> offline, none once offline
+    uint32_t deadline = 0;
+
+    if (state == SERVER_STATE_ONLINE)
+    {
+        deadline = this->m_Detector[slot].GetDeadline(this->m_DetectorConfig.SuspectPhi, this->m_DetectorConfig);
+    }
+    else if (state == SERVER_STATE_SUSPECT)
+    {
+        deadline = this->m_Detector[slot].GetDeadline(this->m_DetectorConfig.OfflinePhi, this->m_DetectorConfig);
+    }
+
+    this->m_Deadline[slot] = (state != SERVER_STATE_OFFLINE && deadline == 0) ? 1 : deadline;
+}
+
+void CServerList::SetLivenessState(int slot, uint8_t state)
+{
+    uint8_t previous = (slot == JOIN_SERVER_SLOT)
+        ? (uint8_t)(this->m_JoinServerState ? SERVER_STATE_ONLINE : SERVER_STATE_OFFLINE)
+        : this->m_ServerState[slot];
+
+    this->UpdateDeadline(slot, state);
+
+    if (slot == JOIN_SERVER_SLOT)
+    {
+        // JoinServer has no suspect stage: it is either usable or not
+        if (state == SERVER_STATE_OFFLINE && previous != SERVER_STATE_OFFLINE)
+        {
+            this->m_JoinServerState = false;
+            this->m_JoinServerStateTime = 0;
+            LogAdd(1, "[ServerList] JoinServer offline");
+        }
+        return;
+    }
+
+    // Every heartbeat ends up here: the user count changes even when the state does not
+    if (this->m_SharedTable != nullptr)
+    {
+        this->m_SharedTable->PublishSlot(slot, state, this->m_UserTotal[slot]);
+    }
+
+    if (state == previous)
+    {
+        return;
+    }
+
+    this->m_ServerState[slot] = state;
+
+    CS_PROBE3(server__state, this->m_ServerListInfo[slot].ServerCode, previous, state);
+    FlightRecorder::record(FLIGHT_SERVER_STATE, this->m_ServerListInfo[slot].ServerCode, previous, state);
+
+    // Only the node that hears a server's heartbeats publishes its transitions
+    if (this->m_ClusterNode != 0 && this->m_ClusterOrigin[slot] == this->m_ClusterNode)
+    {
+        this->UpdateClusterVersion(slot);
+    }
+
+    if (state == SERVER_STATE_OFFLINE)
+    {
+        this->m_ServerStateTime[slot] = 0;
+        this->m_Provisional[slot] = false;
+        LogAdd(0, "[ServerList] GameServer offline (%s) (%d)", 
+               this->m_ServerListInfo[slot].ServerName, this->m_ServerListInfo[slot].ServerCode);
+    }
+    else if (state == SERVER_STATE_SUSPECT)
+    {
+        LogAdd(1, "[ServerList] GameServer suspect (%s) (%d)", 
+               this->m_ServerListInfo[slot].ServerName, this->m_ServerListInfo[slot].ServerCode);
+    }
+    else if (previous == SERVER_STATE_OFFLINE)
+    {
+        LogAdd(0, "[ServerList] GameServer online (%s) (%d)", 
+               this->m_ServerListInfo[slot].ServerName, this->m_ServerListInfo[slot].ServerCode);
+    }
+    else
+    {
+        LogAdd(0, "[ServerList] GameServer recovered (%s) (%d)", 
+               this->m_ServerListInfo[slot].ServerName, this->m_ServerListInfo[slot].ServerCode);
     }
 }
 
+int CServerList::ExportLiveSnapshot(SERVER_LIVE_SNAPSHOT* lpSnapshot, int maxCount)
+{
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    int count = 0;
+
+    for (int n = 0; n < this->m_ServerCount && count < maxCount; n++)
+    {
+        if (this->m_ServerState[n] == SERVER_STATE_OFFLINE)
+        {
+            continue;
+        }
+
+        SERVER_LIVE_SNAPSHOT* lpInfo = &lpSnapshot[count++];
+
+        lpInfo->ServerCode = this->m_ServerListInfo[n].ServerCode;
+        lpInfo->ServerState = this->m_ServerState[n];
+        lpInfo->UserTotal = this->m_UserTotal[n];
+        lpInfo->UserCount = this->m_UserCount[n];
+        lpInfo->AccountCount = this->m_AccountCount[n];
+        lpInfo->MaxUserCount = this->m_MaxUserCount[n];
+        lpInfo->QueueSize = 0;
+        lpInfo->HeartbeatAge = now - this->m_Detector[n].GetLastHeartbeat();
+        lpInfo->Detector = this->m_Detector[n];
+    }
+
+    if (this->m_JoinServerState != false && count < maxCount)
+    {
+        SERVER_LIVE_SNAPSHOT* lpInfo = &lpSnapshot[count++];
+
+        *lpInfo = SERVER_LIVE_SNAPSHOT();
+
+        lpInfo->ServerCode = JOIN_SERVER_SNAPSHOT_CODE;
+        lpInfo->ServerState = SERVER_STATE_ONLINE;
+        lpInfo->QueueSize = this->m_JoinServerQueueSize;
+        lpInfo->HeartbeatAge = now - this->m_Detector[JOIN_SERVER_SLOT].GetLastHeartbeat();
+        lpInfo->Detector = this->m_Detector[JOIN_SERVER_SLOT];
+    }
+
+    return count;
+}
+
+int CServerList::ImportLiveSnapshot(const SERVER_LIVE_SNAPSHOT* lpSnapshot, int count, bool provisional)
+{
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    int imported = 0;
+
+    for (int n = 0; n < count; n++)
+    {
+        const SERVER_LIVE_SNAPSHOT* lpInfo = &lpSnapshot[n];
+
+        // Anything past the hard limit would only be declared offline again
+        if (lpInfo->HeartbeatAge >= this->m_DetectorConfig.MaxHeartbeatPause)
+        {
+            continue;
+        }
+
+        int slot = (lpInfo->ServerCode == JOIN_SERVER_SNAPSHOT_CODE) ? JOIN_SERVER_SLOT : this->GetServerSlot(lpInfo->ServerCode);
+
+        if (slot == -1)
+        {
+            continue;
+        }
+
+        // Torn or corrupted state would index past the interval window
+        if (lpInfo->Detector.IsValid() == false)
+        {
+            LogAdd(1, "[ServerList] Dropping imported state of server %d: invalid failure detector", lpInfo->ServerCode);
+            continue;
+        }
+
+        // An unknown state would never reach a deadline branch and re-arm
+        // the liveness timer every millisecond
+        if (lpInfo->ServerState > SERVER_STATE_SUSPECT)
+        {
+            LogAdd(1, "[ServerList] Dropping imported state of server %d: invalid server state %d", lpInfo->ServerCode, lpInfo->ServerState);
+            continue;
+        }
+
+        this->m_Detector[slot] = lpInfo->Detector;
+        this->m_Detector[slot].SetLastHeartbeat(now - lpInfo->HeartbeatAge);
+
+        if (slot == JOIN_SERVER_SLOT)
+        {
+            this->m_JoinServerState = true;
+            this->m_JoinServerStateTime = now - lpInfo->HeartbeatAge;
+            this->m_JoinServerQueueSize = lpInfo->QueueSize;
+            this->UpdateDeadline(slot, SERVER_STATE_ONLINE);
+        }
+        else
+        {
+            this->m_ServerStateTime[slot] = now - lpInfo->HeartbeatAge;
+            this->m_UserTotal[slot] = lpInfo->UserTotal;
+            this->m_UserCount[slot] = lpInfo->UserCount;
+            this->m_AccountCount[slot] = lpInfo->AccountCount;
+            this->m_MaxUserCount[slot] = lpInfo->MaxUserCount;
+            this->m_Provisional[slot] = provisional;
+            this->SetLivenessState(slot, lpInfo->ServerState);
+        }
+
+        imported++;
+    }
+
+    this->ScheduleLivenessTimer(now);
+
+    LogAdd(2, "[ServerList] Imported live state of %d server(s)%s", imported, (provisional ? " (provisional)" : ""));
+
+    return imported;
+}
+
+bool CServerList::IsProvisional(int ServerCode)
+{
+    int slot = this->GetServerSlot(ServerCode);
+
+    return ((slot == -1) ? false : this->m_Provisional[slot]);
+}
+
+void CServerList::SetClusterNode(uint16_t NodeId)
+{
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    this->m_ClusterNode = NodeId;
+}
+
+void CServerList::UpdateClusterVersion(int slot)
+{
+    // Caller holds m_LivenessMutex; versions from one origin never repeat
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    this->m_ClusterVersion[slot] = std::max(now, this->m_ClusterVersion[slot] + 1);
+    this->m_ClusterChanged[slot] = true;
+}
+
+int CServerList::ExportClusterEntries(SERVER_CLUSTER_ENTRY* lpEntry, int maxCount, bool ChangedOnly)
+{
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    int count = 0;
+
+    for (int n = 0; n < this->m_ServerCount && count < maxCount; n++)
+    {
+        if (this->m_ClusterVersion[n] == 0 || (ChangedOnly != false && this->m_ClusterChanged[n] == false))
+        {
+            continue;
+        }
+
+        SERVER_CLUSTER_ENTRY* lpInfo = &lpEntry[count++];
+
+        lpInfo->Version = this->m_ClusterVersion[n];
+        lpInfo->ServerCode = this->m_ServerListInfo[n].ServerCode;
+        lpInfo->Origin = this->m_ClusterOrigin[n];
+        lpInfo->UserCount = this->m_UserCount[n];
+        lpInfo->AccountCount = this->m_AccountCount[n];
+        lpInfo->MaxUserCount = this->m_MaxUserCount[n];
+        lpInfo->ServerState = this->m_ServerState[n];
+        lpInfo->UserTotal = this->m_UserTotal[n];
+        lpInfo->HeartbeatAge = (this->m_ServerStateTime[n] == 0) ? 0 : (now - this->m_ServerStateTime[n]);
+
+        this->m_ClusterChanged[n] = false;
+    }
+
+    return count;
+}
+
+int CServerList::MergeClusterEntries(const SERVER_CLUSTER_ENTRY* lpEntry, int count, uint32_t* lpMaxLag)
+{
+    uint32_t now = GetTickCountCross();
+    uint64_t wall = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    int merged = 0;
+
+    (*lpMaxLag) = 0;
+
+    for (int n = 0; n < count; n++)
+    {
+        const SERVER_CLUSTER_ENTRY* lpInfo = &lpEntry[n];
+
+        int slot = this->GetServerSlot(lpInfo->ServerCode);
+
+        // A state we don't know would never reach a deadline branch and
+        // re-arm the liveness timer every millisecond
+        if (slot == -1 || lpInfo->ServerState > SERVER_STATE_SUSPECT)
+        {
+            continue;
+        }
+
+        // Last writer wins; ties go to the higher node id
+        if (lpInfo->Version < this->m_ClusterVersion[slot] ||
+            (lpInfo->Version == this->m_ClusterVersion[slot] && lpInfo->Origin <= this->m_ClusterOrigin[slot]))
+        {
+            continue;
+        }
+
+        this->m_ClusterVersion[slot] = lpInfo->Version;
+        this->m_ClusterOrigin[slot] = lpInfo->Origin;
+        this->m_ClusterChanged[slot] = false;
+
+        this->m_UserTotal[slot] = lpInfo->UserTotal;
+        this->m_UserCount[slot] = lpInfo->UserCount;
+        this->m_AccountCount[slot] = lpInfo->AccountCount;
+        this->m_MaxUserCount[slot] = lpInfo->MaxUserCount;
+
+        if (lpInfo->ServerState == SERVER_STATE_ONLINE)
+        {
+            // A relayed heartbeat feeds our detector at the time the origin heard it
+            uint64_t age = (wall > lpInfo->Version) ? (wall - lpInfo->Version) : 0;
+            age = std::min<uint64_t>(age + lpInfo->HeartbeatAge, this->m_DetectorConfig.MaxHeartbeatPause);
+
+            uint32_t heartbeat = now - (uint32_t)age;
+
+            if (this->m_ServerState[slot] == SERVER_STATE_OFFLINE)
+            {
+                this->m_Detector[slot].Reset();
+            }
+
+            if (this->m_ServerStateTime[slot] == 0 || (int32_t)(heartbeat - this->m_Detector[slot].GetLastHeartbeat()) > 0)
+            {
+                this->m_Detector[slot].Heartbeat(heartbeat);
+                this->m_ServerStateTime[slot] = heartbeat;
+            }
+        }
+
+        this->SetLivenessState(slot, lpInfo->ServerState);
+
+        // How long the change took to reach us from its origin
+        uint32_t lag = (uint32_t)std::min<uint64_t>((wall > lpInfo->Version) ? (wall - lpInfo->Version) : 0, UINT32_MAX);
+        (*lpMaxLag) = std::max((*lpMaxLag), lag);
+
+        merged++;
+    }
+
+    if (merged != 0)
+    {
+        this->ScheduleLivenessTimer(now);
+    }
+
+    return merged;
+}
+
+bool CServerList::CheckServerState(int ServerCode)
+{
+    // Suspect and offline servers are withheld from clients
+    return (this->m_ShowOfflineServers != false || this->GetServerState(ServerCode) == SERVER_STATE_ONLINE);
+}
+
 bool CServerList::CheckJoinServerState()
 {
     // TODO: For testing without JoinServer, always return true
@@ -129,78 +733,90 @@ bool CServerList::CheckJoinServerState()
     */
 }
 
-long CServerList::GenerateCustomServerList(uint8_t* lpMsg, int* size)
+long CServerList::GenerateCustomServerList(uint8_t* lpMsg, int* size, int maxSize)
 {
     int count = 0;
 
-    PMSG_CUSTOM_SERVER_LIST info;
-
     if (this->CheckJoinServerState() != 0)
     {
-        for (auto it = this->m_ServerListInfo.begin(); it != this->m_ServerListInfo.end(); it++)
+        for (int n = 0; n < this->m_VisibleCount && ((*size) + (int)PMSG_CUSTOM_SERVER_LIST::Size) <= maxSize; n++)
         {
-            // Temporarily show all servers marked as SHOW, even if offline (for testing)
-            // TODO: Re-enable ServerState check when GameServer is running
-            if (it->second.ServerShow != 0) // && it->second.ServerState != 0)
+            int slot = this->m_VisibleSlot[n];
+
+            // ShowOfflineServers keeps listing servers without a GameServer (testing)
+            if (this->m_ServerState[slot] != SERVER_STATE_ONLINE && this->m_ShowOfflineServers == false)
             {
-                info.ServerCode = it->second.ServerCode;
+                continue;
+            }
 
-                strncpy(info.ServerName, it->second.ServerName, sizeof(info.ServerName) - 1);
-                info.ServerName[sizeof(info.ServerName) - 1] = '\0';
+            uint8_t* lpEntry = &lpMsg[(*size)];
 
-                memcpy(&lpMsg[(*size)], &info, sizeof(info));
+            PMSG_CUSTOM_SERVER_LIST::ServerCode.put(lpEntry, this->m_ServerListInfo[slot].ServerCode);
+            PMSG_CUSTOM_SERVER_LIST::ServerName.put(lpEntry, this->m_ServerListInfo[slot].ServerName);
 
-                (*size) += sizeof(info);
+            (*size) += PMSG_CUSTOM_SERVER_LIST::Size;
 
-                count++;
-            }
+            count++;
         }
     }
 
     return count;
 }
 
-long CServerList::GenerateServerList(uint8_t* lpMsg, int* size)
+long CServerList::GenerateServerList(uint8_t* lpMsg, int* size, int maxSize)
 {
     int count = 0;
 
-    PMSG_SERVER_LIST info;
-
     if (this->CheckJoinServerState() != false)
     {
-        for (auto it = this->m_ServerListInfo.begin(); it != this->m_ServerListInfo.end(); it++)
+        for (int n = 0; n < this->m_VisibleCount && ((*size) + (int)PMSG_SERVER_LIST::Size) <= maxSize; n++)
         {
-            // Temporarily show all servers marked as SHOW, even if offline (for testing)
-            // TODO: Re-enable ServerState check when GameServer is running
-            if (it->second.ServerShow != false) // && it->second.ServerState != false)
+            int slot = this->m_VisibleSlot[n];
+
+            // ShowOfflineServers keeps listing servers without a GameServer (testing)
+            if (this->m_ServerState[slot] != SERVER_STATE_ONLINE && this->m_ShowOfflineServers == false)
             {
-                info.ServerCode = it->second.ServerCode;
-                info.UserTotal = it->second.UserTotal;
+                continue;
+            }
 
-                memcpy(&lpMsg[(*size)], &info, sizeof(info));
+            uint8_t* lpEntry = &lpMsg[(*size)];
 
-                (*size) += sizeof(info);
+            PMSG_SERVER_LIST::ServerCode.put(lpEntry, this->m_ServerListInfo[slot].ServerCode);
+            PMSG_SERVER_LIST::UserTotal.put(lpEntry, this->m_UserTotal[slot]);
 
-                count++;
-            }
+            (*size) += PMSG_SERVER_LIST::Size;
+
+            count++;
         }
     }
 
     return count;
 }
 
-SERVER_LIST_INFO* CServerList::GetServerListInfo(int ServerCode)
+int CServerList::GetServerSlot(int ServerCode)
 {
-    auto it = this->m_ServerListInfo.find(ServerCode);
-
-    if (it == this->m_ServerListInfo.end())
+    if (ServerCode < 0 || ServerCode >= MAX_SERVER_CODE)
     {
-        return nullptr;
-    }
-    else
-    {
-        return &it->second;
+        return -1;
     }
+
+    int slot = this->m_ServerSlot[ServerCode];
+
+    return ((slot == SERVER_SLOT_NONE) ? -1 : slot);
+}
+
+SERVER_LIST_INFO* CServerList::GetServerListInfo(int ServerCode)
+{
+    int slot = this->GetServerSlot(ServerCode);
+
+    return ((slot == -1) ? nullptr : &this->m_ServerListInfo[slot]);
+}
+
+uint8_t CServerList::GetServerState(int ServerCode)
+{
+    int slot = this->GetServerSlot(ServerCode);
+
+    return ((slot == -1) ? (uint8_t)SERVER_STATE_OFFLINE : this->m_ServerState[slot]);
 }
 
 void CServerList::ServerProtocolCore(uint8_t head, uint8_t* lpMsg, int size)
@@ -209,13 +825,37 @@ void CServerList::ServerProtocolCore(uint8_t head, uint8_t* lpMsg, int size)
     {
         case 0x01:
         {
-            this->GCGameServerLiveRecv((SDHP_GAME_SERVER_LIVE_RECV*)lpMsg);
+            if (!SDHP_GAME_SERVER_LIVE_WIRE::Header.fits(lpMsg, size, SDHP_GAME_SERVER_LIVE_WIRE::Size))
+            {
+                break;
+            }
+
+            SDHP_GAME_SERVER_LIVE_RECV pMsg;
+
+            pMsg.header.set(0x01, SDHP_GAME_SERVER_LIVE_WIRE::Size);
+            pMsg.ServerCode = SDHP_GAME_SERVER_LIVE_WIRE::ServerCode.get(lpMsg);
+            pMsg.UserTotal = SDHP_GAME_SERVER_LIVE_WIRE::UserTotal.get(lpMsg);
+            pMsg.UserCount = SDHP_GAME_SERVER_LIVE_WIRE::UserCount.get(lpMsg);
+            pMsg.AccountCount = SDHP_GAME_SERVER_LIVE_WIRE::AccountCount.get(lpMsg);
+            pMsg.MaxUserCount = SDHP_GAME_SERVER_LIVE_WIRE::MaxUserCount.get(lpMsg);
+
+            this->GCGameServerLiveRecv(&pMsg);
             break;
         }
 
         case 0x02:
         {
-            this->JCJoinServerLiveRecv((SDHP_JOIN_SERVER_LIVE_RECV*)lpMsg);
+            if (!SDHP_JOIN_SERVER_LIVE_WIRE::Header.fits(lpMsg, size, SDHP_JOIN_SERVER_LIVE_WIRE::Size))
+            {
+                break;
+            }
+
+            SDHP_JOIN_SERVER_LIVE_RECV pMsg;
+
+            pMsg.header.set(0x02, SDHP_JOIN_SERVER_LIVE_WIRE::Size);
+            pMsg.QueueSize = SDHP_JOIN_SERVER_LIVE_WIRE::QueueSize.get(lpMsg);
+
+            this->JCJoinServerLiveRecv(&pMsg);
             break;
         }
     }
@@ -223,35 +863,74 @@ void CServerList::ServerProtocolCore(uint8_t head, uint8_t* lpMsg, int size)
 
 void CServerList::GCGameServerLiveRecv(SDHP_GAME_SERVER_LIVE_RECV* lpMsg)
 {
-    SERVER_LIST_INFO* lpServerListInfo = this->GetServerListInfo(lpMsg->ServerCode);
+    int slot = this->GetServerSlot(lpMsg->ServerCode);
 
-    if (lpServerListInfo == nullptr)
+    if (slot == -1)
     {
         return;
     }
 
-    if (lpServerListInfo->ServerState == false)
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
+    // A server coming back from offline starts a fresh interval history
+    if (this->m_ServerState[slot] == SERVER_STATE_OFFLINE)
     {
-        LogAdd(0, "[ServerList] GameServer online (%s) (%d)", 
-               lpServerListInfo->ServerName, lpServerListInfo->ServerCode);
+        this->m_Detector[slot].Reset();
+    }
+
+    this->m_Detector[slot].Heartbeat(now);
+
+    this->m_ServerStateTime[slot] = now;
+    this->m_UserTotal[slot] = lpMsg->UserTotal;
+    this->m_UserCount[slot] = lpMsg->UserCount;
+    this->m_AccountCount[slot] = lpMsg->AccountCount;
+    this->m_MaxUserCount[slot] = lpMsg->MaxUserCount;
+
+    if (this->m_ClusterNode != 0)
+    {
+        this->m_ClusterOrigin[slot] = this->m_ClusterNode;
+        this->UpdateClusterVersion(slot);
+    }
+
+    if (this->m_Provisional[slot] != false)
+    {
+        this->m_Provisional[slot] = false;
+        LogAdd(0, "[ServerList] GameServer confirmed (%s) (%d)", 
+               this->m_ServerListInfo[slot].ServerName, this->m_ServerListInfo[slot].ServerCode);
     }
 
-    lpServerListInfo->ServerState = true;
-    lpServerListInfo->ServerStateTime = GetTickCountCross();
-    lpServerListInfo->UserTotal = lpMsg->UserTotal;
-    lpServerListInfo->UserCount = lpMsg->UserCount;
-    lpServerListInfo->AccountCount = lpMsg->AccountCount;
-    lpServerListInfo->MaxUserCount = lpMsg->MaxUserCount;
+    this->SetLivenessState(slot, SERVER_STATE_ONLINE);
+
+    if (this->m_LivenessTimerDeadline == 0 || (int32_t)(this->m_Deadline[slot] - this->m_LivenessTimerDeadline) < 0)
+    {
+        this->ScheduleLivenessTimer(now);
+    }
 }
 
 void CServerList::JCJoinServerLiveRecv(SDHP_JOIN_SERVER_LIVE_RECV* lpMsg)
 {
+    uint32_t now = GetTickCountCross();
+
+    std::lock_guard<ProfiledMutex> lock(this->m_LivenessMutex);
+
     if (this->m_JoinServerState == false)
     {
         LogAdd(2, "[ServerList] JoinServer online");
+        this->m_Detector[JOIN_SERVER_SLOT].Reset();
     }
 
+    this->m_Detector[JOIN_SERVER_SLOT].Heartbeat(now);
+
     this->m_JoinServerState = true;
-    this->m_JoinServerStateTime = GetTickCountCross();
+    this->m_JoinServerStateTime = now;
     this->m_JoinServerQueueSize = lpMsg->QueueSize;
+
+    this->UpdateDeadline(JOIN_SERVER_SLOT, SERVER_STATE_ONLINE);
+
+    if (this->m_LivenessTimerDeadline == 0 || (int32_t)(this->m_Deadline[JOIN_SERVER_SLOT] - this->m_LivenessTimerDeadline) < 0)
+    {
+        this->ScheduleLivenessTimer(now);
+    }
 }
@@ -0,0 +1,632 @@
+#include "SharedServerTable.h"
+#include "ConnectServerProtocol.h"
+#include "Util.h"
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CSharedServerTable* gSharedServerTable = nullptr;
+
+static int GetIpHomeSlot(const char* IpAddress)
+{
+    // FNV-1a over the dotted string, as CIpManager
+    uint32_t hash = 2166136261u;
+
+    for (int n = 0; n < 16 && IpAddress[n] != '\0'; n++)
+    {
+        hash = (hash ^ (uint8_t)IpAddress[n]) * 16777619u;
+    }
+
+    return hash & (MAX_IP_ADDRESS_TABLE - 1);
+}
+
+// Seqlock writer: odd while the guarded fields change
+static uint32_t BeginWrite(std::atomic<uint32_t>& sequence)
+{
+    uint32_t value = sequence.load(std::memory_order_relaxed) | 1;
+
+    sequence.store(value, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    return value;
+}
+
+static void EndWrite(std::atomic<uint32_t>& sequence, uint32_t value)
+{
+    sequence.store(value + 1, std::memory_order_release);
+}
+
+// Seqlock reader: an even sequence to read under, false if the writer did
+// not finish within the retries (or never will, having died mid-write)
+static bool BeginRead(const std::atomic<uint32_t>& sequence, uint32_t* lpValue)
+{
+    for (int n = 0; n < SHARED_TABLE_READ_RETRIES; n++)
+    {
+        uint32_t value = sequence.load(std::memory_order_acquire);
+
+        if ((value & 1) == 0)
+        {
+            (*lpValue) = value;
+            return true;
+        }
+
+        std::this_thread::yield();
+    }
+
+    return false;
+}
+
+static bool EndRead(const std::atomic<uint32_t>& sequence, uint32_t value)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return (sequence.load(std::memory_order_relaxed) == value);
+}
+
+CSharedServerTable::CSharedServerTable()
+{
+    this->m_Table = nullptr;
+    this->m_Handle = -1;
+}
+
+CSharedServerTable::~CSharedServerTable()
+{
+    this->Close();
+}
+
+bool CSharedServerTable::Create()
+{
+#if defined(__linux__)
+    this->Close();
+
+    // No MFD_CLOEXEC: the workers inherit it across exec
+    int handle = memfd_create("cs_server_table", 0);
+
+    if (handle == -1 || ftruncate(handle, sizeof(SHARED_SERVER_TABLE)) != 0)
+    {
+        LogAdd(1, "[SharedServerTable] Could not create the segment: %s", strerror(errno));
+
+        if (handle != -1)
+        {
+            close(handle);
+        }
+
+        return false;
+    }
+
+    if (this->Map(handle) == false)
+    {
+        return false;
+    }
+
+    // A fresh memfd reads as zeros: no servers, no addresses, no workers
+    this->m_Table->Magic = SHARED_SERVER_TABLE_MAGIC;
+    this->m_Table->Version = SHARED_SERVER_TABLE_VERSION;
+    memset(this->m_Table->ServerSlot, 0xFF, sizeof(this->m_Table->ServerSlot));
+
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&this->m_Table->IpMutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    LogAdd(2, "[SharedServerTable] Created %u KB shared segment (fd %d)", (uint32_t)(sizeof(SHARED_SERVER_TABLE) / 1024), handle);
+
+    return true;
+#else
+    LogAdd(1, "[SharedServerTable] Not supported on this platform");
+    return false;
+#endif
+}
+
+bool CSharedServerTable::Attach(int handle)
+{
+    if (this->Map(handle) == false)
+    {
+        return false;
+    }
+
+    // A supervisor of another build can lay out a segment of the same size
+    if (this->m_Table->Magic != SHARED_SERVER_TABLE_MAGIC || this->m_Table->Version != SHARED_SERVER_TABLE_VERSION)
+    {
+        LogAdd(1, "[SharedServerTable] fd %d holds an incompatible server table (version %u)", handle, this->m_Table->Version);
+
+#ifndef _WIN32
+        munmap(this->m_Table, sizeof(SHARED_SERVER_TABLE));
+#endif
+        this->m_Table = nullptr;
+        this->m_Handle = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool CSharedServerTable::Map(int handle)
+{
+#ifdef _WIN32
+    return false;
+#else
+    struct stat info;
+
+    if (fstat(handle, &info) != 0 || info.st_size != (off_t)sizeof(SHARED_SERVER_TABLE))
+    {
+        LogAdd(1, "[SharedServerTable] fd %d is not a server table segment", handle);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(SHARED_SERVER_TABLE), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        LogAdd(1, "[SharedServerTable] Could not map fd %d", handle);
+        return false;
+    }
+
+    this->m_Table = static_cast<SHARED_SERVER_TABLE*>(mapping);
+    this->m_Handle = handle;
+
+    return true;
+#endif
+}
+
+void CSharedServerTable::Close()
+{
+#ifndef _WIN32
+    if (this->m_Table != nullptr)
+    {
+        munmap(this->m_Table, sizeof(SHARED_SERVER_TABLE));
+        this->m_Table = nullptr;
+    }
+
+    if (this->m_Handle != -1)
+    {
+        close(this->m_Handle);
+        this->m_Handle = -1;
+    }
+#endif
+}
+
+void CSharedServerTable::PublishLayout(const SERVER_LIST_INFO* lpInfo, int count, const uint16_t* lpVisible, int visibleCount, bool ShowOfflineServers)
+{
+    SHARED_SERVER_TABLE* lpTable = this->m_Table;
+
+    if (lpTable == nullptr)
+    {
+        return;
+    }
+
+    // Before the workers start (or on a reload): codes and order are
+    // published whole, live state follows slot by slot
+    uint32_t layout = BeginWrite(lpTable->LayoutSequence);
+
+    memset(lpTable->ServerSlot, 0xFF, sizeof(lpTable->ServerSlot));
+
+    for (int n = 0; n < count; n++)
+    {
+        SHARED_SERVER_ENTRY* lpEntry = &lpTable->Entry[n];
+        uint32_t sequence = BeginWrite(lpEntry->Sequence);
+
+        lpEntry->Info = lpInfo[n];
+        lpEntry->ServerState = SERVER_STATE_OFFLINE;
+        lpEntry->UserTotal = 0;
+
+        EndWrite(lpEntry->Sequence, sequence);
+
+        lpTable->ServerSlot[lpInfo[n].ServerCode] = n;
+    }
+
+    memcpy(lpTable->VisibleSlot, lpVisible, visibleCount * sizeof(uint16_t));
+
+    lpTable->ShowOfflineServers = ShowOfflineServers;
+    lpTable->ServerCount = count;
+    lpTable->VisibleCount = visibleCount;
+
+    EndWrite(lpTable->LayoutSequence, layout);
+}
+
+void CSharedServerTable::PublishSlot(int slot, uint8_t ServerState, uint8_t UserTotal)
+{
+    if (this->m_Table == nullptr || slot < 0 || slot >= MAX_SERVER_LIST)
+    {
+        return;
+    }
+
+    SHARED_SERVER_ENTRY* lpEntry = &this->m_Table->Entry[slot];
+
+    // Single writer: an odd sequence tells readers to retry
+    uint32_t sequence = BeginWrite(lpEntry->Sequence);
+
+    lpEntry->ServerState = ServerState;
+    lpEntry->UserTotal = UserTotal;
+
+    EndWrite(lpEntry->Sequence, sequence);
+}
+
+bool CSharedServerTable::ReadSlot(int slot, SERVER_LIST_INFO* lpInfo, uint8_t* lpState, uint8_t* lpUserTotal)
+{
+    SHARED_SERVER_ENTRY* lpEntry = &this->m_Table->Entry[slot];
+
+    for (int n = 0; n < SHARED_TABLE_READ_RETRIES; n++)
+    {
+        uint32_t sequence;
+
+        if (BeginRead(lpEntry->Sequence, &sequence) == false)
+        {
+            break;
+        }
+
+        if (lpInfo != nullptr)
+        {
+            *lpInfo = lpEntry->Info;
+        }
+
+        (*lpState) = lpEntry->ServerState;
+        (*lpUserTotal) = lpEntry->UserTotal;
+
+        if (EndRead(lpEntry->Sequence, sequence))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+long CSharedServerTable::GenerateCustomServerList(uint8_t* lpMsg, int* size, int maxSize)
+{
+    SHARED_SERVER_TABLE* lpTable = this->m_Table;
+    int start = (*size);
+
+    // The whole list under one layout; entries that cannot be read are left out
+    for (int attempt = 0; attempt < SHARED_TABLE_READ_RETRIES; attempt++)
+    {
+        uint32_t layout;
+        int count = 0;
+
+        if (BeginRead(lpTable->LayoutSequence, &layout) == false)
+        {
+            break;
+        }
+
+        (*size) = start;
+
+        for (uint32_t n = 0; n < lpTable->VisibleCount && n < MAX_SERVER_LIST && ((*size) + (int)PMSG_CUSTOM_SERVER_LIST::Size) <= maxSize; n++)
+        {
+            int slot = lpTable->VisibleSlot[n];
+            SERVER_LIST_INFO server;
+            uint8_t state;
+            uint8_t UserTotal;
+
+            if (slot >= MAX_SERVER_LIST || this->ReadSlot(slot, &server, &state, &UserTotal) == false)
+            {
+                continue;
+            }
+
+            if (state != SERVER_STATE_ONLINE && lpTable->ShowOfflineServers == false)
+            {
+                continue;
+            }
+
+            uint8_t* lpEntry = &lpMsg[(*size)];
+
+            PMSG_CUSTOM_SERVER_LIST::ServerCode.put(lpEntry, server.ServerCode);
+            PMSG_CUSTOM_SERVER_LIST::ServerName.put(lpEntry, server.ServerName);
+
+            (*size) += PMSG_CUSTOM_SERVER_LIST::Size;
+
+            count++;
+        }
+
+        if (EndRead(lpTable->LayoutSequence, layout))
+        {
+            return count;
+        }
+    }
+
+    (*size) = start;
+
+    return 0;
+}
+
+long CSharedServerTable::GenerateServerList(uint8_t* lpMsg, int* size, int maxSize)
+{
+    SHARED_SERVER_TABLE* lpTable = this->m_Table;
+    int start = (*size);
+
+    for (int attempt = 0; attempt < SHARED_TABLE_READ_RETRIES; attempt++)
+    {
+        uint32_t layout;
+        int count = 0;
+
+        if (BeginRead(lpTable->LayoutSequence, &layout) == false)
+        {
+            break;
+        }
+
+        (*size) = start;
+
+        for (uint32_t n = 0; n < lpTable->VisibleCount && n < MAX_SERVER_LIST && ((*size) + (int)PMSG_SERVER_LIST::Size) <= maxSize; n++)
+        {
+            int slot = lpTable->VisibleSlot[n];
+            SERVER_LIST_INFO server;
+            uint8_t state;
+            uint8_t UserTotal;
+
+            if (slot >= MAX_SERVER_LIST || this->ReadSlot(slot, &server, &state, &UserTotal) == false)
+            {
+                continue;
+            }
+
+            if (state != SERVER_STATE_ONLINE && lpTable->ShowOfflineServers == false)
+            {
+                continue;
+            }
+
+            uint8_t* lpEntry = &lpMsg[(*size)];
+
+            PMSG_SERVER_LIST::ServerCode.put(lpEntry, server.ServerCode);
+            PMSG_SERVER_LIST::UserTotal.put(lpEntry, UserTotal);
+
+            (*size) += PMSG_SERVER_LIST::Size;
+
+            count++;
+        }
+
+        if (EndRead(lpTable->LayoutSequence, layout))
+        {
+            return count;
+        }
+    }
+
+    (*size) = start;
+
+    return 0;
+}
+
+bool CSharedServerTable::GetServerInfo(int ServerCode, SERVER_LIST_INFO* lpInfo, bool* lpAvailable)
+{
+    SHARED_SERVER_TABLE* lpTable = this->m_Table;
+
+    if (ServerCode < 0 || ServerCode >= MAX_SERVER_CODE)
+    {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < SHARED_TABLE_READ_RETRIES; attempt++)
+    {
+        uint32_t layout;
+
+        if (BeginRead(lpTable->LayoutSequence, &layout) == false)
+        {
+            break;
+        }
+
+        int slot = lpTable->ServerSlot[ServerCode];
+        bool ShowOfflineServers = lpTable->ShowOfflineServers;
+        uint8_t state;
+        uint8_t UserTotal;
+        bool read = (slot < MAX_SERVER_LIST && this->ReadSlot(slot, lpInfo, &state, &UserTotal));
+
+        if (EndRead(lpTable->LayoutSequence, layout) == false)
+        {
+            continue;
+        }
+
+        if (slot == SERVER_SLOT_NONE)
+        {
+            return false;
+        }
+
+        if (read == false)
+        {
+            break;
+        }
+
+        // Suspect and offline servers are withheld from clients
+        (*lpAvailable) = (ShowOfflineServers != false || state == SERVER_STATE_ONLINE);
+
+        return true;
+    }
+
+    // Mid-write for good (the supervisor died there): known, not available
+    memset(lpInfo, 0, sizeof(SERVER_LIST_INFO));
+    lpInfo->ServerCode = ServerCode;
+    lpInfo->ServerShow = true;
+    (*lpAvailable) = false;
+
+    return true;
+}
+
+bool CSharedServerTable::LockIp()
+{
+#ifdef _WIN32
+    return false;
+#else
+    int result = pthread_mutex_lock(&this->m_Table->IpMutex);
+
+    // A worker died holding the lock; counts it held are released when the
+    // supervisor reaps it
+    if (result == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&this->m_Table->IpMutex);
+        result = 0;
+    }
+
+    return (result == 0);
+#endif
+}
+
+void CSharedServerTable::UnlockIp()
+{
+#ifndef _WIN32
+    pthread_mutex_unlock(&this->m_Table->IpMutex);
+#endif
+}
+
+int CSharedServerTable::FindIpAddress(const char* IpAddress, bool* found)
+{
+    // Caller holds the lock; linear probing from the home slot
+    int slot = GetIpHomeSlot(IpAddress);
+
+    for (int n = 0; n < MAX_IP_ADDRESS_TABLE; n++)
+    {
+        SHARED_IP_ENTRY* lpEntry = &this->m_Table->Ip[slot];
+
+        if (lpEntry->Total == 0)
+        {
+            *found = false;
+            return slot;
+        }
+
+        if (strncmp(lpEntry->IpAddress, IpAddress, sizeof(lpEntry->IpAddress)) == 0)
+        {
+            *found = true;
+            return slot;
+        }
+
+        slot = (slot + 1) & (MAX_IP_ADDRESS_TABLE - 1);
+    }
+
+    *found = false;
+    return -1;
+}
+
+void CSharedServerTable::EraseIpSlot(int slot)
+{
+    // Backward-shift deletion, as CIpManager
+    SHARED_IP_ENTRY* lpIp = this->m_Table->Ip;
+    int hole = slot;
+    int next = (slot + 1) & (MAX_IP_ADDRESS_TABLE - 1);
+
+    while (lpIp[next].Total != 0)
+    {
+        int home = GetIpHomeSlot(lpIp[next].IpAddress);
+
+        if (((next - home) & (MAX_IP_ADDRESS_TABLE - 1)) >= ((next - hole) & (MAX_IP_ADDRESS_TABLE - 1)))
+        {
+            lpIp[hole] = lpIp[next];
+            hole = next;
+        }
+
+        next = (next + 1) & (MAX_IP_ADDRESS_TABLE - 1);
+    }
+
+    memset(&lpIp[hole], 0, sizeof(lpIp[hole]));
+}
+
+bool CSharedServerTable::CheckIpAddress(const char* IpAddress, int MaxIpConnection)
+{
+    if (this->LockIp() == false)
+    {
+        return true;
+    }
+
+    bool found;
+
+    int slot = this->FindIpAddress(IpAddress, &found);
+
+    bool allowed = (found == false) ? (slot != -1) : (this->m_Table->Ip[slot].Total < MaxIpConnection);
+
+    this->UnlockIp();
+
+    return allowed;
+}
+
+void CSharedServerTable::InsertIpAddress(const char* IpAddress, int worker)
+{
+    if (worker < 0 || worker >= MAX_PREFORK_WORKERS || this->LockIp() == false)
+    {
+        return;
+    }
+
+    bool found;
+
+    int slot = this->FindIpAddress(IpAddress, &found);
+
+    if (slot != -1)
+    {
+        SHARED_IP_ENTRY* lpEntry = &this->m_Table->Ip[slot];
+
+        if (found == false)
+        {
+            strncpy(lpEntry->IpAddress, IpAddress, sizeof(lpEntry->IpAddress) - 1);
+            lpEntry->IpAddress[sizeof(lpEntry->IpAddress) - 1] = '\0';
+        }
+
+        lpEntry->Total++;
+        lpEntry->Count[worker]++;
+    }
+
+    this->UnlockIp();
+}
+
+void CSharedServerTable::RemoveIpAddress(const char* IpAddress, int worker)
+{
+    if (worker < 0 || worker >= MAX_PREFORK_WORKERS || this->LockIp() == false)
+    {
+        return;
+    }
+
+    bool found;
+
+    int slot = this->FindIpAddress(IpAddress, &found);
+
+    if (found != false && this->m_Table->Ip[slot].Count[worker] != 0)
+    {
+        this->m_Table->Ip[slot].Count[worker]--;
+
+        if ((--this->m_Table->Ip[slot].Total) == 0)
+        {
+            this->EraseIpSlot(slot);
+        }
+    }
+
+    this->UnlockIp();
+}
+
+void CSharedServerTable::ReleaseWorker(int worker)
+{
+    if (this->m_Table == nullptr || worker < 0 || worker >= MAX_PREFORK_WORKERS || this->LockIp() == false)
+    {
+        return;
+    }
+
+    int released = 0;
+    int slot = 0;
+
+    // Erasing shifts later entries back into the current slot: look at it again
+    while (slot < MAX_IP_ADDRESS_TABLE)
+    {
+        SHARED_IP_ENTRY* lpEntry = &this->m_Table->Ip[slot];
+
+        if (lpEntry->Total == 0 || lpEntry->Count[worker] == 0)
+        {
+            slot++;
+            continue;
+        }
+
+        released += lpEntry->Count[worker];
+        lpEntry->Total -= lpEntry->Count[worker];
+        lpEntry->Count[worker] = 0;
+
+        if (lpEntry->Total == 0)
+        {
+            this->EraseIpSlot(slot);
+            continue;
+        }
+
+        slot++;
+    }
+
+    this->UnlockIp();
+
+    LogAdd(2, "[SharedServerTable] Released %d connection(s) of worker %d", released, worker);
+}
@@ -1,21 +1,38 @@
 #include "SocketManager.h"
+#include "FlightRecorder.h"
 #include "IpManager.h"
+#include "Metrics.h"
+#include "Tenant.h"
+#include "Probes.h"
+#include "RateLimitedLog.h"
+#include "BinaryLog.h"
 #include "Util.h"
 #include <iostream>
 
 SocketManager* g_socket_manager = nullptr;
 
-SocketManager::SocketManager(boost::asio::io_context& io)
+SocketManager::SocketManager(boost::asio::io_context& io, TENANT* tenant)
     : io_context_(io)
+    , tenant_(tenant != nullptr ? tenant : GetTenant(0))
+    , index_base_(tenant_->Id * MAX_CLIENT)
     , acceptor_(io)
+    , sessions_mutex_("SocketManager::sessions")
     , running_(false)
+    , accepting_(false)
     , port_(0)
+    , accept_count_(Metrics::get("tcp.accepts"))
+    , reject_count_(Metrics::get("tcp.rejects"))
 {
     sessions_.resize(MAX_CLIENT);
+    tenant_->Tcp = this;
 }
 
 SocketManager::~SocketManager() {
     stop();
+
+    if (tenant_->Tcp == this) {
+        tenant_->Tcp = nullptr;
+    }
 }
 
 bool SocketManager::start(uint16_t port) {
@@ -28,10 +45,12 @@ bool SocketManager::start(uint16_t port) {
         acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
         acceptor_.bind(endpoint);
         acceptor_.listen();
+        port_ = acceptor_.local_endpoint().port();
         
         running_ = true;
+        accepting_ = true;
         
-        LogAdd(2, "[SocketManager] TCP server started on port %d", port);
+        LogAdd(2, "[SocketManager] TCP server started on port %d", port_);
         
         start_accept();
         
@@ -43,18 +62,39 @@ bool SocketManager::start(uint16_t port) {
     }
 }
 
+bool SocketManager::start_native(int native_socket) {
+    try {
+        acceptor_.assign(boost::asio::ip::tcp::v4(), native_socket);
+        port_ = acceptor_.local_endpoint().port();
+        
+        running_ = true;
+        accepting_ = true;
+        
+        LogAdd(2, "[SocketManager] TCP server took over port %d (fd %d)", port_, native_socket);
+        
+        start_accept();
+        
+        return true;
+        
+    } catch (const std::exception& e) {
+        LogAdd(1, "[SocketManager] Failed to take over TCP socket: %s", e.what());
+        return false;
+    }
+}
+
 void SocketManager::stop() {
     if (!running_) {
         return;
     }
     
     running_ = false;
+    accepting_ = false;
     
     boost::system::error_code ec;
     acceptor_.close(ec);
     
     // Close all sessions
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
     for (auto& session : sessions_) {
         if (session) {
             session->close();
@@ -64,14 +104,29 @@ void SocketManager::stop() {
     LogAdd(2, "[SocketManager] TCP server stopped");
 }
 
+void SocketManager::stop_accepting() {
+    if (!accepting_.exchange(false)) {
+        return;
+    }
+    
+    // Close on the io threads, where the accept chain runs. The kernel socket
+    // stays open in the process that inherited it.
+    boost::asio::post(io_context_, [this]() {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+    });
+    
+    LogAdd(2, "[SocketManager] Stopped accepting, %d session(s) left to drain", gClientCount);
+}
+
 void SocketManager::start_accept() {
-    if (!running_) {
+    if (!running_ || !accepting_) {
         return;
     }
     
     int index = find_free_index();
     if (index == -1) {
-        LogAdd(1, "[SocketManager] No free client slots available");
+        LogAddLimited(1, "[SocketManager] No free client slots available");
         
         // Try again after a short delay
         auto timer = std::make_shared<boost::asio::steady_timer>(io_context_);
@@ -82,89 +137,136 @@ void SocketManager::start_accept() {
         return;
     }
     
-    auto session = std::make_shared<ClientSession>(io_context_, index);
+    // Reuse the slot's pooled session when nothing else still holds it,
+    // so steady-state accepts don't allocate. It leaves the slot under the
+    // lock: get_session() cannot hand it out again while it is reset.
+    std::shared_ptr<ClientSession> session;
+    {
+        std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
+        std::shared_ptr<ClientSession>& pooled = sessions_[index - index_base_];
+
+        if (pooled && pooled.use_count() == 1) {
+            session = std::move(pooled);
+        }
+    }
+
+    if (session) {
+        session->reset();
+    } else {
+        session = std::make_shared<ClientSession>(io_context_, index);
+    }
     
-    acceptor_.async_accept(session->socket(),
-        [this, session, index](const boost::system::error_code& error) {
+    acceptor_.async_accept(session->socket(), make_alloc_handler(accept_memory_,
+        [this, session](const boost::system::error_code& error) {
             handle_accept(session, error);
-        });
+        }));
 }
 
 void SocketManager::handle_accept(std::shared_ptr<ClientSession> session,
                                   const boost::system::error_code& error) {
     if (error) {
         if (error != boost::asio::error::operation_aborted) {
-            LogAdd(1, "[SocketManager] Accept error: %s", error.message().c_str());
+            LogAddLimited(1, "[SocketManager] Accept error: %s", error.message().c_str());
+            FlightRecorder::record(FLIGHT_ERROR, 0, FLIGHT_ERROR_ACCEPT, 0, (uint64_t)error.value());
         }
+        park_session(session);
         start_accept();
         return;
     }
     
+    BinaryLog::Session log_session((uint32_t)session->index());
+
     try {
         // Get client IP
-        std::string ip = session->ip_address();
-        if (ip.empty()) {
-            ip = session->socket().remote_endpoint().address().to_string();
+        if (!session->load_remote_address()) {
+            LogAddLimited(1, "[SocketManager] Accepted socket has no remote endpoint");
+            boost::system::error_code ec;
+            session->socket().close(ec);
+            park_session(session);
+            start_accept();
+            return;
         }
+
+        const char* ip = session->ip_address();
+
+        CS_PROBE2(accept, session->index(), ip);
         
         // Check IP connection limit
         if (!check_ip_limit(ip)) {
-            LogAdd(1, "[SocketManager] IP connection limit exceeded: %s", ip.c_str());
-            session->close();
+            LogAddLimited(1, "[SocketManager] IP connection limit exceeded: %s", ip);
+            FlightRecorder::record(FLIGHT_ACCEPT_REJECT, session->index(), 0, 0, session->ipv4());
+            reject_count_->fetch_add(1, std::memory_order_relaxed);
+            boost::system::error_code ec;
+            session->socket().close(ec);
+            park_session(session);
             start_accept();
             return;
         }
         
         // Store session
         {
-            std::lock_guard<std::mutex> lock(sessions_mutex_);
-            sessions_[session->index()] = session;
+            std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
+            sessions_[session->index() - index_base_] = session;
             gClientCount++;
         }
         
         // Track IP
-        gIpManager.InsertIpAddress(ip.c_str());
+        tenant_->IpManager->InsertIpAddress(ip);
+        FlightRecorder::record(FLIGHT_ACCEPT, session->index(), 0, 0, session->ipv4());
+        accept_count_->fetch_add(1, std::memory_order_relaxed);
         
         // Start session
         session->start();
         
-        LogAdd(2, "[SocketManager] Client accepted: Index=%d, IP=%s, Total=%d",
-               session->index(), ip.c_str(), gClientCount);
+        LogAddLimited(2, "[SocketManager] Client accepted: Index=%d, IP=%s, Total=%d",
+               session->index(), ip, gClientCount);
         
     } catch (const std::exception& e) {
-        LogAdd(1, "[SocketManager] Error handling accept: %s", e.what());
+        LogAddLimited(1, "[SocketManager] Error handling accept: %s", e.what());
     }
     
     // Accept next connection
     start_accept();
 }
 
+void SocketManager::park_session(const std::shared_ptr<ClientSession>& session) {
+    // Back into its slot unconnected, for the next accept to reuse
+    std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
+    std::shared_ptr<ClientSession>& slot = sessions_[session->index() - index_base_];
+
+    if (!slot) {
+        slot = session;
+    }
+}
+
 int SocketManager::find_free_index() {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
     
     for (int i = 0; i < MAX_CLIENT; i++) {
         if (!sessions_[i] || !sessions_[i]->is_connected()) {
-            return i;
+            return index_base_ + i;
         }
     }
     
     return -1;
 }
 
-bool SocketManager::check_ip_limit(const std::string& ip) {
-    if (MaxIpConnection == 0) {
+bool SocketManager::check_ip_limit(const char* ip) {
+    if (tenant_->IpManager->GetMaxIpConnection() == 0) {
         return true;  // No limit
     }
     
-    return gIpManager.CheckIpAddress(ip.c_str());
+    return tenant_->IpManager->CheckIpAddress(ip);
 }
 
 std::shared_ptr<ClientSession> SocketManager::get_session(int index) {
+    index -= index_base_;
+
     if (index < 0 || index >= MAX_CLIENT) {
         return nullptr;
     }
     
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::lock_guard<ProfiledMutex> lock(sessions_mutex_);
     return sessions_[index];
 }
 
@@ -2,21 +2,41 @@
 #include "ProtocolDefines.h"
 #include "ServerList.h"
 #include "Console.h"
+#include "FlightRecorder.h"
+#include "Metrics.h"
+#include "Probes.h"
+#include "RateLimitedLog.h"
+#include "ReceiveTimestamps.h"
+#include "Tenant.h"
+#include "TrafficRecorder.h"
 #include "Util.h"
+#include <cerrno>
+#include <future>
 #include <iostream>
 
 SocketManagerUdp* g_socket_manager_udp = nullptr;
 
-SocketManagerUdp::SocketManagerUdp(boost::asio::io_context& io)
+SocketManagerUdp::SocketManagerUdp(boost::asio::io_context& io, TENANT* tenant)
     : io_context_(io)
+    , tenant_(tenant != nullptr ? tenant : GetTenant(0))
     , socket_(io)
     , running_(false)
     , port_(0)
+    , timestamped_(false)
+    , receive_queue_ns_(0)
+    , heartbeat_count_(Metrics::get("udp.heartbeats"))
+    , heartbeat_process_us_(Metrics::get("udp.heartbeat_process_us"))
+    , heartbeat_process_max_us_(Metrics::get("udp.heartbeat_process_max_us"))
 {
+    tenant_->Udp = this;
 }
 
 SocketManagerUdp::~SocketManagerUdp() {
     stop();
+
+    if (tenant_->Udp == this) {
+        tenant_->Udp = nullptr;
+    }
 }
 
 bool SocketManagerUdp::start(uint16_t port) {
@@ -27,10 +47,12 @@ bool SocketManagerUdp::start(uint16_t port) {
         
         socket_.open(endpoint.protocol());
         socket_.bind(endpoint);
+        port_ = socket_.local_endpoint().port();
         
         running_ = true;
+        timestamped_ = ReceiveTimestamps::enabled() && ReceiveTimestamps::enable_socket(socket_.native_handle());
         
-        LogAdd(2, "[SocketManagerUdp] UDP server started on port %d", port);
+        LogAdd(2, "[SocketManagerUdp] UDP server started on port %d", port_);
         
         start_receive();
         
@@ -42,15 +64,48 @@ bool SocketManagerUdp::start(uint16_t port) {
     }
 }
 
+bool SocketManagerUdp::start_native(int native_socket) {
+    try {
+        socket_.assign(boost::asio::ip::udp::v4(), native_socket);
+        port_ = socket_.local_endpoint().port();
+        
+        running_ = true;
+        timestamped_ = ReceiveTimestamps::enabled() && ReceiveTimestamps::enable_socket(socket_.native_handle());
+        
+        LogAdd(2, "[SocketManagerUdp] UDP server took over port %d (fd %d)", port_, native_socket);
+        
+        start_receive();
+        
+        return true;
+        
+    } catch (const std::exception& e) {
+        LogAdd(1, "[SocketManagerUdp] Failed to take over UDP socket: %s", e.what());
+        return false;
+    }
+}
+
 void SocketManagerUdp::stop() {
-    if (!running_) {
+    if (!running_.exchange(false)) {
         return;
     }
     
-    running_ = false;
-    
-    boost::system::error_code ec;
-    socket_.close(ec);
+    // The socket belongs to its io_context thread, which may be re-arming a
+    // receive right now: close it there and wait. Nobody runs a stopped
+    // io_context, so there it is ours to close.
+    if (io_context_.get_executor().running_in_this_thread() || io_context_.stopped()) {
+        boost::system::error_code ec;
+        socket_.close(ec);
+    } else {
+        std::promise<void> closed;
+
+        boost::asio::post(io_context_, [this, &closed]() {
+            boost::system::error_code ec;
+            socket_.close(ec);
+            closed.set_value();
+        });
+
+        closed.get_future().wait();
+    }
     
     LogAdd(2, "[SocketManagerUdp] UDP server stopped");
 }
@@ -59,6 +114,15 @@ void SocketManagerUdp::start_receive() {
     if (!running_) {
         return;
     }
+
+    if (timestamped_) {
+        // Wait for readability, then recvmsg to get the kernel timestamp
+        socket_.async_wait(boost::asio::ip::udp::socket::wait_read,
+            [this](const boost::system::error_code& error) {
+                handle_readable(error);
+            });
+        return;
+    }
     
     socket_.async_receive_from(
         boost::asio::buffer(recv_buffer_.data(), recv_buffer_.size()),
@@ -68,10 +132,35 @@ void SocketManagerUdp::start_receive() {
         });
 }
 
+void SocketManagerUdp::handle_readable(const boost::system::error_code& error) {
+    if (error) {
+        handle_receive(error, 0);
+        return;
+    }
+
+    uint64_t kernel_ns;
+    unsigned int address_size = (unsigned int)remote_endpoint_.capacity();
+    long bytes = ReceiveTimestamps::receive(socket_.native_handle(), recv_buffer_.data(), recv_buffer_.size(),
+                                            remote_endpoint_.data(), &address_size, &kernel_ns);
+
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            start_receive();
+        } else {
+            handle_receive(boost::system::error_code(errno, boost::system::system_category()), 0);
+        }
+        return;
+    }
+
+    remote_endpoint_.resize(address_size);
+    receive_queue_ns_ = ReceiveTimestamps::queue_delay(kernel_ns);
+    handle_receive(boost::system::error_code(), (size_t)bytes);
+}
+
 void SocketManagerUdp::handle_receive(const boost::system::error_code& error, size_t bytes) {
     if (error) {
         if (error != boost::asio::error::operation_aborted) {
-            LogAdd(1, "[SocketManagerUdp] Receive error: %s", error.message().c_str());
+            LogAddLimited(1, "[SocketManagerUdp] Receive error: %s", error.message().c_str());
         }
         if (running_) {
             start_receive();
@@ -80,14 +169,36 @@ void SocketManagerUdp::handle_receive(const boost::system::error_code& error, si
     }
     
     if (bytes > 0) {
-        std::string remote_ip = remote_endpoint_.address().to_string();
+        char remote_ip[16] = "?";
+        if (remote_endpoint_.address().is_v4()) {
+            IpAddressToString(remote_endpoint_.address().to_v4().to_uint(), remote_ip, sizeof(remote_ip));
+        }
         uint16_t remote_port = remote_endpoint_.port();
         
-        LogAdd(2, "[SocketManagerUdp] Received %zu bytes from %s:%d",
-               bytes, remote_ip.c_str(), remote_port);
+        LogAddLimited(2, "[SocketManagerUdp] Received %zu bytes from %s:%d",
+               bytes, remote_ip, remote_port);
+
+        g_traffic_recorder.record(TRAFFIC_UDP_RECV,
+                                  remote_endpoint_.address().is_v4() ? remote_endpoint_.address().to_v4().to_uint() : 0,
+                                  recv_buffer_.data(), bytes);
         
         // Parse and process UDP packets
+        auto started = std::chrono::steady_clock::now();
+
         parse_udp_packets(recv_buffer_.data(), bytes);
+
+        auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        auto elapsed = elapsed_ns / 1000;
+
+        if (timestamped_) {
+            ReceiveTimestamps::histogram(RECEIVE_UDP_SERVICE).record((uint64_t)elapsed_ns);
+            ReceiveTimestamps::histogram(RECEIVE_UDP_QUEUE).record(receive_queue_ns_);
+        }
+
+        heartbeat_process_us_->store(elapsed, std::memory_order_relaxed);
+        Metrics::update_max(heartbeat_process_max_us_, elapsed);
+        heartbeat_count_->fetch_add(1, std::memory_order_relaxed);
     }
     
     // Continue receiving
@@ -114,20 +225,25 @@ bool SocketManagerUdp::parse_udp_packets(const uint8_t* data, size_t size) {
         packet_size = MAKEWORD(data[2], data[1]);
         header_size = 3;
     } else {
-        LogAdd(1, "[SocketManagerUdp] Invalid packet header: 0x%02X", header);
+        LogAddLimited(1, "[SocketManagerUdp] Invalid packet header: 0x%02X", header);
         return false;
     }
     
     // Validate packet size
     if (packet_size < header_size || packet_size > static_cast<int>(size)) {
-        LogAdd(1, "[SocketManagerUdp] Invalid packet size: %d", packet_size);
+        LogAddLimited(1, "[SocketManagerUdp] Invalid packet size: %d", packet_size);
         return false;
     }
     
     uint8_t head = data[header_size];
+
+    uint32_t sender = remote_endpoint_.address().is_v4() ? remote_endpoint_.address().to_v4().to_uint() : 0;
+
+    CS_PROBE3(heartbeat, sender, head, packet_size);
+    FlightRecorder::record(FLIGHT_HEARTBEAT, sender, head, 0, packet_size);
     
     // Process UDP packets (GameServer/JoinServer heartbeats)
-    gServerList.ServerProtocolCore(head, (uint8_t*)data, packet_size);
+    tenant_->ServerList->ServerProtocolCore(head, (uint8_t*)data, packet_size);
     
     return true;
 }
@@ -149,7 +265,7 @@ void SocketManagerUdp::async_send(const uint8_t* data, size_t size,
             endpoint,
             [packet](const boost::system::error_code& error, size_t bytes) {
                 if (error) {
-                    LogAdd(1, "[SocketManagerUdp] Send error: %s", error.message().c_str());
+                    LogAddLimited(1, "[SocketManagerUdp] Send error: %s", error.message().c_str());
                 }
             });
             
@@ -0,0 +1,222 @@
+#include "StatsExport.h"
+#include "Metrics.h"
+#include "ServerList.h"
+#include "SharedServerTable.h"
+#include "Tenant.h"
+#include "ThreadMonitor.h"
+#include "Util.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(STATS_MAX_THREADS >= MAX_MONITORED_THREADS, "stats segment must hold every monitored thread");
+static_assert(STATS_MAX_SERVERS >= MAX_SERVER_LIST, "stats segment must hold a full server list");
+static_assert((int)STATS_SERVER_ONLINE == (int)SERVER_STATE_ONLINE && (int)STATS_SERVER_SUSPECT == (int)SERVER_STATE_SUSPECT,
+              "stats states are the server list states");
+
+static uint64_t GetWallTime()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+CStatsExport::CStatsExport()
+{
+    this->m_Segment = nullptr;
+    this->m_Handle = -1;
+    this->m_SharedTable = nullptr;
+
+    this->m_Accepts = Metrics::get("tcp.accepts");
+    this->m_Rejects = Metrics::get("tcp.rejects");
+    this->m_Packets = Metrics::get("tcp.packets");
+    this->m_Heartbeats = Metrics::get("udp.heartbeats");
+    this->m_IoLag = Metrics::get("io.lag_us");
+    this->m_ControlPlaneLag = Metrics::get("controlplane.lag_us");
+
+    this->m_LastPackets = 0;
+}
+
+CStatsExport::~CStatsExport()
+{
+    this->Close();
+}
+
+bool CStatsExport::Open(const char* path)
+{
+#ifdef _WIN32
+    LogAdd(1, "[StatsExport] Not supported on this platform (%s)", path);
+    return false;
+#else
+    this->Close();
+
+    // A new file, never the old one resized: readers may still have the
+    // previous process' segment mapped, and shrinking it would fault them
+    unlink(path);
+
+    // World-readable: the readers are other users' agents and scripts
+    int handle = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (handle == -1)
+    {
+        LogAdd(1, "[StatsExport] Could not create %s", path);
+        return false;
+    }
+
+    if (ftruncate(handle, sizeof(STATS_SEGMENT)) != 0)
+    {
+        LogAdd(1, "[StatsExport] Could not size %s", path);
+        close(handle);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(STATS_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        LogAdd(1, "[StatsExport] Could not map %s", path);
+        close(handle);
+        return false;
+    }
+
+    this->m_Segment = static_cast<STATS_SEGMENT*>(mapping);
+    this->m_Handle = handle;
+    this->m_Staging.reset(new STATS_SEGMENT());
+
+    // A fresh file reads as zeros: Sequence starts even, no servers yet. The
+    // identity fields go in last so a reader never accepts a half-set header.
+    this->m_Segment->Pid = (uint32_t)getpid();
+    this->m_Segment->StartTime = GetWallTime();
+    this->m_Segment->HeaderSize = offsetof(STATS_SEGMENT, Server);
+    this->m_Segment->EntrySize = sizeof(STATS_SERVER_ENTRY);
+    this->m_Segment->Version = STATS_SEGMENT_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    this->m_Segment->Magic = STATS_SEGMENT_MAGIC;
+
+    this->m_LastPackets = (uint64_t)this->m_Packets->load(std::memory_order_relaxed);
+    this->m_LastPublish = std::chrono::steady_clock::now();
+
+    LogAdd(2, "[StatsExport] Publishing stats to %s (%u KB)", path, (uint32_t)(sizeof(STATS_SEGMENT) / 1024));
+
+    return true;
+#endif
+}
+
+void CStatsExport::Close()
+{
+#ifndef _WIN32
+    if (this->m_Segment != nullptr)
+    {
+        munmap(this->m_Segment, sizeof(STATS_SEGMENT));
+        this->m_Segment = nullptr;
+    }
+
+    if (this->m_Handle != -1)
+    {
+        close(this->m_Handle);
+        this->m_Handle = -1;
+    }
+#endif
+}
+
+void CStatsExport::Gather(STATS_SEGMENT* lpStaging)
+{
+    STATS_COUNTERS* lpCounters = &lpStaging->Counters;
+
+    lpCounters->Sessions = (uint64_t)gClientCount;
+    lpCounters->Accepts = (uint64_t)this->m_Accepts->load(std::memory_order_relaxed);
+    lpCounters->Rejects = (uint64_t)this->m_Rejects->load(std::memory_order_relaxed);
+    lpCounters->Packets = (uint64_t)this->m_Packets->load(std::memory_order_relaxed);
+
+    if (this->m_SharedTable != nullptr && this->m_SharedTable->IsOpen())
+    {
+        for (SHARED_WORKER_INFO& worker : this->m_SharedTable->Get()->Worker)
+        {
+            lpCounters->Sessions += (uint64_t)worker.Clients.load(std::memory_order_relaxed);
+            lpCounters->Accepts += (uint64_t)worker.Accepts.load(std::memory_order_relaxed);
+            lpCounters->Rejects += (uint64_t)worker.Rejects.load(std::memory_order_relaxed);
+            lpCounters->Packets += (uint64_t)worker.Packets.load(std::memory_order_relaxed);
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(now - this->m_LastPublish).count();
+
+    // A restarted worker starts counting from zero again
+    if (elapsed != 0)
+    {
+        lpCounters->PacketsPerSecond = (lpCounters->Packets >= this->m_LastPackets) ? (lpCounters->Packets - this->m_LastPackets) * 1000 / elapsed : 0;
+        this->m_LastPackets = lpCounters->Packets;
+        this->m_LastPublish = now;
+    }
+
+    lpCounters->Heartbeats = (uint64_t)this->m_Heartbeats->load(std::memory_order_relaxed);
+    lpCounters->IoLagUs = (uint64_t)this->m_IoLag->load(std::memory_order_relaxed);
+    lpCounters->ControlPlaneLagUs = (uint64_t)this->m_ControlPlaneLag->load(std::memory_order_relaxed);
+
+    lpStaging->JoinServerState = gServerList.GetJoinServerStats(&lpStaging->JoinServerQueueSize);
+
+    THREAD_STATS threads[MAX_MONITORED_THREADS];
+    int count = ThreadMonitor::snapshot(threads, MAX_MONITORED_THREADS);
+
+    for (int n = 0; n < count; n++)
+    {
+        STATS_THREAD_ENTRY* lpThread = &lpStaging->Thread[n];
+
+        memset(lpThread->Name, 0, sizeof(lpThread->Name));
+        strncpy(lpThread->Name, threads[n].Name, sizeof(lpThread->Name) - 1);
+        lpThread->ThreadId = threads[n].ThreadId;
+        lpThread->Utilization = (uint32_t)threads[n].Utilization;
+        lpThread->Handlers = threads[n].Handlers;
+        lpThread->MaxHandlerUs = threads[n].MaxHandlerNs / 1000;
+        lpThread->CurrentHandlerUs = threads[n].CurrentNs / 1000;
+    }
+
+    lpStaging->ThreadCount = (uint32_t)count;
+
+    // Every tenant's servers, in tenant order
+    int servers = 0;
+
+    for (int n = 0; n < GetTenantCount(); n++)
+    {
+        TENANT* tenant = GetTenant(n);
+
+        servers += tenant->ServerList->ExportStats(&lpStaging->Server[servers], STATS_MAX_SERVERS - servers, (uint8_t)n);
+    }
+
+    lpStaging->ServerCount = (uint32_t)servers;
+}
+
+void CStatsExport::Publish()
+{
+    if (this->m_Segment == nullptr)
+    {
+        return;
+    }
+
+    STATS_SEGMENT* lpStaging = this->m_Staging.get();
+    STATS_SEGMENT* lpSegment = this->m_Segment;
+
+    // Locks and snapshots are taken here, outside the write window
+    this->Gather(lpStaging);
+
+    uint32_t sequence = lpSegment->Sequence.load(std::memory_order_relaxed) | 1;
+
+    lpSegment->Sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    lpSegment->UpdateTime = GetWallTime();
+    lpSegment->UpdateCount++;
+
+    // Everything from the counters on, up to the last server in use
+    size_t offset = offsetof(STATS_SEGMENT, Counters);
+    size_t size = offsetof(STATS_SEGMENT, Server) + lpStaging->ServerCount * sizeof(STATS_SERVER_ENTRY) - offset;
+
+    memcpy((uint8_t*)lpSegment + offset, (const uint8_t*)lpStaging + offset, size);
+
+    lpSegment->Sequence.store(sequence + 1, std::memory_order_release);
+}
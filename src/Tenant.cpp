@@ -0,0 +1,31 @@
+#include "Tenant.h"
+#include "IpManager.h"
+#include "ServerList.h"
+#include "Util.h"
+#include <cstring>
+
+TENANT gTenants[MAX_TENANTS] = {{0, "default", &gServerList, &gIpManager, nullptr, nullptr}};
+
+static int gTenantCount = 1;
+
+TENANT* CreateTenant(const char* name, CServerList* server_list, CIpManager* ip_manager) {
+    if (gTenantCount >= MAX_TENANTS) {
+        LogAdd(1, "[Tenant] No room for tenant %s (%d at most)", name, MAX_TENANTS);
+        return nullptr;
+    }
+
+    TENANT* tenant = &gTenants[gTenantCount];
+    tenant->Id = gTenantCount++;
+    strncpy(tenant->Name, name, sizeof(tenant->Name) - 1);
+    tenant->Name[sizeof(tenant->Name) - 1] = '\0';
+    tenant->ServerList = server_list;
+    tenant->IpManager = ip_manager;
+    tenant->Tcp = nullptr;
+    tenant->Udp = nullptr;
+
+    return tenant;
+}
+
+int GetTenantCount() {
+    return gTenantCount;
+}
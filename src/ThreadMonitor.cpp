@@ -0,0 +1,304 @@
+#include "ThreadMonitor.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include "platform/linux/Symbolize.h"
+#include <csignal>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+static THREAD_SLOT g_thread_slots[MAX_MONITORED_THREADS];
+static std::atomic<int> g_thread_slot_count{0};
+
+static WATCHDOG_CONFIG g_watchdog_config = {100, 200};
+
+// Lag probe, on the io_context it measures
+static std::unique_ptr<boost::asio::steady_timer> g_probe_timer;
+static std::chrono::steady_clock::time_point g_probe_expected;
+static std::atomic<bool> g_probe_running{false};
+
+static std::mutex g_long_handler_mutex;
+static std::string g_long_handler;
+
+static std::thread g_watchdog;
+static std::mutex g_watchdog_mutex;
+static std::condition_variable g_watchdog_wakeup;
+static bool g_watchdog_stop = false;
+
+#ifdef __linux__
+// Real-time signal the watchdog sends to a stuck thread to sample its stack
+static int WatchdogSignal() {
+    return SIGRTMIN + 3;
+}
+#endif
+
+void CaptureThreadStack(int) {
+#ifdef __linux__
+    THREAD_SLOT* slot = ThreadMonitor::t_slot_;
+
+    if (slot != nullptr) {
+        int depth = backtrace(slot->Stack, WATCHDOG_STACK_DEPTH);
+        slot->StackDepth.store(depth, std::memory_order_release);
+    }
+#endif
+}
+
+void ThreadMonitor::register_thread(const char* name) {
+    int index = g_thread_slot_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (index >= MAX_MONITORED_THREADS) {
+        g_thread_slot_count.store(MAX_MONITORED_THREADS, std::memory_order_relaxed);
+        return;
+    }
+
+    THREAD_SLOT* slot = &g_thread_slots[index];
+
+    strncpy(slot->Name, name, sizeof(slot->Name) - 1);
+    slot->Name[sizeof(slot->Name) - 1] = '\0';
+#ifdef __linux__
+    slot->ThreadId = (uint32_t)syscall(SYS_gettid);
+    slot->Handle = (uintptr_t)pthread_self();
+#elif defined(_WIN32)
+    slot->ThreadId = (uint32_t)GetCurrentThreadId();
+    slot->Handle = 0;
+#endif
+    slot->Depth = 0;
+    slot->StackDepth.store(-1, std::memory_order_relaxed);
+    slot->WindowAt = now();
+    slot->BusyMetric = Metrics::get(("thread." + std::string(slot->Name) + ".busy_pct").c_str());
+
+    t_slot_ = slot;
+}
+
+static void ScheduleProbe(std::chrono::milliseconds interval) {
+    static std::atomic<int64_t>* lag_us = Metrics::get("io.lag_us");
+    static std::atomic<int64_t>* lag_max_us = Metrics::get("io.lag_max_us");
+
+    g_probe_expected += interval;
+    g_probe_timer->expires_at(g_probe_expected);
+    g_probe_timer->async_wait([interval](const boost::system::error_code& error) {
+        if (error || !g_probe_running.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - g_probe_expected).count();
+
+        lag_us->store(lag, std::memory_order_relaxed);
+        Metrics::update_max(lag_max_us, lag);
+
+        // After a long stall, measure from now instead of replaying missed probes
+        if (lag > std::chrono::duration_cast<std::chrono::microseconds>(interval).count()) {
+            g_probe_expected = std::chrono::steady_clock::now();
+        }
+
+        ScheduleProbe(interval);
+    });
+}
+
+static void ReportLongHandler(THREAD_SLOT* slot, uint64_t busy_ns) {
+    static std::atomic<int64_t>* long_handlers = Metrics::get("threads.long_handlers");
+    long_handlers->fetch_add(1, std::memory_order_relaxed);
+
+    // Name is at most 15 characters; sized for every field at its widest
+    char line[96];
+    snprintf(line, sizeof(line), "Thread %.15s (%u) has been in one handler for %llu ms", slot->Name, slot->ThreadId,
+             (unsigned long long)(busy_ns / 1000000));
+
+    LogAdd(1, "[ThreadMonitor] %s", line);
+
+    std::string report = line;
+
+#ifdef __linux__
+    slot->StackDepth.store(-1, std::memory_order_relaxed);
+
+    if (pthread_kill((pthread_t)slot->Handle, WatchdogSignal()) != 0) {
+        std::lock_guard<std::mutex> lock(g_long_handler_mutex);
+        g_long_handler = report;
+        return;
+    }
+
+    // The thread answers as soon as the kernel schedules it
+    for (int n = 0; n < 50 && slot->StackDepth.load(std::memory_order_acquire) < 0; n++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    int depth = slot->StackDepth.load(std::memory_order_acquire);
+
+    if (depth < 0) {
+        LogAdd(1, "[ThreadMonitor]   (no stack: thread did not answer)");
+    }
+
+    // Frame 0 and 1 are the capture handler and the signal trampoline
+    for (int n = 2; n < depth; n++) {
+        std::string frame = SymbolizeAddress((uint64_t)(uintptr_t)slot->Stack[n] - 1);
+
+        LogAdd(1, "[ThreadMonitor]   #%-2d %s", n - 2, frame.c_str());
+        report += "\n  " + frame;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(g_long_handler_mutex);
+    g_long_handler = report;
+}
+
+std::string ThreadMonitor::last_long_handler() {
+    std::lock_guard<std::mutex> lock(g_long_handler_mutex);
+    return g_long_handler;
+}
+
+static void WatchdogTick() {
+    int count = g_thread_slot_count.load(std::memory_order_acquire);
+    uint64_t current = ThreadMonitor::now();
+    uint64_t threshold = (uint64_t)g_watchdog_config.LongHandlerMs * 1000000ull;
+
+    for (int n = 0; n < count && n < MAX_MONITORED_THREADS; n++) {
+        THREAD_SLOT* slot = &g_thread_slots[n];
+        uint64_t since = slot->BusySince.load(std::memory_order_relaxed);
+        uint64_t running = (since != 0 && current > since) ? current - since : 0;
+
+        // Once per stuck handler
+        if (threshold != 0 && running >= threshold && since != slot->ReportedSince) {
+            slot->ReportedSince = since;
+            ReportLongHandler(slot, running);
+        }
+
+        // Utilization over about a second, counting the running handler so far
+        uint64_t busy = slot->BusyNs.load(std::memory_order_relaxed) + running;
+
+        if (current - slot->WindowAt >= 1000000000ull) {
+            int utilization = (int)((busy - slot->WindowBusyNs) * 100 / (current - slot->WindowAt));
+
+            slot->Utilization.store(utilization > 100 ? 100 : utilization, std::memory_order_relaxed);
+            slot->BusyMetric->store(slot->Utilization.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            slot->WindowBusyNs = busy;
+            slot->WindowAt = current;
+        }
+    }
+}
+
+void ThreadMonitor::start(boost::asio::io_context& io, const WATCHDOG_CONFIG& config) {
+    if (g_probe_running.exchange(true)) {
+        return;
+    }
+
+    g_watchdog_config = config;
+
+    if (g_watchdog_config.ProbeIntervalMs == 0) {
+        g_watchdog_config.ProbeIntervalMs = 100;
+    }
+
+#ifdef __linux__
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = CaptureThreadStack;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(WatchdogSignal(), &action, nullptr);
+
+    // backtrace() loads libgcc on first use; do that here, not in the handler
+    void* warm[4];
+    backtrace(warm, 4);
+#endif
+
+    auto interval = std::chrono::milliseconds(g_watchdog_config.ProbeIntervalMs);
+
+    g_probe_timer.reset(new boost::asio::steady_timer(io));
+    boost::asio::post(io, [interval]() {
+        g_probe_expected = std::chrono::steady_clock::now();
+        ScheduleProbe(interval);
+    });
+
+    g_watchdog_stop = false;
+    g_watchdog = std::thread([interval]() {
+        std::unique_lock<std::mutex> lock(g_watchdog_mutex);
+
+        while (!g_watchdog_stop) {
+            g_watchdog_wakeup.wait_for(lock, interval);
+
+            lock.unlock();
+            WatchdogTick();
+            lock.lock();
+        }
+    });
+
+    LogAdd(2, "[ThreadMonitor] Watching %d io thread(s): probe every %u ms, long handler %u ms",
+           g_thread_slot_count.load(), g_watchdog_config.ProbeIntervalMs, g_watchdog_config.LongHandlerMs);
+}
+
+void ThreadMonitor::stop() {
+    if (!g_probe_running.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_watchdog_mutex);
+        g_watchdog_stop = true;
+    }
+
+    g_watchdog_wakeup.notify_one();
+    g_watchdog.join();
+
+    // No io thread runs the probe any more; its pending wait is dropped with
+    // the io_context
+    g_probe_timer.reset();
+}
+
+int ThreadMonitor::snapshot(THREAD_STATS* stats, int max) {
+    int count = g_thread_slot_count.load(std::memory_order_acquire);
+    uint64_t current = now();
+    int written = 0;
+
+    for (int n = 0; n < count && n < MAX_MONITORED_THREADS && written < max; n++) {
+        THREAD_SLOT& slot = g_thread_slots[n];
+        uint64_t since = slot.BusySince.load(std::memory_order_relaxed);
+
+        THREAD_STATS& entry = stats[written++];
+        entry.Name = slot.Name;
+        entry.ThreadId = slot.ThreadId;
+        entry.Handlers = slot.Handlers.load(std::memory_order_relaxed);
+        entry.Utilization = slot.Utilization.load(std::memory_order_relaxed);
+        entry.MaxHandlerNs = slot.MaxHandlerNs.load(std::memory_order_relaxed);
+        entry.CurrentNs = (since != 0 && current > since) ? current - since : 0;
+    }
+
+    return written;
+}
+
+void ThreadMonitor::report() {
+    THREAD_STATS stats[MAX_MONITORED_THREADS];
+    int count = snapshot(stats, MAX_MONITORED_THREADS);
+
+    LogAdd(3, "[ThreadMonitor] %d io thread(s); loop lag %lld us (max %lld us), %lld long handler(s)", count,
+           (long long)Metrics::get("io.lag_us")->load(), (long long)Metrics::get("io.lag_max_us")->load(),
+           (long long)Metrics::get("threads.long_handlers")->load());
+
+    for (int n = 0; n < count; n++) {
+        const THREAD_STATS& entry = stats[n];
+
+        char current[32] = "idle";
+
+        if (entry.CurrentNs != 0) {
+            snprintf(current, sizeof(current), "in handler %.2f ms", entry.CurrentNs / 1e6);
+        }
+
+        LogAdd(0, "[ThreadMonitor] %-8s tid %-7u %3d%% busy, %10llu handler(s), max %.2f ms, %s", entry.Name,
+               entry.ThreadId, entry.Utilization, (unsigned long long)entry.Handlers, entry.MaxHandlerNs / 1e6,
+               current);
+    }
+}
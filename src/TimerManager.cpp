@@ -1,13 +1,32 @@
 #include "TimerManager.h"
+#include "Metrics.h"
 #include "Util.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <cstring>
+#include <future>
 
 TimerManager* g_timer_manager = nullptr;
 
+static uint64_t ElapsedNanoseconds(TimerManager::Clock::duration duration) {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return ns > 0 ? (uint64_t)ns : 0;
+}
+
+static void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
 TimerManager::TimerManager(boost::asio::io_context& io)
     : io_context_(io)
-    , timer_1s_(io)
-    , timer_5s_(io)
+    , timer_(io)
     , running_(false)
+    , next_id_(1)
+    , jitter_state_(0x9E3779B97F4A7C15ull)
+    , wakeups_(Metrics::get("timer.wakeups"))
+    , runs_(Metrics::get("timer.runs"))
 {
 }
 
@@ -16,83 +35,273 @@ TimerManager::~TimerManager() {
 }
 
 void TimerManager::start() {
-    if (running_) {
+    if (running_.exchange(true)) {
         return;
     }
-    
-    running_ = true;
-    
-    LogAdd(2, "[TimerManager] Timers started");
-    
-    schedule_1s_timer();
-    schedule_5s_timer();
+
+    LogAdd(2, "[TimerManager] Timers started (%d task(s))", (int)tasks_.size());
+
+    boost::asio::post(io_context_, [this]() { arm(); });
 }
 
 void TimerManager::stop() {
-    if (!running_) {
+    if (!running_.exchange(false)) {
         return;
     }
-    
-    running_ = false;
-    
-    timer_1s_.cancel();
-    timer_5s_.cancel();
-    
+
+    // The timer belongs to the scheduler thread, which may be arming it right
+    // now: cancel it there and wait, so no handler of ours is left queued.
+    // Nobody runs a stopped io_context, so there it is ours to cancel.
+    if (io_context_.get_executor().running_in_this_thread() || io_context_.stopped()) {
+        timer_.cancel();
+    } else {
+        std::promise<void> cancelled;
+
+        boost::asio::post(io_context_, [this, &cancelled]() {
+            timer_.cancel();
+            cancelled.set_value();
+        });
+
+        cancelled.get_future().wait();
+    }
+
     LogAdd(2, "[TimerManager] Timers stopped");
 }
 
-void TimerManager::set_1s_callback(std::function<void()> callback) {
-    callback_1s_ = callback;
+uint32_t TimerManager::schedule_every(const char* name, std::chrono::milliseconds period,
+                                      std::function<void()> task, boost::asio::io_context* executor,
+                                      std::chrono::milliseconds jitter) {
+    if (period.count() <= 0) {
+        return 0;
+    }
+
+    return add(name, period, period, jitter, std::move(task), executor);
+}
+
+uint32_t TimerManager::schedule_once(const char* name, std::chrono::milliseconds delay, std::function<void()> task,
+                                     boost::asio::io_context* executor) {
+    return add(name, Clock::duration::zero(), delay, Clock::duration::zero(), std::move(task), executor);
+}
+
+uint32_t TimerManager::add(const char* name, Clock::duration period, Clock::duration delay, Clock::duration jitter,
+                           std::function<void()> task, boost::asio::io_context* executor) {
+    std::shared_ptr<TASK> entry = std::make_shared<TASK>();
+
+    strncpy(entry->Name, name, sizeof(entry->Name) - 1);
+    entry->Name[sizeof(entry->Name) - 1] = '\0';
+    entry->Function = std::move(task);
+    entry->Executor = executor;
+    entry->Period = period;
+    entry->Jitter = jitter;
+    entry->Base = Clock::now() + delay;
+    entry->Running = false;
+    entry->Runs = 0;
+    entry->Skipped = 0;
+    entry->TotalNs = 0;
+    entry->MaxNs = 0;
+    entry->LastNs = 0;
+    entry->MaxLateNs = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        entry->Id = next_id_++;
+        entry->Due = entry->Base + next_jitter(jitter);
+        tasks_.push_back(entry);
+    }
+
+    // The timer belongs to the scheduler thread; it re-arms for the new task
+    if (running_) {
+        boost::asio::post(io_context_, [this]() { arm(); });
+    }
+
+    return entry->Id;
+}
+
+bool TimerManager::cancel(uint32_t id) {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+
+    for (auto it = tasks_.begin(); it != tasks_.end(); ++it) {
+        if ((*it)->Id == id) {
+            tasks_.erase(it);
+            return true;
+        }
+    }
+
+    return false;
 }
 
-void TimerManager::set_5s_callback(std::function<void()> callback) {
-    callback_5s_ = callback;
+TimerManager::Clock::duration TimerManager::next_jitter(Clock::duration jitter) {
+    // Caller holds tasks_mutex_
+    if (jitter <= Clock::duration::zero()) {
+        return Clock::duration::zero();
+    }
+
+    jitter_state_ ^= jitter_state_ << 13;
+    jitter_state_ ^= jitter_state_ >> 7;
+    jitter_state_ ^= jitter_state_ << 17;
+
+    return Clock::duration((Clock::rep)(jitter_state_ % (uint64_t)jitter.count()));
 }
 
-void TimerManager::schedule_1s_timer() {
+void TimerManager::arm() {
     if (!running_) {
         return;
     }
-    
-    timer_1s_.expires_after(std::chrono::seconds(1));
-    timer_1s_.async_wait([this](const boost::system::error_code& error) {
-        if (error) {
-            if (error != boost::asio::error::operation_aborted) {
-                LogAdd(1, "[TimerManager] 1s timer error: %s", error.message().c_str());
-            }
-            return;
-        }
-        
-        // Execute callback
-        if (callback_1s_) {
-            callback_1s_();
+
+    Clock::time_point next = Clock::time_point::max();
+
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+
+        for (const auto& task : tasks_) {
+            next = std::min(next, task->Due);
         }
-        
-        // Reschedule
-        schedule_1s_timer();
-    });
+    }
+
+    if (next == Clock::time_point::max()) {
+        return;
+    }
+
+    // Replaces (aborts) any earlier wait
+    timer_.expires_at(next);
+    timer_.async_wait([this](const boost::system::error_code& error) { handle_timer(error); });
 }
 
-void TimerManager::schedule_5s_timer() {
+void TimerManager::handle_timer(const boost::system::error_code& error) {
+    if (error) {
+        if (error != boost::asio::error::operation_aborted) {
+            LogAdd(1, "[TimerManager] Timer error: %s", error.message().c_str());
+        }
+        return;
+    }
+
     if (!running_) {
         return;
     }
-    
-    timer_5s_.expires_after(std::chrono::seconds(5));
-    timer_5s_.async_wait([this](const boost::system::error_code& error) {
-        if (error) {
-            if (error != boost::asio::error::operation_aborted) {
-                LogAdd(1, "[TimerManager] 5s timer error: %s", error.message().c_str());
+
+    wakeups_->fetch_add(1, std::memory_order_relaxed);
+
+    Clock::time_point now = Clock::now();
+    Clock::time_point horizon = now + std::chrono::milliseconds(TIMER_COALESCE_MS);
+    std::vector<std::pair<std::shared_ptr<TASK>, Clock::time_point>> due;
+
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+
+        for (auto it = tasks_.begin(); it != tasks_.end();) {
+            TASK& task = **it;
+
+            if (task.Due > horizon) {
+                ++it;
+                continue;
+            }
+
+            due.emplace_back(*it, task.Due);
+
+            if (task.Period == Clock::duration::zero()) {
+                it = tasks_.erase(it);
+                continue;
+            }
+
+            // Fixed rate: the next slot follows the last slot, not this run
+            task.Base += task.Period;
+
+            while (task.Base <= now) {
+                task.Base += task.Period;
+                task.Skipped.fetch_add(1, std::memory_order_relaxed);
             }
-            return;
+
+            task.Due = task.Base + next_jitter(task.Jitter);
+            ++it;
         }
-        
-        // Execute callback
-        if (callback_5s_) {
-            callback_5s_();
+    }
+
+    for (const auto& entry : due) {
+        dispatch(entry.first, entry.second);
+    }
+
+    arm();
+}
+
+void TimerManager::dispatch(const std::shared_ptr<TASK>& task, Clock::time_point due) {
+    runs_->fetch_add(1, std::memory_order_relaxed);
+
+    if (task->Executor == nullptr || task->Executor == &io_context_) {
+        execute(task, due);
+        return;
+    }
+
+    boost::asio::post(*task->Executor, [task, due]() { execute(task, due); });
+}
+
+void TimerManager::execute(const std::shared_ptr<TASK>& task, Clock::time_point due) {
+    // A run still going on another executor: this one is skipped
+    if (task->Running.exchange(true, std::memory_order_acquire)) {
+        task->Skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Clock::time_point started = Clock::now();
+
+    task->Function();
+
+    uint64_t elapsed = ElapsedNanoseconds(Clock::now() - started);
+
+    task->Runs.fetch_add(1, std::memory_order_relaxed);
+    task->TotalNs.fetch_add(elapsed, std::memory_order_relaxed);
+    task->LastNs.store(elapsed, std::memory_order_relaxed);
+    UpdateMax(task->MaxNs, elapsed);
+    UpdateMax(task->MaxLateNs, ElapsedNanoseconds(started - due));
+
+    task->Running.store(false, std::memory_order_release);
+}
+
+int TimerManager::snapshot(TIMER_TASK_STATS* stats, int max) {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    int count = 0;
+
+    for (const auto& task : tasks_) {
+        if (count >= max) {
+            break;
         }
-        
-        // Reschedule
-        schedule_5s_timer();
-    });
+
+        TIMER_TASK_STATS& entry = stats[count++];
+        memcpy(entry.Name, task->Name, sizeof(entry.Name));
+        entry.Id = task->Id;
+        entry.PeriodMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(task->Period).count();
+        entry.Runs = task->Runs.load(std::memory_order_relaxed);
+        entry.Skipped = task->Skipped.load(std::memory_order_relaxed);
+        entry.TotalNs = task->TotalNs.load(std::memory_order_relaxed);
+        entry.MaxNs = task->MaxNs.load(std::memory_order_relaxed);
+        entry.LastNs = task->LastNs.load(std::memory_order_relaxed);
+        entry.MaxLateNs = task->MaxLateNs.load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void TimerManager::report() {
+    TIMER_TASK_STATS stats[64];
+    int count = snapshot(stats, 64);
+
+    LogAdd(0, "[TimerManager] %d task(s), %lld wakeup(s) for %lld run(s)", count,
+           (long long)wakeups_->load(), (long long)runs_->load());
+    LogAdd(0, "[TimerManager] %-20s %8s %8s %7s %9s %9s %9s %10s", "Task", "Period", "Runs", "Skipped", "Avg us",
+           "Max us", "Last us", "MaxLate us");
+
+    for (int n = 0; n < count; n++) {
+        const TIMER_TASK_STATS& task = stats[n];
+        char period[24];
+
+        if (task.PeriodMs == 0) {
+            snprintf(period, sizeof(period), "once");
+        } else {
+            snprintf(period, sizeof(period), "%llums", (unsigned long long)task.PeriodMs);
+        }
+
+        LogAdd(0, "[TimerManager] %-20s %8s %8llu %7llu %9.1f %9.1f %9.1f %10.1f", task.Name, period,
+               (unsigned long long)task.Runs, (unsigned long long)task.Skipped,
+               task.Runs ? task.TotalNs / 1000.0 / task.Runs : 0.0, task.MaxNs / 1000.0, task.LastNs / 1000.0,
+               task.MaxLateNs / 1000.0);
+    }
 }
@@ -0,0 +1,159 @@
+#include "TrafficRecorder.h"
+#include "Metrics.h"
+#include "Util.h"
+#include <cstring>
+
+TrafficRecorder g_traffic_recorder;
+
+static int64_t SteadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TrafficRecorder::TrafficRecorder()
+    : enabled_(false)
+    , started_(0)
+    , file_(nullptr)
+    , writer_stop_(false)
+    , writer_kicked_(false)
+    , records_(Metrics::get("recorder.records"))
+    , bytes_(Metrics::get("recorder.bytes"))
+    , dropped_(Metrics::get("recorder.dropped"))
+{
+}
+
+TrafficRecorder::~TrafficRecorder() {
+    stop();
+}
+
+bool TrafficRecorder::start(const char* path, size_t buffer_size) {
+    if (writer_.joinable()) {
+        LogAdd(1, "[TrafficRecorder] Already recording");
+        return false;
+    }
+
+    ring_.allocate(buffer_size);
+
+    // Whatever producers published after the last stop belongs to no capture
+    drain();
+
+    file_ = fopen(path, "wb");
+
+    if (file_ == nullptr) {
+        LogAdd(1, "[TrafficRecorder] Could not open %s", path);
+        return false;
+    }
+
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    TRAFFIC_CAPTURE_HEADER header;
+    header.Magic = TRAFFIC_CAPTURE_MAGIC;
+    header.Version = TRAFFIC_CAPTURE_VERSION;
+    header.RecordSize = sizeof(TRAFFIC_RECORD);
+    header.StartTime = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    fwrite(&header, sizeof(header), 1, file_);
+
+    started_.store(SteadyNanoseconds(), std::memory_order_relaxed);
+    writer_stop_ = false;
+    writer_ = std::thread([this]() { run_writer(); });
+
+    enabled_.store(true, std::memory_order_release);
+
+    LogAdd(2, "[TrafficRecorder] Recording traffic to %s (%zu KB buffer)", path, ring_.capacity() / 1024);
+
+    return true;
+}
+
+void TrafficRecorder::stop() {
+    if (!writer_.joinable()) {
+        return;
+    }
+
+    enabled_.store(false, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_stop_ = true;
+    }
+
+    writer_wakeup_.notify_one();
+    writer_.join();
+
+    fclose(file_);
+    file_ = nullptr;
+
+    LogAdd(2, "[TrafficRecorder] Recording stopped: %lld record(s), %lld dropped",
+           (long long)records_->load(), (long long)dropped_->load());
+}
+
+void TrafficRecorder::append(uint8_t kind, uint32_t session, const uint8_t* data, size_t size) {
+    uint8_t* slot = (size <= UINT16_MAX) ? ring_.reserve(sizeof(TRAFFIC_RECORD) + size) : nullptr;
+
+    if (slot == nullptr) {
+        dropped_->fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TRAFFIC_RECORD record;
+    record.Timestamp = (uint64_t)(SteadyNanoseconds() - started_.load(std::memory_order_relaxed));
+    record.Session = session;
+    record.Kind = kind;
+    record.Reserved = 0;
+    record.Size = (uint16_t)size;
+
+    memcpy(slot, &record, sizeof(record));
+    if (size != 0) {
+        memcpy(slot + sizeof(record), data, size);
+    }
+
+    ring_.publish(slot, sizeof(record) + size);
+
+    // Half full: wake the writer early, once, instead of waiting for its poll
+    if (ring_.used() > ring_.capacity() / 2 && !writer_kicked_.exchange(true, std::memory_order_relaxed)) {
+        writer_wakeup_.notify_one();
+    }
+}
+
+size_t TrafficRecorder::drain() {
+    // Single consumer: only the writer thread (or start/stop with it joined)
+    size_t written = 0;
+
+    ring_.drain([this, &written](const uint8_t* record, size_t size) {
+        if (file_ != nullptr) {
+            fwrite(record, size, 1, file_);
+            written += size;
+            records_->fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    if (written != 0) {
+        bytes_->fetch_add(written, std::memory_order_relaxed);
+    }
+
+    return written;
+}
+
+void TrafficRecorder::run_writer() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+
+    // Producers only signal when the ring runs half full; otherwise poll
+    while (!writer_stop_) {
+        writer_wakeup_.wait_for(lock, std::chrono::milliseconds(10));
+
+        lock.unlock();
+        writer_kicked_.store(false, std::memory_order_relaxed);
+
+        if (drain() != 0) {
+            fflush(file_);
+        }
+
+        lock.lock();
+    }
+
+    lock.unlock();
+
+    drain();
+    fflush(file_);
+}
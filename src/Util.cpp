@@ -1,4 +1,5 @@
 #include "Util.h"
+#include "BinaryLog.h"
 #include "Console.h"
 #include "ConsoleInterface.h"
 #include <cstdio>
@@ -22,6 +23,26 @@ void ErrorMessageBox(const char* message, ...) {
 }
 
 void LogAdd(int color, const char* text, ...) {
+#ifdef CS_SIMULATION
+    if (!gSimulationLog) {
+        return;
+    }
+#endif
+
+    // The file sink takes the raw arguments, whatever the console shows
+    if (g_binary_log.enabled()) {
+        va_list args;
+        va_start(args, text);
+        g_binary_log.append(color, text, args);
+        va_end(args);
+    }
+
+    // [Console] EnableGeneralOutput=0: skip the formatting as well. Errors
+    // (level 1) are always shown.
+    if (color != 1 && !gConsole.EnableOutput[CON_GENERAL]) {
+        return;
+    }
+
     char buffer[1024];
     va_list args;
     va_start(args, text);
@@ -67,6 +88,12 @@ void ConsoleProtocolLog(int type, const uint8_t* lpMsg, int size) {
     gConsole.Output(type, "%s", buffer);
 }
 
+void IpAddressToString(uint32_t address, char* buffer, int size) {
+    snprintf(buffer, size, "%u.%u.%u.%u",
+             (address >> 24) & 0xFF, (address >> 16) & 0xFF,
+             (address >> 8) & 0xFF, address & 0xFF);
+}
+
 void ConnectServerTimeoutProc() {
     // This will be implemented when ClientManager is ready
     // For now, it's a placeholder
@@ -1,16 +1,41 @@
 #include "ConfigManager.h"
+#include "ControlPlane.h"
+#include "Metrics.h"
 #include "SocketManager.h"
 #include "SocketManagerUdp.h"
 #include "TimerManager.h"
+#include "Tenant.h"
 #include "ConsoleInterface.h"
 #include "Console.h"
 #include "IpManager.h"
 #include "ServerList.h"
+#include "ServerCheckpoint.h"
+#include "ServerCluster.h"
+#include "HttpStatus.h"
+#include "SharedServerTable.h"
+#include "StatsExport.h"
+#include "TrafficRecorder.h"
+#include "FlightRecorder.h"
+#include "LockProfiler.h"
+#include "ReceiveTimestamps.h"
+#include "BinaryLog.h"
+#include "RateLimitedLog.h"
+#include "RequestTracer.h"
+#include "ThreadMonitor.h"
 #include "Util.h"
 #include "Version.h"
 
+#ifdef CS_ALLOC_AUDIT
+#include "AllocAudit.h"
+#endif
+
 #ifdef __linux__
 #include "platform/linux/SignalHandler.h"
+#include "platform/linux/ListenerHandoff.h"
+#include "platform/linux/PreforkSupervisor.h"
+#include "platform/linux/SelfProfiler.h"
+#include <pthread.h>
+#include <unistd.h>
 #elif defined(_WIN32)
 #include "platform/windows/CrashHandler.h"
 #endif
@@ -19,12 +44,36 @@
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <memory>
 #include <csignal>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <string>
 
 // Global io_context
 boost::asio::io_context* g_io_context = nullptr;
 std::atomic<bool> g_running{true};
 
+// An extra tenant ([Tenant.N]) and what it owns; listeners go first
+struct TENANT_INSTANCE
+{
+    std::unique_ptr<CServerList> ServerList;
+    std::unique_ptr<CIpManager> IpManager;
+    std::unique_ptr<SocketManager> Tcp;
+    std::unique_ptr<SocketManagerUdp> Udp;
+};
+
+#ifdef __linux__
+// SIGUSR2 asks for a CPU profile; the main loop starts it outside the handler
+std::atomic<bool> g_profile_requested{false};
+
+void profile_signal_handler(int signal) {
+    g_profile_requested = true;
+}
+#endif
+
 void signal_handler(int signal) {
     std::cout << "\nShutdown signal received..." << std::endl;
     g_running = false;
@@ -56,6 +105,9 @@ int main(int argc, char* argv[]) {
     // Install signal handlers for graceful shutdown
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+#ifdef __linux__
+    std::signal(SIGUSR2, profile_signal_handler);
+#endif
 
     // Load configuration
     // Log build info
@@ -72,9 +124,47 @@ int main(int argc, char* argv[]) {
         std::cout << "[WARN] Configuration file not found, using defaults" << std::endl;
     }
     
+    // Prefork mode: this may be a worker the supervisor started
+    bool prefork_worker = false;
+#ifdef __linux__
+    PREFORK_WORKER_ARGS worker_args;
+    prefork_worker = PreforkSupervisor::parse_worker_args(argc, argv, &worker_args);
+#endif
+
     int tcp_port = config.get_int("ConnectServerInfo", "ConnectServerPortTCP", 44405);
     int udp_port = config.get_int("ConnectServerInfo", "ConnectServerPortUDP", 55601);
     MaxIpConnection = config.get_int("ConnectServerInfo", "MaxIpConnection", 0);
+    gConsole.EnableOutput[CON_GENERAL] = config.get_int("Console", "EnableGeneralOutput", 1) != 0;
+    if (config.get_int("Log", "LOG", 0) != 0 && !prefork_worker) {
+        BINARY_LOG_CONFIG log_config;
+        log_config.Directory = config.get_string("Log", "Path", "log");
+        log_config.SegmentSize = (size_t)config.get_int("Log", "SegmentMB", 64) << 20;
+        log_config.RotateSeconds = (uint32_t)config.get_int("Log", "RotateMinutes", 60) * 60;
+        log_config.MaxFiles = (uint32_t)config.get_int("Log", "MaxFiles", 168);
+        log_config.BufferSize = (size_t)config.get_int("Log", "BufferKB", 4096) * 1024;
+        g_binary_log.start(log_config);
+    }
+
+    // Per-call-site log budgets by "[Prefix]" (lines per second)
+    for (const auto& limit : config.get_section("LogLimits")) {
+        RateLimitedLog::set_limit(limit.first == "Default" ? "" : limit.first.c_str(),
+                                  (uint32_t)std::atoi(limit.second.c_str()));
+    }
+
+    ReceiveTimestamps::set_enabled(config.get_int("Latency", "ReceiveTimestamps", 0) != 0);
+
+    TRACE_CONFIG trace_config;
+    trace_config.Enabled = config.get_int("Trace", "Enable", 1) != 0;
+    trace_config.SlowRequestNs = (uint64_t)config.get_int("Trace", "SlowRequestMs", 50) * 1000000ull;
+    trace_config.SlowSampleRate = (uint32_t)config.get_int("Trace", "SlowSampleRate", 1);
+    trace_config.SlowLogPerSecond = (uint32_t)config.get_int("Trace", "SlowLogPerSecond", 5);
+    RequestTracer::configure(trace_config);
+
+#ifdef __linux__
+    if (prefork_worker) {
+        return PreforkSupervisor::run_worker(worker_args, std::max(config.get_int("Prefork", "Threads", 1), 1));
+    }
+#endif
     
     std::cout << "  TCP Port: " << tcp_port << std::endl;
     std::cout << "  UDP Port: " << udp_port << std::endl;
@@ -84,6 +174,19 @@ int main(int argc, char* argv[]) {
     std::cout << "\n--- Loading ServerList ---" << std::endl;
     gServerList.Load("ServerList.dat");
 
+    FAILURE_DETECTOR_CONFIG detector_config;
+    detector_config.SuspectPhi = std::atof(config.get_string("FailureDetector", "SuspectPhi", "3").c_str());
+    detector_config.OfflinePhi = std::atof(config.get_string("FailureDetector", "OfflinePhi", "8").c_str());
+    detector_config.MinStdDeviation = config.get_int("FailureDetector", "MinStdDeviation", 200);
+    detector_config.AcceptablePause = config.get_int("FailureDetector", "AcceptablePause", 0);
+    detector_config.FirstInterval = config.get_int("FailureDetector", "FirstInterval", 1000);
+    detector_config.MaxHeartbeatPause = config.get_int("FailureDetector", "MaxHeartbeatPause", SERVER_HEARTBEAT_TIMEOUT);
+    gServerList.SetFailureDetectorConfig(detector_config);
+    gServerList.SetShowOfflineServers(config.get_int("ServerList", "ShowOfflineServers", 1) != 0);
+
+    std::cout << "  Suspect/Offline phi: " << detector_config.SuspectPhi
+              << "/" << detector_config.OfflinePhi << std::endl;
+
     // Initialize console interface
     std::cout << "\n--- Initializing Console ---" << std::endl;
     ConsoleInterface console;
@@ -103,42 +206,315 @@ int main(int argc, char* argv[]) {
     SocketManager socket_manager(io_context);
     g_socket_manager = &socket_manager;
     
-    SocketManagerUdp socket_manager_udp(io_context);
+    // Heartbeats, server table updates and timers run on the control plane,
+    // isolated from the client worker pool
+    ControlPlane control_plane;
+    g_control_plane = &control_plane;
+    
+    SocketManagerUdp socket_manager_udp(control_plane.context());
     g_socket_manager_udp = &socket_manager_udp;
     
-    TimerManager timer_manager(io_context);
+    TimerManager timer_manager(control_plane.context());
     g_timer_manager = &timer_manager;
 
+    control_plane.start(config.get_int("ControlPlane", "CpuAffinity", -1),
+                        config.get_int("ControlPlane", "ProbeInterval", 100));
+
+    // Zero-downtime restart: take the listening sockets (and the live server
+    // table) over from systemd or from the process we are replacing
+    int inherited_tcp = -1;
+    int inherited_udp = -1;
+    int inherited_http = -1;
+    bool inherited_table = false;
+    std::atomic<bool> handed_off{false};
+
+    int tenant_count = config.get_int("Tenants", "Count", 0);
+
+#ifdef __linux__
+    std::string handoff_path = config.get_string("Handoff", "Path", "");
+    ListenerHandoff handoff(control_plane.context(), gServerList);
+    HANDOFF_SOCKETS inherited = {-1, -1, -1};
+
+    // Only the default tenant's sockets are passed: the other tenants could
+    // not bind their ports while the predecessor still holds them
+    if (!handoff_path.empty() && tenant_count > 0) {
+        LogAdd(1, "[Handoff] Not offered with more than one tenant");
+        handoff_path.clear();
+    }
+
+    if (!handoff_path.empty() && handoff.request(handoff_path.c_str(), &inherited)) {
+        inherited_table = true;
+    }
+
+    if (inherited_table || ListenerHandoff::receive_from_systemd(&inherited)) {
+        inherited_tcp = inherited.TcpSocket;
+        inherited_udp = inherited.UdpSocket;
+        inherited_http = inherited.HttpSocket;
+        std::cout << "  Inherited listening sockets (tcp fd " << inherited_tcp
+                  << ", udp fd " << inherited_udp << ")" << std::endl;
+    }
+#endif
+
+    // Warm start: without a table from the predecessor, restore the last
+    // checkpoint (fresh entries only, provisional until they heartbeat)
+    std::string checkpoint_path = config.get_string("Checkpoint", "Path", "ConnectServer.state");
+
+    if (!checkpoint_path.empty() && gServerCheckpoint.Open(checkpoint_path.c_str()) && !inherited_table) {
+        gServerCheckpoint.Restore(&gServerList);
+    }
+
+    // Stats segment for external tools (cs_stat, monitoring agents)
+    CStatsExport stats_export;
+    std::string stats_path = config.get_string("Stats", "Path", "");
+    int stats_interval = std::max(config.get_int("Stats", "Interval", 100), 10);
+
+    if (!stats_path.empty()) {
+        stats_export.Open(stats_path.c_str());
+    }
+
+    // Prefork mode: worker processes accept the clients and answer from a
+    // shared copy of the server table; this process only listens for them
+    int prefork_workers = 0;
+#ifdef __linux__
+    CSharedServerTable shared_table;
+    PreforkSupervisor prefork(shared_table);
+    prefork_workers = std::min(config.get_int("Prefork", "Workers", 0), MAX_PREFORK_WORKERS);
+#endif
+
     // Start TCP server
     std::cout << "\n--- Starting TCP Server ---" << std::endl;
-    if (!socket_manager.start(tcp_port)) {
-        std::cerr << "[ERROR] Failed to start TCP server" << std::endl;
-        return 1;
+#ifdef __linux__
+    if (prefork_workers > 0) {
+        int listener = (inherited_tcp != -1) ? inherited_tcp : PreforkSupervisor::open_listener(tcp_port);
+
+        if (listener == -1 || !shared_table.Create()) {
+            std::cerr << "[ERROR] Failed to set up prefork mode" << std::endl;
+            handoff.complete(false);
+            return 1;
+        }
+
+        gServerList.SetSharedTable(&shared_table);
+        stats_export.SetSharedTable(&shared_table);
+
+        if (!prefork.start(listener, prefork_workers)) {
+            std::cerr << "[ERROR] Failed to start prefork workers" << std::endl;
+            handoff.complete(false);
+            return 1;
+        }
+
+        console.log(Color::GREEN, "TCP server started on port " + std::to_string(tcp_port) + " with " +
+                    std::to_string(prefork_workers) + " prefork worker(s)");
+    }
+#endif
+
+    if (prefork_workers == 0) {
+        if (!((inherited_tcp != -1) ? socket_manager.start_native(inherited_tcp) : socket_manager.start(tcp_port))) {
+            std::cerr << "[ERROR] Failed to start TCP server" << std::endl;
+#ifdef __linux__
+            handoff.complete(false);
+#endif
+            return 1;
+        }
+        console.log(Color::GREEN, "TCP server started on port " + std::to_string(socket_manager.port()));
     }
-    console.log(Color::GREEN, "TCP server started on port " + std::to_string(tcp_port));
 
     // Start UDP server
     std::cout << "\n--- Starting UDP Server ---" << std::endl;
-    if (!socket_manager_udp.start(udp_port)) {
+    if (!((inherited_udp != -1) ? socket_manager_udp.start_native(inherited_udp) : socket_manager_udp.start(udp_port))) {
         std::cerr << "[ERROR] Failed to start UDP server" << std::endl;
+#ifdef __linux__
+        handoff.complete(false);
+#endif
+        return 1;
+    }
+    console.log(Color::GREEN, "UDP server started on port " + std::to_string(socket_manager_udp.port()));
+
+    // Multi-tenant mode: more listener pairs on the same io threads and
+    // control plane, each with its own server list and IP limits. Checkpoint
+    // and cluster replication cover tenant 0 only; handoff is off with tenants.
+    std::vector<std::unique_ptr<TENANT_INSTANCE>> tenants;
+
+    for (int n = 1; n <= tenant_count; n++) {
+        std::string section = "Tenant." + std::to_string(n);
+        std::string name = config.get_string(section, "Name", section);
+        std::unique_ptr<TENANT_INSTANCE> instance(new TENANT_INSTANCE());
+
+        instance->ServerList.reset(new CServerList());
+        instance->IpManager.reset(new CIpManager());
+        instance->IpManager->SetMaxIpConnection(config.get_int(section, "MaxIpConnection", MaxIpConnection));
+
+        TENANT* tenant = CreateTenant(name.c_str(), instance->ServerList.get(), instance->IpManager.get());
+
+        if (tenant == nullptr) {
+#ifdef __linux__
+            handoff.complete(false);
+#endif
+            return 1;
+        }
+
+        instance->ServerList->Load(config.get_string(section, "ServerList", "ServerList.dat").c_str());
+        instance->ServerList->SetFailureDetectorConfig(detector_config);
+        instance->ServerList->SetShowOfflineServers(
+            config.get_int(section, "ShowOfflineServers", config.get_int("ServerList", "ShowOfflineServers", 1)) != 0);
+
+        instance->Tcp.reset(new SocketManager(io_context, tenant));
+        instance->Udp.reset(new SocketManagerUdp(control_plane.context(), tenant));
+
+        if (!instance->Tcp->start(config.get_int(section, "PortTCP", 0)) ||
+            !instance->Udp->start(config.get_int(section, "PortUDP", 0))) {
+            std::cerr << "[ERROR] Failed to start tenant " << name << std::endl;
+#ifdef __linux__
+            handoff.complete(false);
+#endif
+            return 1;
+        }
+
+        console.log(Color::GREEN, "Tenant " + name + " started on TCP " + std::to_string(instance->Tcp->port()) +
+                    ", UDP " + std::to_string(instance->Udp->port()));
+
+        tenants.push_back(std::move(instance));
+    }
+
+    // Cluster mode: replicate the server table with the other ConnectServers
+    ServerCluster server_cluster(control_plane.context(), gServerList);
+    g_server_cluster = &server_cluster;
+
+    CLUSTER_CONFIG cluster_config;
+    cluster_config.NodeId = config.get_int("Cluster", "NodeId", 0);
+    cluster_config.Port = config.get_int("Cluster", "Port", 55602);
+    cluster_config.ClusterKey = config.get_int("Cluster", "Key", 0);
+    cluster_config.Interval = config.get_int("Cluster", "Interval", 200);
+    cluster_config.FullSyncInterval = config.get_int("Cluster", "FullSyncInterval", 5000);
+
+    if (cluster_config.NodeId != 0) {
+        if (!ServerCluster::parse_peers(config.get_string("Cluster", "Peers", ""), &cluster_config.Peers) ||
+            !server_cluster.start(cluster_config)) {
+            std::cerr << "[ERROR] Failed to start cluster node" << std::endl;
+#ifdef __linux__
+            handoff.complete(false);
+#endif
+            return 1;
+        }
+        console.log(Color::GREEN, "Cluster node " + std::to_string(cluster_config.NodeId) + " started on port " +
+                    std::to_string(server_cluster.port()));
+    }
+
+    // JSON server list over HTTP for launchers and status pages
+    HttpStatusServer http_status(io_context);
+    HTTP_STATUS_CONFIG http_config;
+    http_config.Port = (uint16_t)config.get_int("Http", "Port", 0);
+    http_config.MaxConnections = (uint32_t)std::max(config.get_int("Http", "MaxConnections", 256), 1);
+    http_config.MaxWaitSeconds = (uint32_t)std::max(config.get_int("Http", "MaxWaitSeconds", 60), 0);
+    int http_render_interval = std::max(config.get_int("Http", "RenderInterval", 250), 10);
+
+    // The predecessor's listener comes with the handoff, like the TCP/UDP pair
+    if (http_config.Port != 0) {
+        if (!((inherited_http != -1) ? http_status.start_native(http_config, inherited_http)
+                                     : http_status.start(http_config))) {
+            std::cerr << "[ERROR] Failed to start HTTP status endpoint" << std::endl;
+#ifdef __linux__
+            handoff.complete(false);
+#endif
+            return 1;
+        }
+        console.log(Color::GREEN, "HTTP status endpoint started on port " + std::to_string(http_status.port()));
+    }
+#ifdef __linux__
+    else if (inherited_http != -1) {
+        ::close(inherited_http);
+    }
+#endif
+
+    // Traffic capture for tools/cs_replay (also "record start <path>" at runtime)
+    size_t recorder_buffer = (size_t)config.get_int("Recorder", "BufferSize", 4096) * 1024;
+    std::string recorder_path = config.get_string("Recorder", "Path", "");
+
+    if (!recorder_path.empty()) {
+        g_traffic_recorder.start(recorder_path.c_str(), recorder_buffer);
+    }
+
+#ifdef __linux__
+    // In-process CPU profiler: "profile <seconds> [file]" or SIGUSR2
+    int profile_frequency = config.get_int("Profiler", "Frequency", PROFILER_DEFAULT_FREQUENCY);
+    int profile_signal_seconds = config.get_int("Profiler", "SignalSeconds", 30);
+#endif
+
+#ifdef __linux__
+    // Predecessor may stop accepting and drain now. If it gave up waiting
+    // for us it still serves on the sockets, and two of us would split the
+    // heartbeats between them.
+    if (!handoff.complete(true)) {
+        std::cerr << "[ERROR] Predecessor kept its sockets, exiting" << std::endl;
         return 1;
     }
-    console.log(Color::GREEN, "UDP server started on port " + std::to_string(udp_port));
 
-    // Set up timer callbacks
-    timer_manager.set_1s_callback([]() {
-        // 1-second timer - ServerList maintenance
-        gServerList.MainProc();
+    // Workers keep accepting on the listening socket, so a prefork
+    // supervisor does not hand it over
+    if (!handoff_path.empty() && prefork_workers > 0) {
+        LogAdd(1, "[Handoff] Not offered in prefork mode");
+    } else if (!handoff_path.empty()) {
+        // Runs on the control plane once a successor took our sockets over
+        handoff.listen(handoff_path.c_str(), socket_manager.native_handle(), socket_manager_udp.native_handle(),
+            http_status.native_handle(), [&]() {
+                socket_manager_udp.stop();
+                socket_manager.stop_accepting();
+                server_cluster.stop();
+                gServerCheckpoint.Close();
+                stats_export.Close();
+                boost::asio::post(io_context, [&http_status]() {
+                    http_status.stop();
+                });
+                handed_off = true;
+            });
+    }
+#endif
+
+    // Maintenance tasks, all on the control plane
+    timer_manager.schedule_every("serverlist", std::chrono::seconds(1), []() {
+        // ServerList maintenance (liveness backstop), every tenant
+        for (int n = 0; n < GetTenantCount(); n++) {
+            GetTenant(n)->ServerList->MainProc();
+        }
+    });
+
+    timer_manager.schedule_every("checkpoint", std::chrono::seconds(1), []() {
+        gServerCheckpoint.Save(&gServerList);
+    });
+
+    if (stats_export.IsOpen()) {
+        timer_manager.schedule_every("stats", std::chrono::milliseconds(stats_interval), [&stats_export]() {
+            stats_export.Publish();
+        });
+    }
+
+    if (http_config.Port != 0) {
+        timer_manager.schedule_every("http-render", std::chrono::milliseconds(http_render_interval), [&http_status]() {
+            http_status.render();
+        });
+    }
+
+    timer_manager.schedule_every("log-limits", std::chrono::seconds(1), []() {
+        RateLimitedLog::flush();
     });
 
-    timer_manager.set_5s_callback([]() {
-        // 5-second timer - timeout checks
-        // TODO: Implement client timeout checking
+    timer_manager.schedule_every("trace-publish", std::chrono::seconds(5), []() {
+        RequestTracer::publish();
     });
 
+#ifdef __linux__
+    if (prefork_workers > 0) {
+        timer_manager.schedule_every("prefork", std::chrono::milliseconds(100), [&prefork]() {
+            prefork.reap();
+        });
+    }
+#endif
+
     // Start timers
     std::cout << "\n--- Starting Timers ---" << std::endl;
     timer_manager.start();
+    for (int n = 0; n < GetTenantCount(); n++) {
+        GetTenant(n)->ServerList->StartLivenessTimer(control_plane.context());
+    }
     console.log(Color::GREEN, "Timers started");
 
     // Create worker threads
@@ -150,11 +526,26 @@ int main(int argc, char* argv[]) {
     
     std::vector<std::thread> worker_threads;
     for (unsigned int i = 0; i < thread_count; ++i) {
-        worker_threads.emplace_back([&io_context]() {
+        worker_threads.emplace_back([&io_context, i]() {
+            FlightRecorder::set_thread_name("io");
+#ifdef CS_ALLOC_AUDIT
+            AllocAudit::set_thread_name("io");
+#endif
+            std::string name = "io-" + std::to_string(i);
+            ThreadMonitor::register_thread(name.c_str());
+#ifdef __linux__
+            pthread_setname_np(pthread_self(), name.c_str());
+#endif
             io_context.run();
         });
     }
 
+    // Loop lag probe and long-handler watchdog over the workers
+    WATCHDOG_CONFIG watchdog_config;
+    watchdog_config.ProbeIntervalMs = (uint32_t)config.get_int("Watchdog", "ProbeInterval", 100);
+    watchdog_config.LongHandlerMs = (uint32_t)config.get_int("Watchdog", "LongHandlerMs", 200);
+    ThreadMonitor::start(io_context, watchdog_config);
+
     console.log(Color::GREEN, "Server is running!");
     console.log(Color::YELLOW, "Press Ctrl+C to shutdown");
     std::cout << "\n=== Phase 2 Test Complete - Server Running ===" << std::endl;
@@ -162,7 +553,90 @@ int main(int argc, char* argv[]) {
 
     // Set up console command handler
     console.set_command_handler([&](const std::string& cmd) {
-        if (cmd.find("reload") == 0) {
+        if (cmd == "metrics") {
+            RequestTracer::publish();
+            Metrics::report();
+        } else if (cmd.find("record") == 0) {
+            // record start <path> | record stop
+            if (cmd.find("start ") != std::string::npos) {
+                std::string path = cmd.substr(cmd.find("start ") + 6);
+                console.log(g_traffic_recorder.start(path.c_str(), recorder_buffer) ? Color::GREEN : Color::RED,
+                            "Traffic recording to " + path);
+            } else if (cmd.find("stop") != std::string::npos) {
+                g_traffic_recorder.stop();
+                console.log(Color::GREEN, "Traffic recording stopped");
+            } else {
+                console.log(Color::YELLOW, g_traffic_recorder.enabled() ? "Recording traffic" : "Not recording");
+            }
+        } else if (cmd.find("locks") == 0) {
+            // locks | locks reset
+            if (cmd.find("reset") != std::string::npos) {
+                LockProfiler::reset();
+                console.log(Color::GREEN, "Lock counters reset");
+            } else {
+                LockProfiler::report();
+            }
+        } else if (cmd == "threads") {
+            ThreadMonitor::report();
+        } else if (cmd == "tasks") {
+            timer_manager.report();
+#ifdef __linux__
+        } else if (cmd == "workers") {
+            prefork.report();
+#endif
+        } else if (cmd == "tenants") {
+            for (int n = 0; n < GetTenantCount(); n++) {
+                TENANT* tenant = GetTenant(n);
+                LogAdd(0, "[Tenant] %d %-20s TCP %5d UDP %5d, %d server(s), max %d per IP", tenant->Id, tenant->Name,
+                       tenant->Tcp ? tenant->Tcp->port() : 0, tenant->Udp ? tenant->Udp->port() : 0,
+                       tenant->ServerList->GetServerCount(), tenant->IpManager->GetMaxIpConnection());
+            }
+        } else if (cmd.find("trace") == 0) {
+            // trace | trace reset
+            if (cmd.find("reset") != std::string::npos) {
+                RequestTracer::reset();
+                console.log(Color::GREEN, "Request traces reset");
+            } else {
+                RequestTracer::report();
+            }
+        } else if (cmd.find("latency") == 0) {
+            // latency | latency reset
+            if (cmd.find("reset") != std::string::npos) {
+                ReceiveTimestamps::reset();
+                console.log(Color::GREEN, "Latency histograms reset");
+            } else {
+                ReceiveTimestamps::report();
+            }
+        } else if (cmd.find("flight") == 0) {
+            // flight [path]: snapshot the flight recorder rings
+            std::string path = (cmd.size() > 7) ? cmd.substr(7)
+                                                : "flight_" + std::to_string(time(nullptr)) + ".bin";
+            console.log(FlightRecorder::dump(path.c_str()) ? Color::GREEN : Color::RED,
+                        "Flight recorder snapshot to " + path);
+#ifdef __linux__
+        } else if (cmd.find("profile") == 0) {
+            // profile <seconds> [file] | profile stop
+            if (cmd.find("stop") != std::string::npos) {
+                g_self_profiler.stop();
+                console.log(Color::GREEN, "Profile stopping, writing output");
+                return;
+            }
+
+            int seconds = (cmd.size() > 8) ? std::atoi(cmd.c_str() + 8) : 0;
+            size_t file_at = cmd.find(' ', 8);
+            std::string path = (file_at != std::string::npos) ? cmd.substr(file_at + 1)
+                                                              : "profile_" + std::to_string(time(nullptr)) + ".folded";
+            std::string error;
+
+            if (seconds <= 0) {
+                console.log(Color::YELLOW, "Usage: profile <seconds> [file] | profile stop");
+            } else if (g_self_profiler.start(seconds, path.c_str(), profile_frequency, &error)) {
+                console.log(Color::GREEN, "Profiling for " + std::to_string(seconds) + "s to " + path);
+            } else {
+                console.log(Color::RED, "Profile not started: " + error);
+            }
+#endif
+        } else if (cmd.find("reload") == 0) {
             console.log(Color::YELLOW, "Reload command (will be implemented in Phase 3)");
         } else if (cmd.find("log") == 0) {
             // Parse log commands
@@ -179,15 +653,53 @@ int main(int argc, char* argv[]) {
                 gConsole.EnableOutput[CON_PROTO_TCP_SEND] = false;
                 console.log(Color::GREEN, "TCP send logging disabled");
             }
+#ifdef CS_ALLOC_AUDIT
+        } else if (cmd.find("alloc") == 0) {
+            // alloc | alloc reset | alloc sample <N>
+            if (cmd.find("reset") != std::string::npos) {
+                AllocAudit::reset();
+                console.log(Color::GREEN, "Allocation counters reset");
+            } else if (cmd.find("sample ") != std::string::npos) {
+                AllocAudit::set_sample_rate(std::atoi(cmd.c_str() + cmd.find("sample ") + 7));
+                console.log(Color::GREEN, "Allocation sample rate updated");
+            } else {
+                AllocAudit::report();
+            }
+#endif
         }
     });
 
     // Start console input loop
     console.start_input_loop();
 
-    // Wait for shutdown signal
-    while (g_running) {
+    // Wait for shutdown signal (or for a successor to take over)
+    while (g_running && !handed_off) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+#ifdef __linux__
+        if (g_profile_requested.exchange(false)) {
+            std::string path = "profile_" + std::to_string(getpid()) + "_" + std::to_string(time(nullptr)) + ".folded";
+            std::string error;
+
+            if (!g_self_profiler.start(profile_signal_seconds, path.c_str(), profile_frequency, &error)) {
+                LogAdd(1, "[SelfProfiler] SIGUSR2 profile not started: %s", error.c_str());
+            }
+        }
+#endif
+    }
+
+    if (handed_off) {
+        // Let in-flight clients finish; a second signal cuts the drain short
+        int drain_timeout = config.get_int("Handoff", "DrainTimeout", 30000);
+        auto drain_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drain_timeout);
+
+        console.log(Color::YELLOW, "Handed over to the new process, draining " +
+                    std::to_string(socket_manager.get_active_count()) + " session(s)...");
+
+        while (g_running && socket_manager.get_active_count() > 0 &&
+               std::chrono::steady_clock::now() < drain_deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
     }
 
     // Shutdown
@@ -195,8 +707,22 @@ int main(int argc, char* argv[]) {
     console.log(Color::YELLOW, "Shutting down server...");
 
     timer_manager.stop();
+    for (int n = 0; n < GetTenantCount(); n++) {
+        GetTenant(n)->ServerList->StopLivenessTimer();
+    }
+#ifdef __linux__
+    handoff.stop();
+    prefork.stop();
+#endif
     socket_manager.stop();
     socket_manager_udp.stop();
+    for (auto& tenant : tenants) {
+        tenant->Tcp->stop();
+        tenant->Udp->stop();
+    }
+    server_cluster.stop();
+    control_plane.stop();
+    g_traffic_recorder.stop();
 
     work_guard.reset();
     io_context.stop();
@@ -208,6 +734,9 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    ThreadMonitor::stop();
+    g_binary_log.stop();
+
     console.stop();
 
     // Cleanup
@@ -102,7 +102,7 @@ int main(int argc, char* argv[]) {
     console.log(Color::GREEN, "UDP server started on port " + std::to_string(udp_port));
 
     // Set up timer callbacks
-    timer_manager.set_1s_callback([]() {
+    timer_manager.schedule_every("tick", std::chrono::seconds(1), []() {
         // 1-second timer - will be used for ServerList.MainProc() in Phase 3
         static int tick_count = 0;
         tick_count++;
@@ -112,7 +112,7 @@ int main(int argc, char* argv[]) {
         }
     });
 
-    timer_manager.set_5s_callback([]() {
+    timer_manager.schedule_every("timeouts", std::chrono::seconds(5), []() {
         // 5-second timer - will be used for timeout checks in Phase 3
         gConsole.Output(CON_GENERAL, "[Timer] 5s tick - Checking timeouts...");
         // TODO: Call ConnectServerTimeoutProc() in Phase 3
@@ -0,0 +1,466 @@
+#ifdef __linux__
+
+#include "platform/linux/ListenerHandoff.h"
+#include "Util.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+constexpr int SD_LISTEN_FDS_START = 3;
+constexpr int HANDOFF_MAX_SOCKETS = 3;
+
+static void SetSocketTimeout(int fd, int timeout_ms) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static bool SendAll(int fd, const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    while (size > 0) {
+        ssize_t sent = ::send(fd, p, size, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+
+        p += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+static bool RecvAll(int fd, void* data, size_t size) {
+    uint8_t* p = static_cast<uint8_t*>(data);
+
+    while (size > 0) {
+        ssize_t received = ::recv(fd, p, size, 0);
+
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+
+        p += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+static bool MakeUnixAddress(const char* path, sockaddr_un* address) {
+    memset(address, 0, sizeof(sockaddr_un));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        LogAdd(1, "[Handoff] Socket path too long: %s", path);
+        return false;
+    }
+
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static void CloseSockets(HANDOFF_SOCKETS* sockets) {
+    for (int* fd : {&sockets->TcpSocket, &sockets->UdpSocket, &sockets->HttpSocket}) {
+        if (*fd != -1) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+ListenerHandoff::ListenerHandoff(boost::asio::io_context& io, CServerList& server_list)
+    : io_context_(io)
+    , server_list_(server_list)
+    , acceptor_(io)
+    , peer_(io)
+    , timeout_(io)
+    , listening_(false)
+    , tcp_socket_(-1)
+    , udp_socket_(-1)
+    , http_socket_(-1)
+    , ack_(0)
+    , request_connection_(-1)
+{
+}
+
+ListenerHandoff::~ListenerHandoff() {
+    stop();
+
+    if (request_connection_ != -1) {
+        ::close(request_connection_);
+    }
+}
+
+bool ListenerHandoff::receive_from_systemd(HANDOFF_SOCKETS* sockets) {
+    sockets->TcpSocket = -1;
+    sockets->UdpSocket = -1;
+    sockets->HttpSocket = -1;
+
+    const char* pid = getenv("LISTEN_PID");
+    const char* fds = getenv("LISTEN_FDS");
+
+    if (pid == nullptr || fds == nullptr || atoi(pid) != getpid()) {
+        return false;
+    }
+
+    int count = atoi(fds);
+
+    // Don't pass them on to anything we might spawn
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + count; fd++) {
+        int type = 0;
+        socklen_t length = sizeof(type);
+
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) != 0) {
+            continue;
+        }
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        if (type == SOCK_STREAM && sockets->TcpSocket == -1) {
+            sockets->TcpSocket = fd;
+        } else if (type == SOCK_DGRAM && sockets->UdpSocket == -1) {
+            sockets->UdpSocket = fd;
+        }
+    }
+
+    LogAdd(2, "[Handoff] systemd passed %d socket(s) (tcp fd %d, udp fd %d)",
+           count, sockets->TcpSocket, sockets->UdpSocket);
+
+    return (sockets->TcpSocket != -1 || sockets->UdpSocket != -1);
+}
+
+bool ListenerHandoff::request(const char* path, HANDOFF_SOCKETS* sockets) {
+    sockets->TcpSocket = -1;
+    sockets->UdpSocket = -1;
+    sockets->HttpSocket = -1;
+
+    sockaddr_un address;
+
+    if (!MakeUnixAddress(path, &address)) {
+        return false;
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    // Nobody listening is the normal cold start
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    SetSocketTimeout(fd, HANDOFF_TIMEOUT_MS);
+
+    HANDOFF_REQUEST request = {HANDOFF_MAGIC, HANDOFF_VERSION, (uint32_t)getpid()};
+
+    if (!SendAll(fd, &request, sizeof(request))) {
+        LogAdd(1, "[Handoff] Could not send request to %s", path);
+        ::close(fd);
+        return false;
+    }
+
+    // Header and the sockets arrive in one message
+    HANDOFF_HEADER header;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_SOCKETS)];
+
+    iovec iov = {&header, sizeof(header)};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+
+    if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        (cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 2) || cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 3))) {
+        int passed[HANDOFF_MAX_SOCKETS] = {-1, -1, -1};
+        memcpy(passed, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+        sockets->TcpSocket = passed[0];
+        sockets->UdpSocket = passed[1];
+        sockets->HttpSocket = passed[2];
+    }
+
+    // The table size comes from the peer: bound it before anything is allocated
+    if (received != (ssize_t)sizeof(header) || header.Magic != HANDOFF_MAGIC ||
+        header.Version != HANDOFF_VERSION || header.SnapshotSize != sizeof(SERVER_LIVE_SNAPSHOT) ||
+        header.SnapshotCount > MAX_SERVER_LIST + 1 || sockets->TcpSocket == -1) {
+        LogAdd(1, "[Handoff] Invalid handoff reply from %s", path);
+
+        CloseSockets(sockets);
+        ::close(fd);
+        return false;
+    }
+
+    std::vector<SERVER_LIVE_SNAPSHOT> snapshot(header.SnapshotCount);
+
+    if (!RecvAll(fd, snapshot.data(), snapshot.size() * sizeof(SERVER_LIVE_SNAPSHOT))) {
+        LogAdd(1, "[Handoff] Server table transfer from %s failed", path);
+    } else if (!snapshot.empty()) {
+        server_list_.ImportLiveSnapshot(snapshot.data(), (int)snapshot.size());
+    }
+
+    request_connection_ = fd;
+
+    LogAdd(2, "[Handoff] Received tcp fd %d, udp fd %d, http fd %d and %u server(s) from %s",
+           sockets->TcpSocket, sockets->UdpSocket, sockets->HttpSocket, header.SnapshotCount, path);
+
+    return true;
+}
+
+bool ListenerHandoff::complete(bool started) {
+    if (request_connection_ == -1) {
+        return true;
+    }
+
+    uint8_t ack = started ? 1 : 0;
+    bool released = SendAll(request_connection_, &ack, sizeof(ack));
+
+    if (!released) {
+        LogAdd(1, "[Handoff] Could not acknowledge handoff");
+    } else if (started) {
+        // Without the confirmation the predecessor gave up on us and still
+        // serves on the sockets
+        uint8_t confirm = 0;
+        released = RecvAll(request_connection_, &confirm, sizeof(confirm)) && confirm == 1;
+
+        if (!released) {
+            LogAdd(1, "[Handoff] Predecessor did not release its sockets");
+        }
+    }
+
+    ::close(request_connection_);
+    request_connection_ = -1;
+
+    return released;
+}
+
+bool ListenerHandoff::listen(const char* path, int tcp_socket, int udp_socket, int http_socket,
+                             std::function<void()> on_handed_off) {
+    sockaddr_un address;
+
+    if (!MakeUnixAddress(path, &address)) {
+        return false;
+    }
+
+    // Whoever listened here before has already handed over (or died)
+    ::unlink(path);
+
+    try {
+        acceptor_.open();
+        acceptor_.bind(boost::asio::local::stream_protocol::endpoint(path));
+        acceptor_.listen(1);
+    } catch (const std::exception& e) {
+        LogAdd(1, "[Handoff] Failed to listen on %s: %s", path, e.what());
+        return false;
+    }
+
+    // Handing out listening sockets is an owner-only operation
+    chmod(path, S_IRUSR | S_IWUSR);
+
+    path_ = path;
+    tcp_socket_ = tcp_socket;
+    udp_socket_ = udp_socket;
+    http_socket_ = http_socket;
+    on_handed_off_ = std::move(on_handed_off);
+    listening_ = true;
+
+    LogAdd(2, "[Handoff] Accepting restart handoff on %s", path);
+
+    start_accept();
+    return true;
+}
+
+void ListenerHandoff::stop() {
+    if (!listening_.exchange(false)) {
+        return;
+    }
+
+    // The acceptor and a handoff in progress belong to the io_context thread:
+    // close them there and wait. Nobody runs a stopped io_context, so there
+    // they are ours to close.
+    if (io_context_.get_executor().running_in_this_thread() || io_context_.stopped()) {
+        close();
+    } else {
+        std::promise<void> closed;
+
+        boost::asio::post(io_context_, [this, &closed]() {
+            close();
+            closed.set_value();
+        });
+
+        closed.get_future().wait();
+    }
+}
+
+void ListenerHandoff::close() {
+    boost::system::error_code ec;
+    timeout_.cancel();
+    peer_.close(ec);
+
+    // After a handoff the successor owns the path; leave it in place
+    if (acceptor_.is_open()) {
+        acceptor_.close(ec);
+        ::unlink(path_.c_str());
+    }
+}
+
+void ListenerHandoff::start_accept() {
+    acceptor_.async_accept(peer_, [this](const boost::system::error_code& error) {
+        if (error) {
+            return;
+        }
+
+        arm_timeout();
+        boost::asio::async_read(peer_, boost::asio::buffer(&request_, sizeof(request_)),
+            [this](const boost::system::error_code& error, size_t) {
+                handle_request(error);
+            });
+    });
+}
+
+void ListenerHandoff::arm_timeout() {
+    // A successor that stalls a step loses its connection, which fails the
+    // pending read or write
+    timeout_.expires_after(std::chrono::milliseconds(HANDOFF_TIMEOUT_MS));
+    timeout_.async_wait([this](const boost::system::error_code& error) {
+        if (error || timeout_.expiry() > boost::asio::steady_timer::clock_type::now()) {
+            return;     // Cancelled or re-armed for a later step
+        }
+
+        boost::system::error_code ec;
+        peer_.close(ec);
+    });
+}
+
+void ListenerHandoff::finish_connection() {
+    // Disarm so a timeout already queued cannot close the next connection
+    timeout_.expires_at(boost::asio::steady_timer::time_point::max());
+
+    boost::system::error_code ec;
+    peer_.close(ec);
+
+    if (acceptor_.is_open()) {
+        start_accept();
+    }
+}
+
+void ListenerHandoff::handle_request(const boost::system::error_code& error) {
+    if (error || request_.Magic != HANDOFF_MAGIC || request_.Version != HANDOFF_VERSION) {
+        LogAdd(1, "[Handoff] Ignoring invalid handoff request");
+        finish_connection();
+        return;
+    }
+
+    LogAdd(2, "[Handoff] Process %u requested our sockets", request_.Pid);
+
+    // Heartbeats handled while the successor starts are not in the table it
+    // gets; each server's next heartbeat brings it up to date there
+    snapshot_.resize(MAX_SERVER_LIST + 1);
+    snapshot_.resize(server_list_.ExportLiveSnapshot(snapshot_.data(), (int)snapshot_.size()));
+
+    HANDOFF_HEADER header = {HANDOFF_MAGIC, HANDOFF_VERSION, (uint32_t)snapshot_.size(),
+                             sizeof(SERVER_LIVE_SNAPSHOT)};
+
+    int passed[HANDOFF_MAX_SOCKETS] = {tcp_socket_, udp_socket_, http_socket_};
+    size_t passed_size = sizeof(int) * ((http_socket_ != -1) ? 3 : 2);
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(passed))];
+    memset(control, 0, sizeof(control));
+
+    iovec iov = {&header, sizeof(header)};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(passed_size);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(passed_size);
+    memcpy(CMSG_DATA(cmsg), passed, passed_size);
+
+    // The header fits the empty socket buffer, so it goes out with the
+    // sockets in one non-blocking send; the table follows asynchronously
+    if (::sendmsg(peer_.native_handle(), &message, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)sizeof(header)) {
+        LogAdd(1, "[Handoff] Sending sockets to process %u failed", request_.Pid);
+        finish_connection();
+        return;
+    }
+
+    arm_timeout();
+    boost::asio::async_write(peer_,
+        boost::asio::buffer(snapshot_.data(), snapshot_.size() * sizeof(SERVER_LIVE_SNAPSHOT)),
+        [this](const boost::system::error_code& error, size_t) {
+            if (error) {
+                LogAdd(1, "[Handoff] Sending sockets to process %u failed", request_.Pid);
+                finish_connection();
+                return;
+            }
+
+            arm_timeout();
+            boost::asio::async_read(peer_, boost::asio::buffer(&ack_, sizeof(ack_)),
+                [this](const boost::system::error_code& error, size_t) {
+                    handle_ack(error);
+                });
+        });
+}
+
+void ListenerHandoff::handle_ack(const boost::system::error_code& error) {
+    if (error || ack_ != 1) {
+        LogAdd(1, "[Handoff] Process %u did not start, keeping our sockets", request_.Pid);
+        finish_connection();
+        return;
+    }
+
+    // Confirm before letting go: a successor that does not get this exits
+    uint8_t confirm = 1;
+
+    if (::send(peer_.native_handle(), &confirm, sizeof(confirm), MSG_NOSIGNAL | MSG_DONTWAIT) != 1) {
+        LogAdd(1, "[Handoff] Process %u went away, keeping our sockets", request_.Pid);
+        finish_connection();
+        return;
+    }
+
+    LogAdd(2, "[Handoff] Process %u took over (%zu server(s) transferred)", request_.Pid, snapshot_.size());
+
+    // The successor owns the path now; leave it in place
+    boost::system::error_code ec;
+    timeout_.cancel();
+    peer_.close(ec);
+    acceptor_.close(ec);
+    snapshot_.clear();
+
+    if (on_handed_off_) {
+        on_handed_off_();
+    }
+}
+
+#endif // __linux__
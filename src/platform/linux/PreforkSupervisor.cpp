@@ -0,0 +1,337 @@
+#ifdef __linux__
+
+#include "platform/linux/PreforkSupervisor.h"
+#include "IpManager.h"
+#include "Metrics.h"
+#include "SocketManager.h"
+#include "Util.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern std::atomic<bool> g_running;
+
+PreforkSupervisor::PreforkSupervisor(CSharedServerTable& table)
+    : table_(table)
+    , count_(0)
+    , tcp_socket_(-1)
+    , stopping_(false)
+{
+    for (WORKER& worker : workers_) {
+        worker.Pid = 0;
+    }
+}
+
+PreforkSupervisor::~PreforkSupervisor() {
+    stop();
+}
+
+int PreforkSupervisor::open_listener(uint16_t port) {
+    // No SOCK_CLOEXEC: the workers inherit it across exec
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        LogAdd(1, "[Prefork] socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (::bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        LogAdd(1, "[Prefork] Could not listen on port %d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool PreforkSupervisor::parse_worker_args(int argc, char* argv[], PREFORK_WORKER_ARGS* args) {
+    if (argc < 5 || strcmp(argv[1], PREFORK_WORKER_ARG) != 0) {
+        return false;
+    }
+
+    args->Worker = std::atoi(argv[2]);
+    args->TcpSocket = std::atoi(argv[3]);
+    args->SharedTable = std::atoi(argv[4]);
+
+    return (args->Worker >= 0 && args->Worker < MAX_PREFORK_WORKERS);
+}
+
+int PreforkSupervisor::run_worker(const PREFORK_WORKER_ARGS& args, int threads) {
+    pid_t supervisor = getppid();
+
+    CSharedServerTable table;
+
+    if (!table.Attach(args.SharedTable)) {
+        return 1;
+    }
+
+    gSharedServerTable = &table;
+    gIpManager.SetSharedTable(&table, args.Worker);
+
+    SHARED_WORKER_INFO& info = table.Get()->Worker[args.Worker];
+    std::atomic<int64_t>* accepts = Metrics::get("tcp.accepts");
+    std::atomic<int64_t>* rejects = Metrics::get("tcp.rejects");
+    std::atomic<int64_t>* packets = Metrics::get("tcp.packets");
+
+    boost::asio::io_context io_context;
+    auto work_guard = boost::asio::make_work_guard(io_context);
+
+    SocketManager socket_manager(io_context);
+    g_socket_manager = &socket_manager;
+
+    if (!socket_manager.start_native(args.TcpSocket)) {
+        return 1;
+    }
+
+    std::vector<std::thread> io_threads;
+
+    for (int n = 0; n < threads; n++) {
+        io_threads.emplace_back([&io_context, &args, n]() {
+            std::string name = "w" + std::to_string(args.Worker) + "-io-" + std::to_string(n);
+            pthread_setname_np(pthread_self(), name.c_str());
+            io_context.run();
+        });
+    }
+
+    LogAdd(2, "[Prefork] Worker %d (pid %d) serving with %d thread(s)", args.Worker, (int)getpid(), threads);
+
+    // Without a supervisor nobody updates the table any more: leave too
+    while (g_running && getppid() == supervisor) {
+        info.Clients.store(gClientCount, std::memory_order_relaxed);
+        info.Accepts.store(accepts->load(std::memory_order_relaxed), std::memory_order_relaxed);
+        info.Rejects.store(rejects->load(std::memory_order_relaxed), std::memory_order_relaxed);
+        info.Packets.store(packets->load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    socket_manager.stop();
+    work_guard.reset();
+    io_context.stop();
+
+    for (std::thread& thread : io_threads) {
+        thread.join();
+    }
+
+    info.Clients.store(0, std::memory_order_relaxed);
+    gSharedServerTable = nullptr;
+    g_socket_manager = nullptr;
+
+    LogAdd(2, "[Prefork] Worker %d stopped", args.Worker);
+
+    return 0;
+}
+
+bool PreforkSupervisor::start(int tcp_socket, int workers) {
+    if (workers <= 0 || workers > MAX_PREFORK_WORKERS || !table_.IsOpen()) {
+        LogAdd(1, "[Prefork] Need 1 to %d workers and a shared table", MAX_PREFORK_WORKERS);
+        return false;
+    }
+
+    tcp_socket_ = tcp_socket;
+    count_ = workers;
+    stopping_ = false;
+
+    for (int n = 0; n < count_; n++) {
+        if (!spawn(n)) {
+            stop();
+            return false;
+        }
+    }
+
+    LogAdd(2, "[Prefork] Supervising %d worker(s) on fd %d", count_, tcp_socket_);
+
+    return true;
+}
+
+bool PreforkSupervisor::spawn(int worker) {
+    // Everything the child needs is prepared here: between fork and exec only
+    // async-signal-safe calls are allowed (the supervisor has threads)
+    std::string worker_arg = std::to_string(worker);
+    std::string tcp_arg = std::to_string(tcp_socket_);
+    std::string table_arg = std::to_string(table_.Handle());
+    char executable[] = "/proc/self/exe";
+    char* argv[] = {executable, (char*)PREFORK_WORKER_ARG, &worker_arg[0], &tcp_arg[0], &table_arg[0], nullptr};
+
+    int keep[] = {tcp_socket_, table_.Handle()};
+
+    struct rlimit limit;
+    int max_fd = (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < 65536) ? (int)limit.rlim_cur : 65536;
+
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        LogAdd(1, "[Prefork] fork failed: %s", strerror(errno));
+        return false;
+    }
+
+    if (pid == 0) {
+        // Only the listening socket and the table cross over
+        for (int fd = 3; fd < max_fd; fd++) {
+            if (fd != keep[0] && fd != keep[1]) {
+                close(fd);
+            }
+        }
+
+        for (int fd : keep) {
+            fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) & ~FD_CLOEXEC);
+        }
+
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigprocmask(SIG_SETMASK, &signals, nullptr);
+
+        execv(executable, argv);
+        _exit(127);
+    }
+
+    WORKER& entry = workers_[worker];
+    entry.Pid = pid;
+    entry.Started = std::chrono::steady_clock::now();
+
+    table_.Get()->Worker[worker].Pid.store(pid, std::memory_order_relaxed);
+
+    LogAdd(2, "[Prefork] Started worker %d (pid %d)", worker, (int)pid);
+
+    return true;
+}
+
+void PreforkSupervisor::exited(int worker, int status) {
+    WORKER& entry = workers_[worker];
+
+    if (WIFSIGNALED(status)) {
+        LogAdd(1, "[Prefork] Worker %d (pid %d) killed by signal %d", worker, (int)entry.Pid, WTERMSIG(status));
+    } else if (!stopping_ || WEXITSTATUS(status) != 0) {
+        LogAdd(1, "[Prefork] Worker %d (pid %d) exited with %d", worker, (int)entry.Pid, WEXITSTATUS(status));
+    }
+
+    SHARED_WORKER_INFO& info = table_.Get()->Worker[worker];
+    info.Pid.store(0, std::memory_order_relaxed);
+    info.Clients.store(0, std::memory_order_relaxed);
+
+    // Its client counters carry on in ours (idle in prefork mode), so the
+    // totals in the stats segment do not drop when it restarts
+    Metrics::get("tcp.accepts")->fetch_add(info.Accepts.exchange(0), std::memory_order_relaxed);
+    Metrics::get("tcp.rejects")->fetch_add(info.Rejects.exchange(0), std::memory_order_relaxed);
+    Metrics::get("tcp.packets")->fetch_add(info.Packets.exchange(0), std::memory_order_relaxed);
+
+    // Its sessions died with it; so do their per-IP counts
+    table_.ReleaseWorker(worker);
+
+    auto now = std::chrono::steady_clock::now();
+    bool crash_loop = (now - entry.Started) < std::chrono::milliseconds(PREFORK_RESTART_DELAY_MS);
+
+    entry.Pid = 0;
+    entry.RestartAt = crash_loop ? now + std::chrono::milliseconds(PREFORK_RESTART_DELAY_MS) : now;
+}
+
+void PreforkSupervisor::reap() {
+    if (stopping_) {
+        return;
+    }
+
+    for (int n = 0; n < count_; n++) {
+        WORKER& entry = workers_[n];
+        int status;
+
+        if (entry.Pid != 0 && waitpid(entry.Pid, &status, WNOHANG) == entry.Pid) {
+            exited(n, status);
+        }
+
+        if (entry.Pid == 0 && std::chrono::steady_clock::now() >= entry.RestartAt && spawn(n)) {
+            table_.Get()->Worker[n].Restarts.fetch_add(1, std::memory_order_relaxed);
+            Metrics::get("prefork.restarts")->fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void PreforkSupervisor::stop() {
+    if (stopping_ || count_ == 0) {
+        return;
+    }
+
+    stopping_ = true;
+
+    for (int n = 0; n < count_; n++) {
+        if (workers_[n].Pid != 0) {
+            kill(workers_[n].Pid, SIGTERM);
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PREFORK_STOP_TIMEOUT_MS);
+    bool running = true;
+
+    while (running) {
+        running = false;
+
+        for (int n = 0; n < count_; n++) {
+            WORKER& entry = workers_[n];
+            int status;
+
+            if (entry.Pid == 0) {
+                continue;
+            }
+
+            if (waitpid(entry.Pid, &status, WNOHANG) == entry.Pid) {
+                exited(n, status);
+                continue;
+            }
+
+            if (std::chrono::steady_clock::now() >= deadline) {
+                LogAdd(1, "[Prefork] Worker %d (pid %d) did not stop, killing it", n, (int)entry.Pid);
+                kill(entry.Pid, SIGKILL);
+                waitpid(entry.Pid, &status, 0);
+                exited(n, status);
+                continue;
+            }
+
+            running = true;
+        }
+
+        if (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    LogAdd(2, "[Prefork] All workers stopped");
+}
+
+pid_t PreforkSupervisor::worker_pid(int worker) const {
+    return (worker >= 0 && worker < count_) ? workers_[worker].Pid : 0;
+}
+
+void PreforkSupervisor::report() {
+    SHARED_SERVER_TABLE* table = table_.Get();
+
+    LogAdd(0, "[Prefork] %d worker(s)", count_);
+
+    for (int n = 0; n < count_; n++) {
+        SHARED_WORKER_INFO& info = table->Worker[n];
+
+        LogAdd(0, "[Prefork] Worker %2d pid %7d, %5d client(s), %u restart(s)", n, (int)info.Pid.load(),
+               (int)info.Clients.load(), info.Restarts.load());
+    }
+}
+
+#endif // __linux__
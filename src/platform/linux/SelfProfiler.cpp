@@ -0,0 +1,389 @@
+#ifdef __linux__
+
+#include "platform/linux/SelfProfiler.h"
+#include "platform/linux/Symbolize.h"
+#include "Metrics.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+SelfProfiler g_self_profiler;
+
+static constexpr size_t PROFILER_RING_PAGES = 16;  // Data pages per thread, power of two
+
+static int PerfEventOpen(perf_event_attr* attr, pid_t tid) {
+    return (int)syscall(SYS_perf_event_open, attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void ReadThreadName(uint32_t tid, char* name, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%u/comm", tid);
+
+    name[0] = '\0';
+    FILE* file = fopen(path, "r");
+
+    if (file != nullptr) {
+        if (fgets(name, (int)size, file) != nullptr) {
+            name[strcspn(name, "\n")] = '\0';
+        }
+        fclose(file);
+    }
+}
+
+static double ThreadCpuMilliseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+SelfProfiler::SelfProfiler()
+    : running_(false)
+    , stop_requested_(false)
+    , samples_(Metrics::get("profiler.samples"))
+    , lost_(Metrics::get("profiler.lost"))
+    , runs_(Metrics::get("profiler.runs"))
+{
+    result_.Completed = false;
+}
+
+SelfProfiler::~SelfProfiler() {
+    stop();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool SelfProfiler::start(int seconds, const char* path, int frequency, std::string* error) {
+    if (running_.exchange(true, std::memory_order_acq_rel)) {
+        *error = "a profile is already running";
+        return false;
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    seconds = std::max(1, std::min(seconds, PROFILER_MAX_SECONDS));
+    frequency = std::max(1, std::min(frequency, PROFILER_MAX_FREQUENCY));
+
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = (uint64_t)frequency;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.sample_max_stack = PROFILER_MAX_DEPTH;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;    // Allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+    attr.watermark = 1;
+    attr.wakeup_watermark = (uint32_t)(PROFILER_RING_PAGES * 4096 / 4);
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t ring_size = page * (1 + PROFILER_RING_PAGES);
+
+    events_.clear();
+
+    DIR* tasks = opendir("/proc/self/task");
+
+    for (dirent* entry = (tasks != nullptr) ? readdir(tasks) : nullptr; entry != nullptr; entry = readdir(tasks)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        PROFILE_EVENT event;
+        event.ThreadId = (uint32_t)atoi(entry->d_name);
+        event.Fd = PerfEventOpen(&attr, (pid_t)event.ThreadId);
+
+        if (event.Fd == -1) {
+            // Thread exited meanwhile: skip it; anything else ends the run
+            if (errno == ESRCH) {
+                continue;
+            }
+
+            *error = std::string("perf_event_open: ") + strerror(errno);
+            break;
+        }
+
+        void* ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, event.Fd, 0);
+
+        if (ring == MAP_FAILED) {
+            *error = std::string("perf ring mmap: ") + strerror(errno);
+            close(event.Fd);
+            break;
+        }
+
+        event.Ring = static_cast<uint8_t*>(ring);
+        event.RingSize = ring_size;
+        ReadThreadName(event.ThreadId, event.Name, sizeof(event.Name));
+        events_.push_back(event);
+    }
+
+    if (tasks != nullptr) {
+        closedir(tasks);
+    }
+
+    if (!error->empty() || events_.empty()) {
+        if (error->empty()) {
+            *error = "no threads to sample";
+        }
+
+        close_events();
+        running_.store(false, std::memory_order_release);
+        return false;
+    }
+
+    stop_requested_.store(false, std::memory_order_relaxed);
+
+    for (const PROFILE_EVENT& event : events_) {
+        ioctl(event.Fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    runs_->fetch_add(1, std::memory_order_relaxed);
+    LogAdd(2, "[SelfProfiler] Sampling %zu thread(s) at %d Hz for %d s", events_.size(), frequency, seconds);
+
+    thread_ = std::thread([this, seconds, frequency, output = std::string(path)]() {
+        run(seconds, output, frequency);
+    });
+
+    return true;
+}
+
+void SelfProfiler::stop() {
+    stop_requested_.store(true, std::memory_order_relaxed);
+}
+
+PROFILE_RESULT SelfProfiler::wait() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    return last_result();
+}
+
+PROFILE_RESULT SelfProfiler::last_result() {
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    return result_;
+}
+
+void SelfProfiler::close_events() {
+    for (const PROFILE_EVENT& event : events_) {
+        munmap(event.Ring, event.RingSize);
+        close(event.Fd);
+    }
+
+    events_.clear();
+}
+
+void SelfProfiler::run(int seconds, std::string path, int frequency) {
+    double cpu_started = ThreadCpuMilliseconds();
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + std::chrono::seconds(seconds);
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t data_size = page * PROFILER_RING_PAGES;
+
+    PROFILE_RESULT result;
+    result.Completed = false;
+    result.Threads = (int)events_.size();
+    result.Samples = 0;
+    result.Lost = 0;
+    result.Truncated = 0;
+    result.Stacks = 0;
+    result.Path = path;
+
+    // Stack key: the sampled thread's index, then the callchain leaf first
+    std::unordered_map<std::string, uint64_t> stacks;
+    std::vector<pollfd> fds(events_.size());
+    std::vector<uint8_t> record;
+
+    for (size_t n = 0; n < events_.size(); n++) {
+        fds[n].fd = events_[n].Fd;
+        fds[n].events = POLLIN;
+    }
+
+    auto drain = [&](size_t index) {
+        PROFILE_EVENT& event = events_[index];
+        perf_event_mmap_page* meta = reinterpret_cast<perf_event_mmap_page*>(event.Ring);
+        const uint8_t* data = event.Ring + page;
+
+        uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+        uint64_t tail = meta->data_tail;
+
+        while (tail < head) {
+            perf_event_header header;
+            size_t offset = (size_t)(tail % data_size);
+            size_t first = std::min(sizeof(header), data_size - offset);
+
+            memcpy(&header, data + offset, first);
+            memcpy(reinterpret_cast<uint8_t*>(&header) + first, data, sizeof(header) - first);
+
+            if (header.size < sizeof(header) || tail + header.size > head) {
+                break;
+            }
+
+            // Records may wrap around the end of the ring: copy them out
+            record.resize(header.size);
+            first = std::min((size_t)header.size, data_size - offset);
+            memcpy(record.data(), data + offset, first);
+            memcpy(record.data() + first, data, header.size - first);
+
+            if (header.type == PERF_RECORD_SAMPLE) {
+                // u32 pid, tid; u64 nr; u64 ips[nr]
+                const uint8_t* body = record.data() + sizeof(header);
+                uint64_t nr;
+                memcpy(&nr, body + 8, sizeof(nr));
+
+                std::string key(reinterpret_cast<const char*>(&index), sizeof(index));
+
+                for (uint64_t n = 0; n < nr && 16 + (n + 1) * 8 <= header.size - sizeof(header); n++) {
+                    uint64_t ip;
+                    memcpy(&ip, body + 16 + n * 8, sizeof(ip));
+
+                    // PERF_CONTEXT_USER and friends mark sections, not frames
+                    if (ip >= (uint64_t)PERF_CONTEXT_MAX) {
+                        continue;
+                    }
+
+                    key.append(reinterpret_cast<const char*>(&ip), sizeof(ip));
+                }
+
+                result.Samples++;
+
+                auto it = stacks.find(key);
+
+                if (it != stacks.end()) {
+                    it->second++;
+                } else if ((int)stacks.size() < PROFILER_MAX_STACKS) {
+                    stacks.emplace(std::move(key), 1);
+                } else {
+                    result.Truncated++;
+                }
+            } else if (header.type == PERF_RECORD_LOST) {
+                uint64_t lost;
+                memcpy(&lost, record.data() + sizeof(header) + 8, sizeof(lost));
+                result.Lost += lost;
+            }
+
+            tail += header.size;
+        }
+
+        __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+    };
+
+    while (!stop_requested_.load(std::memory_order_relaxed)) {
+        auto now = std::chrono::steady_clock::now();
+
+        if (now >= deadline) {
+            break;
+        }
+
+        int timeout = (int)std::min<int64_t>(100,
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+
+        poll(fds.data(), fds.size(), timeout);
+
+        for (size_t n = 0; n < events_.size(); n++) {
+            drain(n);
+        }
+    }
+
+    for (const PROFILE_EVENT& event : events_) {
+        ioctl(event.Fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (size_t n = 0; n < events_.size(); n++) {
+        drain(n);
+    }
+
+    result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    // Symbolize each address once; return addresses point past the call,
+    // so callers are looked up one byte back
+    std::unordered_map<uint64_t, std::string> symbols;
+    FILE* file = fopen(path.c_str(), "w");
+
+    if (file == nullptr) {
+        result.Error = "cannot write " + path;
+    } else {
+        for (const auto& stack : stacks) {
+            size_t index;
+            memcpy(&index, stack.first.data(), sizeof(index));
+
+            const PROFILE_EVENT& event = events_[index];
+            size_t frames = (stack.first.size() - sizeof(index)) / sizeof(uint64_t);
+
+            fputs(event.Name[0] != '\0' ? event.Name : "thread", file);
+
+            // Folded stacks go root first; the callchain is leaf first
+            for (size_t n = frames; n-- > 0;) {
+                uint64_t ip;
+                memcpy(&ip, stack.first.data() + sizeof(index) + n * sizeof(ip), sizeof(ip));
+
+                uint64_t lookup = (n == 0) ? ip : ip - 1;
+                auto symbol = symbols.find(lookup);
+
+                if (symbol == symbols.end()) {
+                    // ';' separates frames in the folded format
+                    std::string name = SymbolizeAddress(lookup);
+                    std::replace(name.begin(), name.end(), ';', ':');
+                    symbol = symbols.emplace(lookup, std::move(name)).first;
+                }
+
+                fputc(';', file);
+                fputs(symbol->second.c_str(), file);
+            }
+
+            fprintf(file, " %llu\n", (unsigned long long)stack.second);
+        }
+
+        if (result.Truncated != 0) {
+            fprintf(file, "[truncated] %llu\n", (unsigned long long)result.Truncated);
+        }
+
+        fclose(file);
+        result.Completed = true;
+    }
+
+    result.Stacks = (int)stacks.size();
+    result.CollectorCpuMs = ThreadCpuMilliseconds() - cpu_started;
+
+    close_events();
+
+    samples_->fetch_add((int64_t)result.Samples, std::memory_order_relaxed);
+    lost_->fetch_add((int64_t)result.Lost, std::memory_order_relaxed);
+
+    // Collector CPU against the run's wall time on one core
+    LogAdd(result.Completed ? 2 : 1,
+           "[SelfProfiler] %s: %llu sample(s) from %d thread(s) in %.1f s at %d Hz, %d stack(s), %llu lost, "
+           "collector %.1f ms CPU (%.3f%% of a core)",
+           result.Completed ? result.Path.c_str() : result.Error.c_str(), (unsigned long long)result.Samples,
+           result.Threads, result.Seconds, frequency, result.Stacks, (unsigned long long)result.Lost,
+           result.CollectorCpuMs, result.Seconds > 0 ? result.CollectorCpuMs / (result.Seconds * 10.0) : 0.0);
+
+    {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        result_ = result;
+    }
+
+    running_.store(false, std::memory_order_release);
+}
+
+#endif // __linux__
@@ -1,6 +1,7 @@
 #ifdef __linux__
 
 #include "platform/linux/SignalHandler.h"
+#include "FlightRecorder.h"
 #include <signal.h>
 #include <execinfo.h>
 #include <unistd.h>
@@ -25,7 +26,37 @@ void SignalHandler::cleanup() {
     signal(SIGBUS, SIG_DFL);
 }
 
+// Decimal digits of value at out, returns the new end (no snprintf in the
+// async-signal-safe part of the handler)
+static char* AppendNumber(char* out, unsigned long value) {
+    char digits[24];
+    int count = 0;
+
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+
+    return out;
+}
+
+static char* AppendText(char* out, const char* text) {
+    while (*text != '\0') {
+        *out++ = *text++;
+    }
+
+    return out;
+}
+
 void SignalHandler::signal_handler(int sig) {
+    // Flight recorder first: it needs nothing but write(2), while the crash
+    // log below uses calls that can hang if the crash happened inside them
+    write_flight_dump(sig);
+
     // Create crash log filename with timestamp
     char filename[256];
     time_t now = time(nullptr);
@@ -78,6 +109,32 @@ void SignalHandler::signal_handler(int sig) {
     _exit(1);
 }
 
+void SignalHandler::write_flight_dump(int sig) {
+    // flight_<pid>_<unix time>.bin
+    char filename[64];
+    char* end = AppendText(filename, "flight_");
+    end = AppendNumber(end, (unsigned long)getpid());
+    end = AppendText(end, "_");
+    end = AppendNumber(end, (unsigned long)time(nullptr));
+    end = AppendText(end, ".bin");
+    *end = '\0';
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        return;
+    }
+
+    bool written = FlightRecorder::dump_fd(fd, sig);
+    close(fd);
+
+    char message[128];
+    end = AppendText(message, written ? "Flight recorder written to: " : "Flight recorder incomplete: ");
+    end = AppendText(end, filename);
+    end = AppendText(end, "\n");
+    write(STDERR_FILENO, message, (size_t)(end - message));
+}
+
 void SignalHandler::write_backtrace() {
     void* array[50];
     size_t size = backtrace(array, 50);
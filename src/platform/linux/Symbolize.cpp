@@ -0,0 +1,36 @@
+#ifdef __linux__
+
+#include "platform/linux/Symbolize.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+std::string SymbolizeAddress(uint64_t address) {
+    Dl_info info;
+    char text[256];
+
+    if (dladdr((void*)address, &info) == 0) {
+        snprintf(text, sizeof(text), "0x%llx", (unsigned long long)address);
+        return text;
+    }
+
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = (status == 0 && demangled != nullptr) ? demangled : info.dli_sname;
+        free(demangled);
+        return name;
+    }
+
+    const char* module = (info.dli_fname != nullptr) ? strrchr(info.dli_fname, '/') : nullptr;
+    module = (module != nullptr) ? module + 1 : (info.dli_fname != nullptr ? info.dli_fname : "?");
+
+    snprintf(text, sizeof(text), "%s+0x%llx", module,
+             (unsigned long long)(address - (uint64_t)(uintptr_t)info.dli_fbase));
+    return text;
+}
+
+#endif // __linux__
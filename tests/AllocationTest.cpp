@@ -0,0 +1,131 @@
+// Drives complete client flows (connect, init, list, info, disconnect)
+// against a live SocketManager and fails if the io thread allocates once
+// the pools and caches are warm.
+
+#include "AllocAudit.h"
+#include "RequestTracer.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int WARMUP_FLOWS = 32;
+static constexpr int MEASURED_FLOWS = 256;
+
+static void ReadPacket(boost::asio::ip::tcp::socket& socket, uint8_t head, uint8_t subhead) {
+    uint8_t buffer[MAX_PACKET_SIZE];
+
+    boost::asio::read(socket, boost::asio::buffer(buffer, 2));
+
+    size_t header_size = (buffer[0] == 0xC1) ? 2 : 3;
+    size_t size = buffer[1];
+
+    if (buffer[0] == 0xC2) {
+        boost::asio::read(socket, boost::asio::buffer(buffer + 2, 1));
+        size = MAKEWORD(buffer[2], buffer[1]);
+    }
+
+    boost::asio::read(socket, boost::asio::buffer(buffer + header_size, size - header_size));
+
+    if (buffer[header_size] != head || (subhead != 0 && buffer[header_size + 1] != subhead)) {
+        throw std::runtime_error("unexpected reply");
+    }
+}
+
+static void RunClientFlow(boost::asio::io_context& io, uint16_t port) {
+    boost::asio::ip::tcp::socket socket(io);
+    socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port});
+
+    ReadPacket(socket, 0x00, 0);
+
+    const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+    boost::asio::write(socket, boost::asio::buffer(list_request));
+    ReadPacket(socket, 0xF4, 0x04);
+    ReadPacket(socket, 0xF4, 0x02);
+
+    const uint8_t info_request[] = {0xC1, 0x05, 0xF4, 0x03, 0x00};
+    boost::asio::write(socket, boost::asio::buffer(info_request));
+    ReadPacket(socket, 0xF4, 0x03);
+
+    socket.close();
+
+    // Wait until the server has torn the session down as well
+    while (g_socket_manager->get_active_count() != 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+int main() {
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    // Request tracing is on in production; its tables fill during warm-up
+    TRACE_CONFIG trace_config = {true, 0, 1, 0};
+    RequestTracer::configure(trace_config);
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+
+    SocketManager socket_manager(io);
+    g_socket_manager = &socket_manager;
+
+    if (!socket_manager.start(0)) {
+        printf("FAIL: could not start TCP server\n");
+        return 1;
+    }
+
+    std::atomic<ALLOC_AUDIT_THREAD*> io_thread_stats{nullptr};
+
+    std::thread io_thread([&]() {
+        AllocAudit::set_thread_name("io");
+        io_thread_stats = AllocAudit::current_thread();
+        io.run();
+    });
+
+    while (io_thread_stats == nullptr) {
+        std::this_thread::yield();
+    }
+
+    boost::asio::io_context client_io;
+    int result = 0;
+
+    try {
+        for (int n = 0; n < WARMUP_FLOWS; n++) {
+            RunClientFlow(client_io, socket_manager.port());
+        }
+
+        AllocAudit::set_sample_rate(1);
+        uint64_t before = io_thread_stats.load()->allocations.load();
+
+        for (int n = 0; n < MEASURED_FLOWS; n++) {
+            RunClientFlow(client_io, socket_manager.port());
+        }
+
+        uint64_t allocations = io_thread_stats.load()->allocations.load() - before;
+
+        if (allocations != 0) {
+            printf("FAIL: %llu allocation(s) on the io thread over %d flows\n",
+                   (unsigned long long)allocations, MEASURED_FLOWS);
+            AllocAudit::report();
+            result = 1;
+        } else {
+            printf("PASS: %d flows, 0 allocations on the io thread\n", MEASURED_FLOWS);
+        }
+    } catch (const std::exception& e) {
+        printf("FAIL: client flow error: %s\n", e.what());
+        result = 1;
+    }
+
+    socket_manager.stop();
+    work_guard.reset();
+    io.stop();
+    io_thread.join();
+
+    return result;
+}
@@ -0,0 +1,211 @@
+// Binary log sink: several threads log through LogAdd, each inside its own
+// session, into 1 MB segments. Every line must reach a segment (none
+// dropped), segments must rotate and be pruned to MaxFiles, each kept
+// segment must define a call site before its first use, and the decoded
+// arguments of every kept line must be the ones logged.
+
+#include "BinaryLog.h"
+#include "Console.h"
+#include "Metrics.h"
+#include "Util.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int THREADS = 4;
+static constexpr int LINES_PER_THREAD = 20000;
+static constexpr uint32_t MAX_FILES = 3;
+
+static const char* LINE_FORMAT = "[BinaryLogTest] Line %d of %s: %zu bytes, %.1f%% done";
+
+static std::vector<std::string> ListSegments(const std::string& directory) {
+    std::vector<std::string> segments;
+    DIR* dir = opendir(directory.c_str());
+
+    while (dir != nullptr) {
+        struct dirent* entry = readdir(dir);
+
+        if (entry == nullptr) {
+            break;
+        }
+
+        if (strncmp(entry->d_name, "cslog_", 6) == 0) {
+            segments.push_back(directory + "/" + entry->d_name);
+        }
+    }
+
+    if (dir != nullptr) {
+        closedir(dir);
+    }
+
+    return segments;
+}
+
+// Checks one segment; returns the lines in it or -1
+static int CheckSegment(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+        return -1;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t read;
+
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + read);
+    }
+
+    fclose(file);
+
+    BINLOG_SEGMENT_HEADER header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (header.Magic != BINARY_LOG_MAGIC || header.RecordSize != sizeof(BINLOG_RECORD)) {
+        printf("FAIL: %s has no segment header\n", path.c_str());
+        return -1;
+    }
+
+    std::map<uint32_t, std::string> sites;
+    size_t offset = sizeof(header);
+    int lines = 0;
+
+    while (offset + sizeof(BINLOG_RECORD) <= data.size()) {
+        BINLOG_RECORD record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+
+        if (record.Length == 0) {
+            break;
+        }
+
+        const uint8_t* payload = data.data() + offset + sizeof(record);
+        offset += ((size_t)record.Length + 7) & ~(size_t)7;
+
+        if (record.Type == BINLOG_SITE) {
+            sites[record.Site] = (const char*)payload;
+            continue;
+        }
+
+        auto site = sites.find(record.Site);
+
+        if (site == sites.end()) {
+            printf("FAIL: %s uses site %u before defining it\n", path.c_str(), record.Site);
+            return -1;
+        }
+
+        if (site->second != LINE_FORMAT) {
+            continue;
+        }
+
+        // %d, %s, %zu, %.1f: 8 bytes, length byte + text, 8 bytes, 8 bytes
+        int64_t line;
+        memcpy(&line, payload, sizeof(line));
+        std::string name((const char*)payload + 9, payload[8]);
+        uint64_t bytes;
+        memcpy(&bytes, payload + 9 + payload[8], sizeof(bytes));
+
+        char expected[16];
+        snprintf(expected, sizeof(expected), "thread-%u", record.Session);
+
+        if (name != expected || bytes != (uint64_t)line * 3 || record.Level != LOG_LEVEL_NOTICE) {
+            printf("FAIL: line %lld of session %u decoded as %s, %llu bytes\n", (long long)line, record.Session,
+                   name.c_str(), (unsigned long long)bytes);
+            return -1;
+        }
+
+        lines++;
+    }
+
+    return lines;
+}
+
+int main() {
+    // The sink records whether or not the console shows the line
+    gConsole.EnableOutput[CON_GENERAL] = false;
+
+    char directory[] = "/tmp/cs_binlog_XXXXXX";
+
+    if (mkdtemp(directory) == nullptr) {
+        printf("FAIL: no temporary directory\n");
+        return 1;
+    }
+
+    BINARY_LOG_CONFIG config;
+    config.Directory = directory;
+    config.SegmentSize = 1 << 20;
+    config.RotateSeconds = 0;
+    config.MaxFiles = MAX_FILES;
+    config.BufferSize = 64 << 20;
+
+    if (!g_binary_log.start(config)) {
+        printf("FAIL: could not start\n");
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([t]() {
+            BinaryLog::Session session((uint32_t)t);
+            char name[16];
+            snprintf(name, sizeof(name), "thread-%d", t);
+
+            for (int n = 0; n < LINES_PER_THREAD; n++) {
+                LogAdd(2, LINE_FORMAT, n, name, (size_t)n * 3, n * 100.0 / LINES_PER_THREAD);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    g_binary_log.stop();
+
+    int64_t records = Metrics::get("binlog.records")->load();
+    int64_t dropped = Metrics::get("binlog.dropped")->load();
+    int64_t created = Metrics::get("binlog.segments")->load();
+    std::vector<std::string> segments = ListSegments(directory);
+
+    printf("%lld record(s), %lld dropped, %lld segment(s) written, %zu kept\n", (long long)records,
+           (long long)dropped, (long long)created, segments.size());
+
+    int result = 0;
+
+    // Plus the start line
+    if (dropped != 0 || records != THREADS * LINES_PER_THREAD + 1) {
+        printf("FAIL: lines lost\n");
+        result = 1;
+    }
+
+    if (created <= (int64_t)MAX_FILES || segments.size() != MAX_FILES) {
+        printf("FAIL: expected rotation down to %u segment(s)\n", MAX_FILES);
+        result = 1;
+    }
+
+    for (const std::string& segment : segments) {
+        int lines = CheckSegment(segment);
+
+        if (lines <= 0) {
+            result = 1;
+        }
+
+        unlink(segment.c_str());
+    }
+
+    rmdir(directory);
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,145 @@
+// Saves the live server table to a checkpoint, restores it into a fresh
+// table, and checks freshness, provisional marking, torn-save rejection and
+// that a corrupted failure detector or server state is dropped instead of
+// imported.
+
+#include "ServerCheckpoint.h"
+#include "ServerList.h"
+#include "Util.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+// Second mapping of the file, standing in for a crash or a clock jump
+template <typename Edit>
+static void EditCheckpoint(const char* path, Edit edit) {
+    int handle = open(path, O_RDWR);
+    void* mapping = mmap(nullptr, sizeof(SERVER_CHECKPOINT_FILE), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+    edit(static_cast<SERVER_CHECKPOINT_FILE*>(mapping));
+
+    munmap(mapping, sizeof(SERVER_CHECKPOINT_FILE));
+    close(handle);
+}
+
+static int Check(bool condition, const char* what) {
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+int main() {
+    std::string path = "/tmp/cs_checkpoint_test_" + std::to_string(getpid()) + ".state";
+    int failures = 0;
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+    heartbeat.header.set(0x01, sizeof(heartbeat));
+    heartbeat.ServerCode = 0;
+    heartbeat.UserTotal = 37;
+    heartbeat.UserCount = 370;
+    heartbeat.MaxUserCount = 1000;
+    gServerList.GCGameServerLiveRecv(&heartbeat);
+
+    CServerCheckpoint writer;
+    failures += Check(writer.Open(path.c_str()), "checkpoint file opened");
+    writer.Save(&gServerList);
+    writer.Close();
+
+    // Restart: a fresh table picks the live state up again
+    auto restored = std::make_unique<CServerList>();
+    restored->Load(CS_TEST_SERVER_LIST);
+
+    CServerCheckpoint reader;
+    reader.Open(path.c_str());
+    failures += Check(reader.Restore(restored.get()) == 1, "fresh entry restored");
+    failures += Check(restored->GetServerState(0) == SERVER_STATE_ONLINE, "restored server is online");
+    failures += Check(restored->IsProvisional(0), "restored server is provisional");
+
+    SERVER_LIVE_SNAPSHOT snapshot[MAX_SERVER_LIST + 1];
+    int count = restored->ExportLiveSnapshot(snapshot, MAX_SERVER_LIST + 1);
+    failures += Check(count == 1 && snapshot[0].UserTotal == 37 && snapshot[0].UserCount == 370 &&
+                      snapshot[0].MaxUserCount == 1000, "load figures carried over");
+
+    restored->GCGameServerLiveRecv(&heartbeat);
+    failures += Check(!restored->IsProvisional(0), "live heartbeat confirms the server");
+
+    // A checkpoint older than MaxHeartbeatPause is not restored
+    {
+        CServerCheckpoint stale;
+        stale.Open(path.c_str());
+        stale.Save(&gServerList);
+
+        EditCheckpoint(path.c_str(), [](SERVER_CHECKPOINT_FILE* lpFile) {
+            lpFile->CheckpointTime -= SERVER_HEARTBEAT_TIMEOUT + 1000;
+        });
+
+        auto cold = std::make_unique<CServerList>();
+        cold->Load(CS_TEST_SERVER_LIST);
+        failures += Check(stale.Restore(cold.get()) == 0, "stale entry dropped");
+        failures += Check(cold->GetServerState(0) == SERVER_STATE_OFFLINE, "stale server stays offline");
+    }
+
+    // A save interrupted halfway (odd sequence) is ignored
+    {
+        CServerCheckpoint torn;
+        torn.Open(path.c_str());
+        torn.Save(&gServerList);
+
+        EditCheckpoint(path.c_str(), [](SERVER_CHECKPOINT_FILE* lpFile) {
+            lpFile->Sequence.fetch_add(1);
+        });
+
+        auto cold = std::make_unique<CServerList>();
+        cold->Load(CS_TEST_SERVER_LIST);
+        failures += Check(torn.Restore(cold.get()) == 0, "torn checkpoint ignored");
+    }
+
+    // Garbage in an entry's detector (window index out of range) drops the entry
+    {
+        CServerCheckpoint corrupt;
+        corrupt.Open(path.c_str());
+        corrupt.Save(&gServerList);
+
+        EditCheckpoint(path.c_str(), [](SERVER_CHECKPOINT_FILE* lpFile) {
+            memset(static_cast<void*>(&lpFile->Entry[0].Detector), 0x7F, sizeof(CFailureDetector));
+        });
+
+        auto cold = std::make_unique<CServerList>();
+        cold->Load(CS_TEST_SERVER_LIST);
+        failures += Check(corrupt.Restore(cold.get()) == 0, "entry with a corrupted detector dropped");
+        failures += Check(cold->GetServerState(0) == SERVER_STATE_OFFLINE, "corrupted server stays offline");
+
+        cold->GCGameServerLiveRecv(&heartbeat);
+        failures += Check(cold->GetServerState(0) == SERVER_STATE_ONLINE, "heartbeat after the drop still works");
+    }
+
+    // So does a server state outside the known ones
+    {
+        CServerCheckpoint corrupt;
+        corrupt.Open(path.c_str());
+        corrupt.Save(&gServerList);
+
+        EditCheckpoint(path.c_str(), [](SERVER_CHECKPOINT_FILE* lpFile) {
+            lpFile->Entry[0].ServerState = SERVER_STATE_SUSPECT + 5;
+        });
+
+        auto cold = std::make_unique<CServerList>();
+        cold->Load(CS_TEST_SERVER_LIST);
+        failures += Check(corrupt.Restore(cold.get()) == 0, "entry with an unknown server state dropped");
+        failures += Check(cold->GetServerState(0) == SERVER_STATE_OFFLINE, "server with an unknown state stays offline");
+    }
+
+    unlink(path.c_str());
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+// Runs three cluster nodes as separate processes on loopback. A GameServer
+// heartbeats one node; every node must list it with the current user count,
+// and a later heartbeat to another node must win everywhere (last writer).
+// Reports convergence time here and per-node gossip bandwidth from the nodes.
+// An entry with an unknown server state is not merged.
+
+#include "ServerCluster.h"
+#include "ConnectServerProtocol.h"
+#include "Metrics.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "SocketManagerUdp.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int NODES = 3;
+static constexpr int CONVERGENCE_BOUND_MS = 2000;
+
+static volatile sig_atomic_t g_terminate = 0;
+
+static void OnTerminate(int) {
+    g_terminate = 1;
+}
+
+static int RunNode(char* argv[]) {
+    std::signal(SIGTERM, OnTerminate);
+
+    int node_id = atoi(argv[2]);
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+    gServerList.SetShowOfflineServers(false);
+
+    boost::asio::io_context data_io;
+    boost::asio::io_context control_io;
+    auto data_guard = boost::asio::make_work_guard(data_io);
+    auto control_guard = boost::asio::make_work_guard(control_io);
+
+    SocketManager socket_manager(data_io);
+    g_socket_manager = &socket_manager;
+    SocketManagerUdp socket_manager_udp(control_io);
+    ServerCluster server_cluster(control_io, gServerList);
+
+    CLUSTER_CONFIG config;
+    config.NodeId = node_id;
+    config.Port = atoi(argv[5]);
+    config.ClusterKey = 0x5EED;
+    config.Interval = 50;
+    config.FullSyncInterval = 1000;
+
+    if (!ServerCluster::parse_peers(argv[6], &config.Peers) || !socket_manager.start(atoi(argv[3])) ||
+        !socket_manager_udp.start(atoi(argv[4])) || !server_cluster.start(config)) {
+        return 2;
+    }
+
+    std::thread data_thread([&data_io]() { data_io.run(); });
+    std::thread control_thread([&control_io]() { control_io.run(); });
+
+    auto started = std::chrono::steady_clock::now();
+
+    while (!g_terminate) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    int64_t sent = Metrics::get("cluster.bytes_sent")->load();
+
+    fprintf(stderr, "Node %d: sent %lld bytes (%.0f B/s), received %lld bytes, merged %lld entries, convergence max %lld ms\n",
+           node_id, (long long)sent, sent / seconds, (long long)Metrics::get("cluster.bytes_received")->load(),
+           (long long)Metrics::get("cluster.entries_merged")->load(),
+           (long long)Metrics::get("cluster.convergence_max_ms")->load());
+
+    server_cluster.stop();
+    socket_manager_udp.stop();
+    socket_manager.stop();
+    data_guard.reset();
+    control_guard.reset();
+    data_io.stop();
+    control_io.stop();
+    data_thread.join();
+    control_thread.join();
+
+    return 0;
+}
+
+static void ReadPacket(boost::asio::ip::tcp::socket& socket, uint8_t* buffer, uint8_t head, uint8_t subhead) {
+    boost::asio::read(socket, boost::asio::buffer(buffer, 2));
+
+    size_t header_size = (buffer[0] == 0xC1) ? 2 : 3;
+    size_t size = buffer[1];
+
+    if (buffer[0] == 0xC2) {
+        boost::asio::read(socket, boost::asio::buffer(buffer + 2, 1));
+        size = MAKEWORD(buffer[2], buffer[1]);
+    }
+
+    boost::asio::read(socket, boost::asio::buffer(buffer + header_size, size - header_size));
+
+    if (buffer[header_size] != head || (subhead != 0 && buffer[header_size + 1] != subhead)) {
+        throw std::runtime_error("unexpected reply");
+    }
+}
+
+// UserTotal of ServerCode 0 as listed by the node, -1 if not listed
+static int QueryUserTotal(boost::asio::io_context& io, uint16_t port) {
+    try {
+        boost::asio::ip::tcp::socket socket(io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port});
+
+        uint8_t buffer[MAX_PACKET_SIZE];
+        ReadPacket(socket, buffer, 0x00, 0);
+
+        const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+        boost::asio::write(socket, boost::asio::buffer(list_request));
+        ReadPacket(socket, buffer, 0xF4, 0x04);
+        ReadPacket(socket, buffer, 0xF4, 0x02);
+
+        int count = PMSG_SERVER_LIST_SEND::Count.get(buffer);
+
+        for (int n = 0; n < count; n++) {
+            const uint8_t* entry = buffer + PMSG_SERVER_LIST_SEND::Size + n * PMSG_SERVER_LIST::Size;
+
+            if (PMSG_SERVER_LIST::ServerCode.get(entry) == 0) {
+                return PMSG_SERVER_LIST::UserTotal.get(entry);
+            }
+        }
+    } catch (const std::exception&) {
+    }
+
+    return -1;
+}
+
+static uint16_t ReservePort(boost::asio::io_context& io, bool tcp) {
+    if (tcp) {
+        boost::asio::ip::tcp::acceptor acceptor(io, {boost::asio::ip::tcp::v4(), 0});
+        return acceptor.local_endpoint().port();
+    }
+
+    boost::asio::ip::udp::socket socket(io, {boost::asio::ip::udp::v4(), 0});
+    return socket.local_endpoint().port();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 7 && strcmp(argv[1], "node") == 0) {
+        return RunNode(argv);
+    }
+
+    {
+        gServerList.Load(CS_TEST_SERVER_LIST);
+
+        SERVER_CLUSTER_ENTRY entry = {};
+        entry.Version = 1;
+        entry.ServerCode = 0;
+        entry.Origin = 2;
+        entry.ServerState = SERVER_STATE_SUSPECT + 5;
+
+        uint32_t lag = 0;
+
+        if (gServerList.MergeClusterEntries(&entry, 1, &lag) != 0 ||
+            gServerList.GetServerState(0) != SERVER_STATE_OFFLINE) {
+            printf("FAIL: entry with server state %d was merged\n", entry.ServerState);
+            return 1;
+        }
+    }
+
+    boost::asio::io_context io;
+    uint16_t tcp_port[NODES];
+    uint16_t udp_port[NODES];
+    uint16_t gossip_port[NODES];
+
+    for (int n = 0; n < NODES; n++) {
+        tcp_port[n] = ReservePort(io, true);
+        udp_port[n] = ReservePort(io, false);
+        gossip_port[n] = ReservePort(io, false);
+    }
+
+    pid_t nodes[NODES];
+
+    for (int n = 0; n < NODES; n++) {
+        std::string peers;
+
+        for (int p = 0; p < NODES; p++) {
+            if (p != n) {
+                peers += (peers.empty() ? "" : ",") + std::string("127.0.0.1:") + std::to_string(gossip_port[p]);
+            }
+        }
+
+        std::string id = std::to_string(n + 1);
+        std::string tcp = std::to_string(tcp_port[n]);
+        std::string udp = std::to_string(udp_port[n]);
+        std::string gossip = std::to_string(gossip_port[n]);
+
+        nodes[n] = fork();
+
+        if (nodes[n] == 0) {
+            // Keep the test output to the parent's summary and the node reports
+            freopen("/dev/null", "w", stdout);
+            execl("/proc/self/exe", argv[0], "node", id.c_str(), tcp.c_str(), udp.c_str(), gossip.c_str(),
+                  peers.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+    }
+
+    // Wait until every node answers
+    int result = 0;
+
+    for (int n = 0; n < NODES && result == 0; n++) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while (true) {
+            boost::system::error_code ec;
+            boost::asio::ip::tcp::socket probe(io);
+            probe.connect({boost::asio::ip::make_address_v4("127.0.0.1"), tcp_port[n]}, ec);
+
+            if (!ec) {
+                break;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                printf("FAIL: node %d did not start\n", n + 1);
+                result = 1;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    // GameServer heartbeating one node every 100 ms
+    std::atomic<int> target{0};
+    std::atomic<int> user_total{11};
+    std::atomic<bool> beating{true};
+
+    std::thread game_server([&]() {
+        boost::asio::io_context sender_io;
+        boost::asio::ip::udp::socket sender(sender_io, boost::asio::ip::udp::v4());
+
+        while (beating) {
+            SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+            heartbeat.header.set(0x01, sizeof(heartbeat));
+            heartbeat.ServerCode = 0;
+            heartbeat.UserTotal = (uint8_t)user_total.load();
+
+            boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), udp_port[target]);
+            sender.send_to(boost::asio::buffer(&heartbeat, sizeof(heartbeat)), endpoint);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    // Every node must list the server with the value the latest heartbeat carried
+    auto converge = [&](const char* what) {
+        auto started = std::chrono::steady_clock::now();
+        auto deadline = started + std::chrono::milliseconds(CONVERGENCE_BOUND_MS);
+        bool converged = false;
+
+        while (!converged && std::chrono::steady_clock::now() < deadline) {
+            converged = true;
+
+            for (int n = 0; n < NODES; n++) {
+                converged = converged && (QueryUserTotal(io, tcp_port[n]) == user_total);
+            }
+
+            if (!converged) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+
+        long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+
+        printf("%s: %s after %lld ms\n", what, converged ? "converged" : "NOT converged", elapsed);
+        return converged;
+    };
+
+    if (result == 0 && !converge("Heartbeats to node 1")) {
+        result = 1;
+    }
+
+    // The server moves to another node: the newer writer wins on all of them
+    target = 1;
+    user_total = 22;
+
+    if (result == 0 && !converge("Heartbeats to node 2")) {
+        result = 1;
+    }
+
+    beating = false;
+    game_server.join();
+
+    for (int n = 0; n < NODES; n++) {
+        int status = 0;
+
+        kill(nodes[n], SIGTERM);
+        waitpid(nodes[n], &status, 0);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("FAIL: node %d exited abnormally\n", n + 1);
+            result = 1;
+        }
+    }
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
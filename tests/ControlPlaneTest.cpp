@@ -0,0 +1,157 @@
+// Floods the client worker pool with connections and busy handlers, then
+// checks that heartbeats sent to the control-plane UDP socket are still
+// processed within a bounded latency.
+
+#include "ControlPlane.h"
+#include "Metrics.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "SocketManagerUdp.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int HEARTBEATS = 200;
+static constexpr int HEARTBEAT_LATENCY_BOUND_MS = 100;
+static constexpr int BUSY_HANDLER_MS = 5;
+
+static void PostBusyHandler(boost::asio::io_context& io, std::atomic<bool>& flooding) {
+    boost::asio::post(io, [&io, &flooding]() {
+        if (!flooding) {
+            return;
+        }
+
+        // Keep the queue non-empty, then hog the worker thread
+        PostBusyHandler(io, flooding);
+
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(BUSY_HANDLER_MS);
+        while (std::chrono::steady_clock::now() < until) {
+        }
+    });
+}
+
+int main() {
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    // Data plane: client sessions on a single saturated worker
+    boost::asio::io_context data_io;
+    auto work_guard = boost::asio::make_work_guard(data_io);
+
+    SocketManager socket_manager(data_io);
+    g_socket_manager = &socket_manager;
+    socket_manager.start(0);
+
+    std::thread data_thread([&data_io]() {
+        data_io.run();
+    });
+
+    // Control plane: heartbeats on their own thread
+    ControlPlane control_plane;
+    g_control_plane = &control_plane;
+
+    SocketManagerUdp socket_manager_udp(control_plane.context());
+    socket_manager_udp.start(0);
+    control_plane.start();
+
+    std::atomic<bool> flooding{true};
+
+    for (int n = 0; n < 4; n++) {
+        PostBusyHandler(data_io, flooding);
+    }
+
+    // Synthetic client flood: connect, ask for the list, hang up, repeat
+    std::thread flood_thread([&]() {
+        boost::asio::io_context client_io;
+        const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+
+        while (flooding) {
+            try {
+                boost::asio::ip::tcp::socket socket(client_io);
+                socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager.port()});
+                boost::asio::write(socket, boost::asio::buffer(list_request));
+            } catch (const std::exception&) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    });
+
+    // Heartbeats: measure send -> processed on the control plane
+    boost::asio::io_context sender_io;
+    boost::asio::ip::udp::socket sender(sender_io, boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::endpoint target(boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager_udp.port());
+
+    std::atomic<int64_t>* processed = Metrics::get("udp.heartbeats");
+    std::vector<int64_t> latencies;
+    int result = 0;
+
+    for (int n = 0; n < HEARTBEATS; n++) {
+        SDHP_GAME_SERVER_LIVE_RECV msg = {};
+        msg.header.set(0x01, sizeof(msg));
+        msg.ServerCode = 0;
+        msg.UserTotal = n % 100;
+
+        int64_t before = processed->load();
+        auto sent = std::chrono::steady_clock::now();
+
+        sender.send_to(boost::asio::buffer(&msg, sizeof(msg)), target);
+
+        while (processed->load() == before) {
+            if (std::chrono::steady_clock::now() - sent > std::chrono::seconds(5)) {
+                printf("FAIL: heartbeat %d was never processed\n", n);
+                result = 1;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        if (result != 0) {
+            break;
+        }
+
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - sent).count());
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    flooding = false;
+    flood_thread.join();
+
+    if (result == 0) {
+        std::sort(latencies.begin(), latencies.end());
+
+        int64_t p50 = latencies[latencies.size() / 2];
+        int64_t p99 = latencies[latencies.size() * 99 / 100];
+        int64_t max = latencies.back();
+
+        printf("Heartbeat latency under flood: p50=%lldus p99=%lldus max=%lldus, control-plane lag max=%lldus\n",
+               (long long)p50, (long long)p99, (long long)max,
+               (long long)Metrics::get("controlplane.lag_max_us")->load());
+
+        if (max > HEARTBEAT_LATENCY_BOUND_MS * 1000) {
+            printf("FAIL: heartbeat latency above %d ms\n", HEARTBEAT_LATENCY_BOUND_MS);
+            result = 1;
+        } else {
+            printf("PASS\n");
+        }
+    }
+
+    socket_manager_udp.stop();
+    control_plane.stop();
+
+    socket_manager.stop();
+    work_guard.reset();
+    data_io.stop();
+    data_thread.join();
+
+    return result;
+}
@@ -0,0 +1,223 @@
+// Flight recorder: threads record more events than their rings hold; a
+// snapshot must keep exactly the newest FLIGHT_RING_SIZE of each, in order.
+// Then a child process installs the crash handler, records a few events and
+// dies on SIGSEGV; its dump must exist and end with those events.
+
+#include "FlightRecorder.h"
+#include "platform/linux/SignalHandler.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int THREADS = 4;
+static constexpr int EVENTS_PER_THREAD = FLIGHT_RING_SIZE * 3 + 17;
+
+struct DUMP_THREAD
+{
+    FLIGHT_DUMP_THREAD Header;
+    std::vector<FLIGHT_EVENT> Events;
+};
+
+static bool ReadDump(const std::string& path, FLIGHT_DUMP_HEADER* header, std::vector<DUMP_THREAD>* threads) {
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool valid = fread(header, sizeof(*header), 1, file) == 1 && header->Magic == FLIGHT_DUMP_MAGIC &&
+                 header->EventSize == sizeof(FLIGHT_EVENT) && header->RingSize == FLIGHT_RING_SIZE;
+
+    for (uint32_t t = 0; valid && t < header->Threads; t++) {
+        DUMP_THREAD thread;
+        valid = fread(&thread.Header, sizeof(thread.Header), 1, file) == 1 && thread.Header.Events <= FLIGHT_RING_SIZE;
+
+        if (valid) {
+            thread.Events.resize(thread.Header.Events);
+            valid = thread.Events.empty() ||
+                    fread(thread.Events.data(), sizeof(FLIGHT_EVENT), thread.Events.size(), file) == thread.Events.size();
+            threads->push_back(thread);
+        }
+    }
+
+    fclose(file);
+    return valid;
+}
+
+static int TestSnapshot(const std::string& path) {
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([t]() {
+            std::string name = "worker" + std::to_string(t);
+            FlightRecorder::set_thread_name(name.c_str());
+
+            for (int n = 0; n < EVENTS_PER_THREAD; n++) {
+                FlightRecorder::record(FLIGHT_MARK, (uint32_t)t, 0, 0, (uint64_t)n);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (!FlightRecorder::dump(path.c_str())) {
+        printf("FAIL: snapshot not written\n");
+        return 1;
+    }
+
+    FLIGHT_DUMP_HEADER header;
+    std::vector<DUMP_THREAD> threads;
+
+    if (!ReadDump(path, &header, &threads) || header.Signal != 0) {
+        printf("FAIL: snapshot not readable\n");
+        return 1;
+    }
+
+    int matched = 0;
+
+    for (const DUMP_THREAD& thread : threads) {
+        if (strncmp(thread.Header.Name, "worker", 6) != 0) {
+            continue;
+        }
+
+        uint32_t t = (uint32_t)atoi(thread.Header.Name + 6);
+        bool intact = thread.Header.Head == EVENTS_PER_THREAD && thread.Events.size() == FLIGHT_RING_SIZE;
+
+        for (size_t n = 0; intact && n < thread.Events.size(); n++) {
+            const FLIGHT_EVENT& event = thread.Events[n];
+            intact = event.Type == FLIGHT_MARK && event.Session == t &&
+                     event.Value == (uint64_t)(EVENTS_PER_THREAD - FLIGHT_RING_SIZE + n) &&
+                     (n == 0 || event.Tsc >= thread.Events[n - 1].Tsc);
+        }
+
+        if (!intact) {
+            printf("FAIL: ring of %s does not hold its newest events in order\n", thread.Header.Name);
+            return 1;
+        }
+
+        matched++;
+    }
+
+    printf("Snapshot: %zu thread(s), %d worker ring(s) intact\n", threads.size(), matched);
+
+    if (matched != THREADS) {
+        printf("FAIL: expected %d worker rings\n", THREADS);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int TestCrash(const std::string& directory) {
+    pid_t child = fork();
+
+    if (child == 0) {
+        if (chdir(directory.c_str()) != 0) {
+            _exit(3);
+        }
+
+        SignalHandler::install();
+        FlightRecorder::set_thread_name("crasher");
+
+        for (int n = 0; n < 10; n++) {
+            FlightRecorder::record(FLIGHT_MARK, 42, 0, 0, (uint64_t)(1000 + n));
+        }
+
+        raise(SIGSEGV);
+        _exit(4);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::string prefix = "flight_" + std::to_string(child) + "_";
+    std::string dump;
+    DIR* dir = opendir(directory.c_str());
+
+    for (dirent* entry = (dir != nullptr) ? readdir(dir) : nullptr; entry != nullptr; entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+            dump = directory + "/" + entry->d_name;
+        }
+    }
+
+    if (dir != nullptr) {
+        closedir(dir);
+    }
+
+    if (dump.empty()) {
+        printf("FAIL: crashed child (status %d) left no flight dump\n", status);
+        return 1;
+    }
+
+    FLIGHT_DUMP_HEADER header;
+    std::vector<DUMP_THREAD> threads;
+
+    if (!ReadDump(dump, &header, &threads) || header.Signal != SIGSEGV || header.Pid != (uint32_t)child) {
+        printf("FAIL: crash dump not readable or not from the crash\n");
+        return 1;
+    }
+
+    for (const DUMP_THREAD& thread : threads) {
+        if (strcmp(thread.Header.Name, "crasher") != 0 || thread.Events.size() < 10) {
+            continue;
+        }
+
+        const FLIGHT_EVENT& last = thread.Events.back();
+
+        if (last.Type == FLIGHT_MARK && last.Session == 42 && last.Value == 1009) {
+            printf("Crash: dump of pid %d holds the events before SIGSEGV\n", (int)child);
+            return 0;
+        }
+    }
+
+    printf("FAIL: crash dump lacks the crashing thread's events\n");
+    return 1;
+}
+
+int main() {
+    char directory[] = "/tmp/cs_flight_test_XXXXXX";
+
+    if (mkdtemp(directory) == nullptr) {
+        printf("FAIL: no temp directory\n");
+        return 1;
+    }
+
+    std::string snapshot = std::string(directory) + "/snapshot.bin";
+
+    int result = TestSnapshot(snapshot);
+
+    if (result == 0) {
+        result = TestCrash(directory);
+    }
+
+    // Snapshot, flight dump and the crash log
+    DIR* dir = opendir(directory);
+
+    for (dirent* entry = (dir != nullptr) ? readdir(dir) : nullptr; entry != nullptr; entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            unlink((std::string(directory) + "/" + entry->d_name).c_str());
+        }
+    }
+
+    if (dir != nullptr) {
+        closedir(dir);
+    }
+
+    rmdir(directory);
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
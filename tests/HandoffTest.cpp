@@ -0,0 +1,476 @@
+// Restarts the server under a steady stream of connect attempts: a successor
+// process takes the listening sockets (HTTP status listener included) and
+// server table over through the handoff socket, the old one drains, and no
+// connect attempt may fail. A peer
+// announcing an absurd server table is refused before anything is allocated,
+// a successor is not served its sockets unless the predecessor confirms it let
+// go of them, and a stalled successor does not hold up the control plane.
+
+#include "platform/linux/ListenerHandoff.h"
+#include "HttpStatus.h"
+#include "Metrics.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "SocketManagerUdp.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+static volatile sig_atomic_t g_terminate = 0;
+
+static void OnTerminate(int) {
+    g_terminate = 1;
+}
+
+// Connect and wait for the init packet; false if nobody served the connection
+static bool ConnectOnce(boost::asio::io_context& io, uint16_t port) {
+    try {
+        boost::asio::ip::tcp::socket socket(io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port});
+
+        struct timeval tv = {2, 0};
+        setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        uint8_t init[4];
+        size_t received = 0;
+
+        while (received < sizeof(init)) {
+            ssize_t n = ::recv(socket.native_handle(), init + received, sizeof(init) - received, 0);
+            if (n <= 0) {
+                return false;
+            }
+            received += n;
+        }
+
+        return (init[0] == 0xC1 && init[2] == 0x00);
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Answers one handoff request with a header claiming count entries of size
+// bytes each, passing two throwaway descriptors along with it. Never confirms
+// the release.
+static void ServeHostileHeader(int listener, uint32_t count, uint32_t size) {
+    int connection = ::accept(listener, nullptr, nullptr);
+
+    if (connection == -1) {
+        return;
+    }
+
+    uint32_t request[3];
+    ::recv(connection, request, sizeof(request), MSG_WAITALL);
+
+    uint32_t header[4] = {HANDOFF_MAGIC, HANDOFF_VERSION, count, size};
+    int passed[2] = {::open("/dev/null", O_RDONLY), ::open("/dev/null", O_RDONLY)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(passed))] = {};
+
+    iovec iov = {header, sizeof(header)};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(passed));
+    memcpy(CMSG_DATA(cmsg), passed, sizeof(passed));
+
+    ::sendmsg(connection, &message, MSG_NOSIGNAL);
+    ::close(passed[0]);
+    ::close(passed[1]);
+
+    // Held open so only the header check can end the request
+    uint8_t ack;
+    ::recv(connection, &ack, sizeof(ack), 0);
+    ::close(connection);
+}
+
+static int ListenAt(const std::string& path) {
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    ::unlink(path.c_str());
+    ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::listen(listener, 1);
+
+    return listener;
+}
+
+static int CheckHostileHeaders(const std::string& path) {
+    const uint32_t headers[][2] = {
+        {0xFFFFFFFF, 0xFFFFFFFF},
+        {0xFFFFFFFF, sizeof(SERVER_LIVE_SNAPSHOT)},
+        {MAX_SERVER_LIST + 2, sizeof(SERVER_LIVE_SNAPSHOT)},
+        {1, sizeof(SERVER_LIVE_SNAPSHOT) + 1},
+    };
+
+    int failures = 0;
+
+    for (const auto& claim : headers) {
+        int listener = ListenAt(path);
+        std::thread peer([listener, &claim]() { ServeHostileHeader(listener, claim[0], claim[1]); });
+
+        boost::asio::io_context io;
+        ListenerHandoff handoff(io, gServerList);
+        HANDOFF_SOCKETS sockets;
+
+        bool taken = handoff.request(path.c_str(), &sockets);
+
+        if (taken || sockets.TcpSocket != -1 || sockets.UdpSocket != -1) {
+            printf("FAIL: handoff header with %u x %u bytes was accepted\n", claim[0], claim[1]);
+            failures++;
+            handoff.complete(false);
+        }
+
+        peer.join();
+        ::close(listener);
+        ::unlink(path.c_str());
+    }
+
+    if (failures == 0) {
+        printf("Hostile handoff headers refused\n");
+    }
+
+    return failures;
+}
+
+// A predecessor that gave up on us does not confirm: complete() must say so
+static int CheckUnreleasedSockets(const std::string& path) {
+    int listener = ListenAt(path);
+    std::thread peer([listener]() { ServeHostileHeader(listener, 0, sizeof(SERVER_LIVE_SNAPSHOT)); });
+
+    boost::asio::io_context io;
+    ListenerHandoff handoff(io, gServerList);
+    HANDOFF_SOCKETS sockets;
+    int failures = 0;
+
+    if (!handoff.request(path.c_str(), &sockets)) {
+        printf("FAIL: valid handoff reply was refused\n");
+        failures++;
+    } else {
+        if (handoff.complete(true)) {
+            printf("FAIL: handoff completed without the predecessor releasing its sockets\n");
+            failures++;
+        }
+
+        ::close(sockets.TcpSocket);
+        ::close(sockets.UdpSocket);
+    }
+
+    peer.join();
+    ::close(listener);
+    ::unlink(path.c_str());
+
+    if (failures == 0) {
+        printf("Unreleased sockets not taken\n");
+    }
+
+    return failures;
+}
+
+// A successor that requests and then reads nothing: the control plane keeps
+// running meanwhile, and the old process keeps its sockets
+static bool CheckStalledSuccessor(const std::string& path, boost::asio::io_context& control_io) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    HANDOFF_REQUEST request = {HANDOFF_MAGIC, HANDOFF_VERSION, 0};
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::send(fd, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t)sizeof(request)) {
+        printf("FAIL: could not reach the handoff socket\n");
+        ::close(fd);
+        return false;
+    }
+
+    // Long enough for the request to be served
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::promise<void> ran;
+    auto started = std::chrono::steady_clock::now();
+    boost::asio::post(control_io, [&ran]() { ran.set_value(); });
+    bool responsive = (ran.get_future().wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+
+    ::close(fd);
+
+    if (!responsive) {
+        printf("FAIL: control plane blocked by a stalled handoff\n");
+        return false;
+    }
+
+    printf("Control plane ran %lld us into a stalled handoff\n",
+           (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - started).count());
+    return true;
+}
+
+// Status code of GET /serverlist, 0 if nobody answered
+static int HttpGet(boost::asio::io_context& io, uint16_t port) {
+    try {
+        boost::asio::ip::tcp::socket socket(io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port});
+
+        struct timeval tv = {2, 0};
+        setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        std::string request = "GET /serverlist HTTP/1.0\r\n\r\n";
+        boost::asio::write(socket, boost::asio::buffer(request));
+
+        char status[13] = {};
+        boost::asio::read(socket, boost::asio::buffer(status, sizeof(status) - 1));
+
+        return atoi(status + 9);
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+static HTTP_STATUS_CONFIG HttpConfig() {
+    HTTP_STATUS_CONFIG config;
+    config.Port = 0;
+    config.MaxConnections = 16;
+    config.MaxWaitSeconds = 0;
+    return config;
+}
+
+static int RunSuccessor(const char* path) {
+    std::signal(SIGTERM, OnTerminate);
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+
+    SocketManager socket_manager(io);
+    g_socket_manager = &socket_manager;
+    SocketManagerUdp socket_manager_udp(io);
+    HttpStatusServer http(io);
+
+    std::thread io_thread([&io]() {
+        io.run();
+    });
+
+    ListenerHandoff handoff(io, gServerList);
+    HANDOFF_SOCKETS sockets;
+    int result = 0;
+
+    if (!handoff.request(path, &sockets)) {
+        printf("FAIL: successor got no sockets\n");
+        result = 2;
+    } else if (gServerList.GetServerState(0) != SERVER_STATE_ONLINE) {
+        printf("FAIL: server table was not carried over\n");
+        handoff.complete(false);
+        result = 3;
+    } else if (sockets.HttpSocket == -1) {
+        printf("FAIL: HTTP listener was not handed over\n");
+        handoff.complete(false);
+        result = 6;
+    } else if (!socket_manager.start_native(sockets.TcpSocket) || !socket_manager_udp.start_native(sockets.UdpSocket) ||
+               !http.start_native(HttpConfig(), sockets.HttpSocket)) {
+        handoff.complete(false);
+        result = 4;
+    } else if (!handoff.complete(true)) {
+        printf("FAIL: predecessor did not release its sockets\n");
+        result = 7;
+    } else {
+        while (!g_terminate) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        if (Metrics::get("udp.heartbeats")->load() == 0) {
+            printf("FAIL: successor received no heartbeats\n");
+            result = 5;
+        }
+    }
+
+    boost::asio::post(io, [&http]() { http.stop(); });
+    socket_manager_udp.stop();
+    socket_manager.stop();
+    work_guard.reset();
+    io.stop();
+    io_thread.join();
+
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "successor") == 0) {
+        return RunSuccessor(argv[2]);
+    }
+
+    std::string path = "/tmp/cs_handoff_test_" + std::to_string(getpid()) + ".sock";
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    if (CheckHostileHeaders(path) != 0 || CheckUnreleasedSockets(path) != 0) {
+        return 1;
+    }
+
+    SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+    heartbeat.header.set(0x01, sizeof(heartbeat));
+    heartbeat.ServerCode = 0;
+    heartbeat.UserTotal = 42;
+    gServerList.GCGameServerLiveRecv(&heartbeat);
+
+    // Old process: clients on one context, heartbeats and handoff on another
+    boost::asio::io_context data_io;
+    boost::asio::io_context control_io;
+    auto data_guard = boost::asio::make_work_guard(data_io);
+    auto control_guard = boost::asio::make_work_guard(control_io);
+
+    SocketManager socket_manager(data_io);
+    g_socket_manager = &socket_manager;
+    SocketManagerUdp socket_manager_udp(control_io);
+    HttpStatusServer http(data_io);
+
+    if (!socket_manager.start(0) || !socket_manager_udp.start(0) || !http.start(HttpConfig())) {
+        printf("FAIL: could not start servers\n");
+        return 1;
+    }
+
+    uint16_t tcp_port = socket_manager.port();
+    uint16_t udp_port = socket_manager_udp.port();
+    uint16_t http_port = http.port();
+
+    std::atomic<bool> handed_off{false};
+    ListenerHandoff handoff(control_io, gServerList);
+
+    handoff.listen(path.c_str(), socket_manager.native_handle(), socket_manager_udp.native_handle(),
+                   http.native_handle(), [&]() {
+        socket_manager_udp.stop();
+        socket_manager.stop_accepting();
+        boost::asio::post(data_io, [&http]() { http.stop(); });
+        handed_off = true;
+    });
+
+    std::thread data_thread([&data_io]() { data_io.run(); });
+    std::thread control_thread([&control_io]() { control_io.run(); });
+
+    bool stalled_refused = CheckStalledSuccessor(path, control_io) && !handed_off;
+
+    // Steady connect attempts across the whole restart
+    std::atomic<bool> connecting{true};
+    std::atomic<int> succeeded{0};
+    std::atomic<int> failed{0};
+
+    std::thread client_thread([&]() {
+        boost::asio::io_context client_io;
+
+        while (connecting) {
+            if (ConnectOnce(client_io, tcp_port)) {
+                succeeded++;
+            } else {
+                failed++;
+            }
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    pid_t successor = fork();
+
+    if (successor == 0) {
+        // Not the client connections open right now: a copy held here would
+        // keep their sessions in the old process from draining
+        for (int fd = 3; fd < 1024; fd++) {
+            ::close(fd);
+        }
+
+        execl("/proc/self/exe", argv[0], "successor", path.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+
+    int result = stalled_refused ? 0 : 1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (!handed_off && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (!handed_off) {
+        printf("FAIL: handoff did not complete\n");
+        result = 1;
+    }
+
+    // Old process drains while the successor serves
+    while (socket_manager.get_active_count() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    int before = succeeded;
+
+    // Our HTTP listener is closed; the successor answers on the same port
+    boost::asio::io_context http_io;
+    int http_status = HttpGet(http_io, http_port);
+
+    if (http_status != 200) {
+        printf("FAIL: HTTP status endpoint answered %d after the handoff\n", http_status);
+        result = 1;
+    }
+
+    boost::asio::io_context sender_io;
+    boost::asio::ip::udp::socket sender(sender_io, boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::endpoint target(boost::asio::ip::make_address_v4("127.0.0.1"), udp_port);
+
+    for (int n = 0; n < 10; n++) {
+        sender.send_to(boost::asio::buffer(&heartbeat, sizeof(heartbeat)), target);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+
+    connecting = false;
+    client_thread.join();
+
+    int after = succeeded - before;
+
+    kill(successor, SIGTERM);
+
+    int status = 0;
+    waitpid(successor, &status, 0);
+
+    printf("Connects: %d ok (%d after handoff), %d failed; successor exit %d\n",
+           succeeded.load(), after, failed.load(), WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+    if (failed != 0 || after == 0) {
+        printf("FAIL: connect attempts were lost during the restart\n");
+        result = 1;
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("FAIL: successor failed\n");
+        result = 1;
+    } else if (result == 0) {
+        printf("PASS\n");
+    }
+
+    handoff.stop();
+    socket_manager.stop();
+    data_guard.reset();
+    control_guard.reset();
+    data_io.stop();
+    control_io.stop();
+    data_thread.join();
+    control_thread.join();
+
+    return result;
+}
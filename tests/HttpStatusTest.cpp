@@ -0,0 +1,192 @@
+// HTTP status endpoint: the JSON list carries a strong ETag, revalidation
+// gets 304 while the table is unchanged, keep-alive connections serve
+// several requests, and a long poll returns when a heartbeat changes the
+// list or when its wait runs out.
+
+#include "HttpStatus.h"
+#include "ServerList.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+
+std::atomic<bool> g_running{true};
+
+using boost::asio::ip::tcp;
+
+struct HTTP_REPLY
+{
+    int Status = 0;
+    std::string ETag;
+    std::string Connection;
+    std::string Body;
+};
+
+static int Check(bool condition, const char* what) {
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+static bool Connect(tcp::socket& socket, uint16_t port) {
+    boost::system::error_code error;
+    socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port}, error);
+
+    timeval timeout = {10, 0};
+    setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return !error;
+}
+
+static std::string Header(const std::string& headers, const char* name) {
+    size_t at = headers.find(std::string("\r\n") + name + ": ");
+
+    if (at == std::string::npos) {
+        return "";
+    }
+
+    at += strlen(name) + 4;
+    return headers.substr(at, headers.find("\r\n", at) - at);
+}
+
+// One request on an open connection; Status 0 on a read error
+static HTTP_REPLY Request(tcp::socket& socket, boost::asio::streambuf& buffer, const std::string& target,
+                          const std::string& extra = "") {
+    HTTP_REPLY reply;
+    boost::system::error_code error;
+
+    std::string request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n" + extra + "\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request), error);
+
+    size_t size = boost::asio::read_until(socket, buffer, "\r\n\r\n", error);
+
+    if (error) {
+        return reply;
+    }
+
+    std::string headers(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + size);
+    buffer.consume(size);
+
+    reply.Status = atoi(headers.c_str() + 9);
+    reply.ETag = Header(headers, "ETag");
+    reply.Connection = Header(headers, "Connection");
+
+    size_t length = (size_t)atoi(Header(headers, "Content-Length").c_str());
+
+    if (buffer.size() < length) {
+        boost::asio::read(socket, buffer, boost::asio::transfer_exactly(length - buffer.size()), error);
+    }
+
+    reply.Body.assign(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + length);
+    buffer.consume(length);
+
+    return reply;
+}
+
+static void Heartbeat(uint8_t user_total) {
+    SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+    heartbeat.header.set(0x01, sizeof(heartbeat));
+    heartbeat.ServerCode = 0;
+    heartbeat.UserTotal = user_total;
+    heartbeat.UserCount = user_total * 10;
+    heartbeat.MaxUserCount = 1000;
+    gServerList.GCGameServerLiveRecv(&heartbeat);
+}
+
+int main() {
+    int failures = 0;
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+    Heartbeat(37);
+
+    boost::asio::io_context io;
+    auto work = boost::asio::make_work_guard(io);
+    HttpStatusServer http(io);
+
+    HTTP_STATUS_CONFIG config;
+    config.Port = 0;
+    config.MaxConnections = 16;
+    config.MaxWaitSeconds = 2;
+
+    failures += Check(http.start(config), "endpoint listening");
+
+    std::thread runner([&io]() { io.run(); });
+
+    boost::asio::io_context client_io;
+    tcp::socket socket(client_io);
+    boost::asio::streambuf buffer;
+    failures += Check(Connect(socket, http.port()), "client connected");
+
+    // Full body with a tag
+    HTTP_REPLY first = Request(socket, buffer, "/serverlist");
+    failures += Check(first.Status == 200 && first.ETag.size() == 18 && first.ETag.front() == '"',
+                      "200 with a strong ETag");
+    failures += Check(first.Body.find("\"name\":\"Server 1\"") != std::string::npos &&
+                      first.Body.find("\"state\":\"online\",\"load\":37,\"users\":370,\"max_users\":1000") !=
+                          std::string::npos &&
+                      first.Body.find("\"joinserver\":{\"online\":false,\"queue\":0}") != std::string::npos,
+                      "body lists the server and the (silent) JoinServer");
+
+    // Same connection, nothing changed
+    failures += Check(!http.render(), "render without a table change keeps the body");
+
+    HTTP_REPLY second = Request(socket, buffer, "/serverlist", "If-None-Match: " + first.ETag + "\r\n");
+    failures += Check(second.Status == 304 && second.ETag == first.ETag && second.Body.empty(),
+                      "304 on If-None-Match over the kept-alive connection");
+
+    HTTP_REPLY stale = Request(socket, buffer, "/serverlist", "If-None-Match: \"0000000000000000\"\r\n");
+    failures += Check(stale.Status == 200 && stale.Body == first.Body, "200 for a tag that is not current");
+
+    failures += Check(Request(socket, buffer, "/other").Status == 404, "404 for other paths");
+
+    // Long poll with nothing changing: 304 after the capped wait
+    auto started = std::chrono::steady_clock::now();
+    HTTP_REPLY timeout = Request(socket, buffer, "/serverlist?wait=30", "If-None-Match: " + first.ETag + "\r\n");
+    auto waited = std::chrono::steady_clock::now() - started;
+    failures += Check(timeout.Status == 304 && waited >= std::chrono::milliseconds(1900) &&
+                      waited < std::chrono::seconds(5),
+                      "long poll answers 304 after MaxWaitSeconds");
+
+    // Long poll woken by a heartbeat and the next render
+    {
+        HTTP_REPLY changed;
+        std::chrono::steady_clock::duration held;
+
+        std::thread poller([&]() {
+            auto begin = std::chrono::steady_clock::now();
+            changed = Request(socket, buffer, "/serverlist?wait=2", "If-None-Match: " + first.ETag + "\r\n");
+            held = std::chrono::steady_clock::now() - begin;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        Heartbeat(38);
+        failures += Check(http.render(), "render after a heartbeat changes the body");
+        poller.join();
+
+        failures += Check(changed.Status == 200 && changed.ETag != first.ETag && changed.ETag == http.body()->ETag &&
+                          changed.Body.find("\"load\":38") != std::string::npos &&
+                          held < std::chrono::milliseconds(1500),
+                          "long poll woken with the new body");
+    }
+
+    HTTP_REPLY last = Request(socket, buffer, "/serverlist", "Connection: close\r\n");
+    boost::system::error_code error;
+    char byte;
+    socket.read_some(boost::asio::buffer(&byte, 1), error);
+    failures += Check(last.Status == 200 && last.Connection == "close" && error == boost::asio::error::eof,
+                      "Connection: close honoured");
+
+    http.stop();
+    work.reset();
+    io.stop();
+    runner.join();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// Prefork mode: the shared server table answers list and info requests the
+// way CServerList does, a reader never sees a torn entry while the
+// supervisor rewrites it nor hangs on one it never finished, a worker
+// refuses a segment of another version, and per-IP counts are shared between
+// worker processes and released when one of them dies (even holding the lock).
+
+#include "ConnectServerProtocol.h"
+#include "IpManager.h"
+#include "ServerList.h"
+#include "SharedServerTable.h"
+#include "Util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+static int Check(bool condition, const char* what) {
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+// Runs body in a forked child, as a worker process would, and waits for it
+template <typename Body>
+static int RunChild(Body body) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        body();
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+int main() {
+    int failures = 0;
+
+    CSharedServerTable table;
+    failures += Check(table.Create(), "shared segment created");
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+    gServerList.SetSharedTable(&table);
+
+    SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+    heartbeat.header.set(0x01, sizeof(heartbeat));
+    heartbeat.ServerCode = 0;
+    heartbeat.UserTotal = 42;
+    heartbeat.UserCount = 420;
+    heartbeat.MaxUserCount = 1000;
+    gServerList.GCGameServerLiveRecv(&heartbeat);
+
+    // Same replies from the shared copy as from the supervisor's table
+    {
+        uint8_t local[1024];
+        uint8_t shared[1024];
+        int local_size = 0;
+        int shared_size = 0;
+
+        long local_count = gServerList.GenerateServerList(local, &local_size, sizeof(local));
+        long shared_count = table.GenerateServerList(shared, &shared_size, sizeof(shared));
+
+        failures += Check(local_count == 1 && shared_count == local_count && shared_size == local_size &&
+                          memcmp(local, shared, local_size) == 0 && PMSG_SERVER_LIST::UserTotal.get(shared) == 42,
+                          "server list matches CServerList");
+
+        local_size = 0;
+        shared_size = 0;
+        local_count = gServerList.GenerateCustomServerList(local, &local_size, sizeof(local));
+        shared_count = table.GenerateCustomServerList(shared, &shared_size, sizeof(shared));
+
+        failures += Check(shared_count == local_count && shared_size == local_size &&
+                          memcmp(local, shared, local_size) == 0, "custom server list matches CServerList");
+
+        SERVER_LIST_INFO info;
+        bool available = false;
+
+        failures += Check(table.GetServerInfo(0, &info, &available) && available &&
+                          strcmp(info.ServerAddress, "127.0.0.1") == 0 && info.ServerPort == 55901,
+                          "server info from the shared table");
+        failures += Check(!table.GetServerInfo(1, &info, &available), "unknown server code not found");
+    }
+
+    // A worker process sees the supervisor's writes
+    {
+        int status = RunChild([&table]() {
+            CSharedServerTable worker;
+            uint8_t send[64];
+            int size = 0;
+
+            if (!worker.Attach(dup(table.Handle())) || worker.GenerateServerList(send, &size, sizeof(send)) != 1 ||
+                PMSG_SERVER_LIST::UserTotal.get(send) != 42) {
+                _exit(1);
+            }
+        });
+
+        failures += Check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "worker process reads the table");
+    }
+
+    // A worker of another build refuses a segment laid out differently
+    {
+        table.Get()->Version = SHARED_SERVER_TABLE_VERSION - 1;
+
+        CSharedServerTable worker;
+        int handle = dup(table.Handle());
+
+        failures += Check(!worker.Attach(handle) && !worker.IsOpen(), "segment of another version refused");
+
+        close(handle);
+        table.Get()->Version = SHARED_SERVER_TABLE_VERSION;
+    }
+
+    // Seqlock: state and load written together are read together. Offline
+    // servers are withheld, and the writer keeps UserTotal odd exactly while
+    // the server is online, so a torn read shows up as an even load
+    {
+        std::atomic<bool> done{false};
+        std::atomic<int> reads{0};
+        std::atomic<int> torn{0};
+
+        table.Get()->ShowOfflineServers = false;
+
+        std::thread reader([&]() {
+            while (!done.load()) {
+                uint8_t send[64];
+                int size = 0;
+
+                if (table.GenerateServerList(send, &size, sizeof(send)) == 1) {
+                    if ((PMSG_SERVER_LIST::UserTotal.get(send) & 1) == 0) {
+                        torn.fetch_add(1);
+                    }
+
+                    reads.fetch_add(1);
+                }
+            }
+        });
+
+        for (int n = 0; n < 2000000; n++) {
+            table.PublishSlot(0, (n & 1) ? SERVER_STATE_ONLINE : SERVER_STATE_OFFLINE, (uint8_t)n);
+        }
+
+        done.store(true);
+        reader.join();
+
+        table.Get()->ShowOfflineServers = true;
+
+        printf("      %d consistent read(s) of an online entry\n", reads.load());
+        failures += Check(torn.load() == 0, "no torn entry under a concurrent writer");
+        failures += Check((table.Get()->Entry[0].Sequence.load() & 1) == 0, "sequence even after the writer stops");
+    }
+
+    // A supervisor that died mid-write leaves a sequence odd: readers give up
+    // on that entry (or the whole layout) and report the server unavailable
+    {
+        SHARED_SERVER_TABLE* lpTable = table.Get();
+        uint8_t send[64];
+        int size = 0;
+        SERVER_LIST_INFO info;
+        bool available = true;
+
+        auto started = std::chrono::steady_clock::now();
+
+        lpTable->Entry[0].Sequence.fetch_or(1);
+
+        failures += Check(table.GenerateServerList(send, &size, sizeof(send)) == 0 && size == 0,
+                          "entry stuck mid-write left out of the list");
+        failures += Check(table.GetServerInfo(0, &info, &available) && !available,
+                          "entry stuck mid-write is unavailable");
+
+        lpTable->Entry[0].Sequence.fetch_add(1);
+        lpTable->LayoutSequence.fetch_or(1);
+
+        failures += Check(table.GenerateCustomServerList(send, &size, sizeof(send)) == 0 && size == 0,
+                          "layout stuck mid-write gives an empty list");
+
+        lpTable->LayoutSequence.fetch_add(1);
+
+        failures += Check(std::chrono::steady_clock::now() - started < std::chrono::seconds(1),
+                          "readers do not wait for the dead writer");
+        failures += Check(table.GenerateServerList(send, &size, sizeof(send)) == 1, "list back once written");
+    }
+
+    // Per-IP limits: two workers, one limit
+    {
+        const char* address = "10.0.0.1";
+
+        RunChild([&table, address]() {
+            table.InsertIpAddress(address, 0);
+        });
+        RunChild([&table, address]() {
+            table.InsertIpAddress(address, 1);
+        });
+
+        failures += Check(!table.CheckIpAddress(address, 2), "limit counts both workers' connections");
+        failures += Check(table.CheckIpAddress(address, 3), "limit above the total admits");
+        failures += Check(table.CheckIpAddress("10.0.0.2", 1), "other address unaffected");
+
+        // Worker 1 crashed: its connection is gone, worker 0's is kept
+        table.ReleaseWorker(1);
+        failures += Check(table.CheckIpAddress(address, 2), "dead worker's connection released");
+        failures += Check(!table.CheckIpAddress(address, 1), "live worker's connection kept");
+
+        table.RemoveIpAddress(address, 0);
+        failures += Check(table.CheckIpAddress(address, 1), "last connection removed");
+
+        // A worker dying inside the lock does not wedge the others
+        int status = RunChild([&table]() {
+            pthread_mutex_lock(&table.Get()->IpMutex);
+        });
+
+        failures += Check(WIFEXITED(status), "worker exited holding the lock");
+        table.InsertIpAddress(address, 2);
+        failures += Check(!table.CheckIpAddress(address, 1), "lock recovered from the dead owner");
+        table.ReleaseWorker(2);
+    }
+
+    // CIpManager goes through the shared counts in a worker
+    {
+        CIpManager manager;
+        manager.SetMaxIpConnection(1);
+        manager.SetSharedTable(&table, 3);
+
+        manager.InsertIpAddress("10.0.0.3");
+        failures += Check(!table.CheckIpAddress("10.0.0.3", 1), "CIpManager counts in the shared table");
+        failures += Check(!manager.CheckIpAddress("10.0.0.3"), "CIpManager checks the shared table");
+
+        manager.RemoveIpAddress("10.0.0.3");
+        failures += Check(manager.CheckIpAddress("10.0.0.3"), "CIpManager removes from the shared table");
+    }
+
+    gServerList.SetSharedTable(nullptr);
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
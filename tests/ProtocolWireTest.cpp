@@ -0,0 +1,248 @@
+// Wire layouts: the packet schemas encode and decode the byte sequences given
+// as examples in docs/PROTOCOL.md, replies written into a session's send
+// buffer come out byte for byte as documented, and short requests and
+// heartbeats are dropped instead of read past their end.
+
+#include "ConnectServerProtocol.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+
+std::atomic<bool> g_running{true};
+
+using boost::asio::ip::tcp;
+using Bytes = std::vector<uint8_t>;
+
+static int Check(bool condition, const char* what) {
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+// "text" zero-filled to size bytes
+static Bytes Text(const char* text, size_t size) {
+    Bytes bytes(size, 0);
+    memcpy(bytes.data(), text, strlen(text));
+    return bytes;
+}
+
+static Bytes Join(std::initializer_list<Bytes> parts) {
+    Bytes bytes;
+
+    for (const Bytes& part : parts) {
+        bytes.insert(bytes.end(), part.begin(), part.end());
+    }
+
+    return bytes;
+}
+
+static void Dump(const char* what, const Bytes& bytes) {
+    printf("      %s:", what);
+
+    for (uint8_t byte : bytes) {
+        printf(" %02X", byte);
+    }
+
+    printf("\n");
+}
+
+// Reads one C1/C2 frame; empty on EOF or timeout
+static Bytes ReadPacket(tcp::socket& socket) {
+    uint8_t head[3];
+    boost::system::error_code error;
+
+    boost::asio::read(socket, boost::asio::buffer(head), error);
+
+    if (error) {
+        return Bytes();
+    }
+
+    size_t size = (head[0] == 0xC2) ? ((head[1] << 8) | head[2]) : head[1];
+    Bytes packet(head, head + sizeof(head));
+
+    if (size < sizeof(head)) {
+        return Bytes();
+    }
+
+    packet.resize(size);
+    boost::asio::read(socket, boost::asio::buffer(packet.data() + sizeof(head), size - sizeof(head)), error);
+
+    return error ? Bytes() : packet;
+}
+
+// The examples of docs/PROTOCOL.md through the schemas, both ways
+static int CheckDocumentedExamples() {
+    int failures = 0;
+    uint8_t packet[256];
+
+    {
+        const Bytes expected = {0xC1, 0x04, 0x00, 0x01};
+
+        PMSG_SERVER_INIT_SEND::Header.put(packet, PMSG_SERVER_INIT_SEND::Size);
+        PMSG_SERVER_INIT_SEND::Result.put(packet, 1);
+
+        failures += Check(Bytes(packet, packet + PMSG_SERVER_INIT_SEND::Size) == expected,
+                          "server init C1:00 as documented");
+    }
+
+    {
+        const Bytes expected = Join({{0xC2, 0x00, 0x4B, 0xF4, 0x04, 0x00, 0x02},
+                                     {0x00, 0x00}, Text("TestServer", 32),
+                                     {0x01, 0x00}, Text("MainServer", 32)});
+        const char* names[] = {"TestServer", "MainServer"};
+        size_t size = PMSG_CUSTOM_SERVER_LIST_SEND::Size;
+
+        for (uint16_t code = 0; code < 2; code++) {
+            PMSG_CUSTOM_SERVER_LIST::ServerCode.put(packet + size, code);
+            PMSG_CUSTOM_SERVER_LIST::ServerName.put(packet + size, names[code]);
+            size += PMSG_CUSTOM_SERVER_LIST::Size;
+        }
+
+        PMSG_CUSTOM_SERVER_LIST_SEND::Header.put(packet, size);
+        PMSG_CUSTOM_SERVER_LIST_SEND::Count.put(packet, 2);
+
+        failures += Check(Bytes(packet, packet + size) == expected, "custom server list C2:F4:04 as documented");
+
+        char name[32];
+        const uint8_t* second = expected.data() + PMSG_CUSTOM_SERVER_LIST_SEND::Size + PMSG_CUSTOM_SERVER_LIST::Size;
+        PMSG_CUSTOM_SERVER_LIST::ServerName.get(second, name);
+
+        failures += Check(PMSG_CUSTOM_SERVER_LIST_SEND::Count.get(expected.data()) == 2 &&
+                          PMSG_CUSTOM_SERVER_LIST::ServerCode.get(second) == 1 && strcmp(name, "MainServer") == 0,
+                          "custom server list decodes back");
+    }
+
+    {
+        const Bytes expected = {0xC2, 0x00, 0x0C, 0xF4, 0x02, 0x02, 0x00, 0x00, 0x32, 0x01, 0x00, 0x64};
+        const uint8_t loads[] = {0x32, 0x64};
+        size_t size = PMSG_SERVER_LIST_SEND::Size;
+
+        for (uint16_t code = 0; code < 2; code++) {
+            PMSG_SERVER_LIST::ServerCode.put(packet + size, code);
+            PMSG_SERVER_LIST::UserTotal.put(packet + size, loads[code]);
+            size += PMSG_SERVER_LIST::Size;
+        }
+
+        PMSG_SERVER_LIST_SEND::Header.put(packet, size);
+        PMSG_SERVER_LIST_SEND::Count.put(packet, 2);
+
+        failures += Check(Bytes(packet, packet + size) == expected, "server list C2:F4:02 as documented, unpadded");
+
+        const uint8_t* second = expected.data() + PMSG_SERVER_LIST_SEND::Size + PMSG_SERVER_LIST::Size;
+        failures += Check(PMSG_SERVER_LIST::ServerCode.get(second) == 1 && PMSG_SERVER_LIST::UserTotal.get(second) == 100,
+                          "server list decodes back");
+    }
+
+    {
+        const Bytes expected = Join({{0xC1, 0x16, 0xF4, 0x03}, Text("127.0.0.1", 16), {0x5D, 0xDA}});
+
+        PMSG_SERVER_INFO_SEND::Header.put(packet, PMSG_SERVER_INFO_SEND::Size);
+        PMSG_SERVER_INFO_SEND::ServerAddress.put(packet, "127.0.0.1");
+        PMSG_SERVER_INFO_SEND::ServerPort.put(packet, 55901);
+
+        failures += Check(Bytes(packet, packet + PMSG_SERVER_INFO_SEND::Size) == expected,
+                          "server info C1:F4:03 as documented");
+    }
+
+    {
+        const Bytes request = {0xC1, 0x05, 0xF4, 0x03, 0x00};
+
+        failures += Check(PMSG_SERVER_INFO_RECV::Header.fits(request.data(), request.size(), PMSG_SERVER_INFO_RECV::Size) &&
+                          !PMSG_SERVER_INFO_RECV::Header.fits(request.data(), 4, PMSG_SERVER_INFO_RECV::Size) &&
+                          PMSG_SERVER_INFO_RECV::ServerCode.get(request.data()) == 0,
+                          "server info request decodes, short one refused");
+    }
+
+    {
+        const Bytes heartbeat = {0xC1, 0x0E, 0x01, 0x00, 0x00, 0x00, 0x32, 0x00, 0xF4, 0x01, 0x2C, 0x01, 0xE8, 0x03};
+        const uint8_t* data = heartbeat.data();
+
+        failures += Check(heartbeat.size() == SDHP_GAME_SERVER_LIVE_WIRE::Size &&
+                          SDHP_GAME_SERVER_LIVE_WIRE::ServerCode.get(data) == 0 &&
+                          SDHP_GAME_SERVER_LIVE_WIRE::UserTotal.get(data) == 50 &&
+                          SDHP_GAME_SERVER_LIVE_WIRE::UserCount.get(data) == 500 &&
+                          SDHP_GAME_SERVER_LIVE_WIRE::AccountCount.get(data) == 300 &&
+                          SDHP_GAME_SERVER_LIVE_WIRE::MaxUserCount.get(data) == 1000,
+                          "GameServer heartbeat C1:01 decodes as documented");
+
+        const Bytes join = {0xC1, 0x08, 0x02, 0x00, 0x64, 0x00, 0x00, 0x00};
+
+        failures += Check(join.size() == SDHP_JOIN_SERVER_LIVE_WIRE::Size &&
+                          SDHP_JOIN_SERVER_LIVE_WIRE::QueueSize.get(join.data()) == 100,
+                          "JoinServer heartbeat C1:02 decodes as documented");
+    }
+
+    return failures;
+}
+
+int main() {
+    int failures = CheckDocumentedExamples();
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    // The documented heartbeat through the UDP dispatch; a truncated copy is dropped
+    Bytes heartbeat = {0xC1, 0x0E, 0x01, 0x00, 0x00, 0x00, 0x32, 0x00, 0xF4, 0x01, 0x2C, 0x01, 0xE8, 0x03};
+    gServerList.ServerProtocolCore(0x01, heartbeat.data(), (int)heartbeat.size());
+
+    heartbeat[6] = 0x33;
+    heartbeat[1] = 0x0D;
+    gServerList.ServerProtocolCore(0x01, heartbeat.data(), (int)heartbeat.size() - 1);
+
+    boost::asio::io_context io;
+    auto work = boost::asio::make_work_guard(io);
+    SocketManager tcp(io);
+
+    if (!tcp.start(0)) {
+        printf("FAIL: could not listen\n");
+        return 1;
+    }
+
+    std::thread runner([&io]() { io.run(); });
+
+    boost::asio::io_context client_io;
+    tcp::socket socket(client_io);
+    boost::system::error_code error;
+    socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), tcp.port()}, error);
+
+    timeval timeout = {5, 0};
+    setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    failures += Check(!error && ReadPacket(socket) == Bytes({0xC1, 0x04, 0x00, 0x01}), "init sent by the session");
+
+    // A short info request gets nothing; the list request after it is answered
+    const uint8_t requests[] = {0xC1, 0x04, 0xF4, 0x03, 0xC1, 0x04, 0xF4, 0x02, 0xC1, 0x05, 0xF4, 0x03, 0x00};
+    boost::asio::write(socket, boost::asio::buffer(requests), error);
+
+    Bytes custom = ReadPacket(socket);
+    Bytes list = ReadPacket(socket);
+    Bytes info = ReadPacket(socket);
+
+    const Bytes expected_custom = Join({{0xC2, 0x00, 0x29, 0xF4, 0x04, 0x00, 0x01}, {0x00, 0x00}, Text("Server 1", 32)});
+    const Bytes expected_list = {0xC2, 0x00, 0x09, 0xF4, 0x02, 0x01, 0x00, 0x00, 0x32};
+    const Bytes expected_info = Join({{0xC1, 0x16, 0xF4, 0x03}, Text("127.0.0.1", 16), {0x5D, 0xDA}});
+
+    if (list != expected_list) {
+        Dump("list", list);
+    }
+
+    failures += Check(custom == expected_custom, "custom list from the send buffer, short request ignored");
+    failures += Check(list == expected_list, "server list from the send buffer: heartbeat load, 3-byte entry");
+    failures += Check(info == expected_info, "server info from the send buffer");
+
+    socket.close();
+    tcp.stop();
+    work.reset();
+    io.stop();
+    runner.join();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
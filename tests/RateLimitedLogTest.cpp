@@ -0,0 +1,104 @@
+// Rate-limited logging: threads hammer two call sites with different
+// budgets. Each site may pass exactly its budget per window, the rest must
+// be counted as suppressed at flush, and after the flush the budget must
+// be back. A limit change must apply from the next window.
+
+#include "Metrics.h"
+#include "RateLimitedLog.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int THREADS = 4;
+static constexpr int CALLS = 10000;
+
+static std::atomic<int> g_limited_lines{0};
+static std::atomic<int> g_default_lines{0};
+
+static LOG_SITE g_limited = {1, "[Limited] message %d", __FILE__, __LINE__, {0}, {LOG_LIMIT_DEFAULT}, {0}, nullptr};
+static LOG_SITE g_other = {1, "[Other] message %d", __FILE__, __LINE__, {0}, {LOG_LIMIT_DEFAULT}, {0}, nullptr};
+
+static void LimitedSite(int n) {
+    LogAddLimited(1, "[Limited] message %d", n);
+}
+
+static int RunWindow(int limited_expected, int default_expected) {
+    // Open the window here: threads racing the first call of a window may
+    // still see the previous window's limit
+    g_limited_lines = RateLimitedLog::allow(&g_limited) ? 1 : 0;
+    g_default_lines = RateLimitedLog::allow(&g_other) ? 1 : 0;
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([]() {
+            for (int n = 0; n < CALLS; n++) {
+                if (RateLimitedLog::allow(&g_limited)) {
+                    g_limited_lines++;
+                }
+
+                if (RateLimitedLog::allow(&g_other)) {
+                    g_default_lines++;
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    int64_t suppressed_before = Metrics::get("log.suppressed")->load();
+    RateLimitedLog::flush();
+    int64_t suppressed = Metrics::get("log.suppressed")->load() - suppressed_before;
+
+    printf("Window: limited %d line(s), other %d line(s), %lld suppressed\n", g_limited_lines.load(),
+           g_default_lines.load(), (long long)suppressed);
+
+    if (g_limited_lines != limited_expected || g_default_lines != default_expected) {
+        printf("FAIL: expected %d and %d line(s)\n", limited_expected, default_expected);
+        return 1;
+    }
+
+    if (suppressed != 2 * THREADS * CALLS + 2 - limited_expected - default_expected) {
+        printf("FAIL: suppressed count does not cover the rest\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    RateLimitedLog::set_limit("Limited", 5);
+    RateLimitedLog::set_limit("", 12);
+
+    int result = RunWindow(5, 12);
+
+    // Budget refilled by the flush
+    result |= RunWindow(5, 12);
+
+    // New limit from the next window on
+    RateLimitedLog::set_limit("Limited", 50);
+    result |= RunWindow(50, 12);
+
+    // The macro itself: one line through, the rest summarized at flush
+    RateLimitedLog::set_limit("Limited", 1);
+    for (int n = 0; n < 100; n++) {
+        LimitedSite(n);
+    }
+
+    int64_t suppressed_before = Metrics::get("log.suppressed")->load();
+    RateLimitedLog::flush();
+
+    if (Metrics::get("log.suppressed")->load() - suppressed_before != 99) {
+        printf("FAIL: macro call site not limited\n");
+        result = 1;
+    }
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
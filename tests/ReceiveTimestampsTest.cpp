@@ -0,0 +1,158 @@
+// Receive timestamps: the latency histogram must report percentiles within
+// its bucket precision. Then with timestamps on, a request written while
+// the only io thread is busy must show that wait as queueing delay, on a
+// real TCP session and on the UDP socket, while the reply still arrives.
+
+#include "ReceiveTimestamps.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "SocketManagerUdp.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int BUSY_MS = 50;
+
+static int TestHistogram() {
+    LatencyHistogram histogram;
+
+    // 1..100000 ns uniformly: p50 = 50000, p99 = 99000
+    for (uint64_t n = 1; n <= 100000; n++) {
+        histogram.record(n);
+    }
+
+    LATENCY_SUMMARY summary = histogram.summary();
+
+    printf("Histogram: p50 %llu, p99 %llu, max %llu, mean %llu\n", (unsigned long long)summary.p50_ns,
+           (unsigned long long)summary.p99_ns, (unsigned long long)summary.max_ns, (unsigned long long)summary.mean_ns);
+
+    if (summary.count != 100000 || summary.max_ns != 100000 || summary.mean_ns != 50000) {
+        printf("FAIL: histogram count/max/mean wrong\n");
+        return 1;
+    }
+
+    if (summary.p50_ns < 50000 || summary.p50_ns > 50000 * 1.125 || summary.p99_ns < 99000 ||
+        summary.p99_ns > 100000) {
+        printf("FAIL: percentiles outside bucket precision\n");
+        return 1;
+    }
+
+    for (int n = 1; n < LATENCY_BUCKETS; n++) {
+        if (LatencyHistogram::bucket(LatencyHistogram::bucket_floor(n)) != n ||
+            LatencyHistogram::bucket(LatencyHistogram::bucket_floor(n) - 1) != n - 1) {
+            printf("FAIL: bucket %d edges inconsistent\n", n);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void Block(boost::asio::io_context& io) {
+    boost::asio::post(io, []() { std::this_thread::sleep_for(std::chrono::milliseconds(BUSY_MS)); });
+
+    // Let the io thread pick it up before the client writes
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+static int CheckQueue(const char* name, int which, uint64_t count) {
+    LATENCY_SUMMARY queue = ReceiveTimestamps::histogram(which).summary();
+    LATENCY_SUMMARY service = ReceiveTimestamps::histogram(which + 1).summary();
+
+    printf("%s: %llu request(s), queue max %.1f ms, service max %.3f ms\n", name, (unsigned long long)queue.count,
+           queue.max_ns / 1e6, service.max_ns / 1e6);
+
+    if (queue.count != count || service.count != count) {
+        printf("FAIL: %s recorded %llu/%llu request(s), expected %llu\n", name, (unsigned long long)queue.count,
+               (unsigned long long)service.count, (unsigned long long)count);
+        return 1;
+    }
+
+    if (queue.max_ns < (BUSY_MS - 15) * 1000000ull) {
+        printf("FAIL: %s queueing delay missed the busy io thread\n", name);
+        return 1;
+    }
+
+    if (service.max_ns >= queue.max_ns) {
+        printf("FAIL: %s wait was charged to the handler\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int TestSockets() {
+    gServerList.Load(CS_TEST_SERVER_LIST);
+    ReceiveTimestamps::set_enabled(true);
+    ReceiveTimestamps::reset();
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+
+    SocketManager socket_manager(io);
+    g_socket_manager = &socket_manager;
+    socket_manager.start(0);
+
+    SocketManagerUdp socket_manager_udp(io);
+    socket_manager_udp.start(0);
+
+    std::thread io_thread([&io]() { io.run(); });
+
+    int result = 0;
+    boost::asio::io_context client_io;
+
+    {
+        boost::asio::ip::tcp::socket socket(client_io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager.port()});
+
+        uint8_t buffer[MAX_PACKET_SIZE];
+        boost::asio::read(socket, boost::asio::buffer(buffer, 4)); // C1 04 00 01
+
+        Block(io);
+
+        const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+        boost::asio::write(socket, boost::asio::buffer(list_request));
+
+        if (socket.read_some(boost::asio::buffer(buffer)) == 0) {
+            printf("FAIL: no reply on a timestamped session\n");
+            result = 1;
+        }
+    }
+
+    {
+        boost::asio::ip::udp::socket socket(client_io, boost::asio::ip::udp::v4());
+
+        Block(io);
+
+        const uint8_t datagram[] = {0xC1, 0x04, 0xFF, 0x00};
+        socket.send_to(boost::asio::buffer(datagram),
+                       {boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager_udp.port()});
+    }
+
+    // Both handlers have run once the io thread completes a posted task
+    std::this_thread::sleep_for(std::chrono::milliseconds(BUSY_MS + 50));
+
+    result |= CheckQueue("TCP", RECEIVE_TCP_QUEUE, 1);
+    result |= CheckQueue("UDP", RECEIVE_UDP_QUEUE, 1);
+
+    socket_manager_udp.stop();
+    socket_manager.stop();
+    work_guard.reset();
+    io.stop();
+    io_thread.join();
+
+    return result;
+}
+
+int main() {
+    int result = TestHistogram();
+    result |= TestSockets();
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
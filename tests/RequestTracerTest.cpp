@@ -0,0 +1,163 @@
+// Request tracing: list requests from a real client must each be traced
+// once under F4:02 with stages that add up (dispatch + handler + write =
+// total), a request without a reply must be closed at handler return, the
+// per-thread view must agree with the per-route one, and requests over the
+// slow threshold must be counted even when their log lines are held back.
+
+#include "Metrics.h"
+#include "RequestTracer.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int LIST_REQUESTS = 50;
+
+static const TRACE_ROUTE_STATS* FindRoute(const TRACE_ROUTE_STATS* stats, int count, uint8_t head, uint8_t subhead) {
+    for (int n = 0; n < count; n++) {
+        if (!stats[n].Other && stats[n].Head == head && stats[n].Subhead == subhead) {
+            return &stats[n];
+        }
+    }
+
+    return nullptr;
+}
+
+int main() {
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    // Every request counts as slow; only three lines a second may be logged
+    TRACE_CONFIG config;
+    config.Enabled = true;
+    config.SlowRequestNs = 1;
+    config.SlowSampleRate = 1;
+    config.SlowLogPerSecond = 3;
+    RequestTracer::configure(config);
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+
+    SocketManager socket_manager(io);
+    g_socket_manager = &socket_manager;
+    socket_manager.start(0);
+
+    std::thread io_thread([&io]() { io.run(); });
+
+    {
+        boost::asio::io_context client_io;
+        boost::asio::ip::tcp::socket socket(client_io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager.port()});
+
+        uint8_t buffer[MAX_PACKET_SIZE * 4];
+        boost::asio::read(socket, boost::asio::buffer(buffer, 4)); // C1 04 00 01
+
+        const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+
+        for (int n = 0; n < LIST_REQUESTS; n++) {
+            boost::asio::write(socket, boost::asio::buffer(list_request));
+            socket.read_some(boost::asio::buffer(buffer));
+        }
+
+        // Unknown subhead: handled, never answered
+        const uint8_t unknown[] = {0xC1, 0x04, 0xF4, 0x7F};
+        boost::asio::write(socket, boost::asio::buffer(unknown));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (socket_manager.get_active_count() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    socket_manager.stop();
+    work_guard.reset();
+    io.stop();
+    io_thread.join();
+
+    int result = 0;
+    TRACE_ROUTE_STATS stats[MAX_TRACE_ROUTES];
+    int count = RequestTracer::snapshot_routes(stats, MAX_TRACE_ROUTES);
+
+    const TRACE_ROUTE_STATS* list = FindRoute(stats, count, 0xF4, 0x02);
+    const TRACE_ROUTE_STATS* silent = FindRoute(stats, count, 0xF4, 0x7F);
+
+    if (list == nullptr || list->Stages[TRACE_TOTAL].count < LIST_REQUESTS) {
+        printf("FAIL: F4:02 traced %llu of %d request(s)\n",
+               list ? (unsigned long long)list->Stages[TRACE_TOTAL].count : 0ull, LIST_REQUESTS);
+        return 1;
+    }
+
+    const LATENCY_SUMMARY* stages = list->Stages;
+    printf("F4:02: %llu req, total p50 %.1f us p99 %.1f us; handler p50 %.1f us, write p50 %.1f us\n",
+           (unsigned long long)stages[TRACE_TOTAL].count, stages[TRACE_TOTAL].p50_ns / 1e3,
+           stages[TRACE_TOTAL].p99_ns / 1e3, stages[TRACE_HANDLER].p50_ns / 1e3, stages[TRACE_WRITE].p50_ns / 1e3);
+
+    for (int s = 0; s < TRACE_STAGES; s++) {
+        if (stages[s].count != stages[TRACE_TOTAL].count) {
+            printf("FAIL: stage %d has %llu sample(s)\n", s, (unsigned long long)stages[s].count);
+            result = 1;
+        }
+    }
+
+    // Means are exact, so the stages must add up to the total
+    uint64_t sum = stages[TRACE_DISPATCH].mean_ns + stages[TRACE_HANDLER].mean_ns + stages[TRACE_WRITE].mean_ns;
+    uint64_t total = stages[TRACE_TOTAL].mean_ns;
+
+    if (sum + 3 < total || sum > total + 3 || stages[TRACE_WRITE].max_ns == 0) {
+        printf("FAIL: stage means %llu ns do not add up to total %llu ns\n", (unsigned long long)sum,
+               (unsigned long long)total);
+        result = 1;
+    }
+
+    if (silent == nullptr || silent->Stages[TRACE_TOTAL].count != 1 || silent->Stages[TRACE_WRITE].max_ns != 0) {
+        printf("FAIL: unanswered request not closed at handler return\n");
+        result = 1;
+    }
+
+    uint64_t routed = 0;
+    for (int n = 0; n < count; n++) {
+        routed += stats[n].Stages[TRACE_TOTAL].count;
+    }
+
+    uint64_t threaded = 0;
+    uint32_t thread_id;
+    LATENCY_SUMMARY thread_total;
+    for (int t = 0; RequestTracer::thread_total(t, &thread_id, &thread_total); t++) {
+        threaded += thread_total.count;
+    }
+
+    RequestTracer::publish();
+    int64_t published = Metrics::get("trace.requests")->load();
+    int64_t slow = Metrics::get("trace.slow")->load();
+
+    if (threaded != routed || published != (int64_t)routed) {
+        printf("FAIL: %llu by route, %llu by thread, %lld published\n", (unsigned long long)routed,
+               (unsigned long long)threaded, (long long)published);
+        result = 1;
+    }
+
+    if (slow != (int64_t)routed) {
+        printf("FAIL: %lld of %llu slow request(s) counted\n", (long long)slow, (unsigned long long)routed);
+        result = 1;
+    }
+
+    RequestTracer::reset();
+    count = RequestTracer::snapshot_routes(stats, MAX_TRACE_ROUTES);
+
+    for (int n = 0; n < count; n++) {
+        if (stats[n].Stages[TRACE_TOTAL].count != 0) {
+            printf("FAIL: reset left samples behind\n");
+            result = 1;
+        }
+    }
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,120 @@
+// Self-profiler: two threads burn CPU in a known function while the
+// profiler samples the process for a second. The folded output must hold
+// samples, name that function (by frame-pointer stacks and dladdr) and list
+// the busy threads by name. Skipped (77) where perf events are refused.
+
+#include "platform/linux/SelfProfiler.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static std::atomic<bool> g_spinning{true};
+
+// Exported (ENABLE_EXPORTS) and kept out of line so it shows up by name
+__attribute__((noinline)) uint64_t ProfilerTestSpin(uint64_t seed) {
+    while (g_spinning.load(std::memory_order_relaxed)) {
+        for (int n = 0; n < 10000; n++) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        }
+    }
+
+    return seed;
+}
+
+int main() {
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sink{0};
+
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([&sink, t]() {
+            pthread_setname_np(pthread_self(), "spinner");
+            sink += ProfilerTestSpin((uint64_t)t);
+        });
+    }
+
+    // Let the threads exist and be named before they are enumerated
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const char* path = "SelfProfilerTest.folded";
+    std::string error;
+
+    if (!g_self_profiler.start(1, path, 499, &error)) {
+        g_spinning = false;
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        printf("SKIP: %s\n", error.c_str());
+        return 77;
+    }
+
+    int result = 0;
+    std::string second_error;
+
+    if (g_self_profiler.start(1, path, 499, &second_error)) {
+        printf("FAIL: a second run started while one was active\n");
+        result = 1;
+    }
+
+    PROFILE_RESULT profile = g_self_profiler.wait();
+
+    g_spinning = false;
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    printf("%llu sample(s), %d stack(s), %llu lost, %d thread(s), collector %.2f ms CPU\n",
+           (unsigned long long)profile.Samples, profile.Stacks, (unsigned long long)profile.Lost, profile.Threads,
+           profile.CollectorCpuMs);
+
+    if (!profile.Completed || profile.Samples == 0) {
+        printf("FAIL: no samples (%s)\n", profile.Error.c_str());
+        result = 1;
+    }
+
+    std::ifstream file(path);
+    std::string line;
+    uint64_t spin_samples = 0;
+
+    while (std::getline(file, line)) {
+        size_t space = line.rfind(' ');
+
+        if (space == std::string::npos) {
+            printf("FAIL: malformed line: %s\n", line.c_str());
+            result = 1;
+            continue;
+        }
+
+        if (line.compare(0, 8, "spinner;") == 0 && line.find("ProfilerTestSpin") != std::string::npos) {
+            spin_samples += std::stoull(line.substr(space + 1));
+        }
+    }
+
+    // Two threads busy for the whole second at 499 Hz; a single-CPU host
+    // splits that second between them
+    if (spin_samples < profile.Samples / 4) {
+        printf("FAIL: ProfilerTestSpin in %llu of %llu sample(s)\n", (unsigned long long)spin_samples,
+               (unsigned long long)profile.Samples);
+        result = 1;
+    }
+
+    if (g_self_profiler.running()) {
+        printf("FAIL: still running after wait\n");
+        result = 1;
+    }
+
+    remove(path);
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,85 @@
+// Deterministic simulation: 10k clients and 200 GameServers for a minute of
+// virtual time, with heartbeat loss, a reconnect storm (five clients per
+// address against MaxIpConnection 4) and 10% of the GameServers crashing.
+// The same seed must replay the same event trace, and the run must take
+// less wall time than the virtual time it covers.
+// CS_SIM_LOG=1 turns the server's log on; CS_SIM_SEED picks another seed.
+
+#include "Simulator.h"
+#include "Metrics.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+std::atomic<bool> g_running{true};
+
+static void PrintReport(const char* what, const SIMULATION_CONFIG& config, const SIMULATION_REPORT& report)
+{
+    printf("%s: seed %llu, %llu events in %.2f s (%.0fx real time), digest %016llx\n", what,
+           (unsigned long long)config.Seed, (unsigned long long)report.Events, report.WallSeconds,
+           (config.Duration / 1000.0) / report.WallSeconds, (unsigned long long)report.Digest);
+    printf("  flows %llu (p50 %u ms, p99 %u ms, max %u ms), rejected %llu, timeouts %llu, peak sessions %d\n",
+           (unsigned long long)report.Flows, report.FlowP50, report.FlowP99, report.FlowMax,
+           (unsigned long long)report.Rejected, (unsigned long long)report.Timeouts, report.PeakSessions);
+    printf("  heartbeats %llu (%llu lost), crashed %d, detected %d (max %u ms), false suspects %llu\n",
+           (unsigned long long)report.HeartbeatsSent, (unsigned long long)report.HeartbeatsLost, report.Crashed,
+           report.Detected, report.DetectMax, (unsigned long long)report.FalseSuspects);
+}
+
+int main()
+{
+    gSimulationLog = (getenv("CS_SIM_LOG") != nullptr);
+
+    SIMULATION_CONFIG config;
+    config.Seed = (getenv("CS_SIM_SEED") != nullptr) ? strtoull(getenv("CS_SIM_SEED"), nullptr, 0) : 0x5EED;
+    config.Duration = 60000;
+    config.Clients = 10000;
+    config.GameServers = 200;
+    config.ClientAddresses = 2000;
+    config.MaxIpConnection = 4;
+    config.HeartbeatLoss = 0.01;
+    config.StormTime = 20000;
+    config.CrashTime = 40000;
+    config.CrashFraction = 0.1;
+
+    SIMULATION_REPORT first = CSimulator(config).Run();
+    PrintReport("Run 1", config, first);
+
+    SIMULATION_REPORT second = CSimulator(config).Run();
+    PrintReport("Run 2", config, second);
+
+    int result = 0;
+
+    if (first.Digest != second.Digest || first.Events != second.Events || first.Flows != second.Flows)
+    {
+        printf("FAIL: same seed produced a different run\n");
+        result = 1;
+    }
+
+    if (first.Flows == 0 || first.Rejected == 0)
+    {
+        printf("FAIL: no client flows completed or the storm never hit the IP limit\n");
+        result = 1;
+    }
+
+    if (first.Detected != first.Crashed || first.DetectMax > config.Detector.MaxHeartbeatPause)
+    {
+        printf("FAIL: %d of %d crashed servers detected within %u ms\n",
+               first.Detected, first.Crashed, config.Detector.MaxHeartbeatPause);
+        result = 1;
+    }
+
+    double speedup = (config.Duration / 1000.0) / first.WallSeconds;
+
+    if (speedup <= 1.0)
+    {
+        printf("FAIL: simulation ran slower than real time (%.2fx)\n", speedup);
+        result = 1;
+    }
+
+    gSimulationLog = true;
+    Metrics::report();
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,153 @@
+// Stats segment: what the server publishes comes back through the
+// header-only reader, snapshots stay consistent while the writer keeps
+// publishing, and a restarted writer leaves mapped readers intact.
+
+#include "Metrics.h"
+#include "ServerList.h"
+#include "StatsExport.h"
+#include "StatsReader.h"
+#include "Util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+static int Check(bool condition, const char* what) {
+    printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+int main() {
+    std::string path = "/tmp/cs_stats_test_" + std::to_string(getpid()) + ".stats";
+    int failures = 0;
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    SDHP_GAME_SERVER_LIVE_RECV heartbeat = {};
+    heartbeat.header.set(0x01, sizeof(heartbeat));
+    heartbeat.ServerCode = 0;
+    heartbeat.UserTotal = 37;
+    heartbeat.UserCount = 370;
+    heartbeat.MaxUserCount = 1000;
+    gServerList.GCGameServerLiveRecv(&heartbeat);
+
+    std::atomic<int64_t>* accepts = Metrics::get("tcp.accepts");
+    std::atomic<int64_t>* packets = Metrics::get("tcp.packets");
+
+    accepts->store(5);
+    packets->store(1000);
+    gClientCount = 3;
+
+    auto writer = std::make_unique<CStatsExport>();
+    failures += Check(writer->Open(path.c_str()), "segment created");
+
+    CStatsReader reader;
+    failures += Check(reader.Open(path.c_str()), "reader maps the segment");
+
+    std::unique_ptr<STATS_SNAPSHOT> snapshot(new STATS_SNAPSHOT());
+
+    // Before the first publish: a valid, empty segment
+    failures += Check(reader.Read(snapshot.get()) && snapshot->Data.UpdateCount == 0 &&
+                      snapshot->Data.ServerCount == 0 && snapshot->Data.Pid == (uint32_t)getpid(),
+                      "empty segment before the first publish");
+
+    writer->Publish();
+
+    failures += Check(reader.Read(snapshot.get()) && snapshot->Data.UpdateCount == 1, "snapshot published");
+
+    const STATS_SEGMENT& data = snapshot->Data;
+    failures += Check(data.Counters.Sessions == 3 && data.Counters.Accepts == 5 && data.Counters.Packets == 1000,
+                      "counters published");
+    failures += Check(data.ServerCount == 1 && data.Server[0].ServerCode == 0 &&
+                      strcmp(data.Server[0].ServerName, "Server 1") == 0, "server table published");
+    failures += Check(data.Server[0].State == STATS_SERVER_ONLINE && data.Server[0].Visible != 0 &&
+                      data.Server[0].UserTotal == 37 && data.Server[0].UserCount == 370 &&
+                      data.Server[0].MaxUserCount == 1000 && data.Server[0].HeartbeatAgeMs < 5000,
+                      "live state of the server");
+
+    // Packets per second over the publish interval
+    packets->store(1000 + 500);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    writer->Publish();
+    reader.Read(snapshot.get());
+    failures += Check(data.Counters.PacketsPerSecond > 2500 && data.Counters.PacketsPerSecond <= 5000,
+                      "packets per second from the counter delta");
+
+    // Sessions and packets are written together: a torn snapshot shows them apart
+    {
+        std::atomic<bool> done{false};
+        std::atomic<int> reads{0};
+        std::atomic<int> torn{0};
+
+        std::thread poller([&]() {
+            std::unique_ptr<STATS_SNAPSHOT> copy(new STATS_SNAPSHOT());
+
+            while (!done.load()) {
+                if (reader.Read(copy.get())) {
+                    if (copy->Data.Counters.Sessions != copy->Data.Counters.Packets) {
+                        torn.fetch_add(1);
+                    }
+
+                    reads.fetch_add(1);
+                }
+            }
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        for (int n = 0; reads.load() < 10000 && std::chrono::steady_clock::now() < deadline; n++) {
+            gClientCount = n;
+            packets->store(n);
+            writer->Publish();
+        }
+
+        done.store(true);
+        poller.join();
+
+        printf("      %d snapshot(s) read while publishing\n", reads.load());
+        failures += Check(reads.load() > 0 && torn.load() == 0, "no torn snapshot under a concurrent writer");
+    }
+
+    // A restarted server creates a new file; the old mapping stays readable
+    {
+        reader.Read(snapshot.get());
+        uint64_t before = snapshot->Data.UpdateCount;
+
+        writer.reset(new CStatsExport());
+        failures += Check(writer->Open(path.c_str()), "restarted writer creates the segment again");
+        writer->Publish();
+
+        failures += Check(reader.Read(snapshot.get()) && snapshot->Data.UpdateCount == before,
+                          "old mapping still readable, no longer updated");
+
+        CStatsReader fresh;
+        failures += Check(fresh.Open(path.c_str()) && fresh.Read(snapshot.get()) && snapshot->Data.UpdateCount == 1,
+                          "reopened path shows the new writer");
+    }
+
+    // Anything else under the path is refused
+    {
+        std::string other = path + ".bad";
+        FILE* file = fopen(other.c_str(), "wb");
+        std::unique_ptr<STATS_SEGMENT> junk(new STATS_SEGMENT());
+        fwrite(junk.get(), sizeof(STATS_SEGMENT), 1, file);
+        fclose(file);
+
+        CStatsReader bad;
+        failures += Check(!bad.Open(other.c_str()), "segment without the magic refused");
+        unlink(other.c_str());
+    }
+
+    writer.reset();
+    unlink(path.c_str());
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+// Multi-tenant mode: two tenants with their own server lists and listener
+// pairs on one set of io threads. A heartbeat reaches only the tenant whose
+// UDP port received it, each client gets its own tenant's list, and per-IP
+// limits are counted per tenant.
+
+#include "ConnectServerProtocol.h"
+#include "ControlPlane.h"
+#include "IpManager.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "SocketManagerUdp.h"
+#include "Tenant.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+using boost::asio::ip::tcp;
+using ServerMap = std::map<uint16_t, uint8_t>;
+
+// Reads one C1/C2 packet; false on EOF or timeout
+static bool ReadPacket(tcp::socket& socket, std::vector<uint8_t>& packet) {
+    uint8_t head[3];
+    boost::system::error_code error;
+
+    boost::asio::read(socket, boost::asio::buffer(head), error);
+
+    if (error) {
+        return false;
+    }
+
+    size_t size = (head[0] == 0xC2) ? ((head[1] << 8) | head[2]) : head[1];
+
+    if (size < sizeof(head)) {
+        return false;
+    }
+
+    packet.assign(head, head + sizeof(head));
+    packet.resize(size);
+    boost::asio::read(socket, boost::asio::buffer(packet.data() + sizeof(head), size - sizeof(head)), error);
+
+    return !error;
+}
+
+static bool Connect(tcp::socket& socket, uint16_t port) {
+    boost::system::error_code error;
+    socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), port}, error);
+
+    // A rejected connection is closed before the init packet
+    timeval timeout = {1, 0};
+    setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<uint8_t> init;
+    return !error && ReadPacket(socket, init) && init[0] == 0xC1 && init[2] == 0x00;
+}
+
+static ServerMap RequestList(uint16_t port) {
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    ServerMap servers;
+
+    if (!Connect(socket, port)) {
+        return servers;
+    }
+
+    const uint8_t request[] = {0xC1, 0x04, 0xF4, 0x02};
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    // Other packets (e.g. server names) may come first
+    std::vector<uint8_t> reply;
+
+    do {
+        if (!ReadPacket(socket, reply)) {
+            return servers;
+        }
+    } while (reply[0] != 0xC2 || reply[3] != 0xF4 || reply[4] != 0x02);
+
+    for (size_t offset = PMSG_SERVER_LIST_SEND::Size; offset + PMSG_SERVER_LIST::Size <= reply.size();
+         offset += PMSG_SERVER_LIST::Size) {
+        const uint8_t* entry = reply.data() + offset;
+        servers[PMSG_SERVER_LIST::ServerCode.get(entry)] = PMSG_SERVER_LIST::UserTotal.get(entry);
+    }
+
+    return servers;
+}
+
+static void SendHeartbeat(uint16_t port, uint16_t server_code, uint8_t user_total) {
+    boost::asio::io_context io;
+    boost::asio::ip::udp::socket socket(io, boost::asio::ip::udp::v4());
+
+    SDHP_GAME_SERVER_LIVE_RECV msg = {};
+    msg.header.set(0x01, sizeof(msg));
+    msg.ServerCode = server_code;
+    msg.UserTotal = user_total;
+
+    socket.send_to(boost::asio::buffer(&msg, sizeof(msg)),
+                   {boost::asio::ip::make_address_v4("127.0.0.1"), port});
+}
+
+static bool WaitForList(uint16_t port, const ServerMap& expected) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (RequestList(port) == expected) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    return false;
+}
+
+static std::string Describe(const ServerMap& servers) {
+    std::string text;
+
+    for (const auto& server : servers) {
+        text += " " + std::to_string(server.first) + ":" + std::to_string(server.second);
+    }
+
+    return text.empty() ? " (empty)" : text;
+}
+
+int main() {
+    // Tenant 1 lists server 0 too; only its own heartbeats may bring it online
+    std::string list_path = "/tmp/cs_tenant_test_" + std::to_string(getpid()) + ".dat";
+    FILE* file = fopen(list_path.c_str(), "w");
+    fprintf(file, "0\t\"Other 0\"\t\"127.0.0.1\"\t55910\t\"SHOW\"\n");
+    fprintf(file, "20\t\"Other 20\"\t\"127.0.0.1\"\t55920\t\"SHOW\"\n");
+    fprintf(file, "end\n");
+    fclose(file);
+
+    gServerList.Load(CS_TEST_SERVER_LIST);
+    gServerList.SetShowOfflineServers(false);
+
+    CServerList other_list;
+    CIpManager other_ip_manager;
+    other_list.Load(list_path.c_str());
+    other_list.SetShowOfflineServers(false);
+    unlink(list_path.c_str());
+
+    TENANT* other = CreateTenant("other", &other_list, &other_ip_manager);
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+    ControlPlane control_plane;
+
+    SocketManager tcp0(io);
+    SocketManagerUdp udp0(control_plane.context());
+    SocketManager tcp1(io, other);
+    SocketManagerUdp udp1(control_plane.context(), other);
+
+    int result = 0;
+
+    if (other == nullptr || !tcp0.start(0) || !udp0.start(0) || !tcp1.start(0) || !udp1.start(0)) {
+        printf("FAIL: could not start both tenants\n");
+        return 1;
+    }
+
+    control_plane.start();
+
+    std::vector<std::thread> threads;
+    for (int n = 0; n < 2; n++) {
+        threads.emplace_back([&io]() { io.run(); });
+    }
+
+    SendHeartbeat(udp0.port(), 0, 40);
+    SendHeartbeat(udp1.port(), 20, 70);
+
+    ServerMap expected0 = {{0, 40}};
+    ServerMap expected1 = {{20, 70}};
+
+    if (!WaitForList(tcp0.port(), expected0)) {
+        printf("FAIL: tenant 0 listed%s\n", Describe(RequestList(tcp0.port())).c_str());
+        result = 1;
+    }
+
+    if (!WaitForList(tcp1.port(), expected1)) {
+        printf("FAIL: tenant 1 listed%s\n", Describe(RequestList(tcp1.port())).c_str());
+        result = 1;
+    }
+
+    // One connection per IP and tenant: a client of each tenant fits, a
+    // second one on tenant 1 does not
+    auto closed = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (gClientCount > 0 && std::chrono::steady_clock::now() < closed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    gIpManager.SetMaxIpConnection(1);
+    other_ip_manager.SetMaxIpConnection(1);
+
+    boost::asio::io_context client_io;
+    tcp::socket first1(client_io);
+    tcp::socket first0(client_io);
+    tcp::socket second1(client_io);
+
+    bool accepted1 = Connect(first1, tcp1.port());
+    bool accepted0 = Connect(first0, tcp0.port());
+    bool accepted_second = Connect(second1, tcp1.port());
+
+    printf("IP limits: tenant 1 first %s, tenant 0 first %s, tenant 1 second %s\n",
+           accepted1 ? "accepted" : "rejected", accepted0 ? "accepted" : "rejected",
+           accepted_second ? "accepted" : "rejected");
+
+    if (!accepted1 || !accepted0 || accepted_second) {
+        printf("FAIL: per-IP limits are not per tenant\n");
+        result = 1;
+    }
+
+    first1.close();
+    first0.close();
+    second1.close();
+
+    tcp0.stop();
+    tcp1.stop();
+    udp0.stop();
+    udp1.stop();
+    control_plane.stop();
+
+    work_guard.reset();
+    io.stop();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
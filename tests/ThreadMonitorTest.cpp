@@ -0,0 +1,102 @@
+// Thread monitor: one registered io thread runs a handler that stalls well
+// past the long-handler threshold. The watchdog must report it exactly once
+// with the stalled function on the captured stack, the lag probe must see
+// the pool stall, and the thread must show up busy while quick handlers
+// around it are counted.
+
+#include "HandlerAllocator.h"
+#include "Metrics.h"
+#include "ThreadMonitor.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int STALL_MS = 400;
+
+// Exported (ENABLE_EXPORTS) and out of line so the stack names it
+__attribute__((noinline)) void ThreadMonitorTestStall() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(STALL_MS));
+    asm volatile("" ::: "memory");
+}
+
+int main() {
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+    HandlerMemory memory;
+
+    std::thread worker([&io]() {
+        ThreadMonitor::register_thread("io-test");
+        io.run();
+    });
+
+    WATCHDOG_CONFIG config;
+    config.ProbeIntervalMs = 20;
+    config.LongHandlerMs = 100;
+    ThreadMonitor::start(io, config);
+
+    // Let the probe settle, then quick handlers around one stall
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (int n = 0; n < 100; n++) {
+        boost::asio::post(io, make_alloc_handler(memory, []() {}));
+    }
+
+    boost::asio::post(io, make_alloc_handler(memory, []() { ThreadMonitorTestStall(); }));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(STALL_MS / 2));
+
+    int result = 0;
+    THREAD_STATS stats[MAX_MONITORED_THREADS];
+    int count = ThreadMonitor::snapshot(stats, MAX_MONITORED_THREADS);
+
+    if (count != 1 || stats[0].CurrentNs < (STALL_MS / 4) * 1000000ull) {
+        printf("FAIL: stalled thread not seen in its handler\n");
+        result = 1;
+    }
+
+    // Past the stall and a full utilization window
+    std::this_thread::sleep_for(std::chrono::milliseconds(STALL_MS + 600));
+
+    ThreadMonitor::report();
+
+    count = ThreadMonitor::snapshot(stats, MAX_MONITORED_THREADS);
+    int64_t long_handlers = Metrics::get("threads.long_handlers")->load();
+    int64_t lag_max_us = Metrics::get("io.lag_max_us")->load();
+    std::string stall = ThreadMonitor::last_long_handler();
+
+    printf("%lld long handler(s), lag max %.1f ms, %llu handler(s), max %.1f ms\n%s\n", (long long)long_handlers,
+           lag_max_us / 1e3, (unsigned long long)stats[0].Handlers, stats[0].MaxHandlerNs / 1e6, stall.c_str());
+
+    if (long_handlers != 1) {
+        printf("FAIL: expected one long handler report\n");
+        result = 1;
+    }
+
+    if (stall.find("ThreadMonitorTestStall") == std::string::npos) {
+        printf("FAIL: stalled function missing from the captured stack\n");
+        result = 1;
+    }
+
+    if (lag_max_us < (STALL_MS / 2) * 1000) {
+        printf("FAIL: loop lag probe missed the stall\n");
+        result = 1;
+    }
+
+    if (stats[0].Handlers < 101 || stats[0].MaxHandlerNs < STALL_MS * 1000000ull || stats[0].CurrentNs != 0) {
+        printf("FAIL: handler accounting off\n");
+        result = 1;
+    }
+
+    work_guard.reset();
+    io.stop();
+    worker.join();
+    ThreadMonitor::stop();
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,155 @@
+// Task scheduler: fixed-rate tasks keep their rate over many periods, many
+// tasks due together share one wakeup, tasks posted to another executor run
+// there, a task slower than its period is skipped rather than stacked, a
+// one-shot runs once and a cancelled task stops.
+
+#include "TimerManager.h"
+#include "Metrics.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int RUN_MS = 1000;
+static constexpr int PERIOD_MS = 10;
+static constexpr int COALESCED_TASKS = 20;
+
+static const TIMER_TASK_STATS* Find(const std::vector<TIMER_TASK_STATS>& stats, const char* name) {
+    for (const TIMER_TASK_STATS& task : stats) {
+        if (strcmp(task.Name, name) == 0) {
+            return &task;
+        }
+    }
+
+    return nullptr;
+}
+
+int main() {
+    boost::asio::io_context scheduler_io;
+    boost::asio::io_context pool_io;
+    auto scheduler_guard = boost::asio::make_work_guard(scheduler_io);
+    auto pool_guard = boost::asio::make_work_guard(pool_io);
+
+    std::thread scheduler_thread([&]() { scheduler_io.run(); });
+    std::vector<std::thread> pool_threads;
+    for (int n = 0; n < 2; n++) {
+        pool_threads.emplace_back([&]() { pool_io.run(); });
+    }
+
+    TimerManager timers(scheduler_io);
+
+    std::atomic<int> coalesced_runs{0};
+    for (int n = 0; n < COALESCED_TASKS; n++) {
+        timers.schedule_every("coalesced", std::chrono::milliseconds(PERIOD_MS), [&]() { coalesced_runs++; });
+    }
+
+    // Each run costs 3 ms; rescheduling from completion would lose a third
+    timers.schedule_every("fixed-rate", std::chrono::milliseconds(PERIOD_MS), []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    });
+
+    std::atomic<bool> pool_wrong_thread{false};
+    std::thread::id scheduler_id = scheduler_thread.get_id();
+    timers.schedule_every("on-pool", std::chrono::milliseconds(PERIOD_MS), [&]() {
+        if (std::this_thread::get_id() == scheduler_id) {
+            pool_wrong_thread = true;
+        }
+    }, &pool_io);
+
+    // Slower than its period, on a pool with a free second thread
+    timers.schedule_every("slow", std::chrono::milliseconds(PERIOD_MS), []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(35));
+    }, &pool_io);
+
+    timers.schedule_every("jittered", std::chrono::milliseconds(PERIOD_MS), []() {}, nullptr,
+                          std::chrono::milliseconds(5));
+
+    std::atomic<int> once_runs{0};
+    timers.schedule_once("once", std::chrono::milliseconds(50), [&]() { once_runs++; });
+
+    std::atomic<int> cancelled_runs{0};
+    uint32_t cancelled = timers.schedule_every("cancelled", std::chrono::milliseconds(PERIOD_MS),
+                                               [&]() { cancelled_runs++; });
+
+    timers.start();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(RUN_MS / 2));
+    timers.cancel(cancelled);
+    int cancelled_at = cancelled_runs.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(RUN_MS / 2));
+
+    std::vector<TIMER_TASK_STATS> stats(64);
+    stats.resize(timers.snapshot(stats.data(), (int)stats.size()));
+
+    timers.report();
+    timers.stop();
+
+    pool_guard.reset();
+    scheduler_guard.reset();
+    pool_io.stop();
+    scheduler_io.stop();
+    scheduler_thread.join();
+    for (std::thread& thread : pool_threads) {
+        thread.join();
+    }
+
+    int result = 0;
+    int periods = RUN_MS / PERIOD_MS;
+
+    const TIMER_TASK_STATS* fixed = Find(stats, "fixed-rate");
+    printf("fixed-rate: %llu run(s) in %d period(s), max late %.1f us\n", (unsigned long long)fixed->Runs, periods,
+           fixed->MaxLateNs / 1000.0);
+
+    if (fixed->Runs < (uint64_t)periods * 9 / 10 || fixed->Runs > (uint64_t)periods) {
+        printf("FAIL: fixed-rate task drifted\n");
+        result = 1;
+    }
+
+    int64_t wakeups = Metrics::get("timer.wakeups")->load();
+    printf("coalesced: %d run(s), %lld wakeup(s) in total\n", coalesced_runs.load(), (long long)wakeups);
+
+    if (coalesced_runs < periods * COALESCED_TASKS * 9 / 10 || wakeups > periods * 4) {
+        printf("FAIL: due tasks were not coalesced into shared wakeups\n");
+        result = 1;
+    }
+
+    const TIMER_TASK_STATS* pool = Find(stats, "on-pool");
+    if (pool_wrong_thread || pool->Runs < (uint64_t)periods * 9 / 10) {
+        printf("FAIL: pool task ran on the scheduler or too rarely\n");
+        result = 1;
+    }
+
+    const TIMER_TASK_STATS* slow = Find(stats, "slow");
+    printf("slow: %llu run(s), %llu skipped\n", (unsigned long long)slow->Runs, (unsigned long long)slow->Skipped);
+
+    if (slow->Skipped == 0 || slow->Runs > (uint64_t)(RUN_MS / 35 + 1)) {
+        printf("FAIL: overlapping runs of a slow task were not skipped\n");
+        result = 1;
+    }
+
+    const TIMER_TASK_STATS* jittered = Find(stats, "jittered");
+    if (jittered->Runs < (uint64_t)periods * 9 / 10 || jittered->Runs > (uint64_t)periods) {
+        printf("FAIL: jitter moved the schedule\n");
+        result = 1;
+    }
+
+    if (once_runs != 1 || Find(stats, "once") != nullptr) {
+        printf("FAIL: one-shot ran %d time(s)\n", once_runs.load());
+        result = 1;
+    }
+
+    if (cancelled_runs > cancelled_at + 1 || Find(stats, "cancelled") != nullptr) {
+        printf("FAIL: cancelled task kept running\n");
+        result = 1;
+    }
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
@@ -0,0 +1,231 @@
+// Traffic recorder: several threads append through a small ring at once;
+// every record in the capture must be intact and in per-thread order, and
+// every record must be either written or counted as dropped. Then one real
+// client session must come out as open, init, request, replies, close.
+
+#include "TrafficRecorder.h"
+#include "Metrics.h"
+#include "ServerList.h"
+#include "SocketManager.h"
+#include "Util.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+std::atomic<bool> g_running{true};
+
+static constexpr int PRODUCERS = 4;
+static constexpr int RECORDS_PER_PRODUCER = 50000;
+
+struct CAPTURED
+{
+    TRAFFIC_RECORD Header;
+    std::vector<uint8_t> Payload;
+};
+
+static bool ReadCapture(const char* path, std::vector<CAPTURED>* records) {
+    FILE* file = fopen(path, "rb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    TRAFFIC_CAPTURE_HEADER header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.Magic == TRAFFIC_CAPTURE_MAGIC &&
+                 header.Version == TRAFFIC_CAPTURE_VERSION && header.RecordSize == sizeof(TRAFFIC_RECORD);
+
+    CAPTURED record;
+
+    while (valid && fread(&record.Header, sizeof(record.Header), 1, file) == 1) {
+        record.Payload.resize(record.Header.Size);
+
+        if (record.Header.Size != 0 && fread(record.Payload.data(), record.Header.Size, 1, file) != 1) {
+            valid = false;
+            break;
+        }
+
+        records->push_back(record);
+    }
+
+    fclose(file);
+    return valid;
+}
+
+static int TestConcurrentProducers(const std::string& path) {
+    int64_t dropped_before = Metrics::get("recorder.dropped")->load();
+
+    // Smallest ring, so producers lap the writer and hit the full case
+    if (!g_traffic_recorder.start(path.c_str(), 0)) {
+        printf("FAIL: recorder did not start\n");
+        return 1;
+    }
+
+    std::vector<std::thread> producers;
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([p]() {
+            uint8_t payload[256];
+
+            for (uint32_t seq = 0; seq < RECORDS_PER_PRODUCER; seq++) {
+                size_t size = 4 + (seq * 37) % 200;
+
+                memcpy(payload, &seq, sizeof(seq));
+                for (size_t n = 4; n < size; n++) {
+                    payload[n] = (uint8_t)(seq + n + p);
+                }
+
+                g_traffic_recorder.record(TRAFFIC_TCP_RECV, p, payload, size);
+            }
+        });
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    g_traffic_recorder.stop();
+
+    std::vector<CAPTURED> records;
+
+    if (!ReadCapture(path.c_str(), &records)) {
+        printf("FAIL: capture is not readable\n");
+        return 1;
+    }
+
+    int64_t dropped = Metrics::get("recorder.dropped")->load() - dropped_before;
+    int64_t last_seq[PRODUCERS];
+    std::fill(last_seq, last_seq + PRODUCERS, -1);
+
+    for (const CAPTURED& record : records) {
+        uint32_t seq;
+        int p = (int)record.Header.Session;
+
+        if (p >= PRODUCERS || record.Header.Size < 4) {
+            printf("FAIL: malformed record\n");
+            return 1;
+        }
+
+        memcpy(&seq, record.Payload.data(), sizeof(seq));
+
+        bool intact = (record.Header.Size == 4 + (seq * 37) % 200) && (int64_t)seq > last_seq[p];
+
+        for (size_t n = 4; intact && n < record.Header.Size; n++) {
+            intact = (record.Payload[n] == (uint8_t)(seq + n + p));
+        }
+
+        if (!intact) {
+            printf("FAIL: producer %d record %u corrupted or out of order\n", p, seq);
+            return 1;
+        }
+
+        last_seq[p] = seq;
+    }
+
+    printf("Producers: %zu record(s) written, %lld dropped of %d\n", records.size(), (long long)dropped,
+           PRODUCERS * RECORDS_PER_PRODUCER);
+
+    if ((int64_t)records.size() + dropped != PRODUCERS * RECORDS_PER_PRODUCER) {
+        printf("FAIL: records lost without being counted\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int TestClientSession(const std::string& path) {
+    gServerList.Load(CS_TEST_SERVER_LIST);
+
+    boost::asio::io_context io;
+    auto work_guard = boost::asio::make_work_guard(io);
+
+    SocketManager socket_manager(io);
+    g_socket_manager = &socket_manager;
+    socket_manager.start(0);
+
+    std::thread io_thread([&io]() { io.run(); });
+
+    g_traffic_recorder.start(path.c_str(), 1 << 20);
+
+    {
+        boost::asio::io_context client_io;
+        boost::asio::ip::tcp::socket socket(client_io);
+        socket.connect({boost::asio::ip::make_address_v4("127.0.0.1"), socket_manager.port()});
+
+        uint8_t buffer[MAX_PACKET_SIZE];
+        boost::asio::read(socket, boost::asio::buffer(buffer, 4)); // C1 04 00 01
+
+        const uint8_t list_request[] = {0xC1, 0x04, 0xF4, 0x02};
+        boost::asio::write(socket, boost::asio::buffer(list_request));
+
+        // Custom list and server list; the server closes after we hang up
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        socket.read_some(boost::asio::buffer(buffer));
+    }
+
+    // Wait for the server side of the close
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+    while (socket_manager.get_active_count() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    g_traffic_recorder.stop();
+
+    socket_manager.stop();
+    work_guard.reset();
+    io.stop();
+    io_thread.join();
+
+    std::vector<CAPTURED> records;
+
+    if (!ReadCapture(path.c_str(), &records)) {
+        printf("FAIL: session capture is not readable\n");
+        return 1;
+    }
+
+    // open, init, request, custom list, server list, close
+    const uint8_t expected_kind[] = {TRAFFIC_TCP_OPEN, TRAFFIC_TCP_SEND, TRAFFIC_TCP_RECV,
+                                     TRAFFIC_TCP_SEND, TRAFFIC_TCP_SEND, TRAFFIC_TCP_CLOSE};
+    bool match = (records.size() == sizeof(expected_kind));
+
+    for (size_t n = 0; match && n < records.size(); n++) {
+        match = (records[n].Header.Kind == expected_kind[n]) && (records[n].Header.Session == records[0].Header.Session);
+        match = match && (n == 0 || records[n].Header.Timestamp >= records[n - 1].Header.Timestamp);
+    }
+
+    match = match && memcmp(records[0].Payload.data(), "127.0.0.1", 9) == 0;
+    match = match && records[2].Payload.size() == 4 && records[2].Payload[3] == 0x02;
+
+    printf("Session: %zu record(s) captured\n", records.size());
+
+    if (!match) {
+        for (const CAPTURED& record : records) {
+            printf("  kind %d session %u size %u\n", record.Header.Kind, record.Header.Session, record.Header.Size);
+        }
+        printf("FAIL: session capture does not match the exchange\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    std::string path = "/tmp/cs_traffic_test_" + std::to_string(getpid()) + ".cap";
+
+    int result = TestConcurrentProducers(path);
+
+    if (result == 0) {
+        result = TestClientSession(path);
+    }
+
+    unlink(path.c_str());
+
+    printf(result == 0 ? "PASS\n" : "FAIL\n");
+    return result;
+}
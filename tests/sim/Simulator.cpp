@@ -0,0 +1,582 @@
+#include "Simulator.h"
+#include "ConnectServerProtocol.h"
+#include "IpManager.h"
+#include "Metrics.h"
+#include "SocketManager.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+std::atomic<uint32_t> gSimulationTick{0};
+bool gSimulationLog = false;
+CSimulationTransport* gSimulationTransport = nullptr;
+
+// Liveness is re-evaluated at least this often, like the 1s MainProc backstop
+// but fine enough to time detection
+static constexpr uint32_t LIVENESS_STEP = 10;
+
+// Virtual epoch; far from 0 so no tick reads as "never"
+static constexpr uint32_t SIMULATION_EPOCH = 1000000;
+
+CSimulator::CSimulator(const SIMULATION_CONFIG& config)
+    : m_Config(config)
+    , m_Random(config.Seed)
+    , m_Sequence(0)
+    , m_Start(SIMULATION_EPOCH)
+    , m_Now(SIMULATION_EPOCH)
+    , m_Sessions(0)
+{
+    memset(&this->m_Report, 0, sizeof(this->m_Report));
+
+    this->m_Client.resize(config.Clients);
+
+    for (CLIENT& client : this->m_Client)
+    {
+        client = CLIENT{-1, 0, 0, false, 0, 0, 0};
+    }
+
+    for (int n = 0; n < config.ClientAddresses; n++)
+    {
+        char address[16];
+        snprintf(address, sizeof(address), "10.%d.%d.%d", (n >> 16) & 0xFF, (n >> 8) & 0xFF, n & 0xFF);
+        this->m_Address.push_back(address);
+    }
+
+    this->m_SessionClient.assign(MAX_CLIENT, -1);
+    this->m_SessionGeneration.assign(MAX_CLIENT, 0);
+
+    // Lowest index first, like SocketManager::find_free_index
+    for (int n = MAX_CLIENT - 1; n >= 0; n--)
+    {
+        this->m_FreeSession.push_back(n);
+    }
+
+    this->m_GameServer.assign(config.GameServers, GAME_SERVER{false, SERVER_STATE_OFFLINE});
+
+    this->m_ServerListPath = "/tmp/cs_sim_serverlist_" + std::to_string(getpid()) + ".dat";
+}
+
+CSimulator::~CSimulator()
+{
+    if (gSimulationTransport == this)
+    {
+        gSimulationTransport = nullptr;
+    }
+
+    unlink(this->m_ServerListPath.c_str());
+}
+
+uint32_t CSimulator::Uniform(uint32_t min, uint32_t max)
+{
+    return std::uniform_int_distribution<uint32_t>(min, max)(this->m_Random);
+}
+
+uint32_t CSimulator::Delay()
+{
+    return this->Uniform(this->m_Config.MinDelay, this->m_Config.MaxDelay);
+}
+
+void CSimulator::Schedule(uint32_t time, uint8_t type, int id, uint32_t generation, uint32_t arg)
+{
+    this->m_Queue.push(EVENT{time, this->m_Sequence++, type, id, generation, arg});
+}
+
+SIMULATION_REPORT CSimulator::Run()
+{
+    const SIMULATION_CONFIG& config = this->m_Config;
+
+    FILE* file = fopen(this->m_ServerListPath.c_str(), "w");
+
+    if (file == nullptr)
+    {
+        return this->m_Report;
+    }
+
+    for (int n = 0; n < config.GameServers; n++)
+    {
+        fprintf(file, "%d \"Server %d\" \"127.0.0.1\" %d \"SHOW\"\n", n, n, 55901 + n);
+    }
+
+    fprintf(file, "end\n");
+    fclose(file);
+
+    gSimulationTick.store(this->m_Start, std::memory_order_relaxed);
+    gSimulationTransport = this;
+
+    gServerList.SetFailureDetectorConfig(config.Detector);
+    gServerList.SetShowOfflineServers(false);
+    gServerList.Load(this->m_ServerListPath.c_str());
+
+    MaxIpConnection = config.MaxIpConnection;
+
+    std::atomic<int64_t>* heartbeats = Metrics::get("udp.heartbeats");
+
+    // GameServers heartbeat out of phase; clients start once the list has filled
+    for (int n = 0; n < config.GameServers; n++)
+    {
+        this->Schedule(this->m_Start + this->Uniform(0, config.HeartbeatInterval - 1), EVENT_HEARTBEAT_SEND, n, 0, 0);
+    }
+
+    for (int n = 0; n < config.Clients; n++)
+    {
+        this->Schedule(this->m_Start + config.HeartbeatInterval * 2 + this->Uniform(0, config.ThinkTime), EVENT_CONNECT, n, 0, 0);
+    }
+
+    this->Schedule(this->m_Start, EVENT_LIVENESS, 0, 0, 0);
+
+    if (config.StormTime != 0)
+    {
+        this->Schedule(this->m_Start + config.StormTime, EVENT_STORM, 0, 0, 0);
+    }
+
+    if (config.CrashTime != 0)
+    {
+        this->Schedule(this->m_Start + config.CrashTime, EVENT_CRASH, 0, 0, 0);
+    }
+
+    uint32_t end = this->m_Start + config.Duration;
+    uint64_t digest = 0xCBF29CE484222325ULL;
+
+    auto started = std::chrono::steady_clock::now();
+
+    while (!this->m_Queue.empty() && this->m_Queue.top().Time <= end)
+    {
+        EVENT event = this->m_Queue.top();
+        this->m_Queue.pop();
+
+        this->m_Now = event.Time;
+        gSimulationTick.store(event.Time, std::memory_order_relaxed);
+
+        // FNV-1a over what happened when
+        uint32_t fields[4] = {event.Time, event.Type, (uint32_t)event.Id, event.Arg};
+
+        for (uint32_t field : fields)
+        {
+            digest = (digest ^ field) * 0x100000001B3ULL;
+        }
+
+        if (event.Type == EVENT_HEARTBEAT_ARRIVE)
+        {
+            heartbeats->fetch_add(1, std::memory_order_relaxed);
+        }
+
+        this->Dispatch(event);
+        this->m_Report.Events++;
+    }
+
+    this->m_Report.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    this->m_Report.Digest = digest;
+
+    // Tear down what is still connected so the next run starts clean
+    for (int index = 0; index < MAX_CLIENT; index++)
+    {
+        if (this->m_SessionClient[index] != -1)
+        {
+            this->OnClose(index);
+        }
+    }
+
+    while (!this->m_Queue.empty())
+    {
+        this->m_Queue.pop();
+    }
+
+    gSimulationTransport = nullptr;
+
+    std::vector<uint32_t>& latency = this->m_FlowLatency;
+
+    if (!latency.empty())
+    {
+        std::sort(latency.begin(), latency.end());
+
+        this->m_Report.FlowP50 = latency[latency.size() / 2];
+        this->m_Report.FlowP99 = latency[latency.size() * 99 / 100];
+        this->m_Report.FlowMax = latency.back();
+    }
+
+    Metrics::get("sim.events")->store(this->m_Report.Events, std::memory_order_relaxed);
+    Metrics::get("sim.flows")->store(this->m_Report.Flows, std::memory_order_relaxed);
+    Metrics::get("sim.rejected")->store(this->m_Report.Rejected, std::memory_order_relaxed);
+    Metrics::get("sim.timeouts")->store(this->m_Report.Timeouts, std::memory_order_relaxed);
+    Metrics::get("sim.heartbeats_lost")->store(this->m_Report.HeartbeatsLost, std::memory_order_relaxed);
+    Metrics::get("sim.flow_p99_ms")->store(this->m_Report.FlowP99, std::memory_order_relaxed);
+    Metrics::get("sim.detect_max_ms")->store(this->m_Report.DetectMax, std::memory_order_relaxed);
+    Metrics::get("sim.false_suspects")->store(this->m_Report.FalseSuspects, std::memory_order_relaxed);
+
+    return this->m_Report;
+}
+
+void CSimulator::Dispatch(const EVENT& event)
+{
+    switch (event.Type)
+    {
+        case EVENT_CONNECT: this->OnConnect(event.Id, event.Generation); break;
+        case EVENT_ACCEPT: this->OnAccept(event.Id, event.Generation); break;
+        case EVENT_REFUSED: this->OnRefused(event.Id, event.Generation); break;
+        case EVENT_TO_SERVER: this->OnToServer(event.Id, event.Arg); break;
+        case EVENT_TO_CLIENT: this->OnToClient(event.Id, event.Generation, event.Arg); break;
+        case EVENT_TIMEOUT: this->OnTimeout(event.Id, event.Generation, event.Arg); break;
+        case EVENT_CLOSE: this->OnClose(event.Id); break;
+        case EVENT_HEARTBEAT_SEND: this->OnHeartbeatSend(event.Id); break;
+        case EVENT_HEARTBEAT_ARRIVE: this->OnHeartbeatArrive(event.Id, event.Arg); break;
+        case EVENT_LIVENESS: this->OnLiveness(); break;
+        case EVENT_STORM: this->OnStorm(); break;
+        case EVENT_CRASH: this->OnCrash(); break;
+    }
+}
+
+//**********************************************//
+//****************** Clients *******************//
+//**********************************************//
+
+void CSimulator::OnConnect(int id, uint32_t generation)
+{
+    CLIENT& client = this->m_Client[id];
+
+    // Superseded by a storm reconnect
+    if (generation != client.Generation)
+    {
+        return;
+    }
+
+    client.Generation++;
+    client.FlowStart = this->m_Now;
+
+    this->Schedule(this->m_Now + this->Delay(), EVENT_ACCEPT, id, client.Generation, 0);
+}
+
+void CSimulator::OnAccept(int id, uint32_t generation)
+{
+    CLIENT& client = this->m_Client[id];
+
+    if (generation != client.Generation)
+    {
+        return;
+    }
+
+    // Same admission as SocketManager::handle_accept
+    const char* ip = this->m_Address[id % this->m_Address.size()].c_str();
+
+    if (this->m_FreeSession.empty() || (MaxIpConnection != 0 && !gIpManager.CheckIpAddress(ip)))
+    {
+        this->m_Report.Rejected++;
+        this->Schedule(this->m_Now + this->Delay(), EVENT_REFUSED, id, generation, 0);
+        return;
+    }
+
+    int index = this->m_FreeSession.back();
+    this->m_FreeSession.pop_back();
+
+    this->m_SessionClient[index] = id;
+    this->m_SessionGeneration[index] = generation;
+    gClientCount++;
+    gIpManager.InsertIpAddress(ip);
+
+    this->m_Sessions++;
+    this->m_Report.PeakSessions = std::max(this->m_Report.PeakSessions, this->m_Sessions);
+
+    client.Session = index;
+    client.LastToServer = this->m_Now;
+    client.LastToClient = this->m_Now;
+
+    CCServerInitSend(index, 1);
+}
+
+void CSimulator::OnRefused(int id, uint32_t generation)
+{
+    if (generation != this->m_Client[id].Generation)
+    {
+        return;
+    }
+
+    this->Revisit(id, this->Uniform(500, 1500));
+}
+
+void CSimulator::ClientSend(int index, const uint8_t* lpMsg, int size)
+{
+    int id = this->m_SessionClient[index];
+
+    if (id == -1 || size < 3)
+    {
+        return;
+    }
+
+    CLIENT& client = this->m_Client[id];
+
+    size_t header_size = (lpMsg[0] == 0xC1 || lpMsg[0] == 0xC3) ? 2 : 3;
+    uint8_t head = lpMsg[header_size];
+    uint32_t arg = 0;
+
+    if (head == 0xF4)
+    {
+        arg = lpMsg[header_size + 1];
+
+        // The client picks one of the listed servers right away
+        if (arg == 0x02)
+        {
+            int count = PMSG_SERVER_LIST_SEND::Count.get(lpMsg);
+
+            if (count > 0)
+            {
+                int n = (int)this->Uniform(0, count - 1);
+                const uint8_t* lpEntry = lpMsg + PMSG_SERVER_LIST_SEND::Size + n * PMSG_SERVER_LIST::Size;
+
+                arg |= (uint32_t)(PMSG_SERVER_LIST::ServerCode.get(lpEntry) + 1) << 8;
+            }
+        }
+    }
+
+    uint32_t time = std::max(this->m_Now + this->Delay(), client.LastToClient);
+    client.LastToClient = time;
+
+    this->Schedule(time, EVENT_TO_CLIENT, id, this->m_SessionGeneration[index], arg);
+}
+
+void CSimulator::OnToClient(int id, uint32_t generation, uint32_t arg)
+{
+    CLIENT& client = this->m_Client[id];
+
+    if (generation != client.Generation || client.Session == -1)
+    {
+        return;
+    }
+
+    switch (arg & 0xFF)
+    {
+        case 0x00: // Init: ask for the list
+        {
+            this->SendRequest(id, 0x0200);
+            break;
+        }
+
+        case 0x02:
+        {
+            client.Waiting = false;
+
+            uint32_t code = arg >> 8;
+
+            if (code == 0)
+            {
+                this->Disconnect(id);
+                this->Revisit(id, this->Uniform(500, 1500));
+                break;
+            }
+
+            this->SendRequest(id, 0x0300 | (code - 1));
+            break;
+        }
+
+        case 0x03:
+        {
+            client.Waiting = false;
+
+            this->m_Report.Flows++;
+            this->m_FlowLatency.push_back(this->m_Now - client.FlowStart);
+
+            this->Disconnect(id);
+            this->Revisit(id, this->Uniform(this->m_Config.ThinkTime / 2, this->m_Config.ThinkTime * 3 / 2));
+            break;
+        }
+    }
+}
+
+void CSimulator::SendRequest(int id, uint32_t arg)
+{
+    CLIENT& client = this->m_Client[id];
+
+    client.Request++;
+    client.Waiting = true;
+
+    uint32_t time = std::max(this->m_Now + this->Delay(), client.LastToServer);
+    client.LastToServer = time;
+
+    this->Schedule(time, EVENT_TO_SERVER, client.Session, client.Generation, arg);
+    this->Schedule(this->m_Now + this->m_Config.ClientTimeout, EVENT_TIMEOUT, id, client.Generation, client.Request);
+}
+
+void CSimulator::OnToServer(int index, uint32_t arg)
+{
+    // The server still reads what a client sent before hanging up
+    if (this->m_SessionClient[index] == -1)
+    {
+        return;
+    }
+
+    uint8_t subhead = (uint8_t)(arg >> 8);
+
+    if (subhead == 0x02)
+    {
+        const uint8_t packet[] = {0xC1, 0x04, 0xF4, 0x02};
+        ConnectServerProtocolCore(index, 0xF4, packet, sizeof(packet));
+    }
+    else
+    {
+        const uint8_t packet[] = {0xC1, 0x05, 0xF4, 0x03, (uint8_t)arg};
+        ConnectServerProtocolCore(index, 0xF4, packet, sizeof(packet));
+    }
+}
+
+void CSimulator::OnTimeout(int id, uint32_t generation, uint32_t arg)
+{
+    CLIENT& client = this->m_Client[id];
+
+    if (generation != client.Generation || !client.Waiting || client.Request != arg)
+    {
+        return;
+    }
+
+    this->m_Report.Timeouts++;
+
+    this->Disconnect(id);
+    this->Revisit(id, this->Uniform(500, 1500));
+}
+
+void CSimulator::Disconnect(int id)
+{
+    CLIENT& client = this->m_Client[id];
+
+    if (client.Session != -1)
+    {
+        uint32_t time = std::max(this->m_Now + this->Delay(), client.LastToServer);
+        this->Schedule(time, EVENT_CLOSE, client.Session, 0, 0);
+    }
+
+    // Whatever is still in flight for this connection is dropped on arrival
+    client.Session = -1;
+    client.Waiting = false;
+    client.Generation++;
+}
+
+void CSimulator::Revisit(int id, uint32_t after)
+{
+    this->Schedule(this->m_Now + after, EVENT_CONNECT, id, this->m_Client[id].Generation, 0);
+}
+
+void CSimulator::OnClose(int index)
+{
+    int id = this->m_SessionClient[index];
+
+    if (id == -1)
+    {
+        return;
+    }
+
+    // Same teardown as ClientSession::close
+    gIpManager.RemoveIpAddress(this->m_Address[id % this->m_Address.size()].c_str());
+    gClientCount--;
+
+    this->m_SessionClient[index] = -1;
+    this->m_FreeSession.push_back(index);
+    this->m_Sessions--;
+}
+
+void CSimulator::OnStorm()
+{
+    // Every client drops its connection and dials again within 200 ms
+    for (int id = 0; id < (int)this->m_Client.size(); id++)
+    {
+        this->Disconnect(id);
+        this->Revisit(id, this->Uniform(0, 200));
+    }
+}
+
+//**********************************************//
+//***************** GameServers ****************//
+//**********************************************//
+
+void CSimulator::OnHeartbeatSend(int id)
+{
+    if (this->m_GameServer[id].Crashed)
+    {
+        return;
+    }
+
+    this->m_Report.HeartbeatsSent++;
+
+    // Datagrams are delayed independently, so they may arrive out of order
+    if (std::uniform_real_distribution<double>(0.0, 1.0)(this->m_Random) < this->m_Config.HeartbeatLoss)
+    {
+        this->m_Report.HeartbeatsLost++;
+    }
+    else
+    {
+        this->Schedule(this->m_Now + this->Delay(), EVENT_HEARTBEAT_ARRIVE, id, 0, this->Uniform(0, 100));
+    }
+
+    this->Schedule(this->m_Now + this->m_Config.HeartbeatInterval + this->Uniform(0, 20), EVENT_HEARTBEAT_SEND, id, 0, 0);
+}
+
+void CSimulator::OnHeartbeatArrive(int id, uint32_t arg)
+{
+    SDHP_GAME_SERVER_LIVE_RECV pMsg;
+
+    pMsg.header.set(0x01, sizeof(pMsg));
+    pMsg.ServerCode = (uint16_t)id;
+    pMsg.UserTotal = (uint8_t)arg;
+    pMsg.UserCount = (uint16_t)arg;
+    pMsg.AccountCount = (uint16_t)arg;
+    pMsg.MaxUserCount = 100;
+
+    gServerList.ServerProtocolCore(0x01, (uint8_t*)&pMsg, sizeof(pMsg));
+}
+
+void CSimulator::OnCrash()
+{
+    std::vector<int> victims;
+
+    for (int n = 0; n < (int)this->m_GameServer.size(); n++)
+    {
+        victims.push_back(n);
+    }
+
+    std::shuffle(victims.begin(), victims.end(), this->m_Random);
+    victims.resize((size_t)(victims.size() * this->m_Config.CrashFraction));
+
+    for (int n : victims)
+    {
+        this->m_GameServer[n].Crashed = true;
+    }
+
+    this->m_Report.Crashed = (int)victims.size();
+}
+
+void CSimulator::OnLiveness()
+{
+    uint32_t next = gServerList.ProcessDeadlines(this->m_Now);
+
+    for (int n = 0; n < (int)this->m_GameServer.size(); n++)
+    {
+        GAME_SERVER& server = this->m_GameServer[n];
+        uint8_t state = gServerList.GetServerState(n);
+
+        if (state == server.State)
+        {
+            continue;
+        }
+
+        if (!server.Crashed && server.State == SERVER_STATE_ONLINE)
+        {
+            this->m_Report.FalseSuspects++;
+        }
+
+        if (server.Crashed && state == SERVER_STATE_OFFLINE)
+        {
+            this->m_Report.Detected++;
+            this->m_Report.DetectMax = std::max(this->m_Report.DetectMax, this->m_Now - (this->m_Start + this->m_Config.CrashTime));
+        }
+
+        server.State = state;
+    }
+
+    uint32_t at = this->m_Now + LIVENESS_STEP;
+
+    if (next != 0 && (int32_t)(next - this->m_Now) > 0 && (int32_t)(next - at) < 0)
+    {
+        at = next;
+    }
+
+    this->Schedule(at, EVENT_LIVENESS, 0, 0, 0);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Simulation.h"
+#include "ServerList.h"
+#include <cstdint>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// Deterministic simulation of one ConnectServer: thousands of clients and
+// hundreds of GameServers run against the real protocol handlers and server
+// table on a virtual clock. Every source of nondeterminism (latency, loss,
+// think time, crash victims) comes from one seeded generator, so a seed
+// replays the same run event for event.
+// Modelled: TCP sessions (admission, per-IP limit, in-order delivery, client
+// timeouts), UDP heartbeats (loss, reordering), liveness deadlines,
+// reconnect storms and GameServer crashes. Not modelled: the asio glue in
+// SocketManager/ClientSession and cluster gossip.
+
+struct SIMULATION_CONFIG
+{
+    uint64_t Seed = 1;
+    uint32_t Duration = 60000;        // Virtual ms
+    int Clients = 10000;
+    int ClientAddresses = 2500;       // Distinct client IPs (MaxIpConnection is per IP)
+    int GameServers = 200;
+    int MaxIpConnection = 0;
+    uint32_t MinDelay = 1;            // One-way network latency range, ms
+    uint32_t MaxDelay = 40;
+    double HeartbeatLoss = 0.01;      // Fraction of UDP heartbeats dropped
+    uint32_t HeartbeatInterval = 1000;
+    uint32_t ThinkTime = 5000;        // Mean ms between two visits of a client
+    uint32_t ClientTimeout = 5000;    // Client gives up on a reply after this
+    uint32_t StormTime = 0;           // Every client reconnects at once (0 = never)
+    uint32_t CrashTime = 0;           // CrashFraction of the GameServers die (0 = never)
+    double CrashFraction = 0.0;
+    FAILURE_DETECTOR_CONFIG Detector = {3.0, 8.0, 200, 0, 1000, SERVER_HEARTBEAT_TIMEOUT};
+};
+
+struct SIMULATION_REPORT
+{
+    uint64_t Events;
+    uint64_t Digest;                  // Hash of the event trace, equal for equal seeds
+    double WallSeconds;
+    uint64_t Flows;                   // connect -> list -> info -> disconnect
+    uint64_t Rejected;                // Connects refused (no slot, IP limit)
+    uint64_t Timeouts;                // Requests the client gave up on
+    uint64_t HeartbeatsSent;
+    uint64_t HeartbeatsLost;
+    uint32_t FlowP50;                 // Flow latency, ms
+    uint32_t FlowP99;
+    uint32_t FlowMax;
+    int PeakSessions;
+    int Crashed;
+    int Detected;                     // Crashed servers that went offline
+    uint32_t DetectMax;               // Crash -> offline, ms
+    uint64_t FalseSuspects;           // Live servers marked suspect/offline
+};
+
+class CSimulator : public CSimulationTransport
+{
+public:
+    explicit CSimulator(const SIMULATION_CONFIG& config);
+    ~CSimulator();
+
+    SIMULATION_REPORT Run();
+
+    void ClientSend(int index, const uint8_t* lpMsg, int size) override;
+
+private:
+    enum eEventType : uint8_t
+    {
+        EVENT_CONNECT,          // Client dials
+        EVENT_ACCEPT,           // SYN reaches the server
+        EVENT_REFUSED,          // Client learns the connect failed
+        EVENT_TO_SERVER,        // Request reaches the server
+        EVENT_TO_CLIENT,        // Reply reaches the client
+        EVENT_TIMEOUT,          // Client's reply timer
+        EVENT_CLOSE,            // FIN reaches the server
+        EVENT_HEARTBEAT_SEND,
+        EVENT_HEARTBEAT_ARRIVE,
+        EVENT_LIVENESS,
+        EVENT_STORM,
+        EVENT_CRASH,
+    };
+
+    struct EVENT
+    {
+        uint32_t Time;
+        uint64_t Sequence;      // Insertion order breaks ties deterministically
+        uint8_t Type;
+        int Id;                 // Client, server-side index or GameServer number
+        uint32_t Generation;    // Client connection the event belongs to
+        uint32_t Arg;
+
+        bool operator>(const EVENT& other) const
+        {
+            return (this->Time != other.Time) ? (this->Time > other.Time) : (this->Sequence > other.Sequence);
+        }
+    };
+
+    struct CLIENT
+    {
+        int Session;            // Server-side index, -1 when not connected
+        uint32_t Generation;
+        uint32_t Request;       // Number of the last request (for timeouts)
+        bool Waiting;
+        uint32_t FlowStart;
+        uint32_t LastToServer;  // TCP keeps each direction in order
+        uint32_t LastToClient;
+    };
+
+    struct GAME_SERVER
+    {
+        bool Crashed;
+        uint8_t State;          // Last state seen by the liveness poll
+    };
+
+    void Schedule(uint32_t time, uint8_t type, int id, uint32_t generation, uint32_t arg);
+    void Dispatch(const EVENT& event);
+
+    void OnConnect(int id, uint32_t generation);
+    void OnAccept(int id, uint32_t generation);
+    void OnRefused(int id, uint32_t generation);
+    void OnToServer(int index, uint32_t arg);
+    void OnToClient(int id, uint32_t generation, uint32_t arg);
+    void OnTimeout(int id, uint32_t generation, uint32_t arg);
+    void OnClose(int index);
+    void OnHeartbeatSend(int id);
+    void OnHeartbeatArrive(int id, uint32_t arg);
+    void OnLiveness();
+    void OnStorm();
+    void OnCrash();
+
+    void SendRequest(int id, uint32_t arg);
+    void Disconnect(int id);
+    void Revisit(int id, uint32_t after);
+
+    uint32_t Delay();
+    uint32_t Uniform(uint32_t min, uint32_t max);
+
+    SIMULATION_CONFIG m_Config;
+    std::mt19937_64 m_Random;
+    std::priority_queue<EVENT, std::vector<EVENT>, std::greater<EVENT>> m_Queue;
+    uint64_t m_Sequence;
+    uint32_t m_Start;
+    uint32_t m_Now;
+
+    std::vector<CLIENT> m_Client;
+    std::vector<std::string> m_Address;
+    std::vector<int> m_SessionClient;   // Server index -> client, -1 if free
+    std::vector<uint32_t> m_SessionGeneration;
+    std::vector<int> m_FreeSession;
+    int m_Sessions;
+
+    std::vector<GAME_SERVER> m_GameServer;
+    std::string m_ServerListPath;
+
+    std::vector<uint32_t> m_FlowLatency;
+    SIMULATION_REPORT m_Report;
+};
@@ -0,0 +1,236 @@
+// cs_flightdump: turns a flight recorder dump (see FlightRecorder.h) into a
+// timeline. Events from all threads are merged in timestamp order and shown
+// in wall clock time; the last lines are what happened right before the
+// crash or snapshot.
+//
+//   cs_flightdump <dump> [--session N] [--tail N]
+
+#include "FlightRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+struct TIMELINE_EVENT
+{
+    FLIGHT_EVENT Event;
+    int Thread;
+};
+
+static const char* EventName(uint8_t type) {
+    switch (type) {
+        case FLIGHT_ACCEPT: return "accept";
+        case FLIGHT_ACCEPT_REJECT: return "reject";
+        case FLIGHT_FRAME: return "frame";
+        case FLIGHT_HANDLER_ENTER: return "handler>";
+        case FLIGHT_HANDLER_EXIT: return "handler<";
+        case FLIGHT_SEND: return "send";
+        case FLIGHT_CLOSE: return "close";
+        case FLIGHT_HEARTBEAT: return "heartbeat";
+        case FLIGHT_SERVER_STATE: return "state";
+        case FLIGHT_ERROR: return "ERROR";
+        case FLIGHT_MARK: return "mark";
+    }
+
+    return "?";
+}
+
+static const char* ErrorName(uint8_t error) {
+    switch (error) {
+        case FLIGHT_ERROR_READ: return "read";
+        case FLIGHT_ERROR_WRITE: return "write";
+        case FLIGHT_ERROR_FRAME: return "frame";
+        case FLIGHT_ERROR_ACCEPT: return "accept";
+        case FLIGHT_ERROR_SEND_FULL: return "send buffer full";
+        case FLIGHT_ERROR_UDP: return "udp";
+    }
+
+    return "?";
+}
+
+static const char* StateName(uint8_t state) {
+    switch (state) {
+        case 0: return "offline";
+        case 1: return "online";
+        case 2: return "suspect";
+    }
+
+    return "?";
+}
+
+static std::string Address(uint64_t ipv4) {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(ipv4 >> 24) & 0xFF, (unsigned)(ipv4 >> 16) & 0xFF,
+             (unsigned)(ipv4 >> 8) & 0xFF, (unsigned)ipv4 & 0xFF);
+    return text;
+}
+
+static std::string Describe(const FLIGHT_EVENT& event) {
+    char text[128];
+
+    switch (event.Type) {
+        case FLIGHT_ACCEPT:
+        case FLIGHT_ACCEPT_REJECT:
+            snprintf(text, sizeof(text), "session %u from %s", event.Session, Address(event.Value).c_str());
+            break;
+
+        case FLIGHT_FRAME:
+        case FLIGHT_HANDLER_ENTER:
+        case FLIGHT_SEND:
+            snprintf(text, sizeof(text), "session %u %02X:%02X %llu bytes", event.Session, event.A, event.B,
+                     (unsigned long long)event.Value);
+            break;
+
+        case FLIGHT_CLOSE:
+            snprintf(text, sizeof(text), "session %u", event.Session);
+            break;
+
+        case FLIGHT_HANDLER_EXIT:
+            snprintf(text, sizeof(text), "session %u %02X:%02X", event.Session, event.A, event.B);
+            break;
+
+        case FLIGHT_HEARTBEAT:
+            snprintf(text, sizeof(text), "%s %02X %llu bytes", Address(event.Session).c_str(), event.A,
+                     (unsigned long long)event.Value);
+            break;
+
+        case FLIGHT_SERVER_STATE:
+            snprintf(text, sizeof(text), "server %u %s -> %s", event.Session, StateName(event.A),
+                     StateName(event.B));
+            break;
+
+        case FLIGHT_ERROR:
+            snprintf(text, sizeof(text), "session %u %s (%llu)", event.Session, ErrorName(event.A),
+                     (unsigned long long)event.Value);
+            break;
+
+        default:
+            snprintf(text, sizeof(text), "session %u %02X %02X %llu", event.Session, event.A, event.B,
+                     (unsigned long long)event.Value);
+            break;
+    }
+
+    return text;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: cs_flightdump <dump> [--session N] [--tail N]\n");
+        return 2;
+    }
+
+    long session = -1;
+    size_t tail = 0;
+
+    for (int n = 2; n < argc; n++) {
+        std::string option = argv[n];
+        const char* value = (n + 1 < argc) ? argv[n + 1] : "0";
+
+        if (option == "--session") {
+            session = atol(value);
+            n++;
+        } else if (option == "--tail") {
+            tail = (size_t)atol(value);
+            n++;
+        } else {
+            fprintf(stderr, "cs_flightdump: unknown option %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+
+    if (file == nullptr) {
+        fprintf(stderr, "cs_flightdump: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    FLIGHT_DUMP_HEADER header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.Magic != FLIGHT_DUMP_MAGIC ||
+        header.Version != FLIGHT_DUMP_VERSION || header.EventSize != sizeof(FLIGHT_EVENT)) {
+        fprintf(stderr, "cs_flightdump: %s is not a flight recorder dump\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<FLIGHT_DUMP_THREAD> threads;
+    std::vector<TIMELINE_EVENT> timeline;
+
+    for (uint32_t t = 0; t < header.Threads; t++) {
+        FLIGHT_DUMP_THREAD thread;
+
+        if (fread(&thread, sizeof(thread), 1, file) != 1 || thread.Events > header.RingSize) {
+            fprintf(stderr, "cs_flightdump: dump truncated after %u thread(s)\n", t);
+            break;
+        }
+
+        thread.Name[sizeof(thread.Name) - 1] = '\0';
+        threads.push_back(thread);
+
+        for (uint32_t e = 0; e < thread.Events; e++) {
+            TIMELINE_EVENT item;
+
+            if (fread(&item.Event, sizeof(item.Event), 1, file) != 1) {
+                break;
+            }
+
+            item.Thread = (int)t;
+
+            if (session < 0 || (item.Event.Type != FLIGHT_HEARTBEAT && item.Event.Type != FLIGHT_SERVER_STATE &&
+                                item.Event.Session == (uint32_t)session)) {
+                timeline.push_back(item);
+            }
+        }
+    }
+
+    fclose(file);
+
+    std::stable_sort(timeline.begin(), timeline.end(), [](const TIMELINE_EVENT& a, const TIMELINE_EVENT& b) {
+        return a.Event.Tsc < b.Event.Tsc;
+    });
+
+    // TSC -> wall clock from the two calibration points in the header
+    double ns_per_tick = 1.0;
+
+    if (header.DumpTsc > header.StartTsc && header.DumpTime > header.StartTime) {
+        ns_per_tick = (double)(header.DumpTime - header.StartTime) / (double)(header.DumpTsc - header.StartTsc);
+    }
+
+    time_t dump_seconds = (time_t)(header.DumpTime / 1000000000ull);
+    char dump_time[32];
+    strftime(dump_time, sizeof(dump_time), "%Y-%m-%d %H:%M:%S", localtime(&dump_seconds));
+
+    printf("Flight recorder of pid %u, %s at %s, %zu thread(s), %.3f ns/tick\n", header.Pid,
+           header.Signal != 0 ? ("signal " + std::to_string(header.Signal)).c_str() : "snapshot", dump_time,
+           threads.size(), ns_per_tick);
+
+    for (size_t t = 0; t < threads.size(); t++) {
+        printf("  thread %zu: tid %u %-16s %llu event(s) recorded, %u kept\n", t, threads[t].ThreadId,
+               threads[t].Name[0] != '\0' ? threads[t].Name : "-", (unsigned long long)threads[t].Head,
+               threads[t].Events);
+    }
+
+    printf("\n");
+
+    size_t first = (tail != 0 && timeline.size() > tail) ? timeline.size() - tail : 0;
+
+    for (size_t n = first; n < timeline.size(); n++) {
+        const FLIGHT_EVENT& event = timeline[n].Event;
+        double offset = ((double)event.Tsc - (double)header.DumpTsc) * ns_per_tick;
+        uint64_t when = header.DumpTime + (int64_t)offset;
+        time_t seconds = (time_t)(when / 1000000000ull);
+        char clock[16];
+        strftime(clock, sizeof(clock), "%H:%M:%S", localtime(&seconds));
+
+        printf("%s.%06llu %-12s %-10s %s\n", clock, (unsigned long long)(when % 1000000000ull) / 1000,
+               threads[timeline[n].Thread].Name[0] != '\0' ? threads[timeline[n].Thread].Name : "-",
+               EventName(event.Type), Describe(event).c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+// cs_logcat: turns binary log segments (see BinaryLog.h) back into text.
+// Arguments are formatted here with the call site's own format, which every
+// segment carries. Given a directory, all cslog_*.bin segments in it are
+// read oldest first.
+//
+//   cs_logcat <segment|directory>... [--level error|notice|info]
+//             [--subsystem Name] [--session N]
+
+#include "BinaryLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+struct LOGCAT_FILTER
+{
+    int Level;                  // Show this level and more severe
+    std::string Subsystem;      // "" for all
+    int64_t Session;            // -1 for all
+};
+
+static const char* LevelName(uint8_t level) {
+    switch (level) {
+        case LOG_LEVEL_ERROR: return "ERROR";
+        case LOG_LEVEL_NOTICE: return "NOTICE";
+        case LOG_LEVEL_INFO: return "INFO";
+    }
+
+    return "?";
+}
+
+static int ParseLevel(const char* name) {
+    if (strcmp(name, "error") == 0) {
+        return LOG_LEVEL_ERROR;
+    }
+
+    if (strcmp(name, "notice") == 0) {
+        return LOG_LEVEL_NOTICE;
+    }
+
+    if (strcmp(name, "info") == 0) {
+        return LOG_LEVEL_INFO;
+    }
+
+    return -1;
+}
+
+// Literal text of the format, with "%%" as "%"
+static void AppendLiteral(std::string& text, const char* begin, const char* end) {
+    while (begin < end) {
+        if (begin[0] == '%' && begin + 1 < end && begin[1] == '%') {
+            begin++;
+        }
+
+        text += *begin++;
+    }
+}
+
+template <typename T>
+static void AppendValue(std::string& text, const std::string& spec, int stars, const int* star, T value) {
+    char out[1024];
+
+    switch (stars) {
+        case 0: snprintf(out, sizeof(out), spec.c_str(), value); break;
+        case 1: snprintf(out, sizeof(out), spec.c_str(), star[0], value); break;
+        default: snprintf(out, sizeof(out), spec.c_str(), star[0], star[1], value); break;
+    }
+
+    text += out;
+}
+
+static std::string FormatEntry(const char* format, const uint8_t* args, size_t size) {
+    std::string text;
+    const char* cursor = format;
+    const char* literal = format;
+    size_t offset = 0;
+    BINLOG_SPEC spec;
+
+    while (NextLogSpec(cursor, &spec)) {
+        AppendLiteral(text, literal, spec.Begin);
+        literal = cursor;
+
+        // The spec without its length modifier; the value's own type is
+        // added back below
+        std::string base(spec.Begin, spec.Size - 1);
+
+        while (!base.empty() && strchr("hlqzjtL", base.back()) != nullptr) {
+            base.pop_back();
+        }
+
+        int star[2] = {0, 0};
+        bool missing = false;
+
+        for (int n = 0; n < spec.Stars; n++) {
+            int64_t value = 0;
+
+            if (offset + sizeof(value) > size) {
+                missing = true;
+                break;
+            }
+
+            memcpy(&value, args + offset, sizeof(value));
+            offset += sizeof(value);
+            star[n] = (int)value;
+        }
+
+        if (spec.Argument == BINLOG_ARG_STRING) {
+            if (missing || offset + 1 > size || offset + 1 + args[offset] > size) {
+                text += "?";
+                break;
+            }
+
+            std::string value((const char*)args + offset + 1, args[offset]);
+            offset += 1 + args[offset];
+            AppendValue(text, base + "s", spec.Stars, star, value.c_str());
+            continue;
+        }
+
+        uint64_t value = 0;
+
+        if (missing || offset + sizeof(value) > size) {
+            text += "?";
+            break;
+        }
+
+        memcpy(&value, args + offset, sizeof(value));
+        offset += sizeof(value);
+
+        switch (spec.Argument) {
+            case BINLOG_ARG_SIGNED:
+                AppendValue(text, base + "ll" + spec.Conversion, spec.Stars, star, (long long)value);
+                break;
+
+            case BINLOG_ARG_UNSIGNED:
+                if (spec.Conversion == 'c') {
+                    AppendValue(text, base + "c", spec.Stars, star, (int)value);
+                } else {
+                    AppendValue(text, base + "ll" + spec.Conversion, spec.Stars, star, (unsigned long long)value);
+                }
+                break;
+
+            case BINLOG_ARG_DOUBLE: {
+                double number;
+                memcpy(&number, &value, sizeof(number));
+                AppendValue(text, base + spec.Conversion, spec.Stars, star, number);
+                break;
+            }
+
+            case BINLOG_ARG_POINTER:
+                AppendValue(text, base + "p", spec.Stars, star, (void*)(uintptr_t)value);
+                break;
+        }
+    }
+
+    AppendLiteral(text, literal, literal + strlen(literal));
+    return text;
+}
+
+// "[ClientSession] ..." -> "ClientSession"
+static std::string Subsystem(const std::string& text) {
+    size_t end = text.find(']');
+
+    if (text.empty() || text[0] != '[' || end == std::string::npos) {
+        return "";
+    }
+
+    return text.substr(1, end - 1);
+}
+
+static void PrintEntry(const BINLOG_RECORD& record, const std::string& text) {
+    time_t seconds = (time_t)(record.Time / 1000000000ull);
+    struct tm tm_info;
+#ifdef _WIN32
+    localtime_s(&tm_info, &seconds);
+#else
+    localtime_r(&seconds, &tm_info);
+#endif
+
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    char session[16] = "-";
+    if (record.Session != BINLOG_NO_SESSION) {
+        snprintf(session, sizeof(session), "%u", record.Session);
+    }
+
+    printf("%s.%06u %-6s tid %-6u session %-5s %s\n", stamp, (unsigned)(record.Time % 1000000000ull / 1000),
+           LevelName(record.Level), record.Thread, session, text.c_str());
+}
+
+static bool ReadSegment(const std::string& path, const LOGCAT_FILTER& filter, size_t* shown) {
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+        fprintf(stderr, "cs_logcat: cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t read;
+
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + read);
+    }
+
+    fclose(file);
+
+    BINLOG_SEGMENT_HEADER header;
+
+    if (data.size() < sizeof(header)) {
+        fprintf(stderr, "cs_logcat: %s: too short\n", path.c_str());
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (header.Magic != BINARY_LOG_MAGIC || header.Version != BINARY_LOG_VERSION ||
+        header.RecordSize != sizeof(BINLOG_RECORD)) {
+        fprintf(stderr, "cs_logcat: %s: not a binary log segment (or another version)\n", path.c_str());
+        return false;
+    }
+
+    std::map<uint32_t, std::string> sites;
+    size_t offset = (sizeof(header) + 7) & ~(size_t)7;
+
+    // Up to the unused preallocated space (Length 0) or a torn last record
+    while (offset + sizeof(BINLOG_RECORD) <= data.size()) {
+        BINLOG_RECORD record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+
+        if (record.Length < sizeof(record) || offset + record.Length > data.size()) {
+            break;
+        }
+
+        const uint8_t* payload = data.data() + offset + sizeof(record);
+        size_t payload_size = record.Length - sizeof(record);
+        offset += ((size_t)record.Length + 7) & ~(size_t)7;
+
+        if (record.Type == BINLOG_SITE) {
+            sites[record.Site].assign((const char*)payload, strnlen((const char*)payload, payload_size));
+            continue;
+        }
+
+        if (record.Type != BINLOG_ENTRY || record.Level > filter.Level) {
+            continue;
+        }
+
+        if (filter.Session >= 0 && record.Session != (uint32_t)filter.Session) {
+            continue;
+        }
+
+        auto site = sites.find(record.Site);
+        std::string text = (site != sites.end()) ? FormatEntry(site->second.c_str(), payload, payload_size)
+                                                 : "<unknown call site " + std::to_string(record.Site) + ">";
+
+        if (!filter.Subsystem.empty() && Subsystem(text) != filter.Subsystem) {
+            continue;
+        }
+
+        PrintEntry(record, text);
+        (*shown)++;
+    }
+
+    return true;
+}
+
+// A directory expands to its segments, oldest first (names sort by time)
+static void AddPath(const char* path, std::vector<std::string>& segments) {
+#ifndef _WIN32
+    struct stat info;
+
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path);
+        std::vector<std::string> found;
+
+        while (dir != nullptr) {
+            struct dirent* entry = readdir(dir);
+
+            if (entry == nullptr) {
+                break;
+            }
+
+            size_t length = strlen(entry->d_name);
+
+            if (strncmp(entry->d_name, "cslog_", 6) == 0 && length > 4 &&
+                strcmp(entry->d_name + length - 4, ".bin") == 0) {
+                found.push_back(std::string(path) + "/" + entry->d_name);
+            }
+        }
+
+        if (dir != nullptr) {
+            closedir(dir);
+        }
+
+        std::sort(found.begin(), found.end());
+        segments.insert(segments.end(), found.begin(), found.end());
+        return;
+    }
+#endif
+
+    segments.push_back(path);
+}
+
+int main(int argc, char** argv) {
+    LOGCAT_FILTER filter;
+    filter.Level = LOG_LEVEL_INFO;
+    filter.Session = -1;
+
+    std::vector<std::string> segments;
+
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "--level") == 0 && n + 1 < argc) {
+            filter.Level = ParseLevel(argv[++n]);
+
+            if (filter.Level < 0) {
+                fprintf(stderr, "cs_logcat: unknown level %s (error, notice, info)\n", argv[n]);
+                return 2;
+            }
+        } else if (strcmp(argv[n], "--subsystem") == 0 && n + 1 < argc) {
+            filter.Subsystem = argv[++n];
+
+            // Accept "[Name]" as well
+            if (filter.Subsystem.size() > 2 && filter.Subsystem.front() == '[' && filter.Subsystem.back() == ']') {
+                filter.Subsystem = filter.Subsystem.substr(1, filter.Subsystem.size() - 2);
+            }
+        } else if (strcmp(argv[n], "--session") == 0 && n + 1 < argc) {
+            filter.Session = atoll(argv[++n]);
+        } else if (argv[n][0] == '-') {
+            segments.clear();
+            break;
+        } else {
+            AddPath(argv[n], segments);
+        }
+    }
+
+    if (segments.empty()) {
+        fprintf(stderr, "usage: cs_logcat <segment|directory>... [--level error|notice|info] "
+                        "[--subsystem Name] [--session N]\n");
+        return 2;
+    }
+
+    size_t shown = 0;
+    bool ok = true;
+
+    for (const std::string& segment : segments) {
+        ok &= ReadSegment(segment, filter, &shown);
+    }
+
+    fprintf(stderr, "%zu line(s) from %zu segment(s)\n", shown, segments.size());
+    return ok ? 0 : 1;
+}
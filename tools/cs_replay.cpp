@@ -0,0 +1,390 @@
+// cs_replay: plays a traffic capture (see TrafficRecorder.h) back against a
+// running ConnectServer. Every recorded TCP session becomes a connection that
+// sends what the client sent, at the original pace, scaled, or as fast as
+// possible; UDP datagrams go to the UDP port. Reports throughput and the
+// latency from each request to the first reply byte.
+//
+//   cs_replay <capture> [--host 127.0.0.1] [--tcp 44405] [--udp 55601]
+//                       [--speed 1 | <factor> | max] [--no-udp]
+
+#include "TrafficRecorder.h"
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct REPLAY_RECORD
+{
+    TRAFFIC_RECORD Header;
+    size_t Offset;          // Payload position in the capture
+};
+
+struct REPLAY_STATS
+{
+    uint64_t Sessions = 0;
+    uint64_t ConnectFailures = 0;
+    uint64_t Packets = 0;
+    uint64_t Bytes = 0;
+    uint64_t Datagrams = 0;
+    uint64_t ReplyBytes = 0;
+    std::vector<uint32_t> Latency;  // us
+};
+
+static REPLAY_STATS g_stats;
+
+class ReplayConnection : public std::enable_shared_from_this<ReplayConnection> {
+public:
+    ReplayConnection(boost::asio::io_context& io, int* active)
+        : socket_(io), connected_(false), failed_(false), closing_(false), writing_(false), waiting_(false),
+          active_(active) {
+        (*active_)++;
+    }
+
+    ~ReplayConnection() {
+        (*active_)--;
+    }
+
+    void connect(const boost::asio::ip::tcp::endpoint& endpoint) {
+        auto self = shared_from_this();
+        socket_.async_connect(endpoint, [this, self](const boost::system::error_code& error) {
+            if (error) {
+                g_stats.ConnectFailures++;
+                failed_ = true;
+                return;
+            }
+
+            connected_ = true;
+            start_read();
+            start_write();
+        });
+    }
+
+    void send(const uint8_t* data, size_t size) {
+        if (failed_) {
+            return;
+        }
+
+        queue_.emplace_back(data, size);
+        start_write();
+    }
+
+    // Half-close once everything queued is out; the server's close ends the read
+    void close() {
+        closing_ = true;
+        start_write();
+    }
+
+private:
+    void start_write() {
+        if (!connected_ || writing_) {
+            return;
+        }
+
+        if (queue_.empty()) {
+            if (closing_) {
+                boost::system::error_code ec;
+                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+            }
+            return;
+        }
+
+        writing_ = true;
+
+        if (!waiting_) {
+            waiting_ = true;
+            request_time_ = Clock::now();
+        }
+
+        auto self = shared_from_this();
+        auto item = queue_.front();
+
+        boost::asio::async_write(socket_, boost::asio::buffer(item.first, item.second),
+            [this, self](const boost::system::error_code& error, size_t bytes) {
+                writing_ = false;
+
+                if (error) {
+                    queue_.clear();
+                    return;
+                }
+
+                g_stats.Packets++;
+                g_stats.Bytes += bytes;
+                queue_.pop_front();
+                start_write();
+            });
+    }
+
+    void start_read() {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(read_buffer_, sizeof(read_buffer_)),
+            [this, self](const boost::system::error_code& error, size_t bytes) {
+                if (error) {
+                    boost::system::error_code ec;
+                    socket_.close(ec);
+                    return;
+                }
+
+                g_stats.ReplyBytes += bytes;
+
+                if (waiting_) {
+                    waiting_ = false;
+                    g_stats.Latency.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - request_time_).count());
+                }
+
+                start_read();
+            });
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    std::deque<std::pair<const uint8_t*, size_t>> queue_;
+    uint8_t read_buffer_[8192];
+    bool connected_;
+    bool failed_;
+    bool closing_;
+    bool writing_;
+    bool waiting_;
+    Clock::time_point request_time_;
+    int* active_;
+};
+
+static bool LoadCapture(const char* path, std::vector<uint8_t>* data, std::vector<REPLAY_RECORD>* records) {
+    FILE* file = fopen(path, "rb");
+
+    if (file == nullptr) {
+        fprintf(stderr, "cs_replay: cannot open %s\n", path);
+        return false;
+    }
+
+    uint8_t chunk[65536];
+    size_t read;
+
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data->insert(data->end(), chunk, chunk + read);
+    }
+
+    fclose(file);
+
+    TRAFFIC_CAPTURE_HEADER header;
+
+    if (data->size() < sizeof(header)) {
+        fprintf(stderr, "cs_replay: %s is not a capture\n", path);
+        return false;
+    }
+
+    memcpy(&header, data->data(), sizeof(header));
+
+    if (header.Magic != TRAFFIC_CAPTURE_MAGIC || header.Version != TRAFFIC_CAPTURE_VERSION ||
+        header.RecordSize != sizeof(TRAFFIC_RECORD)) {
+        fprintf(stderr, "cs_replay: %s has an unsupported format\n", path);
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+
+    while (offset + sizeof(TRAFFIC_RECORD) <= data->size()) {
+        REPLAY_RECORD record;
+        memcpy(&record.Header, data->data() + offset, sizeof(record.Header));
+        record.Offset = offset + sizeof(TRAFFIC_RECORD);
+
+        // A capture cut short by a crash ends with a partial record
+        if (record.Offset + record.Header.Size > data->size()) {
+            break;
+        }
+
+        records->push_back(record);
+        offset = record.Offset + record.Header.Size;
+    }
+
+    // Writer order is almost time order; make it exact
+    std::stable_sort(records->begin(), records->end(), [](const REPLAY_RECORD& a, const REPLAY_RECORD& b) {
+        return a.Header.Timestamp < b.Header.Timestamp;
+    });
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: cs_replay <capture> [--host addr] [--tcp port] [--udp port] "
+                        "[--speed 1|<factor>|max] [--no-udp]\n");
+        return 2;
+    }
+
+    std::string host = "127.0.0.1";
+    int tcp_port = 44405;
+    int udp_port = 55601;
+    double speed = 1.0;    // 0 = as fast as possible
+    bool replay_udp = true;
+
+    for (int n = 2; n < argc; n++) {
+        std::string option = argv[n];
+        const char* value = (n + 1 < argc) ? argv[n + 1] : "";
+
+        if (option == "--host") {
+            host = value;
+            n++;
+        } else if (option == "--tcp") {
+            tcp_port = atoi(value);
+            n++;
+        } else if (option == "--udp") {
+            udp_port = atoi(value);
+            n++;
+        } else if (option == "--speed") {
+            speed = (strcmp(value, "max") == 0) ? 0.0 : atof(value);
+            n++;
+        } else if (option == "--no-udp") {
+            replay_udp = false;
+        } else {
+            fprintf(stderr, "cs_replay: unknown option %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<REPLAY_RECORD> records;
+
+    if (!LoadCapture(argv[1], &data, &records)) {
+        return 1;
+    }
+
+    if (records.empty()) {
+        printf("Capture is empty\n");
+        return 0;
+    }
+
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::endpoint tcp_endpoint(boost::asio::ip::make_address(host), (uint16_t)tcp_port);
+    boost::asio::ip::udp::endpoint udp_endpoint(boost::asio::ip::make_address(host), (uint16_t)udp_port);
+    boost::asio::ip::udp::socket udp_socket(io, boost::asio::ip::udp::v4());
+    boost::asio::steady_timer timer(io);
+
+    std::unordered_map<uint32_t, std::shared_ptr<ReplayConnection>> sessions;
+    int active = 0;
+    size_t next = 0;
+    uint64_t first_timestamp = records.front().Header.Timestamp;
+    uint64_t capture_ns = records.back().Header.Timestamp - first_timestamp;
+    Clock::time_point started = Clock::now();
+    Clock::time_point dispatched;
+
+    auto dispatch = [&](const REPLAY_RECORD& record) {
+        const uint8_t* payload = data.data() + record.Offset;
+        uint32_t session = record.Header.Session;
+
+        switch (record.Header.Kind) {
+            case TRAFFIC_TCP_OPEN: {
+                auto connection = std::make_shared<ReplayConnection>(io, &active);
+                sessions[session] = connection;
+                connection->connect(tcp_endpoint);
+                g_stats.Sessions++;
+                break;
+            }
+
+            case TRAFFIC_TCP_RECV: {
+                auto it = sessions.find(session);
+
+                // Session opened before the capture started: nothing to replay it on
+                if (it != sessions.end()) {
+                    it->second->send(payload, record.Header.Size);
+                }
+                break;
+            }
+
+            case TRAFFIC_TCP_CLOSE: {
+                auto it = sessions.find(session);
+
+                if (it != sessions.end()) {
+                    it->second->close();
+                    sessions.erase(it);
+                }
+                break;
+            }
+
+            case TRAFFIC_UDP_RECV: {
+                if (replay_udp) {
+                    boost::system::error_code ec;
+                    udp_socket.send_to(boost::asio::buffer(payload, record.Header.Size), udp_endpoint, 0, ec);
+                    g_stats.Datagrams += ec ? 0 : 1;
+                }
+                break;
+            }
+        }
+    };
+
+    // Paces the records; at full speed hands back to the io loop every batch
+    std::function<void()> pump = [&]() {
+        for (int batch = 0; batch < 256 && next < records.size(); batch++) {
+            const REPLAY_RECORD& record = records[next];
+
+            if (speed > 0) {
+                auto due = started + std::chrono::nanoseconds(
+                    (int64_t)((record.Header.Timestamp - first_timestamp) / speed));
+
+                if (due > Clock::now()) {
+                    timer.expires_at(due);
+                    timer.async_wait([&](const boost::system::error_code&) { pump(); });
+                    return;
+                }
+            }
+
+            dispatch(record);
+            next++;
+        }
+
+        if (next < records.size()) {
+            boost::asio::post(io, pump);
+            return;
+        }
+
+        dispatched = Clock::now();
+
+        // Sessions still open at the end of the capture: close them now
+        for (auto& session : sessions) {
+            session.second->close();
+        }
+        sessions.clear();
+    };
+
+    boost::asio::post(io, pump);
+
+    // Run until every connection has finished (or 5 s after the last record)
+    while (true) {
+        io.run_for(std::chrono::milliseconds(50));
+
+        if (next == records.size() && (active == 0 || Clock::now() - dispatched > std::chrono::seconds(5))) {
+            break;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    std::vector<uint32_t>& latency = g_stats.Latency;
+    std::sort(latency.begin(), latency.end());
+
+    auto percentile = [&](size_t p) -> uint32_t {
+        return latency.empty() ? 0 : latency[std::min(latency.size() - 1, latency.size() * p / 100)];
+    };
+
+    printf("Replayed %zu records (%.3f s captured) in %.3f s, speed %s\n", records.size(), capture_ns / 1e9,
+           elapsed, (speed > 0) ? std::to_string(speed).c_str() : "max");
+    printf("  sessions %llu (%llu failed to connect), packets %llu, datagrams %llu\n",
+           (unsigned long long)g_stats.Sessions, (unsigned long long)g_stats.ConnectFailures,
+           (unsigned long long)g_stats.Packets, (unsigned long long)g_stats.Datagrams);
+    printf("  throughput %.0f packets/s, %.2f MB/s sent, %.2f MB/s received\n",
+           (g_stats.Packets + g_stats.Datagrams) / elapsed, g_stats.Bytes / elapsed / 1e6,
+           g_stats.ReplyBytes / elapsed / 1e6);
+    printf("  request -> reply latency: p50 %u us, p99 %u us, max %u us (%zu samples)\n",
+           percentile(50), percentile(99), latency.empty() ? 0 : latency.back(), latency.size());
+
+    return (g_stats.ConnectFailures == 0) ? 0 : 1;
+}
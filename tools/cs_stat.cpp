@@ -0,0 +1,206 @@
+// cs_stat: prints the stats segment a running server publishes ([Stats] Path,
+// see StatsReader.h): counters, the JoinServer, io threads and the server
+// table. With --watch it prints again every interval, opening the path anew
+// so a restarted server is picked up; --kv prints key=value lines for
+// scripts instead of tables.
+//
+//   cs_stat <segment> [--watch ms] [--kv] [--servers | --threads | --counters]
+
+#include "StatsReader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+enum STAT_SECTIONS
+{
+    SECTION_COUNTERS = 1,
+    SECTION_THREADS = 2,
+    SECTION_SERVERS = 4,
+    SECTION_ALL = 7,
+};
+
+static const char* StateName(uint8_t state) {
+    switch (state) {
+        case STATS_SERVER_OFFLINE: return "offline";
+        case STATS_SERVER_ONLINE: return "online";
+        case STATS_SERVER_SUSPECT: return "suspect";
+    }
+
+    return "?";
+}
+
+static uint64_t WallTime() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void PrintTables(const STATS_SEGMENT& data, int sections) {
+    uint64_t now = WallTime();
+    uint64_t age = (now > data.UpdateTime) ? now - data.UpdateTime : 0;
+
+    printf("pid %u, up %llu s, snapshot %llu ms old (#%llu)\n", data.Pid,
+           (unsigned long long)((now - data.StartTime) / 1000), (unsigned long long)age,
+           (unsigned long long)data.UpdateCount);
+
+    if (sections & SECTION_COUNTERS) {
+        const STATS_COUNTERS& counters = data.Counters;
+
+        printf("\nsessions %llu  accepts %llu  rejects %llu  packets %llu (%llu/s)  heartbeats %llu\n",
+               (unsigned long long)counters.Sessions, (unsigned long long)counters.Accepts,
+               (unsigned long long)counters.Rejects, (unsigned long long)counters.Packets,
+               (unsigned long long)counters.PacketsPerSecond, (unsigned long long)counters.Heartbeats);
+        printf("io lag %llu us  control plane lag %llu us  JoinServer %s (queue %u)\n",
+               (unsigned long long)counters.IoLagUs, (unsigned long long)counters.ControlPlaneLagUs,
+               StateName(data.JoinServerState), data.JoinServerQueueSize);
+    }
+
+    if (sections & SECTION_THREADS) {
+        printf("\n%-16s %8s %5s %12s %12s %12s\n", "thread", "tid", "busy", "handlers", "max us", "running us");
+
+        for (uint32_t n = 0; n < data.ThreadCount && n < STATS_MAX_THREADS; n++) {
+            const STATS_THREAD_ENTRY& thread = data.Thread[n];
+
+            printf("%-16.16s %8u %4u%% %12llu %12llu %12llu\n", thread.Name, thread.ThreadId, thread.Utilization,
+                   (unsigned long long)thread.Handlers, (unsigned long long)thread.MaxHandlerUs,
+                   (unsigned long long)thread.CurrentHandlerUs);
+        }
+    }
+
+    if (sections & SECTION_SERVERS) {
+        printf("\n%6s %3s %-24s %-8s %4s %5s %11s %10s\n", "code", "ten", "name", "state", "show", "load",
+               "users", "heartbeat");
+
+        for (uint32_t n = 0; n < data.ServerCount; n++) {
+            const STATS_SERVER_ENTRY& server = data.Server[n];
+            char heartbeat[16];
+
+            if (server.HeartbeatAgeMs == STATS_NO_HEARTBEAT) {
+                snprintf(heartbeat, sizeof(heartbeat), "-");
+            } else {
+                snprintf(heartbeat, sizeof(heartbeat), "%u ms", server.HeartbeatAgeMs);
+            }
+
+            printf("%6u %3u %-24.32s %-8s %4s %4u%% %5u/%-5u %10s\n", server.ServerCode, server.Tenant,
+                   server.ServerName, StateName(server.State), server.Visible ? "yes" : "no", server.UserTotal,
+                   server.UserCount, server.MaxUserCount, heartbeat);
+        }
+    }
+}
+
+static void PrintKeyValues(const STATS_SEGMENT& data, int sections) {
+    printf("pid=%u start_time=%llu update_time=%llu update_count=%llu\n", data.Pid,
+           (unsigned long long)data.StartTime, (unsigned long long)data.UpdateTime,
+           (unsigned long long)data.UpdateCount);
+
+    if (sections & SECTION_COUNTERS) {
+        const STATS_COUNTERS& counters = data.Counters;
+
+        printf("sessions=%llu accepts=%llu rejects=%llu packets=%llu packets_per_second=%llu heartbeats=%llu "
+               "io_lag_us=%llu controlplane_lag_us=%llu joinserver=%s joinserver_queue=%u\n",
+               (unsigned long long)counters.Sessions, (unsigned long long)counters.Accepts,
+               (unsigned long long)counters.Rejects, (unsigned long long)counters.Packets,
+               (unsigned long long)counters.PacketsPerSecond, (unsigned long long)counters.Heartbeats,
+               (unsigned long long)counters.IoLagUs, (unsigned long long)counters.ControlPlaneLagUs,
+               StateName(data.JoinServerState), data.JoinServerQueueSize);
+    }
+
+    if (sections & SECTION_THREADS) {
+        for (uint32_t n = 0; n < data.ThreadCount && n < STATS_MAX_THREADS; n++) {
+            const STATS_THREAD_ENTRY& thread = data.Thread[n];
+
+            printf("thread=%.16s tid=%u busy_pct=%u handlers=%llu max_handler_us=%llu running_us=%llu\n",
+                   thread.Name, thread.ThreadId, thread.Utilization, (unsigned long long)thread.Handlers,
+                   (unsigned long long)thread.MaxHandlerUs, (unsigned long long)thread.CurrentHandlerUs);
+        }
+    }
+
+    if (sections & SECTION_SERVERS) {
+        for (uint32_t n = 0; n < data.ServerCount; n++) {
+            const STATS_SERVER_ENTRY& server = data.Server[n];
+
+            printf("server=%u tenant=%u state=%s visible=%u load=%u users=%u max_users=%u heartbeat_age_ms=%lld "
+                   "name=\"%.32s\"\n",
+                   server.ServerCode, server.Tenant, StateName(server.State), server.Visible, server.UserTotal,
+                   server.UserCount, server.MaxUserCount,
+                   (server.HeartbeatAgeMs == STATS_NO_HEARTBEAT) ? -1LL : (long long)server.HeartbeatAgeMs,
+                   server.ServerName);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: cs_stat <segment> [--watch ms] [--kv] [--servers | --threads | --counters]\n");
+        return 2;
+    }
+
+    long watch = 0;
+    bool key_values = false;
+    int sections = 0;
+
+    for (int n = 2; n < argc; n++) {
+        std::string option = argv[n];
+        const char* value = (n + 1 < argc) ? argv[n + 1] : "0";
+
+        if (option == "--watch") {
+            watch = atol(value);
+            n++;
+        } else if (option == "--kv") {
+            key_values = true;
+        } else if (option == "--servers") {
+            sections |= SECTION_SERVERS;
+        } else if (option == "--threads") {
+            sections |= SECTION_THREADS;
+        } else if (option == "--counters") {
+            sections |= SECTION_COUNTERS;
+        } else {
+            fprintf(stderr, "cs_stat: unknown option %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    if (sections == 0) {
+        sections = SECTION_ALL;
+    }
+
+    // Every server slot included: kept off the stack
+    std::unique_ptr<STATS_SNAPSHOT> snapshot(new STATS_SNAPSHOT());
+
+    while (true) {
+        CStatsReader reader;
+
+        if (!reader.Open(argv[1])) {
+            fprintf(stderr, "cs_stat: %s is not a stats segment of this version\n", argv[1]);
+            return 1;
+        }
+
+        if (!reader.Read(snapshot.get())) {
+            fprintf(stderr, "cs_stat: no consistent snapshot, the writer is too busy\n");
+            return 1;
+        }
+
+        if (key_values) {
+            PrintKeyValues(snapshot->Data, sections);
+        } else {
+            PrintTables(snapshot->Data, sections);
+        }
+
+        if (watch <= 0) {
+            break;
+        }
+
+        fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::milliseconds(watch));
+
+        if (!key_values) {
+            printf("\n");
+        }
+    }
+
+    return 0;
+}